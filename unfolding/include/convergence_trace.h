@@ -0,0 +1,64 @@
+#ifndef CONVERGENCE_TRACE_H
+#define CONVERGENCE_TRACE_H
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "mlem_workspace.h"
+
+//--------------------------------------------------------------------------------------------------
+// State of an unfolding algorithm after an iteration. J & J2 are calculated from the measurements
+// & the estimate of the iteration (as MLEM-STOP does), and the deviations of the ratios between
+// measurements & estimate are |ratio - 1|.
+//--------------------------------------------------------------------------------------------------
+struct TraceRecord {
+    int iteration; // # of iterations completed
+    double j_factor;
+    double j_factor2;
+    double max_ratio_deviation;
+    double avg_ratio_deviation;
+    double total_flux; // of the spectrum after the iteration
+};
+
+//--------------------------------------------------------------------------------------------------
+// Recorder of the convergence of an unfolding algorithm (runMLEM, runMLEMSTOP, runMAP), e.g. to
+// find out why MLEM-STOP reached its cutoff before the J threshold. The algorithm notifies it after
+// every iteration, and the state is recorded every <stride> iterations, as well as after the last
+// iteration (see finish). Records are kept in a ring buffer allocated once: only the last
+// <capacity> are kept, and no memory is allocated while iterating. The records are saved to a CSV
+// file with the outcome of the run (completed, or the error that ended it).
+//--------------------------------------------------------------------------------------------------
+class ConvergenceTrace {
+    public:
+        ConvergenceTrace(int capacity, int stride);
+
+        void reset();
+        void record(int num_iterations, std::vector<double> &measurements,
+            const std::vector<double> &spectrum, const MlemWorkspace &workspace);
+        void finish(int num_iterations, std::vector<double> &measurements,
+            const std::vector<double> &spectrum, const MlemWorkspace &workspace);
+        std::vector<TraceRecord> records() const;
+        long long numDropped() const;
+        void save(const std::string &path, const std::string &outcome) const;
+
+        // Called by the algorithms after each iteration (inline: cheap unless a record is due)
+        void notify(int num_iterations, std::vector<double> &measurements,
+            const std::vector<double> &spectrum, const MlemWorkspace &workspace)
+        {
+            if (num_iterations >= next_iteration) {
+                record(num_iterations, measurements, spectrum, workspace);
+            }
+        }
+
+    private:
+        int stride;
+        int next_iteration; // # of iterations at which the next record is due
+        std::vector<TraceRecord> buffer; // ring buffer (capacity)
+        long long num_recorded; // the last record is buffer[(num_recorded-1) % capacity]
+};
+
+std::string getTracePath(const std::string &path_trace, const std::string &irradiation_conditions,
+    const std::string &suffix = "");
+
+#endif
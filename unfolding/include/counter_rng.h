@@ -0,0 +1,37 @@
+#ifndef COUNTER_RNG_H
+#define COUNTER_RNG_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+//--------------------------------------------------------------------------------------------------
+// Counter-based random number generator (Philox4x32-10; Salmon et al., "Parallel random numbers:
+// as easy as 1, 2, 3", SC11). Each value is a pure function of the seed, a stream index, a
+// substream index and a position within the stream, so independent streams (e.g. one per sampled
+// measurement set) can be created in any order, on any thread, and always produce the same values.
+//
+// Satisfies the UniformRandomBitGenerator requirements, so it can be used with the standard
+// distributions (std::poisson_distribution, std::normal_distribution, ...).
+//--------------------------------------------------------------------------------------------------
+class CounterRng {
+    public:
+        typedef uint32_t result_type;
+
+        CounterRng(uint64_t seed, uint32_t stream, uint32_t substream = 0);
+
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return 0xFFFFFFFF; }
+        result_type operator()();
+
+    private:
+        uint32_t key[2];
+        uint32_t counter[4]; // [0,1]: position within the stream, [2]: stream, [3]: substream
+        uint32_t output[4];
+        int output_index; // next unused value of output
+
+        void generateBlock();
+};
+
+uint64_t generateRandomSeed();
+
+#endif
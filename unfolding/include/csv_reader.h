@@ -0,0 +1,68 @@
+#ifndef CSV_READER_H
+#define CSV_READER_H
+
+#include <stdlib.h>
+#include <string>
+
+//--------------------------------------------------------------------------------------------------
+// This class reads a comma-delimited (CSV) file line by line & field by field. The file is
+// memory-mapped, and fields are returned as ranges of the mapped file, so no intermediate strings
+// are built. Lines may end with "\n" or "\r\n" (as written by saveSpectrumAsRow). As with
+// getline(line_stream, field, ','), an empty field at the end of a line (trailing comma) is
+// ignored.
+//
+// Numbers are converted independently of the locale. Fields that are not entirely a number (apart
+// from surrounding spaces & tabs) are reported as errors with their line & column (field #).
+//
+// Usage:
+//     CsvReader reader;
+//     if (!reader.open(file_name)) ...
+//     while (reader.nextLine()) {
+//         while (reader.nextField()) {
+//             double value = reader.fieldDouble();
+//         }
+//     }
+//--------------------------------------------------------------------------------------------------
+class CsvReader {
+    public:
+        CsvReader();
+        ~CsvReader();
+
+        bool open(const std::string &file_name);
+        void close();
+
+        bool nextLine();
+        bool nextField();
+
+        int lineNumber() const { return line_number; }
+        int columnNumber() const { return column_number; }
+
+        std::string lineString() const;
+        std::string fieldString() const;
+        double fieldDouble() const;
+
+    private:
+        std::string file_name;
+        int file_descriptor;
+        char *mapped; // mapped file contents (NULL if not mapped)
+        size_t file_size;
+
+        const char *data; // file contents
+        const char *data_end;
+        const char *line_begin; // current line, without the line ending
+        const char *line_end;
+        const char *next_line; // start of the line following the current line
+        const char *field_begin; // current field, without the delimiter
+        const char *field_end;
+        const char *next_field; // start of the field following the current field (NULL: none)
+        int line_number; // 1-based (0: before the first line)
+        int column_number; // 1-based (0: before the first field of the line)
+
+        // Not copyable (owns the mapping)
+        CsvReader(const CsvReader&) = delete;
+        CsvReader& operator=(const CsvReader&) = delete;
+};
+
+bool parseDouble(const char *begin, const char *end, double &value);
+
+#endif
@@ -7,7 +7,9 @@
 #include <algorithm>
 #include <iostream>
 
+#include "phase_timer.h"
 #include "physics_calculations.h"
+#include "response_matrix.h"
 
 // class Settings {
 //     public:
@@ -25,6 +27,12 @@ class UnfoldingSettings{
         int cutoff; 
         std::string uncertainty_type;
         int num_uncertainty_samples;
+        double uncertainty_target_error; // > 0: sample until uncertainties reach this relative error
+        int max_uncertainty_samples;
+        int uncertainty_batch_size;
+        long long seed; // seed of the sampled measurement sets (< 0: random)
+        std::string sample_initialization; // spectrum each sample is unfolded from (input or central)
+        int num_threads; // # of threads used to unfold sampled measurement sets (0: all cores)
         int num_meas_per_shell; 
         std::string meas_units; 
 
@@ -38,12 +46,18 @@ class UnfoldingSettings{
         std::string path_energy_bins;
         std::string path_system_response;
         std::string path_icrp_factors;
+        std::string path_instrument_profile; // compiled instrument profile (replaces the 4 files above)
 
         std::string path_output_spectra;
+        std::string path_spectra_store; // spectra store (replaces path_output_spectra)
         int generate_report;
         std::string path_report;
         int generate_figure;
         std::string path_figure;
+        int generate_performance;
+        std::string path_performance;
+        int generate_results;
+        std::string path_results; // results at full precision (e.g. for regression checks)
 
         // MAP specific
         double beta; 
@@ -57,12 +71,20 @@ class UnfoldingSettings{
         int iteration_increment;
         double beta_min;
         double beta_max;
+        int beta_continuation;
         std::string parameter_of_interest;
         std::string algorithm;
         std::string trend_type;
         int derivatives;
         std::string path_output_trend;
         std::string path_ref_spectrum;
+        int trend_precision; // # of significant digits of the values written to the trend files
+        // Performance specific
+        std::string projection_kernel;
+        // Debugging specific
+        int trace_stride; // record the convergence every <trace_stride> iterations (0: no trace)
+        int trace_capacity; // # of records kept (the last ones)
+        std::string path_trace;
 
         UnfoldingSettings(); 
 
@@ -74,6 +96,12 @@ class UnfoldingSettings{
         void set_cutoff(int);
         void set_uncertainty_type(std::string);
         void set_num_uncertainty_samples(int);
+        void set_uncertainty_target_error(double);
+        void set_max_uncertainty_samples(int);
+        void set_uncertainty_batch_size(int);
+        void set_seed(long long);
+        void set_sample_initialization(std::string);
+        void set_num_threads(int);
         void set_num_meas_per_shell(int);
         void set_meas_units(std::string);
         void set_dose_mu(int);
@@ -89,22 +117,34 @@ class UnfoldingSettings{
         void set_iteration_increment(int);
         void set_beta_min(double);
         void set_beta_max(double);
+        void set_beta_continuation(int);
         void set_parameter_of_interest(std::string);
         void set_algorithm(std::string);
         void set_trend_type(std::string);
         void set_path_output_spectra(std::string);
+        void set_path_spectra_store(std::string);
         void set_generate_report(int);
         void set_path_report(std::string);
         void set_generate_figure(int);
         void set_path_figure(std::string);
+        void set_generate_performance(int);
+        void set_path_performance(std::string);
+        void set_generate_results(int);
+        void set_path_results(std::string);
         void set_path_output_trend(std::string);
         void set_derivatives(int);
+        void set_trend_precision(int);
         void set_path_measurements(std::string);
         void set_path_input_spectrum(std::string);
         void set_path_energy_bins(std::string);
         void set_path_system_response(std::string);
         void set_path_icrp_factors(std::string);
+        void set_path_instrument_profile(std::string);
         void set_path_ref_spectrum(std::string);
+        void set_projection_kernel(std::string);
+        void set_trace_stride(int);
+        void set_trace_capacity(int);
+        void set_path_trace(std::string);
 };
 
 
@@ -137,9 +177,11 @@ class UncertaintyManagerJ {
         UncertaintyManagerJ();
         UncertaintyManagerJ(double original_j_threshold, double sigma_j);
 
+        // Run the solver (see physics_calculations.cpp), so that programs that only read settings
+        // need not link it
         void determineSpectrumUncertainty(std::vector<double> &mlemstop_spectrum, 
             int cutoff, int num_measurements, int num_bins, std::vector<double> &measurements, 
-            std::vector<std::vector<double>> &nns_response, std::vector<double> &normalized_response,
+            const ResponseMatrix &nns_response, std::vector<double> &normalized_response,
             std::vector<double> &initial_spectrum);
 
         void determineDoseUncertainty(double dose, std::vector<double> &mlemstop_spectrum, int num_bins, 
@@ -173,6 +215,12 @@ class UnfoldingReport {
         int num_bins;
         std::string uncertainty_type;
         int num_uncertainty_samples;
+        long long seed;
+        double uncertainty_target_error;
+        double dose_uncertainty_error;
+        double spectrum_uncertainty_error;
+        std::string sample_initialization;
+        double avg_sample_iterations; // average # of iterations spent per sample (incl. redrawn ones)
         std::string git_commit;
 
         std::vector<double> measurements; // measurements_report
@@ -184,7 +232,7 @@ class UnfoldingReport {
 
         std::vector<double> initial_spectrum;
         std::vector<double> energy_bins;
-        std::vector<std::vector<double>> nns_response;
+        ResponseMatrix nns_response;
         std::vector<double> icrp_factors;
 
         std::vector<double> spectrum;
@@ -214,6 +262,9 @@ class UnfoldingReport {
         UncertaintyManagerJ j_manager_high;
         int num_toss;
 
+        // Resources used by each phase so far (listed if any)
+        PerformanceLog performance;
+
         UnfoldingReport(); 
 
         void prepare_report();
@@ -223,6 +274,7 @@ class UnfoldingReport {
         void report_inputs(std::ofstream&);
         void report_mlem_info(std::ofstream&);
         void report_results(std::ofstream&);
+        void report_performance(std::ofstream&);
 
         void set_path(std::string);
         void set_irradiation_conditions(std::string);
@@ -237,6 +289,12 @@ class UnfoldingReport {
         void set_num_bins(int);
         void set_uncertainty_type(std::string);
         void set_num_uncertainty_samples(int);
+        void set_seed(long long);
+        void set_uncertainty_target_error(double);
+        void set_dose_uncertainty_error(double);
+        void set_spectrum_uncertainty_error(double);
+        void set_sample_initialization(std::string);
+        void set_avg_sample_iterations(double);
         void set_git_commit(std::string);
 
         void set_measurements(std::vector<double>&);
@@ -248,7 +306,7 @@ class UnfoldingReport {
 
         void set_initial_spectrum(std::vector<double>&);
         void set_energy_bins(std::vector<double>&);
-        void set_nns_response(std::vector<std::vector<double>>&);
+        void set_nns_response(const ResponseMatrix&);
         void set_icrp_factors(std::vector<double>&);
 
         void set_spectrum(std::vector<double>&);
@@ -274,6 +332,7 @@ class UnfoldingReport {
         void set_j_manager_low(UncertaintyManagerJ);
         void set_j_manager_high(UncertaintyManagerJ);
         void set_num_toss(int);
+        void set_performance(const PerformanceLog&);
 };
 
 class SpectraSettings{
@@ -299,6 +358,7 @@ class SpectraSettings{
         std::string error_style;
         int error_fill_style;
         int rows_per_spectrum;
+        std::vector<std::string> spectra_selection;
         std::vector<int> line_style;
         std::vector<int> line_width;
         int border_width;
@@ -349,6 +409,7 @@ class SpectraSettings{
         void set_error_style(std::string);
         void set_error_fill_style(std::string);
         void set_rows_per_spectrum(std::string);
+        void set_spectra_selection(std::string);
         void set_line_style(std::string);
         void set_line_width(std::string);
         void set_border_width(std::string);
@@ -0,0 +1,44 @@
+#ifndef EVENT_TRACE_H
+#define EVENT_TRACE_H
+
+#include <chrono>
+#include <stdlib.h>
+#include <string>
+
+//--------------------------------------------------------------------------------------------------
+// Scoped event of the event trace (see startEventTrace): records the wall time from its
+// construction until stop() is called or it is destroyed, whichever comes first, on the thread that
+// constructed it, under a name (e.g. "unfold") & a category (e.g. "uncertainty"). An event may
+// carry a detail (e.g. the file read) or a range of samples. Nothing is recorded (and nothing is
+// allocated) if the trace is not enabled. The name & category must be string literals (they are
+// not copied).
+//--------------------------------------------------------------------------------------------------
+class EventSpan {
+    public:
+        EventSpan(const char *name, const char *category);
+        EventSpan(const char *name, const char *category, const std::string &detail);
+        EventSpan(const char *name, const char *category, long long first_sample,
+            long long num_samples);
+        ~EventSpan();
+
+        void stop();
+
+    private:
+        const char *name;
+        const char *category;
+        std::string args; // JSON members of the "args" object of the event
+        std::chrono::steady_clock::time_point start;
+        bool recording;
+
+        void begin();
+
+        // Not copyable (records its event once)
+        EventSpan(const EventSpan&) = delete;
+        EventSpan& operator=(const EventSpan&) = delete;
+};
+
+void startEventTrace();
+bool eventTraceEnabled();
+void saveEventTrace();
+
+#endif
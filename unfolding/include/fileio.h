@@ -7,6 +7,7 @@
 #include <map>
 #include <algorithm>
 #include "custom_classes.h"
+#include "response_matrix.h"
 
 bool is_empty(std::ifstream& pFile);
 
@@ -24,6 +25,10 @@ bool checkStringMap(std::string test_key, std::map<std::string, std::string>& te
 
 std::vector<double> getMeasurements(UnfoldingSettings &settings);
 
+std::vector<std::string> getBatchFiles(std::string batch_source);
+
+std::string insertBeforeExtension(const std::string &path, const std::string &suffix);
+
 int saveSpectrumAsRow(std::string spectrum_file, int num_bins, std::string irradiation_conditions, 
     std::vector<double>& spectrum, std::vector<double> &error_lower, std::vector<double> &error_upper,
     std::vector<double>& energy_bins
@@ -35,7 +40,7 @@ int saveSpectrumAsColumn(std::string spectrum_file, std::string irradiation_cond
 
 int readInputFile1D(std::string file_name, std::vector<double>& input_vector);
 
-int readInputFile2D(std::string file_name, std::vector<std::vector<double>>& input_vector);
+int readInputFile2D(std::string file_name, ResponseMatrix& input_matrix);
 
 int readSpectra(std::string file_name, std::vector<std::string>& header_vector, std::vector<double>& energy_bins, 
     std::vector<std::vector<double>>& spectra_vector, std::vector<std::vector<double>>& error_lower_vector, 
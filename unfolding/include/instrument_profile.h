@@ -0,0 +1,58 @@
+#ifndef INSTRUMENT_PROFILE_H
+#define INSTRUMENT_PROFILE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "custom_classes.h"
+#include "response_matrix.h"
+
+// Version of the instrument profile file format. Profiles of another version are rejected (rebuild
+// them with build_profile.exe).
+const uint32_t INSTRUMENT_PROFILE_VERSION = 1;
+
+//--------------------------------------------------------------------------------------------------
+// This class holds the inputs that describe the instrument (NNS) and the unfolding problem, rather
+// than a measurement: energy bins, NNS response, ICRP conversion factors & input (guess) spectrum,
+// along with the normalized response derived from them.
+//
+// They are either read from their CSV files (path_energy_bins, path_system_response,
+// path_icrp_factors, path_input_spectrum) and validated, or loaded from a compiled instrument profile
+// (path_instrument_profile), i.e. a binary file built from those CSV files by build_profile.exe. A
+// profile holds all arrays (incl. the normalized & transposed response) ready to use, so loading it
+// requires no parsing, validation nor normalization. It is versioned & checksummed, and records the
+// path, size & modification time of its CSV files: a profile whose CSV files have changed since it
+// was built (stale), or that was built from other CSV files than those of the settings, is
+// rejected. CSV files that no longer exist cannot be checked (a warning is printed).
+//--------------------------------------------------------------------------------------------------
+class InstrumentProfile {
+    public:
+        std::vector<double> energy_bins;
+        ResponseMatrix nns_response;
+        std::vector<double> icrp_factors;
+        std::vector<double> initial_spectrum;
+        std::vector<double> normalized_response;
+
+        void readCSV(const UnfoldingSettings &settings);
+        void save(const std::string &path) const;
+        void load(const std::string &path);
+        void checkSourceFiles(const UnfoldingSettings &settings, const std::string &path) const;
+
+    private:
+        // CSV file from which the profile was read (energy bins, response, input spectrum & ICRP
+        // factors, in that order)
+        struct SourceFile {
+            std::string path; // absolute & normalized
+            int64_t size; // -1 if unknown
+            int64_t modification_time; // ns since epoch (-1 if unknown)
+        };
+        std::vector<SourceFile> source_files;
+
+        void addSourceFile(const std::string &path);
+};
+
+void readInstrumentProfile(const UnfoldingSettings &settings, InstrumentProfile &profile);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef ITERATION_OBSERVER_H
+#define ITERATION_OBSERVER_H
+
+#include <functional>
+#include <stdlib.h>
+#include <vector>
+
+#include "mlem_workspace.h"
+
+// Called with the # of iterations completed, the current spectrum and the workspace of the
+// algorithm (mlem_estimate, mlem_ratio, mlem_correction & energy_correction of that iteration)
+typedef std::function<void(int num_iterations, const std::vector<double> &spectrum, 
+    const MlemWorkspace &workspace)> IterationCallback;
+
+//--------------------------------------------------------------------------------------------------
+// Observer of the progress of an unfolding algorithm (runMLEM, runMLEMSTOP, runMAP). The algorithm
+// notifies it after every iteration, and the callback is invoked after the iterations listed as
+// checkpoints (ascending # of completed iterations), with read-only views of the algorithm's
+// state. A single run of the algorithm can therefore provide values at many iteration counts.
+// If the algorithm terminates before the last checkpoint (e.g. target error or J threshold
+// reached), notifyRemaining() invokes the callback for the remaining checkpoints with the final
+// state.
+//--------------------------------------------------------------------------------------------------
+class IterationObserver {
+    public:
+        IterationObserver(const std::vector<int> &checkpoints, const IterationCallback &callback);
+
+        void reset();
+        int lastCheckpoint() const;
+        bool complete() const;
+        void notifyRemaining(const std::vector<double> &spectrum, const MlemWorkspace &workspace);
+
+        // Called by the algorithms after each iteration (inline: cheap unless at a checkpoint)
+        void notify(int num_iterations, const std::vector<double> &spectrum, 
+            const MlemWorkspace &workspace) 
+        {
+            if (next_checkpoint < checkpoints.size() && checkpoints[next_checkpoint] == num_iterations) {
+                callback(num_iterations, spectrum, workspace);
+                next_checkpoint++;
+            }
+        }
+
+    private:
+        std::vector<int> checkpoints;
+        size_t next_checkpoint; // index of the next checkpoint to be reached
+        IterationCallback callback;
+};
+
+#endif
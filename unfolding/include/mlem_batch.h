@@ -0,0 +1,67 @@
+#ifndef MLEM_BATCH_H
+#define MLEM_BATCH_H
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "response_matrix.h"
+
+//--------------------------------------------------------------------------------------------------
+// This class holds a batch of unfolding problems (e.g. sampled measurement sets used to determine
+// uncertainty) that share the same NNS response, so that they can be advanced together by the
+// batched algorithms (runMLEMBatch, runMLEMSTOPBatch, runMAPBatch). Each response value is then
+// loaded once per iteration for the whole batch, instead of once per sample.
+//
+// Working arrays are stored column-wise: each sample occupies a column, and the values of all
+// samples for a given energy bin (or measurement) are contiguous. Samples that meet their stopping
+// criterion are removed from the active columns (the last active column is moved in its place), so
+// the batch shrinks as samples converge. Final results are stored per sample.
+//--------------------------------------------------------------------------------------------------
+class MlemBatch {
+    public:
+        int num_measurements;
+        int num_bins;
+        int capacity; // maximum # of samples in the batch
+        int stride; // # of doubles between consecutive rows of the working arrays (>= capacity)
+        int num_samples; // # of samples in the current batch
+        int num_active; // # of samples still iterating (held in the first num_active columns)
+
+        // Working arrays (rows x stride)
+        std::vector<double> spectra; // num_bins x stride
+        std::vector<double> measurements; // num_measurements x stride
+        std::vector<double> estimates; // num_measurements x stride
+        std::vector<double> ratios; // num_measurements x stride
+        std::vector<double> corrections; // num_bins x stride
+        std::vector<double> energy_corrections; // num_bins x stride
+        std::vector<double> column_j_threshold; // stride
+        std::vector<double> column_j_factor; // stride
+        std::vector<int> column_sample; // index of the sample held in each column (stride)
+
+        // Results, indexed by sample (capacity)
+        std::vector<std::vector<double>> result_spectra; // capacity x num_bins
+        std::vector<int> num_iterations;
+        std::vector<double> j_factors; // MLEM-STOP only
+        std::vector<int> converged; // 0 if MLEM-STOP reached the cutoff before the J threshold
+
+        MlemBatch(int num_measurements, int num_bins, int capacity);
+
+        void reset(int num_samples);
+        void setSample(int i_samp, std::vector<double> &sample_measurements, 
+            std::vector<double> &initial_spectrum, double j_threshold = 0);
+        void finishColumn(int i_col, int num_iterations, bool converged);
+};
+
+int runMLEMBatch(int cutoff, double error, const ResponseMatrix &nns_response, 
+    std::vector<double> &normalized_response, MlemBatch &batch
+);
+
+int runMLEMSTOPBatch(int cutoff, const ResponseMatrix &nns_response, 
+    std::vector<double> &normalized_response, MlemBatch &batch
+);
+
+int runMAPBatch(double beta, const std::string &prior, int cutoff, double error, 
+    const ResponseMatrix &nns_response, std::vector<double> &normalized_response, MlemBatch &batch
+);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef MLEM_WORKSPACE_H
+#define MLEM_WORKSPACE_H
+
+#include <stdlib.h>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// This class holds the working vectors used by the MLEM-style unfolding algorithms (MLEM,
+// MLEM-STOP, MAP & their accelerated variants). It is sized once from the number of measurements
+// and energy bins, and then passed to every call of the algorithms, so that no memory is allocated
+// while iterating (or while unfolding the sampled measurement sets used to determine uncertainty).
+// After an algorithm returns, the vectors hold the values of its final iteration.
+//--------------------------------------------------------------------------------------------------
+class MlemWorkspace {
+    public:
+        int num_measurements;
+        int num_bins;
+
+        std::vector<double> mlem_ratio; // ratio between measured & MLEM-estimated data (num_measurements)
+        std::vector<double> mlem_correction; // correction factors applied to the spectrum (num_bins)
+        std::vector<double> mlem_estimate; // MLEM-estimated data (num_measurements)
+        std::vector<double> energy_correction; // MAP energy (penalty) correction factors (num_bins)
+
+        // Intermediate spectra of the accelerated (SQUAREM) algorithms
+        std::vector<double> accel_spectrum_1; // num_bins
+        std::vector<double> accel_spectrum_2; // num_bins
+
+        // Buffers for a single sampled measurement set & its unfolded spectrum
+        std::vector<double> sampled_measurements; // num_measurements
+        std::vector<double> sampled_spectrum; // num_bins
+
+        MlemWorkspace();
+        MlemWorkspace(int num_measurements, int num_bins);
+
+        void resize(int num_measurements, int num_bins);
+        void checkDimensions(int num_measurements, int num_bins) const;
+};
+
+#endif
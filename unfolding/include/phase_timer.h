@@ -0,0 +1,103 @@
+#ifndef PHASE_TIMER_H
+#define PHASE_TIMER_H
+
+#include <algorithm>
+#include <chrono>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Resources used by a phase of an application (e.g. reading the measurements, unfolding, report).
+// The CPU time is that of the thread that ran the phase, or that of the process (all of its
+// threads) if the phase ran on several threads (num_threads > 1), so that the phases of files
+// unfolded concurrently (batch mode) are not charged for each other. The peak RSS is that of the
+// process: the largest resident set size reached so far (at the end of the phase), by all files.
+//--------------------------------------------------------------------------------------------------
+struct PhaseRecord {
+    std::string name;
+    int num_threads = 1;
+    double wall_seconds = 0;
+    double cpu_seconds = 0;
+    long peak_rss_kb = 0;
+    long long num_iterations = 0; // iterations of the unfolding algorithm (if any)
+    long long num_samples = 0; // sampled measurement sets unfolded (if any)
+
+    double samplesPerSecond() const { return wall_seconds > 0 ? num_samples/wall_seconds : 0; }
+};
+
+//--------------------------------------------------------------------------------------------------
+// This class collects the phases of an application (see PhaseTimer), in the order they end. They
+// are reported in the unfolding report and saved to a JSON file for monitoring.
+//--------------------------------------------------------------------------------------------------
+class PerformanceLog {
+    public:
+        std::vector<PhaseRecord> phases;
+
+        void add(const PhaseRecord &record);
+        PhaseRecord* find(const std::string &name);
+        const PhaseRecord* find(const std::string &name) const;
+        double totalWallSeconds() const;
+        long peakRssKb() const;
+        void saveJSON(const std::string &path, const std::string &program,
+            const std::string &irradiation_conditions, int num_threads) const;
+};
+
+//--------------------------------------------------------------------------------------------------
+// Return the wall time [s] of all phases. Inline, like peakRssKb, so that programs that only read
+// the settings (custom_classes) need not link the timers.
+//--------------------------------------------------------------------------------------------------
+inline double PerformanceLog::totalWallSeconds() const {
+    double total = 0;
+    for (size_t i_phase = 0; i_phase < phases.size(); i_phase++) {
+        total += phases[i_phase].wall_seconds;
+    }
+    return total;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the peak RSS [kB] reached over all phases
+//--------------------------------------------------------------------------------------------------
+inline long PerformanceLog::peakRssKb() const {
+    long peak = 0;
+    for (size_t i_phase = 0; i_phase < phases.size(); i_phase++) {
+        peak = std::max(peak, phases[i_phase].peak_rss_kb);
+    }
+    return peak;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Scoped timer of a phase: measures the wall time, CPU time & peak RSS from its construction until
+// stop() is called or it is destroyed, whichever comes first, and adds the phase to the log. No
+// phase is recorded if the log is NULL. A phase that runs on num_threads > 1 threads (e.g. those of
+// a ThreadPool) is charged the CPU time of the process, others that of the calling thread.
+//--------------------------------------------------------------------------------------------------
+class PhaseTimer {
+    public:
+        PhaseTimer(PerformanceLog *log, const std::string &name, int num_threads = 1);
+        ~PhaseTimer();
+
+        void setIterations(long long num_iterations) { record.num_iterations = num_iterations; }
+        void setSamples(long long num_samples) { record.num_samples = num_samples; }
+        void stop();
+
+    private:
+        PerformanceLog *log;
+        PhaseRecord record;
+        std::chrono::steady_clock::time_point wall_start;
+        double cpu_start;
+        bool running;
+
+        double getCpuSeconds() const;
+
+        // Not copyable (records its phase once)
+        PhaseTimer(const PhaseTimer&) = delete;
+        PhaseTimer& operator=(const PhaseTimer&) = delete;
+};
+
+double getProcessCpuSeconds();
+double getThreadCpuSeconds();
+long getPeakRssKb();
+std::string toJSONString(const std::string &value);
+
+#endif
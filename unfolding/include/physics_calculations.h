@@ -3,9 +3,40 @@
 
 #include <stdlib.h>
 #include <fstream>
+#include <string>
 #include <vector>
 #include <algorithm>
 
+#include "convergence_trace.h"
+#include "iteration_observer.h"
+#include "mlem_workspace.h"
+#include "response_matrix.h"
+
+// Priors available for MAP unfolding
+enum MapPrior {
+    PRIOR_QUADRATIC,
+    PRIOR_QUADRATIC_NORMALIZED,
+    PRIOR_MRP,
+    PRIOR_MEANRP,
+    PRIOR_GAUSSIANS
+};
+
+// Parameters of interest that can be calculated at each checkpoint of a trend (unfold_trend)
+enum TrendParameter {
+    TREND_TOTAL_FLUENCE,
+    TREND_TOTAL_DOSE,
+    TREND_TOTAL_ENERGY_CORRECTION,
+    TREND_MAX_MLEM_RATIO,
+    TREND_AVG_MLEM_RATIO,
+    TREND_J_FACTOR,
+    TREND_J_FACTOR2,
+    TREND_NOISE,
+    TREND_REDUCED_CHI_SQUARED,
+    TREND_RMS,
+    TREND_NRMSD,
+    TREND_CHI_SQUARED_G
+};
+
 int processMeasurements(int num_measurements, int num_meas_per_shell, std::vector<double>& measurements, 
     std::vector<double>& std_errors);
 
@@ -13,54 +44,66 @@ double getMeanValueD(std::vector<double>& data);
 
 double getSampleMeanStandardErrorD(std::vector<double>& data, double mean);
 
-std::vector<double> normalizeResponse(int num_bins, int num_measurements, std::vector<std::vector<double>>& system_response);
-
 std::vector<double> normalizeVector(std::vector<double>& unnormalized_vector);
 
-double poisson(double lambda);
-
 int runMLEM(int cutoff, double error, int num_measurements, int num_bins, std::vector<double> &measurements, 
-    std::vector<double> &spectrum, std::vector<std::vector<double>>& nns_response, 
-    std::vector<double> &normalized_response, std::vector<double> &mlem_ratio, 
-    std::vector<double> &mlem_correction, std::vector<double> &mlem_estimate
+    std::vector<double> &spectrum, const ResponseMatrix& nns_response, 
+    std::vector<double> &normalized_response, MlemWorkspace &workspace, 
+    IterationObserver *observer = NULL, ConvergenceTrace *trace = NULL
 );
 
 int runMLEMSTOP(int cutoff, int num_measurements, int num_bins, std::vector<double> &measurements, 
-    std::vector<double> &spectrum, std::vector<std::vector<double>>& nns_response, 
-    std::vector<double> &normalized_response, std::vector<double> &mlem_ratio, 
-    std::vector<double> &mlem_correction, std::vector<double> &mlem_estimate, double j_threshold,
-    double& j_factor
+    std::vector<double> &spectrum, const ResponseMatrix& nns_response, 
+    std::vector<double> &normalized_response, MlemWorkspace &workspace, double j_threshold,
+    double& j_factor, IterationObserver *observer = NULL, ConvergenceTrace *trace = NULL
 );
 
 double determineJThreshold(int num_measurements, std::vector<double>& measurements, double cps_crossover);
 
-int runMAP(std::vector<double> &energy_correction, double beta, std::string prior, int cutoff, 
-    double error, int num_measurements, int num_bins, std::vector<double> &measurements, 
-    std::vector<double> &spectrum, std::vector<std::vector<double>>& nns_response, 
-    std::vector<double> &normalized_response, std::vector<double> &mlem_ratio
+MapPrior parseMapPrior(const std::string &prior);
+
+void calculateEnergyCorrection(MapPrior prior, double beta, int num_bins, const double* spectrum, 
+    double* energy_correction, int stride
+);
+
+int runMAP(double beta, const std::string &prior, int cutoff, double error, int num_measurements, 
+    int num_bins, std::vector<double> &measurements, std::vector<double> &spectrum, 
+    const ResponseMatrix& nns_response, std::vector<double> &normalized_response, 
+    MlemWorkspace &workspace, IterationObserver *observer = NULL, ConvergenceTrace *trace = NULL
+);
+
+int runMLEMAccel(int cutoff, double error, int num_measurements, int num_bins, 
+    std::vector<double> &measurements, std::vector<double> &spectrum, const ResponseMatrix& nns_response, 
+    std::vector<double> &normalized_response, MlemWorkspace &workspace
+);
+
+int runMAPAccel(double beta, const std::string &prior, int cutoff, double error, int num_measurements, 
+    int num_bins, std::vector<double> &measurements, std::vector<double> &spectrum, 
+    const ResponseMatrix& nns_response, std::vector<double> &normalized_response, 
+    MlemWorkspace &workspace
 );
 
-double calculateDose(int num_bins, std::vector<double> &spectrum, std::vector<double> &icrp_factors);
+double calculateDose(int num_bins, const std::vector<double> &spectrum, std::vector<double> &icrp_factors);
 
 double calculateTotalCharge(int num_measurements, std::vector<double> measurements_nc);
 
-double calculateTotalFlux(int num_bins, std::vector<double> &spectrum);
+double calculateTotalFlux(int num_bins, const std::vector<double> &spectrum);
 
-double calculateTotalEnergyCorrection(std::vector<double> &energy_correction);
+double calculateTotalEnergyCorrection(const std::vector<double> &energy_correction);
 
-double calculateMaxRatio(int num_measurements, std::vector<double> &mlem_ratio);
+double calculateMaxRatio(int num_measurements, const std::vector<double> &mlem_ratio);
 
-double calculateAvgRatio(int num_measurements, std::vector<double> &mlem_ratio);
+double calculateAvgRatio(int num_measurements, const std::vector<double> &mlem_ratio);
 
 double calculateAverageEnergy(int num_bins, std::vector<double> &spectrum, std::vector<double> &energy_bins);
 
 double calculateSourceStrength(int num_bins, std::vector<double> &spectrum, int duration, double dose_mu);
 
-double calculateRMSEstimator(int size, std::vector<double> &true_vector, std::vector<double> &estimate_vector);
+double calculateRMSEstimator(int size, std::vector<double> &true_vector, const std::vector<double> &estimate_vector);
 
-double calculateNRMSD(int size, std::vector<double> &true_vector, std::vector<double> &estimate_vector);
+double calculateNRMSD(int size, std::vector<double> &true_vector, const std::vector<double> &estimate_vector);
 
-double calculateChiSquaredG(int size, std::vector<double> &true_vector, std::vector<double> &estimate_vector);
+double calculateChiSquaredG(int size, std::vector<double> &true_vector, const std::vector<double> &estimate_vector);
 
 int calculateRMSD_vector(int num_samples, std::vector<double> &true_vector, 
     std::vector<std::vector<double>> &sampled_vectors, std::vector<double> &rms_differences
@@ -75,17 +118,26 @@ double calculateEnergyUncertainty(int num_bins, std::vector<double> energy_bins,
 );
 
 double calculateJFactor(int num_measurements, std::vector<double> &measurements,
-    std::vector<double> &mlem_estimate
+    const std::vector<double> &mlem_estimate
 );
 
 double calculateJFactor2(int num_measurements, std::vector<double> &measurements,
-    std::vector<double> &mlem_estimate
+    const std::vector<double> &mlem_estimate
 ); 
 
-double calculateNoise(int start_bin, int end_bin, std::vector<double>& spectrum);
+double calculateNoise(int start_bin, int end_bin, const std::vector<double>& spectrum);
+
+double calculateChiSquared(int i_num, int num_bins, int num_measurements, const std::vector<double> &spectrum, 
+    std::vector<double> &measurements, const std::vector<double> &mlem_ratio
+);
+
+TrendParameter parseTrendParameter(const std::string &parameter);
+
+bool trendParameterNeedsReference(TrendParameter parameter);
 
-double calculateChiSquared(int i_num, int num_bins, int num_measurements, std::vector<double> &spectrum, 
-    std::vector<double> &measurements, std::vector<double> &mlem_ratio
+double calculateTrendParameter(TrendParameter parameter, int i_num, int num_measurements, int num_bins, 
+    std::vector<double> &measurements, const std::vector<double> &spectrum, 
+    const MlemWorkspace &workspace, std::vector<double> &icrp_factors, std::vector<double> &ref_spectrum
 );
 
 void calculateDerivatives(std::vector<double> &derivatives, int num_points, std::vector<int> &x_data, 
@@ -0,0 +1,30 @@
+#ifndef PLOT_PLUGIN_H
+#define PLOT_PLUGIN_H
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// Version of the interface between the applications & the plotting backend. Backends built for
+// another version are rejected.
+const int PLOT_PLUGIN_VERSION = 1;
+
+// Name of the ROOT plotting backend (shared library built by "make plot_root.so")
+const std::string PLOT_PLUGIN_NAME = "plot_root.so";
+
+// Functions exported (with C linkage) by a plotting backend
+typedef int (*PlotPluginVersionFunction)();
+typedef int (*PlotPluginSpectrumFunction)(const char *path_figure, const char *irradiation_conditions,
+    int num_measurements, int num_bins, const double *energy_bins, const double *spectrum,
+    const double *spectrum_uncertainty_upper, const double *spectrum_uncertainty_lower
+);
+
+std::string plotPluginPath();
+
+int plotSpectrumWithPlugin(std::string path_figure,
+    std::string irradiation_conditions, int num_measurements, int num_bins,
+    std::vector<double> &energy_bins, std::vector<double> &spectrum,
+    std::vector<double> &spectrum_uncertainty_upper, std::vector<double> &spectrum_uncertainty_lower
+);
+
+#endif
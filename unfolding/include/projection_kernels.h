@@ -0,0 +1,42 @@
+#ifndef PROJECTION_KERNELS_H
+#define PROJECTION_KERNELS_H
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "response_matrix.h"
+
+void forwardProject(const ResponseMatrix& response, const double* spectrum, double* estimate);
+
+void backProject(const ResponseMatrix& response, const double* ratio, const double* normalization,
+    double* correction);
+
+void forwardProjectScalar(const ResponseMatrix& response, const double* spectrum, double* estimate);
+
+void backProjectScalar(const ResponseMatrix& response, const double* ratio, const double* normalization,
+    double* correction);
+
+void forwardProjectBatch(const ResponseMatrix& response, const double* spectra, int num_samples, int stride,
+    double* estimates);
+
+void backProjectBatch(const ResponseMatrix& response, const double* ratios, int num_samples, int stride,
+    const double* normalization, double* corrections);
+
+void forwardProjectBatchScalar(const ResponseMatrix& response, const double* spectra, int num_samples,
+    int stride, double* estimates);
+
+void backProjectBatchScalar(const ResponseMatrix& response, const double* ratios, int num_samples,
+    int stride, const double* normalization, double* corrections);
+
+int getProjectionBatchBlock();
+
+bool projectionKernelSupported(std::string kernel);
+
+void setProjectionKernel(std::string kernel);
+
+std::string getProjectionKernel();
+
+std::vector<std::string> getSupportedProjectionKernels();
+
+#endif
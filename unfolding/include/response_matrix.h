@@ -0,0 +1,53 @@
+#ifndef RESPONSE_MATRIX_H
+#define RESPONSE_MATRIX_H
+
+#include <stdlib.h>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// This class stores the NNS response (system) matrix used by the unfolding algorithms. Values are
+// held in a single aligned, contiguous buffer in row-major order (measurements x bins). A transposed
+// copy (bins x measurements) is kept alongside it, so that both the forward projection (response x
+// spectrum) and the back projection (transposed response x ratios) read memory in order.
+// Each row is padded to a multiple of ALIGNMENT bytes so that every row starts on an aligned address.
+//--------------------------------------------------------------------------------------------------
+class ResponseMatrix {
+    public:
+        static const int ALIGNMENT = 64; // bytes
+
+        ResponseMatrix();
+        ResponseMatrix(int num_measurements, int num_bins);
+        ResponseMatrix(const ResponseMatrix& other);
+        ResponseMatrix& operator=(const ResponseMatrix& other);
+        ~ResponseMatrix();
+
+        void resize(int num_measurements, int num_bins);
+        void set(int i_meas, int i_bin, double value);
+        void assign(const double* row_values, const double* column_values);
+
+        int num_measurements() const { return n_meas; }
+        int num_bins() const { return n_bins; }
+        bool empty() const { return n_meas == 0 || n_bins == 0; }
+
+        // Response of a single measurement (moderator configuration) at a single energy bin
+        double at(int i_meas, int i_bin) const { return values[i_meas*row_stride + i_bin]; }
+        // Contiguous response of measurement i_meas across all energy bins
+        const double* row(int i_meas) const { return values + i_meas*row_stride; }
+        // Contiguous response of all measurements at energy bin i_bin (i.e. row of the transpose)
+        const double* column(int i_bin) const { return values_transposed + i_bin*column_stride; }
+
+    private:
+        int n_meas;
+        int n_bins;
+        int row_stride; // # of doubles between the starts of consecutive rows (>= n_bins)
+        int column_stride; // # of doubles between the starts of consecutive columns (>= n_meas)
+        double* values;
+        double* values_transposed;
+
+        void allocate();
+        void release();
+};
+
+std::vector<double> normalizeResponse(int num_bins, int num_measurements, const ResponseMatrix& system_response);
+
+#endif
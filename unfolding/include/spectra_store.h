@@ -0,0 +1,87 @@
+#ifndef SPECTRA_STORE_H
+#define SPECTRA_STORE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// Version of the spectra store file format. Stores of another version are rejected.
+const uint32_t SPECTRA_STORE_VERSION = 1;
+
+//--------------------------------------------------------------------------------------------------
+// This class reads a spectra store: a binary file to which unfolded spectra (and their lower & upper
+// uncertainties) are appended, as an alternative to the ever-growing output spectra CSV file. All
+// spectra of a store share the same energy bins, saved once in its header.
+//
+// Appending a spectrum (appendToSpectraStore) writes a single record at the end of the file &
+// updates the fixed-size header, whatever the number of spectra already in the store. A sidecar
+// index file (<store>.idx) lists the name (irradiation conditions) & position of every record, so
+// that opening a store reads the index rather than the whole store, and any spectrum can then be
+// looked up by name & read on its own. The index is rebuilt from the store if it is missing or out
+// of date (e.g. the store was copied without it).
+//
+// Stores can be exported to the legacy CSV layouts (exportRows, exportColumns), and are read
+// directly by plot_spectra (see readSpectraStore).
+//
+// Usage:
+//     SpectraStore store;
+//     store.open(path);
+//     int i_entry = store.find(irradiation_conditions);
+//     if (i_entry >= 0) store.read(i_entry, spectrum, error_lower, error_upper);
+//--------------------------------------------------------------------------------------------------
+class SpectraStore {
+    public:
+        SpectraStore();
+        ~SpectraStore();
+
+        void open(const std::string &path);
+        void close();
+
+        int numEntries() const { return entries.size(); }
+        int numBins() const { return energy_bins.size(); }
+        const std::vector<double>& energyBins() const { return energy_bins; }
+        const std::string& name(int i_entry) const { return entries[i_entry].name; }
+
+        int find(const std::string &irradiation_conditions) const;
+        std::vector<int> findAll(const std::string &irradiation_conditions) const;
+        std::vector<int> select(const std::vector<std::string> &selection) const;
+        void read(int i_entry, std::vector<double> &spectrum, std::vector<double> &error_lower,
+            std::vector<double> &error_upper) const;
+
+        void exportRows(const std::string &csv_path, const std::vector<int> &selected_entries) const;
+        void exportColumns(const std::string &csv_path, const std::vector<int> &selected_entries) const;
+
+    private:
+        struct Entry {
+            std::string name;
+            uint64_t offset; // position of the record in the store
+        };
+
+        std::string path;
+        int file_descriptor;
+        std::vector<double> energy_bins;
+        std::vector<Entry> entries;
+        std::map<std::string, std::vector<int>> entries_by_name; // entry indices, in store order
+
+        // Not copyable (owns the file descriptor)
+        SpectraStore(const SpectraStore&) = delete;
+        SpectraStore& operator=(const SpectraStore&) = delete;
+};
+
+bool isSpectraStore(const std::string &path);
+
+void appendToSpectraStore(const std::string &path, const std::string &irradiation_conditions,
+    const std::vector<double> &energy_bins, const std::vector<double> &spectrum,
+    const std::vector<double> &error_lower, const std::vector<double> &error_upper
+);
+
+int readSpectraStore(std::string file_name, std::vector<std::string>& selection,
+    std::vector<std::string>& header_vector, std::vector<double>& energy_bins,
+    std::vector<std::vector<double>>& spectra_vector, std::vector<std::vector<double>>& error_lower_vector,
+    std::vector<std::vector<double>>& error_upper_vector, bool plot_per_mu, std::vector<int>& number_mu,
+    std::vector<int>& duration
+);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef SPECTRUM_UNFOLDING_H
+#define SPECTRUM_UNFOLDING_H
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "custom_classes.h"
+#include "instrument_profile.h"
+#include "phase_timer.h"
+#include "thread_pool.h"
+
+//--------------------------------------------------------------------------------------------------
+// Outcome of the unfolding of a set of measurements (see unfoldSpectrum): the unfolded spectrum, the
+// quantities of interest calculated from it, and their uncertainties.
+//--------------------------------------------------------------------------------------------------
+struct UnfoldingResult {
+    // Unfolded spectrum & the measurements it reconstructs
+    std::vector<double> spectrum;
+    std::vector<double> mlem_estimate;
+    std::vector<double> mlem_ratio;
+    int num_iterations = 0;
+    // MLEM-STOP specific
+    double j_factor = 0;
+    double j_threshold = 0;
+    UncertaintyManagerJ j_manager_low;
+    UncertaintyManagerJ j_manager_high;
+
+    // Uncertainty of the spectrum
+    std::vector<double> spectrum_uncertainty_lower;
+    std::vector<double> spectrum_uncertainty_upper;
+    // Sampled measurement sets (uncertainty_type = poisson or gaussian)
+    long long seed = -1; // seed used (drawn at random if settings.seed < 0)
+    int num_uncertainty_samples = 0;
+    int num_toss = 0; // # of sets discarded b/c they don't converge with MLEM-STOP
+    double dose_uncertainty_error = 0;
+    double spectrum_uncertainty_error = 0;
+    double avg_sample_iterations = 0;
+
+    // Quantities of interest & their uncertainties
+    double dose = 0;
+    double dose_uncertainty_upper = 0;
+    double dose_uncertainty_lower = 0;
+    double total_flux = 0;
+    double total_flux_uncertainty_upper = 0;
+    double total_flux_uncertainty_lower = 0;
+    double avg_energy = 0;
+    double avg_energy_uncertainty_upper = 0;
+    double avg_energy_uncertainty_lower = 0;
+
+    // Convergence trace of the unfolding (empty if not traced, see trace_stride)
+    std::string path_trace;
+};
+
+void prepareMeasurements(const UnfoldingSettings &settings, std::vector<double> &measurements,
+    std::vector<double> &measurements_nc, std::vector<double> &std_errors
+);
+
+void unfoldSpectrum(const UnfoldingSettings &settings, InstrumentProfile &profile, ThreadPool &pool,
+    std::vector<double> &measurements, std::vector<double> &std_errors, UnfoldingResult &result,
+    PerformanceLog *performance = NULL
+);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Fixed set of worker threads that execute a numbered list of tasks. run() hands out task indices
+// 0..num_tasks-1 to the threads (the calling thread takes part as thread 0) and returns once all
+// tasks are done. Tasks are given the index of the thread executing them, so they can use
+// per-thread working memory. Which thread executes a task is not deterministic: tasks should only
+// write to results owned by their task index if the outcome must not depend on the # of threads.
+//--------------------------------------------------------------------------------------------------
+class ThreadPool {
+    public:
+        ThreadPool(int num_threads = 0);
+        ~ThreadPool();
+
+        int size() const;
+        void run(int num_tasks, const std::function<void(int i_task, int i_thread)>& task);
+
+    private:
+        std::vector<std::thread> workers; // threads 1..size()-1
+        std::mutex mutex;
+        std::condition_variable start_condition;
+        std::condition_variable done_condition;
+
+        const std::function<void(int, int)>* job;
+        int num_tasks;
+        std::atomic<int> next_task;
+        int num_busy; // # of workers that have not finished the current job
+        int generation; // incremented for each job
+        bool stopping;
+        std::exception_ptr error; // first exception thrown by a task of the current job
+
+        ThreadPool(const ThreadPool&);
+        ThreadPool& operator=(const ThreadPool&);
+
+        void workerLoop(int i_thread);
+        void executeTasks(int i_thread);
+};
+
+int resolveNumThreads(int num_threads);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef UNCERTAINTY_ACCUMULATOR_H
+#define UNCERTAINTY_ACCUMULATOR_H
+
+#include <stdlib.h>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Running statistics of a sampled quantity, updated one value at a time: mean & variance (Welford's
+// algorithm) and the sum of squared deviations from a reference value (e.g. the quantity obtained
+// from the measured, unsampled, data), along with the variance of those squared deviations (used
+// to estimate the precision of the root-mean-square deviation). Two sets of statistics can be
+// merged (Chan et al.), so samples can be accumulated separately (e.g. per thread) and combined.
+//--------------------------------------------------------------------------------------------------
+class RunningStatistic {
+    public:
+        double reference;
+        int count;
+        double mean;
+        double m2; // sum of squared deviations from the mean
+        double sum_sq_deviation; // sum of squared deviations from the reference
+        double sq_deviation_m2; // sum of squared deviations of the above from their mean
+
+        RunningStatistic(double reference = 0);
+
+        void reset();
+        void add(double value);
+        void merge(const RunningStatistic &other);
+
+        double variance() const;
+        double standardError() const;
+        double rmsd() const;
+        double rmsdRelativeError() const;
+};
+
+//--------------------------------------------------------------------------------------------------
+// Accumulates the spectra unfolded from sampled measurement sets, in order to determine the
+// uncertainty of the unfolded (central) spectrum and of the dose derived from it. Each spectrum is
+// added as it is unfolded and then discarded, so memory does not depend on the # of samples. The
+// root-mean-square deviation of each energy bin from the central spectrum is identical to
+// calculateRMSD_vector applied to all sampled spectra (up to rounding, when accumulators are
+// merged). The uncertainties of the total flux & average energy are propagated from those of the
+// energy bins (calculateSumUncertainty, calculateEnergyUncertainty), so they are not accumulated.
+//--------------------------------------------------------------------------------------------------
+class UncertaintyAccumulator {
+    public:
+        int num_bins;
+        std::vector<RunningStatistic> spectrum; // per energy bin (num_bins)
+        RunningStatistic dose;
+
+        UncertaintyAccumulator();
+        UncertaintyAccumulator(std::vector<double> &central_spectrum, std::vector<double> &icrp_factors);
+
+        int num_samples() const;
+        void reset();
+        void addSample(std::vector<double> &sampled_spectrum);
+        void merge(const UncertaintyAccumulator &other);
+        void calculateSpectrumRMSD(std::vector<double> &rms_differences) const;
+        double spectrumRelativeError() const;
+
+    private:
+        std::vector<double> *icrp_factors;
+};
+
+#endif
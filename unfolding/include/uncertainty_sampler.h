@@ -0,0 +1,95 @@
+#ifndef UNCERTAINTY_SAMPLER_H
+#define UNCERTAINTY_SAMPLER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "counter_rng.h"
+#include "custom_classes.h"
+#include "mlem_batch.h"
+#include "mlem_workspace.h"
+#include "response_matrix.h"
+#include "thread_pool.h"
+#include "uncertainty_accumulator.h"
+
+// # of consecutive samples whose spectra are accumulated together (by one thread) before being
+// merged with the other samples. Fixed, so that results do not depend on the # of threads or the
+// batch size. Also the maximum batch size.
+const int SAMPLES_PER_BLOCK = 64;
+
+//--------------------------------------------------------------------------------------------------
+// This class generates sampled (pseudo-)measurement sets around the measured values and unfolds
+// them, in order to determine the uncertainty of the unfolded spectrum (uncertainty_type=poisson
+// or gaussian).
+//
+// Samples are numbered. The random values of sample i are drawn from their own stream of a
+// counter-based generator, identified by (seed, i, attempt), where attempt counts the times the
+// sample was redrawn because MLEM-STOP did not converge. Each sampled spectrum therefore only
+// depends on the seed and its sample number. Every sample is unfolded from the same initial
+// spectrum: the input (guess) spectrum, or the central unfolded spectrum (sample_initialization).
+//
+// The samples are split into fixed blocks of SAMPLES_PER_BLOCK consecutive samples, which are
+// distributed across the threads of a ThreadPool. A thread unfolds the samples of a block in
+// batches (MlemBatch) of up to uncertainty_batch_size samples, then adds their spectra, in sample
+// order, to an accumulator of the block. The accelerated algorithms (mlem_accel, map_accel) unfold
+// one sample at a time instead, with a per-thread MlemWorkspace. Block accumulators are merged in
+// block order, so results are identical whatever the # of threads. Only a fixed group of block
+// accumulators is held at a time.
+//
+// If trace_stride is set, each MLEM-STOP sample that is redrawn is unfolded again with a
+// ConvergenceTrace (see traceSample), to show why it did not reach its J threshold.
+//--------------------------------------------------------------------------------------------------
+class UncertaintySampler {
+    public:
+        UnfoldingSettings settings;
+        uint64_t seed;
+        int num_measurements;
+        int num_bins;
+        int batch_size; // # of samples unfolded together
+        long long num_iterations; // total # of iterations spent on samples, incl. redrawn ones
+
+        UncertaintySampler(const UnfoldingSettings &settings, uint64_t seed, ThreadPool &pool,
+            std::vector<double> &measurements, std::vector<double> &std_errors, 
+            std::vector<double> &initial_spectrum, const ResponseMatrix &nns_response, 
+            std::vector<double> &normalized_response
+        );
+
+        void sampleMeasurements(int i_samp, int attempt, std::vector<double> &sampled_measurements);
+        int unfoldSamples(int first_sample, int num_samples, UncertaintyAccumulator &accumulator);
+        int unfoldUntilConverged(double target_error, int min_samples, int max_samples, 
+            UncertaintyAccumulator &accumulator
+        );
+
+    private:
+        ThreadPool *pool;
+        std::vector<double> *measurements;
+        std::vector<double> *std_errors;
+        std::vector<double> *initial_spectrum;
+        const ResponseMatrix *nns_response;
+        std::vector<double> *normalized_response;
+
+        // Per-thread working memory
+        std::vector<MlemBatch> batches;
+        std::vector<MlemWorkspace> workspaces; // accelerated algorithms (no batch solver)
+        std::vector<std::vector<double>> thread_measurements; // sampled measurement set
+        std::vector<std::vector<std::vector<double>>> block_spectra; // sampled spectra of the block
+        std::vector<std::vector<int>> pending_samples; // samples of the batch still to be unfolded
+        std::vector<std::vector<int>> pending_attempts;
+        std::vector<long long> thread_iterations; // # of iterations spent by each thread
+
+        // Per-block results, for one group of blocks
+        std::vector<UncertaintyAccumulator> block_accumulators;
+        std::vector<int> block_tosses; // # of samples redrawn in each block
+
+        int unfoldBlock(int first_sample, int num_samples, int i_thread, 
+            UncertaintyAccumulator &block_accumulator
+        );
+        int unfoldBatch(int first_sample, int num_samples, int i_thread,
+            std::vector<std::vector<double>> &sampled_spectra, int block_first
+        );
+        void traceSample(int i_samp, int attempt);
+};
+
+#endif
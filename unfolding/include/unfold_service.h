@@ -0,0 +1,55 @@
+#ifndef UNFOLD_SERVICE_H
+#define UNFOLD_SERVICE_H
+
+#include <stdlib.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Default pathname of the Unix domain socket of unfold_server
+const std::string DEFAULT_SERVICE_SOCKET = "output/unfold_server.sock";
+
+// Fields (name, value) of a request or reply, in the order they are written
+typedef std::vector<std::pair<std::string, std::string>> ServiceMessage;
+
+//--------------------------------------------------------------------------------------------------
+// This class exchanges messages (requests & replies) between unfold_server & its clients, over a
+// connected Unix domain socket. A message is a series of "name=value" lines (as in the settings
+// files) terminated by an empty line, e.g.:
+//     profile=default
+//     algorithm=map
+//     measurements=104512,169256,210326,193958,140020,102647,64387.6,12895.2
+//     <empty line>
+// Several messages may be exchanged over a connection. The connection (file descriptor) is closed
+// on destruction.
+//--------------------------------------------------------------------------------------------------
+class ServiceConnection {
+    public:
+        explicit ServiceConnection(int file_descriptor);
+        ~ServiceConnection();
+
+        bool receive(ServiceMessage &message);
+        void send(const ServiceMessage &message);
+
+    private:
+        int file_descriptor;
+        std::string buffer; // received data not yet returned as a message
+        size_t buffer_position;
+
+        bool readLine(std::string &line);
+
+        // Not copyable (owns the file descriptor)
+        ServiceConnection(const ServiceConnection&) = delete;
+        ServiceConnection& operator=(const ServiceConnection&) = delete;
+};
+
+int listenOnServiceSocket(const std::string &path);
+int connectToServiceSocket(const std::string &path);
+
+const std::string& getServiceField(const ServiceMessage &message, const std::string &name);
+void addServiceField(ServiceMessage &message, const std::string &name, double value);
+void addServiceField(ServiceMessage &message, const std::string &name, const std::vector<double> &values);
+double parseServiceValue(const std::string &name, const std::string &value_string);
+std::vector<double> parseServiceVector(const std::string &name, const std::string &values_string);
+
+#endif
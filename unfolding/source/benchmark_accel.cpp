@@ -0,0 +1,234 @@
+//**************************************************************************************************
+// This program compares the accelerated (SQUAREM) unfolding algorithms with the regular ones:
+// mlem_accel vs. mlem and map_accel vs. map. A set of measurements is unfolded with each NNS
+// response function provided in the "input/" directory (He-3 & gold), for a range of target
+// errors (mlem_max_error). For every case, the # of iterations & wall time of both algorithms are
+// reported, along with the reductions obtained and the difference between the unfolded spectra
+// (and doses).
+// The settings are read from the same configuration file as unfold_spectrum. So that the target
+// errors can be reached with every response function, the unfolded measurements are not the
+// measured values themselves: the measurements are first unfolded (regular MLEM, with the
+// configured response, mlem_cutoff & mlem_max_error), and the resulting reference spectrum is
+// projected through each response function. The algorithm setting is ignored. mlem_cutoff should
+// be large enough for the regular algorithms to reach the target errors.
+//**************************************************************************************************
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// Local
+#include "custom_classes.h"
+#include "fileio.h"
+#include "handle_args.h"
+#include "mlem_workspace.h"
+#include "physics_calculations.h"
+#include "projection_kernels.h"
+#include "response_matrix.h"
+#include "spectrum_unfolding.h"
+
+// Minimum duration over which the unfolding of each case is repeated (to time it)
+const double MIN_TIMING_SECONDS = 0.2;
+
+//==================================================================================================
+// Unfold the measurements using the given algorithm, starting from initial_spectrum. The unfolded
+// spectrum is stored in spectrum. Returns the # of iterations.
+//==================================================================================================
+int unfold(const std::string &algorithm, const UnfoldingSettings &settings, double error,
+    int num_measurements, int num_bins, std::vector<double> &measurements,
+    std::vector<double> &initial_spectrum, std::vector<double> &spectrum,
+    const ResponseMatrix &nns_response, std::vector<double> &normalized_response,
+    MlemWorkspace &workspace)
+{
+    spectrum = initial_spectrum;
+    if (algorithm == "mlem") {
+        return runMLEM(settings.cutoff, error, num_measurements, num_bins, measurements, spectrum,
+            nns_response, normalized_response, workspace
+        );
+    }
+    else if (algorithm == "mlem_accel") {
+        return runMLEMAccel(settings.cutoff, error, num_measurements, num_bins, measurements, spectrum,
+            nns_response, normalized_response, workspace
+        );
+    }
+    else if (algorithm == "map") {
+        return runMAP(settings.beta, settings.prior, settings.cutoff, error, num_measurements, num_bins,
+            measurements, spectrum, nns_response, normalized_response, workspace
+        );
+    }
+    else if (algorithm == "map_accel") {
+        return runMAPAccel(settings.beta, settings.prior, settings.cutoff, error, num_measurements,
+            num_bins, measurements, spectrum, nns_response, normalized_response, workspace
+        );
+    }
+    throw std::logic_error("Unrecognized unfolding algorithm: " + algorithm);
+}
+
+//==================================================================================================
+// Return the average wall time (in seconds) of unfolding the measurements with the given algorithm.
+// The unfolding is repeated for at least MIN_TIMING_SECONDS (and at least 3 times).
+//==================================================================================================
+double timeUnfolding(const std::string &algorithm, const UnfoldingSettings &settings, double error,
+    int num_measurements, int num_bins, std::vector<double> &measurements,
+    std::vector<double> &initial_spectrum, std::vector<double> &spectrum,
+    const ResponseMatrix &nns_response, std::vector<double> &normalized_response,
+    MlemWorkspace &workspace)
+{
+    int num_runs = 0;
+    double elapsed = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (num_runs < 3 || elapsed < MIN_TIMING_SECONDS) {
+        unfold(algorithm, settings, error, num_measurements, num_bins, measurements, initial_spectrum,
+            spectrum, nns_response, normalized_response, workspace
+        );
+        num_runs++;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return elapsed/num_runs;
+}
+
+int main(int argc, char* argv[])
+{
+    // Put arguments in vector for easier processing
+    std::vector<std::string> arg_vector;
+    for (int i = 1; i < argc; i++) {
+        arg_vector.push_back(argv[i]);
+    }
+
+    std::vector<std::string> input_file_flags;
+    input_file_flags.push_back("--configuration");
+    std::string config_file;
+    setfile(arg_vector, "--configuration", "input/unfold_spectrum.cfg", config_file);
+    checkUnknownParameters(arg_vector, input_file_flags);
+
+    UnfoldingSettings settings;
+    setSettings(config_file, settings);
+    settings.set_f_factor(settings.f_factor / 1e6); // Convert f_factor from fA/cps to nA/cps
+
+    // Response functions & target errors to benchmark
+    const int num_responses = 2;
+    std::string response_files[num_responses] = {
+        "input/response_nns_he3.csv",
+        "input/response_nns_gold.csv"
+    };
+    const int num_errors = 3;
+    double errors[num_errors] = {1e-2, 1e-3, 1e-4};
+    const int num_algorithms = 2;
+    std::string algorithms[num_algorithms] = {"mlem", "map"};
+
+    // Read in measurements, and prepare them for unfolding (as in unfold_spectrum)
+    std::vector<double> measurements = getMeasurements(settings);
+    std::cout << "Measurements successfully retrieved from " + settings.path_measurements + '\n';
+    std::vector<double> measurements_nc;
+    std::vector<double> std_errors;
+    prepareMeasurements(settings, measurements, measurements_nc, std_errors);
+    int num_measurements = measurements.size();
+
+    std::vector<double> energy_bins;
+    readInputFile1D(settings.path_energy_bins,energy_bins);
+    int num_bins = energy_bins.size();
+
+    std::vector<double> initial_spectrum;
+    readInputFile1D(settings.path_input_spectrum,initial_spectrum);
+    checkDimensions(num_bins, "number of energy bins", initial_spectrum.size(), "Input spectrum");
+
+    std::vector<double> icrp_factors;
+    readInputFile1D(settings.path_icrp_factors,icrp_factors);
+    checkDimensions(num_bins, "number of energy bins", icrp_factors.size(), "Number of ICRP factors");
+
+    setProjectionKernel(settings.projection_kernel);
+
+    MlemWorkspace workspace(num_measurements, num_bins);
+    std::vector<double> spectrum(num_bins, 0);
+    std::vector<double> spectrum_accel(num_bins, 0);
+
+    // Reference spectrum, from which the benchmark measurements are generated
+    std::vector<double> reference_spectrum(num_bins, 0);
+    {
+        ResponseMatrix nns_response;
+        readInputFile2D(settings.path_system_response,nns_response);
+        checkDimensions(num_measurements, "number of measurements", nns_response.num_measurements(), "NNS response");
+        checkDimensions(num_bins, "number of energy bins", nns_response.num_bins(), "NNS response");
+        std::vector<double> normalized_response = normalizeResponse(num_bins, num_measurements, nns_response);
+        unfold("mlem", settings, settings.error, num_measurements, num_bins, measurements,
+            initial_spectrum, reference_spectrum, nns_response, normalized_response, workspace
+        );
+    }
+    std::vector<double> response_measurements(num_measurements, 0);
+
+    std::cout << "Accelerated vs. regular unfolding (mlem_cutoff=" << settings.cutoff << ", beta="
+        << settings.beta << ", prior=" << settings.prior << ")\n\n";
+    std::cout << std::left << std::setw(30) << "Response" << std::setw(11) << "Algorithm"
+        << std::setw(8) << "Error" << std::right << std::setw(8) << "Iter" << std::setw(8) << "Accel"
+        << std::setw(9) << "Iter -%" << std::setw(11) << "Time (us)" << std::setw(11) << "Accel"
+        << std::setw(9) << "Time -%" << std::setw(13) << "Max bin diff" << std::setw(11) << "Dose diff"
+        << "\n";
+
+    for (int i_resp = 0; i_resp < num_responses; i_resp++) {
+        ResponseMatrix nns_response;
+        readInputFile2D(response_files[i_resp],nns_response);
+        checkDimensions(num_measurements, "number of measurements", nns_response.num_measurements(), "NNS response");
+        checkDimensions(num_bins, "number of energy bins", nns_response.num_bins(), "NNS response");
+        std::vector<double> normalized_response = normalizeResponse(num_bins, num_measurements, nns_response);
+        forwardProject(nns_response, reference_spectrum.data(), response_measurements.data());
+
+        for (int i_alg = 0; i_alg < num_algorithms; i_alg++) {
+            std::string algorithm_accel = algorithms[i_alg] + "_accel";
+            for (int i_err = 0; i_err < num_errors; i_err++) {
+                int num_iterations = unfold(algorithms[i_alg], settings, errors[i_err], num_measurements,
+                    num_bins, response_measurements, initial_spectrum, spectrum, nns_response,
+                    normalized_response, workspace
+                );
+                int num_iterations_accel = unfold(algorithm_accel, settings, errors[i_err],
+                    num_measurements, num_bins, response_measurements, initial_spectrum, spectrum_accel,
+                    nns_response, normalized_response, workspace
+                );
+                double time = timeUnfolding(algorithms[i_alg], settings, errors[i_err], num_measurements,
+                    num_bins, response_measurements, initial_spectrum, spectrum, nns_response,
+                    normalized_response, workspace
+                );
+                double time_accel = timeUnfolding(algorithm_accel, settings, errors[i_err],
+                    num_measurements, num_bins, response_measurements, initial_spectrum, spectrum_accel,
+                    nns_response, normalized_response, workspace
+                );
+
+                // Relative differences between spectra (largest bin, relative to the peak) & doses
+                double max_bin = *std::max_element(spectrum.begin(), spectrum.end());
+                double max_bin_diff = 0;
+                for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+                    max_bin_diff = std::max(max_bin_diff, fabs(spectrum_accel[i_bin]-spectrum[i_bin])/max_bin);
+                }
+                double dose = calculateDose(num_bins, spectrum, icrp_factors);
+                double dose_accel = calculateDose(num_bins, spectrum_accel, icrp_factors);
+
+                // Flag cases where the cutoff was reached before the target error
+                std::string iterations = std::to_string(num_iterations);
+                if (num_iterations >= settings.cutoff) {
+                    iterations += "*";
+                }
+                std::string iterations_accel = std::to_string(num_iterations_accel);
+                if (num_iterations_accel >= settings.cutoff) {
+                    iterations_accel += "*";
+                }
+
+                std::cout << std::left << std::setw(30) << response_files[i_resp] << std::setw(11)
+                    << algorithms[i_alg] << std::setw(8) << errors[i_err] << std::right
+                    << std::setw(8) << iterations << std::setw(8) << iterations_accel << std::fixed
+                    << std::setprecision(1) << std::setw(9)
+                    << 100.0*(num_iterations-num_iterations_accel)/std::max(num_iterations,1)
+                    << std::setw(11) << time*1e6 << std::setw(11) << time_accel*1e6 << std::setw(9)
+                    << 100.0*(time-time_accel)/time << std::scientific << std::setprecision(2)
+                    << std::setw(13) << max_bin_diff << std::setw(11) << fabs(dose_accel-dose)/dose
+                    << std::defaultfloat << std::setprecision(6) << "\n";
+            }
+        }
+    }
+    std::cout << "\n* mlem_cutoff reached before the target error\n";
+
+    return 0;
+}
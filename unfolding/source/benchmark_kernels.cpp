@@ -0,0 +1,420 @@
+//**************************************************************************************************
+// This program times the kernels of physics_calculations: runMLEM, runMLEMSTOP, runMAP (with each
+// prior), normalizeResponse & calculateDose. Every kernel is timed with the NNS response functions
+// provided in the "input/" directory (He-3 & gold), and with synthetic responses of 200 & 2000
+// energy bins (so that changes that only matter for large matrices are visible).
+// For each kernel & response, the kernel is first run for WARMUP_SECONDS (warm-up, and to choose
+// the # of calls per repetition), then timed over a series of repetitions. The median & median
+// absolute deviation (MAD) of the time per iteration over the repetitions are reported, along with
+// the # of iterations per second and the # of heap allocations (operator new) per call. An
+// "iteration" is one MLEM/MAP iteration for the unfolding algorithms, and one call for
+// normalizeResponse & calculateDose.
+// The measurements are generated by projecting a reference spectrum through each response, so no
+// configuration or measurements file is needed. The unfolding algorithms run a fixed # of
+// iterations (--iterations): runMLEM & runMAP with a target error of 0, runMLEMSTOP with the J
+// threshold reached after that many iterations. runMLEM/trace_<stride> is runMLEM recording a
+// ConvergenceTrace every <stride> iterations: compare it with runMLEM (no trace) for the cost of
+// tracing. When no trace is recorded (the default), the algorithms only check a NULL pointer.
+//
+// Usage:
+//     benchmark_kernels.exe [--repetitions <#>] [--iterations <# per call>] [--output <JSON file>]
+// --output saves the results as JSON (along with the git commit), for tracking them over time.
+//**************************************************************************************************
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// Local
+#include "convergence_trace.h"
+#include "fileio.h"
+#include "handle_args.h"
+#include "mlem_workspace.h"
+#include "physics_calculations.h"
+#include "projection_kernels.h"
+#include "response_matrix.h"
+
+// Duration of the warm-up of each case, and minimum duration of each repetition
+const double WARMUP_SECONDS = 0.05;
+const double MIN_REPETITION_SECONDS = 0.01;
+
+// Energy range [MeV] & # of measurements of the synthetic responses
+const double SYNTHETIC_MIN_ENERGY = 1e-9;
+const double SYNTHETIC_MAX_ENERGY = 20;
+const int SYNTHETIC_NUM_MEASUREMENTS = 8;
+
+// MAP strength used for every prior
+const double MAP_BETA = 1e-8;
+
+//==================================================================================================
+// Heap allocations (through operator new) since the start of the program. The replacement
+// operators below count them for the whole program; the benchmark is single-threaded.
+//==================================================================================================
+static long num_allocations = 0;
+
+void* operator new(size_t size) {
+    num_allocations++;
+    void *pointer = malloc(size == 0 ? 1 : size);
+    if (pointer == NULL) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept {
+    free(pointer);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Inputs of the kernels for one response function: the response, energy bins & ICRP factors, and
+// the measurements obtained by projecting the reference spectrum through the response
+//--------------------------------------------------------------------------------------------------
+struct BenchmarkInput {
+    std::string name;
+    ResponseMatrix nns_response;
+    std::vector<double> energy_bins;
+    std::vector<double> icrp_factors;
+    std::vector<double> normalized_response;
+    std::vector<double> measurements;
+    std::vector<double> initial_spectrum;
+};
+
+//--------------------------------------------------------------------------------------------------
+// Timing of one kernel with one input
+//--------------------------------------------------------------------------------------------------
+struct BenchmarkResult {
+    std::string kernel;
+    std::string input;
+    int num_measurements;
+    int num_bins;
+    int iterations_per_call;
+    int calls_per_repetition;
+    double ns_per_iteration; // median over the repetitions
+    double ns_per_iteration_mad; // median absolute deviation
+    double allocations_per_call;
+};
+
+//==================================================================================================
+// Reference spectrum (fluence rate per bin) at the given energy bins: thermal, epithermal (1/E) &
+// fast components, as in the spectrum of a moderated source
+//==================================================================================================
+static std::vector<double> referenceSpectrum(const std::vector<double> &energy_bins) {
+    std::vector<double> spectrum(energy_bins.size());
+    for (size_t i_bin = 0; i_bin < energy_bins.size(); i_bin++) {
+        double log_energy = log10(energy_bins[i_bin]);
+        spectrum[i_bin] = 1000*exp(-0.5*pow((log_energy+7.6)/0.4, 2)) + 200
+            + 2000*exp(-0.5*pow((log_energy-0.2)/0.5, 2));
+    }
+    return spectrum;
+}
+
+//==================================================================================================
+// Complete an input whose response & energy bins are set: normalized response, measurements
+// (projection of the reference spectrum) & uniform initial spectrum
+//==================================================================================================
+static void prepareInput(BenchmarkInput &input) {
+    int num_measurements = input.nns_response.num_measurements();
+    int num_bins = input.nns_response.num_bins();
+    input.normalized_response = normalizeResponse(num_bins, num_measurements, input.nns_response);
+    std::vector<double> reference_spectrum = referenceSpectrum(input.energy_bins);
+    input.measurements.assign(num_measurements, 0);
+    forwardProject(input.nns_response, reference_spectrum.data(), input.measurements.data());
+    input.initial_spectrum.assign(num_bins, 1);
+}
+
+//==================================================================================================
+// Read one of the NNS response functions provided in the "input/" directory
+//==================================================================================================
+static void readInput(const std::string &name, const std::string &response_file, BenchmarkInput &input) {
+    input.name = name;
+    readInputFile2D(response_file, input.nns_response);
+    readInputFile1D("input/energy_bins.csv", input.energy_bins);
+    readInputFile1D("input/icrp_conversion_coefficients.csv", input.icrp_factors);
+    checkDimensions(input.nns_response.num_bins(), "number of energy bins", input.energy_bins.size(),
+        "Energy bins");
+    checkDimensions(input.nns_response.num_bins(), "number of energy bins", input.icrp_factors.size(),
+        "Number of ICRP factors");
+    prepareInput(input);
+}
+
+//==================================================================================================
+// Generate a synthetic response of num_bins log-spaced energy bins: the response of each
+// measurement (moderator configuration) is a Gaussian in log(energy), centered at higher energies
+// for thicker moderators. The ICRP factors increase smoothly with energy.
+//==================================================================================================
+static void generateInput(int num_bins, BenchmarkInput &input) {
+    input.name = "synthetic_" + std::to_string(num_bins);
+    int num_measurements = SYNTHETIC_NUM_MEASUREMENTS;
+    double log_min = log10(SYNTHETIC_MIN_ENERGY);
+    double log_max = log10(SYNTHETIC_MAX_ENERGY);
+
+    input.energy_bins.resize(num_bins);
+    input.icrp_factors.resize(num_bins);
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        double log_energy = log_min + (log_max-log_min)*i_bin/(num_bins-1);
+        input.energy_bins[i_bin] = pow(10, log_energy);
+        input.icrp_factors[i_bin] = 10 + 400/(1+exp(-2*(log_energy+1)));
+    }
+
+    input.nns_response.resize(num_measurements, num_bins);
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        double center = log_min + (log_max-log_min)*(i_meas+0.5)/num_measurements;
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            double log_energy = log10(input.energy_bins[i_bin]);
+            input.nns_response.set(i_meas, i_bin, 2*exp(-0.5*pow((log_energy-center)/2.0, 2)));
+        }
+    }
+    prepareInput(input);
+}
+
+//==================================================================================================
+// Return the median of values (which are reordered)
+//==================================================================================================
+static double median(std::vector<double> &values) {
+    std::sort(values.begin(), values.end());
+    size_t num_values = values.size();
+    if (num_values % 2 == 1) {
+        return values[num_values/2];
+    }
+    return (values[num_values/2-1] + values[num_values/2])/2;
+}
+
+//==================================================================================================
+// Time a kernel. kernel performs one call and returns the # of iterations it performed.
+//==================================================================================================
+static BenchmarkResult timeKernel(const std::string &kernel_name, const BenchmarkInput &input,
+    int num_repetitions, const std::function<int()> &kernel)
+{
+    BenchmarkResult result;
+    result.kernel = kernel_name;
+    result.input = input.name;
+    result.num_measurements = input.nns_response.num_measurements();
+    result.num_bins = input.nns_response.num_bins();
+
+    // Warm-up (caches, branch predictors, CPU frequency), which also sets the # of calls per
+    // repetition
+    int num_warmup_calls = 0;
+    double warmup_elapsed = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (num_warmup_calls < 1 || warmup_elapsed < WARMUP_SECONDS) {
+        result.iterations_per_call = kernel();
+        num_warmup_calls++;
+        warmup_elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    result.calls_per_repetition = std::max(1,
+        (int)ceil(MIN_REPETITION_SECONDS*num_warmup_calls/warmup_elapsed));
+
+    // Allocations of a single (warm) call
+    long allocations_before = num_allocations;
+    kernel();
+    result.allocations_per_call = num_allocations - allocations_before;
+
+    std::vector<double> ns_per_iteration(num_repetitions);
+    for (int i_rep = 0; i_rep < num_repetitions; i_rep++) {
+        long num_iterations = 0;
+        auto rep_start = std::chrono::steady_clock::now();
+        for (int i_call = 0; i_call < result.calls_per_repetition; i_call++) {
+            num_iterations += kernel();
+        }
+        double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - rep_start).count();
+        ns_per_iteration[i_rep] = elapsed/std::max(num_iterations, 1L);
+    }
+    result.ns_per_iteration = median(ns_per_iteration);
+    std::vector<double> deviations(num_repetitions);
+    for (int i_rep = 0; i_rep < num_repetitions; i_rep++) {
+        deviations[i_rep] = fabs(ns_per_iteration[i_rep] - result.ns_per_iteration);
+    }
+    result.ns_per_iteration_mad = median(deviations);
+    return result;
+}
+
+//==================================================================================================
+// Time every kernel with the given input, appending the results
+//==================================================================================================
+static void benchmarkInput(BenchmarkInput &input, int num_repetitions, int num_iterations,
+    std::vector<BenchmarkResult> &results)
+{
+    int num_measurements = input.nns_response.num_measurements();
+    int num_bins = input.nns_response.num_bins();
+    MlemWorkspace workspace(num_measurements, num_bins);
+    std::vector<double> spectrum(num_bins);
+
+    results.push_back(timeKernel("runMLEM", input, num_repetitions, [&]() {
+        spectrum = input.initial_spectrum;
+        return runMLEM(num_iterations, 0, num_measurements, num_bins, input.measurements, spectrum,
+            input.nns_response, input.normalized_response, workspace
+        );
+    }));
+
+    const int num_strides = 2;
+    int trace_strides[num_strides] = {1, 100};
+    for (int i_stride = 0; i_stride < num_strides; i_stride++) {
+        ConvergenceTrace trace(num_iterations, trace_strides[i_stride]);
+        results.push_back(timeKernel("runMLEM/trace_" + std::to_string(trace_strides[i_stride]), input,
+            num_repetitions, [&]() {
+            spectrum = input.initial_spectrum;
+            trace.reset();
+            return runMLEM(num_iterations, 0, num_measurements, num_bins, input.measurements, spectrum,
+                input.nns_response, input.normalized_response, workspace, NULL, &trace
+            );
+        }));
+    }
+
+    // J threshold: the J factor of the last of num_iterations MLEM iterations (the J factor is
+    // calculated from the estimate of the spectrum before its update, as in runMLEMSTOP)
+    spectrum = input.initial_spectrum;
+    runMLEM(num_iterations, 0, num_measurements, num_bins, input.measurements, spectrum,
+        input.nns_response, input.normalized_response, workspace
+    );
+    double j_threshold = calculateJFactor(num_measurements, input.measurements, workspace.mlem_estimate);
+    double j_factor;
+    results.push_back(timeKernel("runMLEMSTOP", input, num_repetitions, [&]() {
+        spectrum = input.initial_spectrum;
+        return runMLEMSTOP(num_iterations, num_measurements, num_bins, input.measurements, spectrum,
+            input.nns_response, input.normalized_response, workspace, j_threshold, j_factor
+        ) + 1; // returns the index of the last iteration
+    }));
+
+    const int num_priors = 5;
+    std::string priors[num_priors] = {"quadratic", "quadratic_normalized", "mrp", "meanrp", "gaussians"};
+    for (int i_prior = 0; i_prior < num_priors; i_prior++) {
+        const std::string &prior = priors[i_prior];
+        results.push_back(timeKernel("runMAP/" + prior, input, num_repetitions, [&]() {
+            spectrum = input.initial_spectrum;
+            return runMAP(MAP_BETA, prior, num_iterations, 0, num_measurements, num_bins,
+                input.measurements, spectrum, input.nns_response, input.normalized_response, workspace
+            );
+        }));
+    }
+
+    results.push_back(timeKernel("normalizeResponse", input, num_repetitions, [&]() {
+        std::vector<double> normalized_response = normalizeResponse(num_bins, num_measurements,
+            input.nns_response);
+        return normalized_response.empty() ? 0 : 1;
+    }));
+
+    std::vector<double> reference_spectrum = referenceSpectrum(input.energy_bins);
+    double dose = 0;
+    results.push_back(timeKernel("calculateDose", input, num_repetitions, [&]() {
+        dose += calculateDose(num_bins, reference_spectrum, input.icrp_factors);
+        return 1;
+    }));
+    if (!std::isfinite(dose)) {
+        throw std::logic_error("Invalid dose calculated for input " + input.name);
+    }
+}
+
+//==================================================================================================
+// Save the results as JSON
+//==================================================================================================
+static void saveResults(const std::string &output_file, int num_repetitions, int num_iterations,
+    const std::vector<BenchmarkResult> &results)
+{
+    std::ofstream output(output_file);
+    if (!output.is_open()) {
+        throw std::logic_error("Unable to open file: " + output_file);
+    }
+    auto t = std::time(nullptr);
+    auto tm = *std::localtime(&t);
+    output << "{\n";
+    output << "  \"program\": \"benchmark_kernels\",\n";
+    output << "  \"git_commit\": \"" << GIT_COMMIT << "\",\n";
+    output << "  \"date\": \"" << std::put_time(&tm, "%Y-%m-%d %H:%M:%S") << "\",\n";
+    output << "  \"repetitions\": " << num_repetitions << ",\n";
+    output << "  \"iterations\": " << num_iterations << ",\n";
+    output << "  \"results\": [\n";
+    for (size_t i_result = 0; i_result < results.size(); i_result++) {
+        const BenchmarkResult &result = results[i_result];
+        output << "    {\"kernel\": \"" << result.kernel << "\", \"input\": \"" << result.input
+            << "\", \"num_measurements\": " << result.num_measurements << ", \"num_bins\": "
+            << result.num_bins << ", \"iterations_per_call\": " << result.iterations_per_call
+            << ", \"calls_per_repetition\": " << result.calls_per_repetition
+            << ", \"ns_per_iteration\": " << result.ns_per_iteration
+            << ", \"ns_per_iteration_mad\": " << result.ns_per_iteration_mad
+            << ", \"iterations_per_second\": " << 1e9/result.ns_per_iteration
+            << ", \"allocations_per_call\": " << result.allocations_per_call << "}"
+            << (i_result+1 < results.size() ? "," : "") << "\n";
+    }
+    output << "  ]\n";
+    output << "}\n";
+}
+
+int main(int argc, char* argv[])
+{
+    // Put arguments in vector for easier processing
+    std::vector<std::string> arg_vector;
+    for (int i = 1; i < argc; i++) {
+        arg_vector.push_back(argv[i]);
+    }
+
+    std::vector<std::string> input_file_flags;
+    input_file_flags.push_back("--repetitions");
+    input_file_flags.push_back("--iterations");
+    input_file_flags.push_back("--output");
+    std::string repetitions_string, iterations_string, output_file;
+    setfile(arg_vector, "--repetitions", "15", repetitions_string);
+    setfile(arg_vector, "--iterations", "500", iterations_string);
+    setfile(arg_vector, "--output", "", output_file);
+    checkUnknownParameters(arg_vector, input_file_flags);
+
+    int num_repetitions = atoi(repetitions_string.c_str());
+    int num_iterations = atoi(iterations_string.c_str());
+    if (num_repetitions < 1 || num_iterations < 1) {
+        throw std::logic_error("--repetitions & --iterations must be positive integers");
+    }
+
+    const int num_inputs = 4;
+    BenchmarkInput inputs[num_inputs];
+    readInput("he3", "input/response_nns_he3.csv", inputs[0]);
+    readInput("gold", "input/response_nns_gold.csv", inputs[1]);
+    generateInput(200, inputs[2]);
+    generateInput(2000, inputs[3]);
+
+    std::cout << "Kernel benchmark (" << num_repetitions << " repetitions, " << num_iterations
+        << " iterations per unfolding, projection kernel " << getProjectionKernel() << ")\n\n";
+    std::cout << std::left << std::setw(30) << "Kernel" << std::setw(16) << "Input" << std::right
+        << std::setw(6) << "Bins" << std::setw(7) << "Iter" << std::setw(13) << "ns/iter"
+        << std::setw(11) << "MAD" << std::setw(14) << "iter/s" << std::setw(12) << "Allocs/call"
+        << "\n";
+
+    std::vector<BenchmarkResult> results;
+    for (int i_input = 0; i_input < num_inputs; i_input++) {
+        size_t first_result = results.size();
+        benchmarkInput(inputs[i_input], num_repetitions, num_iterations, results);
+        for (size_t i_result = first_result; i_result < results.size(); i_result++) {
+            const BenchmarkResult &result = results[i_result];
+            std::cout << std::left << std::setw(30) << result.kernel << std::setw(16) << result.input
+                << std::right << std::setw(6) << result.num_bins << std::setw(7)
+                << result.iterations_per_call << std::fixed << std::setprecision(1) << std::setw(13)
+                << result.ns_per_iteration << std::setw(11) << result.ns_per_iteration_mad
+                << std::setprecision(0) << std::setw(14) << 1e9/result.ns_per_iteration
+                << std::setw(12) << result.allocations_per_call << std::defaultfloat
+                << std::setprecision(6) << "\n";
+        }
+    }
+
+    if (!output_file.empty()) {
+        saveResults(output_file, num_repetitions, num_iterations, results);
+        std::cout << "\nSaved results to " << output_file << "\n";
+    }
+
+    return 0;
+}
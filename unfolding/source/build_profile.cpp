@@ -0,0 +1,55 @@
+//**************************************************************************************************
+// This program builds a compiled instrument profile (see InstrumentProfile) from the CSV files
+// specified in a configuration file (path_energy_bins, path_system_response, path_icrp_factors and
+// path_input_spectrum). The profile is saved to path_instrument_profile of the same configuration
+// file, from which unfold_spectrum & unfold_trend then load it instead of the CSV files.
+// The profile must be rebuilt whenever one of the CSV files changes (stale profiles are rejected),
+// or when the configuration file specifies other CSV files (the profile is then rejected too).
+//**************************************************************************************************
+
+#include <iostream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// Local
+#include "custom_classes.h"
+#include "fileio.h"
+#include "handle_args.h"
+#include "instrument_profile.h"
+
+int main(int argc, char* argv[])
+{
+    // Put arguments in vector for easier processing
+    std::vector<std::string> arg_vector;
+    for (int i = 1; i < argc; i++) {
+        arg_vector.push_back(argv[i]);
+    }
+
+    std::vector<std::string> input_file_flags;
+    input_file_flags.push_back("--configuration");
+    std::string config_file;
+    setfile(arg_vector, "--configuration", "input/unfold_spectrum.cfg", config_file);
+    checkUnknownParameters(arg_vector, input_file_flags);
+
+    UnfoldingSettings settings;
+    setSettings(config_file, settings);
+    if (settings.path_instrument_profile.empty()) {
+        throw std::logic_error("No path_instrument_profile specified in " + config_file);
+    }
+
+    InstrumentProfile profile;
+    profile.readCSV(settings);
+    profile.save(settings.path_instrument_profile);
+
+    std::cout << "Built instrument profile " << settings.path_instrument_profile << " (version "
+        << INSTRUMENT_PROFILE_VERSION << ", " << profile.nns_response.num_measurements()
+        << " measurements x " << profile.energy_bins.size() << " energy bins) from:\n";
+    std::cout << "  " << settings.path_energy_bins << "\n";
+    std::cout << "  " << settings.path_system_response << "\n";
+    std::cout << "  " << settings.path_input_spectrum << "\n";
+    std::cout << "  " << settings.path_icrp_factors << "\n";
+
+    return 0;
+}
@@ -0,0 +1,194 @@
+//**************************************************************************************************
+// This program compares an output file of the unfolding applications (results file of
+// unfold_spectrum.exe, trend file of unfold_trend.exe, ...) with a reference (e.g. golden) file,
+// value by value, to check that a change of the code did not change the results (see
+// make regression).
+//
+// Usage:
+//     compare_results.exe --reference <file> --output <file> [--ulp <N>]
+// The files are split into lines, and the lines into fields (delimited by ',' or '='). Fields that
+// are numbers are compared as doubles: exactly (default), or within N units in the last place
+// (ULP) with --ulp N. Other fields (names, labels) must be identical. The differences are printed,
+// and the exit status is non-zero if the files differ.
+//**************************************************************************************************
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// Local
+#include "handle_args.h"
+
+// # of differences printed (all are counted)
+const int MAX_DIFFERENCES_PRINTED = 20;
+
+//==================================================================================================
+// Read the lines of a file, split into fields (delimited by ',' or '=')
+//==================================================================================================
+static std::vector<std::vector<std::string>> readFields(const std::string &path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::logic_error("Unable to access file: " + path);
+    }
+    std::vector<std::vector<std::string>> lines;
+    std::string line;
+    while (getline(file, line)) {
+        std::vector<std::string> fields(1);
+        for (size_t i_char = 0; i_char < line.size(); i_char++) {
+            if (line[i_char] == ',' || line[i_char] == '=') {
+                fields.push_back("");
+            }
+            else if (line[i_char] != '\r') {
+                fields.back() += line[i_char];
+            }
+        }
+        lines.push_back(fields);
+    }
+    return lines;
+}
+
+//==================================================================================================
+// Convert a field to a number. Returns false if the field is not a number.
+//==================================================================================================
+static bool parseNumber(const std::string &field, double &value) {
+    const char *begin = field.c_str();
+    char *end;
+    value = strtod(begin, &end);
+    if (end == begin) {
+        return false;
+    }
+    while (*end == ' ') {
+        end++;
+    }
+    return *end == '\0';
+}
+
+//==================================================================================================
+// Return the distance between two doubles in units in the last place (# of representable doubles
+// between them; +0 & -0 are equal). NaNs are equal to each other only.
+//==================================================================================================
+static uint64_t ulpDistance(double a, double b) {
+    if (std::isnan(a) || std::isnan(b)) {
+        return std::isnan(a) && std::isnan(b) ? 0 : std::numeric_limits<uint64_t>::max();
+    }
+    int64_t bits_a, bits_b;
+    memcpy(&bits_a, &a, sizeof(a));
+    memcpy(&bits_b, &b, sizeof(b));
+    // Map the sign-magnitude representation onto a monotonic integer scale
+    if (bits_a < 0) {
+        bits_a = std::numeric_limits<int64_t>::min() - bits_a;
+    }
+    if (bits_b < 0) {
+        bits_b = std::numeric_limits<int64_t>::min() - bits_b;
+    }
+    return bits_a >= bits_b ? (uint64_t)bits_a - (uint64_t)bits_b : (uint64_t)bits_b - (uint64_t)bits_a;
+}
+
+int main(int argc, char* argv[])
+{
+    // Put arguments in vector for easier processing
+    std::vector<std::string> arg_vector;
+    for (int i = 1; i < argc; i++) {
+        arg_vector.push_back(argv[i]);
+    }
+
+    std::vector<std::string> input_file_flags;
+    input_file_flags.push_back("--reference");
+    input_file_flags.push_back("--output");
+    input_file_flags.push_back("--ulp");
+    std::string reference_file, output_file, ulp_string;
+    setfile(arg_vector, "--reference", "", reference_file);
+    setfile(arg_vector, "--output", "", output_file);
+    setfile(arg_vector, "--ulp", "0", ulp_string);
+    checkUnknownParameters(arg_vector, input_file_flags);
+
+    if (reference_file.empty() || output_file.empty()) {
+        throw std::logic_error("Usage: compare_results.exe --reference <file> --output <file> [--ulp <N>]");
+    }
+    char *ulp_end;
+    long long max_ulp = strtoll(ulp_string.c_str(), &ulp_end, 10);
+    if (ulp_string.empty() || *ulp_end != '\0' || max_ulp < 0) {
+        throw std::logic_error("Invalid # of ULP: " + ulp_string);
+    }
+
+    std::vector<std::vector<std::string>> reference = readFields(reference_file);
+    std::vector<std::vector<std::string>> output = readFields(output_file);
+
+    long long num_values = 0;
+    long long num_differences = 0;
+    uint64_t largest_ulp = 0;
+    std::ostringstream differences;
+    if (reference.size() != output.size()) {
+        num_differences++;
+        differences << "    " << output_file << ": " << output.size() << " lines, expected "
+            << reference.size() << "\n";
+    }
+    size_t num_lines = std::min(reference.size(), output.size());
+    for (size_t i_line = 0; i_line < num_lines; i_line++) {
+        const std::vector<std::string> &reference_fields = reference[i_line];
+        const std::vector<std::string> &output_fields = output[i_line];
+        // Differences are located by line, & by the first field of the line (name or label)
+        std::ostringstream location;
+        location << output_file << ":" << i_line+1 << " (" << reference_fields[0] << ")";
+        if (reference_fields.size() != output_fields.size()) {
+            num_differences++;
+            if (num_differences <= MAX_DIFFERENCES_PRINTED) {
+                differences << "    " << location.str() << ": " << output_fields.size()
+                    << " fields, expected " << reference_fields.size() << "\n";
+            }
+            continue;
+        }
+        for (size_t i_field = 0; i_field < reference_fields.size(); i_field++) {
+            double reference_value, output_value;
+            bool are_numbers = parseNumber(reference_fields[i_field], reference_value)
+                && parseNumber(output_fields[i_field], output_value);
+            bool different;
+            uint64_t distance = 0;
+            if (are_numbers) {
+                num_values++;
+                distance = ulpDistance(reference_value, output_value);
+                if (distance != std::numeric_limits<uint64_t>::max()) {
+                    largest_ulp = std::max(largest_ulp, distance);
+                }
+                different = distance > (uint64_t)max_ulp;
+            }
+            else {
+                different = reference_fields[i_field] != output_fields[i_field];
+            }
+            if (!different) {
+                continue;
+            }
+            num_differences++;
+            if (num_differences <= MAX_DIFFERENCES_PRINTED) {
+                differences << "    " << location.str() << ", field " << i_field << ": "
+                    << output_fields[i_field] << ", expected " << reference_fields[i_field];
+                if (are_numbers && distance != std::numeric_limits<uint64_t>::max()) {
+                    differences << " (" << distance << " ULP)";
+                }
+                differences << "\n";
+            }
+        }
+    }
+
+    std::string tolerance = max_ulp == 0 ? "exactly" : "within " + ulp_string + " ULP";
+    if (num_differences == 0) {
+        std::cout << output_file << ": matches " << reference_file << " " << tolerance << " ("
+            << num_values << " values, largest difference " << largest_ulp << " ULP)\n";
+        return 0;
+    }
+    std::cout << output_file << ": DIFFERS from " << reference_file << " (" << num_differences
+        << " differences, values compared " << tolerance << "):\n" << differences.str();
+    if (num_differences > MAX_DIFFERENCES_PRINTED) {
+        std::cout << "    ...\n";
+    }
+    return 1;
+}
@@ -0,0 +1,137 @@
+//**************************************************************************************************
+// The functions & classes included in this module record the convergence of an unfolding
+// algorithm (J, J2, deviations of the MLEM ratios & total flux) at regular iterations, and save it
+// for debugging (e.g. MLEM-STOP samples that do not reach the J threshold).
+//**************************************************************************************************
+
+#include "convergence_trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "fileio.h"
+#include "physics_calculations.h"
+
+//--------------------------------------------------------------------------------------------------
+// Record every <stride> iterations, keeping the last <capacity> records
+//--------------------------------------------------------------------------------------------------
+ConvergenceTrace::ConvergenceTrace(int capacity, int stride) {
+    if (capacity < 1 || stride < 1) {
+        throw std::logic_error("Trace capacity & stride must be >= 1");
+    }
+    this->stride = stride;
+    buffer.resize(capacity);
+    reset();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Discard the records (e.g. before tracing another run)
+//--------------------------------------------------------------------------------------------------
+void ConvergenceTrace::reset() {
+    next_iteration = stride;
+    num_recorded = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Record the state after <num_iterations> iterations (overwriting the oldest record if the buffer
+// is full)
+//--------------------------------------------------------------------------------------------------
+void ConvergenceTrace::record(int num_iterations, std::vector<double> &measurements,
+    const std::vector<double> &spectrum, const MlemWorkspace &workspace)
+{
+    int num_measurements = workspace.num_measurements;
+    TraceRecord &record = buffer[num_recorded % buffer.size()];
+    record.iteration = num_iterations;
+    record.j_factor = calculateJFactor(num_measurements, measurements, workspace.mlem_estimate);
+    record.j_factor2 = calculateJFactor2(num_measurements, measurements, workspace.mlem_estimate);
+    record.max_ratio_deviation = 0;
+    record.avg_ratio_deviation = 0;
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        double deviation = fabs(workspace.mlem_ratio[i_meas] - 1);
+        record.max_ratio_deviation = std::max(record.max_ratio_deviation, deviation);
+        record.avg_ratio_deviation += deviation;
+    }
+    record.avg_ratio_deviation /= num_measurements;
+    record.total_flux = calculateTotalFlux(workspace.num_bins, spectrum);
+    num_recorded++;
+
+    next_iteration = (num_iterations/stride + 1)*stride;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Called by the algorithms when they end (after <num_iterations> iterations): records the final
+// state, unless already recorded
+//--------------------------------------------------------------------------------------------------
+void ConvergenceTrace::finish(int num_iterations, std::vector<double> &measurements,
+    const std::vector<double> &spectrum, const MlemWorkspace &workspace)
+{
+    if (num_iterations < 1) {
+        return;
+    }
+    if (num_recorded > 0 && buffer[(num_recorded-1) % buffer.size()].iteration == num_iterations) {
+        return;
+    }
+    record(num_iterations, measurements, spectrum, workspace);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the records kept, oldest first
+//--------------------------------------------------------------------------------------------------
+std::vector<TraceRecord> ConvergenceTrace::records() const {
+    std::vector<TraceRecord> kept;
+    long long first = numDropped();
+    for (long long i_record = first; i_record < num_recorded; i_record++) {
+        kept.push_back(buffer[i_record % buffer.size()]);
+    }
+    return kept;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the # of records overwritten because the buffer was full
+//--------------------------------------------------------------------------------------------------
+long long ConvergenceTrace::numDropped() const {
+    return std::max(0LL, num_recorded - (long long)buffer.size());
+}
+
+//--------------------------------------------------------------------------------------------------
+// Save the records to a CSV file, preceded by comment lines (#) with the outcome of the run &
+// the # of records dropped
+//--------------------------------------------------------------------------------------------------
+void ConvergenceTrace::save(const std::string &path, const std::string &outcome) const {
+    std::ofstream output(path);
+    if (!output.is_open()) {
+        throw std::logic_error("Unable to open file: " + path);
+    }
+    output << "# outcome: " << outcome << "\n";
+    output << "# stride: " << stride << ", records dropped (oldest): " << numDropped() << "\n";
+    output << "iteration,j_factor,j_factor2,max_ratio_deviation,avg_ratio_deviation,total_flux\n";
+    output << std::setprecision(10);
+    std::vector<TraceRecord> kept = records();
+    for (size_t i_record = 0; i_record < kept.size(); i_record++) {
+        const TraceRecord &record = kept[i_record];
+        output << record.iteration << "," << record.j_factor << "," << record.j_factor2 << ","
+            << record.max_ratio_deviation << "," << record.avg_ratio_deviation << ","
+            << record.total_flux << "\n";
+    }
+}
+
+//==================================================================================================
+// Return the pathname of a trace file: path_trace, or output/trace_<irradiation_conditions>.csv if
+// it is empty. A suffix (e.g. for the trace of a sampled measurement set) is inserted before the
+// extension (see insertBeforeExtension).
+//==================================================================================================
+std::string getTracePath(const std::string &path_trace, const std::string &irradiation_conditions,
+    const std::string &suffix)
+{
+    std::string path = path_trace;
+    if (path.empty()) {
+        path = "output/trace_" + irradiation_conditions + ".csv";
+    }
+    return insertBeforeExtension(path, suffix);
+}
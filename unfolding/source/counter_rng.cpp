@@ -0,0 +1,87 @@
+//**************************************************************************************************
+// The functions included in this module generate reproducible streams of random numbers, used to
+// sample measurement sets independently of the order (and thread) in which they are unfolded.
+//**************************************************************************************************
+
+#include "counter_rng.h"
+
+#include <random>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Philox4x32 round multipliers & key increments (Weyl sequence)
+const uint32_t PHILOX_M0 = 0xD2511F53;
+const uint32_t PHILOX_M1 = 0xCD9E8D57;
+const uint32_t PHILOX_W0 = 0x9E3779B9;
+const uint32_t PHILOX_W1 = 0xBB67AE85;
+const int PHILOX_ROUNDS = 10;
+
+//--------------------------------------------------------------------------------------------------
+// Create the stream identified by (seed, stream, substream), positioned at its first value
+//--------------------------------------------------------------------------------------------------
+CounterRng::CounterRng(uint64_t seed, uint32_t stream, uint32_t substream) {
+    key[0] = (uint32_t)seed;
+    key[1] = (uint32_t)(seed >> 32);
+    counter[0] = 0;
+    counter[1] = 0;
+    counter[2] = stream;
+    counter[3] = substream;
+    output_index = 4; // no values generated yet
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the next 32 bit value of the stream
+//--------------------------------------------------------------------------------------------------
+CounterRng::result_type CounterRng::operator()() {
+    if (output_index == 4) {
+        generateBlock();
+    }
+    return output[output_index++];
+}
+
+//--------------------------------------------------------------------------------------------------
+// Encrypt the current counter into the next 4 values of the stream, then advance the counter
+//--------------------------------------------------------------------------------------------------
+void CounterRng::generateBlock() {
+    uint32_t c0 = counter[0];
+    uint32_t c1 = counter[1];
+    uint32_t c2 = counter[2];
+    uint32_t c3 = counter[3];
+    uint32_t k0 = key[0];
+    uint32_t k1 = key[1];
+
+    for (int i_round = 0; i_round < PHILOX_ROUNDS; i_round++) {
+        if (i_round > 0) {
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+        uint64_t product0 = (uint64_t)PHILOX_M0 * c0;
+        uint64_t product1 = (uint64_t)PHILOX_M1 * c2;
+        c0 = (uint32_t)(product1 >> 32) ^ c1 ^ k0;
+        c2 = (uint32_t)(product0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)product1;
+        c3 = (uint32_t)product0;
+    }
+    output[0] = c0;
+    output[1] = c1;
+    output[2] = c2;
+    output[3] = c3;
+    output_index = 0;
+
+    // 64 bit position within the stream
+    counter[0]++;
+    if (counter[0] == 0) {
+        counter[1]++;
+    }
+}
+
+//==================================================================================================
+// Return a seed drawn from the system's source of randomness (used when no seed is specified)
+//==================================================================================================
+uint64_t generateRandomSeed() {
+    std::random_device device;
+    uint64_t seed = device();
+    seed = (seed << 32) ^ device();
+    // Keep seeds positive when stored as signed values (e.g. the seed setting)
+    return seed & 0x7FFFFFFFFFFFFFFFULL;
+}
@@ -0,0 +1,337 @@
+//**************************************************************************************************
+// The functions included in this module read comma-delimited files from memory-mapped storage and
+// convert their fields to numbers (see CsvReader).
+//**************************************************************************************************
+
+#include "csv_reader.h"
+
+#include <fcntl.h>
+#include <locale.h>
+#include <sstream>
+#include <stdexcept>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+
+// Powers of 10 that are exactly representable as doubles
+const double EXACT_POWERS_OF_10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16,
+    1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+const int MAX_EXACT_POWER_OF_10 = 22;
+// Largest integer below which every integer is exactly representable as a double (2^53)
+const uint64_t MAX_EXACT_MANTISSA = 9007199254740992ULL;
+// Maximum # of significant digits accumulated by the fast conversion (fits in 64 bits)
+const int MAX_FAST_DIGITS = 19;
+
+//==================================================================================================
+// Return the "C" locale, used to convert numbers whatever the locale of the program
+//==================================================================================================
+static locale_t cLocale() {
+    static locale_t c_locale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+    return c_locale;
+}
+
+//==================================================================================================
+// Convert the characters [begin,end) to a double, stored in value. Surrounding spaces & tabs are
+// ignored. Returns false if the characters (other than those) are not entirely a number.
+// Decimal numbers of up to 19 significant digits whose value is exactly the product (or quotient)
+// of an integer < 2^53 and a power of 10 <= 10^22 are converted directly, which is exact (correctly
+// rounded, as the product of two exact doubles). Other numbers (larger exponents, more digits,
+// nan, inf, ...) are converted by strtod in the "C" locale. The results are therefore identical to
+// those of atof/strtod.
+//==================================================================================================
+bool parseDouble(const char *begin, const char *end, double &value) {
+    while (begin < end && (*begin == ' ' || *begin == '\t')) {
+        begin++;
+    }
+    while (end > begin && (end[-1] == ' ' || end[-1] == '\t')) {
+        end--;
+    }
+    if (begin == end) {
+        return false;
+    }
+
+    // Fast conversion: [sign] digits [. digits] [e|E [sign] digits]
+    const char *p = begin;
+    bool negative = false;
+    if (*p == '+' || *p == '-') {
+        negative = (*p == '-');
+        p++;
+    }
+    uint64_t mantissa = 0;
+    int num_digits = 0; // significant digits in mantissa (leading zeros excluded)
+    int exponent = 0;
+    bool has_digits = false;
+    bool fast = true;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        has_digits = true;
+        if (num_digits == 0 && *p == '0') {
+            continue;
+        }
+        if (num_digits == MAX_FAST_DIGITS) {
+            fast = false;
+            break;
+        }
+        mantissa = mantissa*10 + (*p - '0');
+        num_digits++;
+    }
+    if (fast && p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+            has_digits = true;
+            exponent--;
+            if (num_digits == 0 && *p == '0') {
+                continue;
+            }
+            if (num_digits == MAX_FAST_DIGITS) {
+                fast = false;
+                break;
+            }
+            mantissa = mantissa*10 + (*p - '0');
+            num_digits++;
+        }
+    }
+    if (fast && has_digits && p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool negative_exponent = false;
+        if (p < end && (*p == '+' || *p == '-')) {
+            negative_exponent = (*p == '-');
+            p++;
+        }
+        if (p == end || *p < '0' || *p > '9') {
+            fast = false;
+        }
+        int exponent_value = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            if (exponent_value < 10000) {
+                exponent_value = exponent_value*10 + (*p - '0');
+            }
+        }
+        exponent += negative_exponent ? -exponent_value : exponent_value;
+    }
+    if (fast && has_digits && p == end) {
+        if (mantissa == 0) {
+            value = negative ? -0.0 : 0.0;
+            return true;
+        }
+        if (mantissa <= MAX_EXACT_MANTISSA && exponent >= -MAX_EXACT_POWER_OF_10
+            && exponent <= MAX_EXACT_POWER_OF_10)
+        {
+            value = (double)mantissa;
+            if (exponent < 0) {
+                value /= EXACT_POWERS_OF_10[-exponent];
+            }
+            else {
+                value *= EXACT_POWERS_OF_10[exponent];
+            }
+            if (negative) {
+                value = -value;
+            }
+            return true;
+        }
+    }
+
+    // General conversion (requires a null-terminated copy of the field)
+    char buffer[64];
+    std::string long_field;
+    const char *field;
+    size_t length = end - begin;
+    if (length < sizeof(buffer)) {
+        memcpy(buffer, begin, length);
+        buffer[length] = '\0';
+        field = buffer;
+    }
+    else {
+        long_field.assign(begin, end);
+        field = long_field.c_str();
+    }
+    char *field_end;
+    value = strtod_l(field, &field_end, cLocale());
+    return field_end == field + length;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Default constructor for CsvReader (no file open)
+//--------------------------------------------------------------------------------------------------
+CsvReader::CsvReader() {
+    file_descriptor = -1;
+    mapped = NULL;
+    file_size = 0;
+    data = NULL;
+    data_end = NULL;
+    line_begin = NULL;
+    line_end = NULL;
+    next_line = NULL;
+    field_begin = NULL;
+    field_end = NULL;
+    next_field = NULL;
+    line_number = 0;
+    column_number = 0;
+}
+
+CsvReader::~CsvReader() {
+    close();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Open & map the file file_name, positioned before its first line. Returns false if the file cannot
+// be opened.
+//--------------------------------------------------------------------------------------------------
+bool CsvReader::open(const std::string &file_name) {
+    close();
+    this->file_name = file_name;
+
+    file_descriptor = ::open(file_name.c_str(), O_RDONLY);
+    if (file_descriptor < 0) {
+        return false;
+    }
+    struct stat file_status;
+    if (fstat(file_descriptor, &file_status) != 0 || !S_ISREG(file_status.st_mode)) {
+        close();
+        return false;
+    }
+    file_size = file_status.st_size;
+
+    // An empty file cannot be mapped (and has no lines)
+    if (file_size > 0) {
+        void *address = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+        if (address == MAP_FAILED) {
+            close();
+            throw std::logic_error("Unable to map file: " + file_name);
+        }
+        mapped = (char*)address;
+        madvise(address, file_size, MADV_SEQUENTIAL);
+    }
+
+    data = mapped;
+    data_end = mapped + file_size;
+    next_line = data;
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Unmap & close the file (if any)
+//--------------------------------------------------------------------------------------------------
+void CsvReader::close() {
+    if (mapped != NULL) {
+        munmap(mapped, file_size);
+        mapped = NULL;
+    }
+    if (file_descriptor >= 0) {
+        ::close(file_descriptor);
+        file_descriptor = -1;
+    }
+    file_size = 0;
+    data = NULL;
+    data_end = NULL;
+    next_line = NULL;
+    field_begin = NULL;
+    next_field = NULL;
+    line_number = 0;
+    column_number = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Move to the next line of the file, before its first field. Returns false if there are no more
+// lines.
+//--------------------------------------------------------------------------------------------------
+bool CsvReader::nextLine() {
+    if (next_line == NULL || next_line >= data_end) {
+        field_begin = NULL;
+        next_field = NULL;
+        return false;
+    }
+
+    line_begin = next_line;
+    const char *newline = (const char*)memchr(line_begin, '\n', data_end - line_begin);
+    if (newline != NULL) {
+        line_end = newline;
+        next_line = newline + 1;
+    }
+    else {
+        line_end = data_end;
+        next_line = data_end;
+    }
+    if (line_end > line_begin && line_end[-1] == '\r') {
+        line_end--;
+    }
+
+    line_number++;
+    column_number = 0;
+    field_begin = NULL;
+    next_field = line_begin;
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Move to the next field of the current line. Returns false if there are no more fields.
+//--------------------------------------------------------------------------------------------------
+bool CsvReader::nextField() {
+    if (next_field == NULL || next_field == line_end) {
+        field_begin = NULL;
+        next_field = NULL;
+        return false;
+    }
+
+    field_begin = next_field;
+    const char *comma = (const char*)memchr(field_begin, ',', line_end - field_begin);
+    if (comma != NULL) {
+        field_end = comma;
+        next_field = comma + 1;
+    }
+    else {
+        field_end = line_end;
+        next_field = NULL;
+    }
+    column_number++;
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the current line (without its line ending) as a string
+//--------------------------------------------------------------------------------------------------
+std::string CsvReader::lineString() const {
+    if (line_number == 0 || line_begin == NULL) {
+        return std::string();
+    }
+    return std::string(line_begin, line_end);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the current field as a string
+//--------------------------------------------------------------------------------------------------
+std::string CsvReader::fieldString() const {
+    if (field_begin == NULL) {
+        return std::string();
+    }
+    return std::string(field_begin, field_end);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the current field converted to a double. Throws if there is no current field, or if it is
+// not a number.
+//--------------------------------------------------------------------------------------------------
+double CsvReader::fieldDouble() const {
+    if (field_begin == NULL) {
+        std::ostringstream error_message;
+        error_message << "Missing value in " << file_name << ", line " << line_number << ", column "
+            << column_number+1;
+        throw std::logic_error(error_message.str());
+    }
+
+    double value;
+    if (!parseDouble(field_begin, field_end, value)) {
+        std::ostringstream error_message;
+        error_message << "Malformed number \"" << std::string(field_begin, field_end) << "\" in "
+            << file_name << ", line " << line_number << ", column " << column_number;
+        throw std::logic_error(error_message.str());
+    }
+    return value;
+}
@@ -22,6 +22,12 @@ UnfoldingSettings::UnfoldingSettings() {
     cutoff = 15000;
     uncertainty_type = "poisson";
     num_uncertainty_samples = 50;
+    uncertainty_target_error = 0;
+    max_uncertainty_samples = 10000;
+    uncertainty_batch_size = 32;
+    seed = -1;
+    sample_initialization = "input";
+    num_threads = 0;
     num_meas_per_shell = 1;
     meas_units = "nc";
     // Measurement specs
@@ -41,22 +47,36 @@ UnfoldingSettings::UnfoldingSettings() {
     iteration_increment = 100;
     beta_min = 1E-10;
     beta_max = 1E-8;
+    beta_continuation = 0;
     parameter_of_interest = "total_fluence";
     algorithm = "mlem";
     trend_type = "cps";
     path_output_spectra = "output/output_spectra.csv";
+    path_spectra_store = "";
     generate_report = 1;
     path_report = "";
     generate_figure = 1;
     path_figure = "";
+    generate_performance = 0;
+    path_performance = "";
+    generate_results = 0;
+    path_results = "";
     path_output_trend = "output/output_trend.csv";
     derivatives = 0;
+    trend_precision = 6;
     path_measurements = "input/measurements.txt";
     path_input_spectrum = "input/spectrum_step.csv";
     path_energy_bins = "input/energy_bins.csv";
     path_system_response = "input/response_nns_he3.csv";
     path_icrp_factors = "input/icrp_conversion_coefficients.csv";
+    path_instrument_profile = "";
     path_ref_spectrum = "";
+    // Performance specific
+    projection_kernel = "auto";
+    // Debugging specific
+    trace_stride = 0;
+    trace_capacity = 1000;
+    path_trace = "";
 }
 
 // Apply a value to a setting:
@@ -76,6 +96,18 @@ void UnfoldingSettings::set_setting(std::string settings_name, std::string setti
         this->set_uncertainty_type(settings_value);
     else if (settings_name == "num_uncertainty_samples")
         this->set_num_uncertainty_samples(atoi(settings_value.c_str()));
+    else if (settings_name == "uncertainty_target_error")
+        this->set_uncertainty_target_error(atof(settings_value.c_str()));
+    else if (settings_name == "max_uncertainty_samples")
+        this->set_max_uncertainty_samples(atoi(settings_value.c_str()));
+    else if (settings_name == "uncertainty_batch_size")
+        this->set_uncertainty_batch_size(atoi(settings_value.c_str()));
+    else if (settings_name == "seed")
+        this->set_seed(atoll(settings_value.c_str()));
+    else if (settings_name == "sample_initialization")
+        this->set_sample_initialization(settings_value);
+    else if (settings_name == "num_threads")
+        this->set_num_threads(atoi(settings_value.c_str()));
     else if (settings_name == "num_meas_per_shell")
         this->set_num_meas_per_shell(atoi(settings_value.c_str()));
     else if (settings_name == "meas_units")
@@ -106,6 +138,8 @@ void UnfoldingSettings::set_setting(std::string settings_name, std::string setti
         this->set_beta_min(atof(settings_value.c_str()));
     else if (settings_name == "beta_max")
         this->set_beta_max(atof(settings_value.c_str()));
+    else if (settings_name == "beta_continuation")
+        this->set_beta_continuation(atoi(settings_value.c_str()));
     else if (settings_name == "parameter_of_interest")
         this->set_parameter_of_interest(settings_value);
     else if (settings_name == "algorithm")
@@ -122,10 +156,20 @@ void UnfoldingSettings::set_setting(std::string settings_name, std::string setti
         this->set_generate_figure(atoi(settings_value.c_str()));
     else if (settings_name == "path_figure")
         this->set_path_figure(settings_value);
+    else if (settings_name == "generate_performance")
+        this->set_generate_performance(atoi(settings_value.c_str()));
+    else if (settings_name == "path_performance")
+        this->set_path_performance(settings_value);
+    else if (settings_name == "generate_results")
+        this->set_generate_results(atoi(settings_value.c_str()));
+    else if (settings_name == "path_results")
+        this->set_path_results(settings_value);
     else if (settings_name == "path_output_trend")
         this->set_path_output_trend(settings_value);
     else if (settings_name == "derivatives")
         this->set_derivatives(atoi(settings_value.c_str()));
+    else if (settings_name == "trend_precision")
+        this->set_trend_precision(atoi(settings_value.c_str()));
     else if (settings_name == "path_measurements")
         this->set_path_measurements(settings_value);
     else if (settings_name == "path_input_spectrum")
@@ -136,8 +180,20 @@ void UnfoldingSettings::set_setting(std::string settings_name, std::string setti
         this->set_path_system_response(settings_value);
     else if (settings_name == "path_icrp_factors")
         this->set_path_icrp_factors(settings_value);
+    else if (settings_name == "path_instrument_profile")
+        this->set_path_instrument_profile(settings_value);
+    else if (settings_name == "path_spectra_store")
+        this->set_path_spectra_store(settings_value);
     else if (settings_name == "path_ref_spectrum")
         this->set_path_ref_spectrum(settings_value);
+    else if (settings_name == "projection_kernel")
+        this->set_projection_kernel(settings_value);
+    else if (settings_name == "trace_stride")
+        this->set_trace_stride(atoi(settings_value.c_str()));
+    else if (settings_name == "trace_capacity")
+        this->set_trace_capacity(atoi(settings_value.c_str()));
+    else if (settings_name == "path_trace")
+        this->set_path_trace(settings_value);
     else
         throw std::logic_error("Unrecognized setting: " + settings_name 
             + ". Please refer to the README for allowed settings");
@@ -163,6 +219,24 @@ void UnfoldingSettings::set_uncertainty_type(std::string uncertainty_type) {
 void UnfoldingSettings::set_num_uncertainty_samples(int num_uncertainty_samples) {
     this->num_uncertainty_samples = num_uncertainty_samples;
 }
+void UnfoldingSettings::set_uncertainty_target_error(double uncertainty_target_error) {
+    this->uncertainty_target_error = uncertainty_target_error;
+}
+void UnfoldingSettings::set_max_uncertainty_samples(int max_uncertainty_samples) {
+    this->max_uncertainty_samples = max_uncertainty_samples;
+}
+void UnfoldingSettings::set_uncertainty_batch_size(int uncertainty_batch_size) {
+    this->uncertainty_batch_size = uncertainty_batch_size;
+}
+void UnfoldingSettings::set_seed(long long seed) {
+    this->seed = seed;
+}
+void UnfoldingSettings::set_sample_initialization(std::string sample_initialization) {
+    this->sample_initialization = sample_initialization;
+}
+void UnfoldingSettings::set_num_threads(int num_threads) {
+    this->num_threads = num_threads;
+}
 void UnfoldingSettings::set_num_meas_per_shell(int num_meas_per_shell) {
     this->num_meas_per_shell = num_meas_per_shell;
 }
@@ -208,6 +282,9 @@ void UnfoldingSettings::set_beta_min(double beta_min) {
 void UnfoldingSettings::set_beta_max(double beta_max) {
     this->beta_max = beta_max;
 }
+void UnfoldingSettings::set_beta_continuation(int beta_continuation) {
+    this->beta_continuation = beta_continuation;
+}
 void UnfoldingSettings::set_parameter_of_interest(std::string parameter_of_interest) {
     this->parameter_of_interest = parameter_of_interest;
 }
@@ -232,12 +309,27 @@ void UnfoldingSettings::set_generate_figure(int generate_figure) {
 void UnfoldingSettings::set_path_figure(std::string path_figure) {
     this->path_figure = path_figure;
 }
+void UnfoldingSettings::set_generate_performance(int generate_performance) {
+    this->generate_performance = generate_performance;
+}
+void UnfoldingSettings::set_path_performance(std::string path_performance) {
+    this->path_performance = path_performance;
+}
+void UnfoldingSettings::set_generate_results(int generate_results) {
+    this->generate_results = generate_results;
+}
+void UnfoldingSettings::set_path_results(std::string path_results) {
+    this->path_results = path_results;
+}
 void UnfoldingSettings::set_path_output_trend(std::string path_output_trend) {
     this->path_output_trend = path_output_trend;
 }
 void UnfoldingSettings::set_derivatives(int derivatives) {
     this->derivatives = derivatives;
 }
+void UnfoldingSettings::set_trend_precision(int trend_precision) {
+    this->trend_precision = trend_precision;
+}
 void UnfoldingSettings::set_path_measurements(std::string path_measurements) {
     this->path_measurements = path_measurements;
 }
@@ -253,9 +345,27 @@ void UnfoldingSettings::set_path_system_response(std::string path_system_respons
 void UnfoldingSettings::set_path_icrp_factors(std::string path_icrp_factors) {
     this->path_icrp_factors = path_icrp_factors;
 }
+void UnfoldingSettings::set_path_instrument_profile(std::string path_instrument_profile) {
+    this->path_instrument_profile = path_instrument_profile;
+}
+void UnfoldingSettings::set_path_spectra_store(std::string path_spectra_store) {
+    this->path_spectra_store = path_spectra_store;
+}
 void UnfoldingSettings::set_path_ref_spectrum(std::string path_ref_spectrum) {
     this->path_ref_spectrum = path_ref_spectrum;
 }
+void UnfoldingSettings::set_projection_kernel(std::string projection_kernel) {
+    this->projection_kernel = projection_kernel;
+}
+void UnfoldingSettings::set_trace_stride(int trace_stride) {
+    this->trace_stride = trace_stride;
+}
+void UnfoldingSettings::set_trace_capacity(int trace_capacity) {
+    this->trace_capacity = trace_capacity;
+}
+void UnfoldingSettings::set_path_trace(std::string path_trace) {
+    this->path_trace = path_trace;
+}
 
 
 //--------------------------------------------------------------------------------------------------
@@ -263,6 +373,11 @@ void UnfoldingSettings::set_path_ref_spectrum(std::string path_ref_spectrum) {
 //--------------------------------------------------------------------------------------------------
 UnfoldingReport::UnfoldingReport() {
     path = "output/report.txt";
+    seed = -1;
+    uncertainty_target_error = 0;
+    dose_uncertainty_error = 0;
+    spectrum_uncertainty_error = 0;
+    avg_sample_iterations = 0;
 }
 
 void UnfoldingReport::set_path(std::string path) {
@@ -301,6 +416,24 @@ void UnfoldingReport::set_uncertainty_type(std::string uncertainty_type) {
 void UnfoldingReport::set_num_uncertainty_samples(int num_uncertainty_samples) {
     this->num_uncertainty_samples = num_uncertainty_samples;
 }
+void UnfoldingReport::set_seed(long long seed) {
+    this->seed = seed;
+}
+void UnfoldingReport::set_uncertainty_target_error(double uncertainty_target_error) {
+    this->uncertainty_target_error = uncertainty_target_error;
+}
+void UnfoldingReport::set_dose_uncertainty_error(double dose_uncertainty_error) {
+    this->dose_uncertainty_error = dose_uncertainty_error;
+}
+void UnfoldingReport::set_spectrum_uncertainty_error(double spectrum_uncertainty_error) {
+    this->spectrum_uncertainty_error = spectrum_uncertainty_error;
+}
+void UnfoldingReport::set_sample_initialization(std::string sample_initialization) {
+    this->sample_initialization = sample_initialization;
+}
+void UnfoldingReport::set_avg_sample_iterations(double avg_sample_iterations) {
+    this->avg_sample_iterations = avg_sample_iterations;
+}
 void UnfoldingReport::set_git_commit(std::string git_commit) {
     this->git_commit = git_commit;
 }
@@ -328,7 +461,7 @@ void UnfoldingReport::set_initial_spectrum(std::vector<double>& initial_spectrum
 void UnfoldingReport::set_energy_bins(std::vector<double>& energy_bins) {
     this->energy_bins = energy_bins;
 }
-void UnfoldingReport::set_nns_response(std::vector<std::vector<double>>& nns_response) {
+void UnfoldingReport::set_nns_response(const ResponseMatrix& nns_response) {
     this->nns_response = nns_response;
 }
 void UnfoldingReport::set_icrp_factors(std::vector<double>& icrp_factors) {
@@ -397,6 +530,9 @@ void UnfoldingReport::set_j_manager_high(UncertaintyManagerJ j_manager_high) {
 void UnfoldingReport::set_num_toss(int num_toss) {
     this->num_toss = num_toss;
 }
+void UnfoldingReport::set_performance(const PerformanceLog& performance) {
+    this->performance = performance;
+}
 
 //----------------------------------------------------------------------------------------------
 // Prepare summary report of unfolding
@@ -410,6 +546,7 @@ void UnfoldingReport::prepare_report() {
     report_inputs(rfile);
     report_mlem_info(rfile);
     report_results(rfile);
+    report_performance(rfile);
 
     rfile.close();
 }
@@ -447,6 +584,17 @@ void UnfoldingReport::report_settings(std::ofstream& rfile) {
     rfile << std::left << std::setw(sw) << "NNS calibration factor:" << f_factor << " fA/cps\n";
     rfile << std::left << std::setw(sw) << "Uncertainty type:" << uncertainty_type << " fA/cps\n";
     rfile << std::left << std::setw(sw) << "# of uncertainty samples:" << num_uncertainty_samples << "\n";
+    if (uncertainty_target_error > 0) {
+        rfile << std::left << std::setw(sw) << "Uncertainty target error:" << uncertainty_target_error 
+            << " (samples used until reached)\n";
+        rfile << std::left << std::setw(sw) << "Dose uncertainty error:" << dose_uncertainty_error << "\n";
+        rfile << std::left << std::setw(sw) << "Spectrum uncertainty error:" << spectrum_uncertainty_error 
+            << " (largest bin)\n";
+    }
+    if (seed >= 0) {
+        rfile << std::left << std::setw(sw) << "Random seed:" << seed << "\n";
+        rfile << std::left << std::setw(sw) << "Sample initialization:" << sample_initialization << "\n";
+    }
     if (algorithm == "mlemstop") {
         rfile << std::left << std::setw(sw) << "Crossover CPS value:" << cps_crossover << "\n";
         rfile << std::left << std::setw(sw) << "J threshold:" << j_threshold << "\n";
@@ -509,7 +657,7 @@ void UnfoldingReport::report_inputs(std::ofstream& rfile) {
     for (int i=0; i<num_bins; i++) {
         rfile << std::left << std::setw(cw) << energy_bins[i] << std::setw(cw) << initial_spectrum[i] << "| ";
         for (int j=0; j<num_measurements; j++) {
-            rfile << std::left << std::setw(rw) << nns_response[j][i];
+            rfile << std::left << std::setw(rw) << nns_response.at(j,i);
         }
         rfile << "\n";
     }
@@ -522,10 +670,14 @@ void UnfoldingReport::report_inputs(std::ofstream& rfile) {
 void UnfoldingReport::report_mlem_info(std::ofstream& rfile) {
     rfile << "Unfolding information\n\n";
     rfile << std::left << std::setw(sw) << "Algorithm: " << algorithm << "\n";
-    if (algorithm == "map") {
+    if (algorithm == "map" || algorithm == "map_accel") {
         rfile << std::left << std::setw(sw) << "MAP beta value: " << beta << "\n";
     }
     rfile << std::left << std::setw(sw) << "# of iterations: " << num_iterations << "/" << cutoff << "\n\n";
+    if (seed >= 0) {
+        rfile << std::left << std::setw(sw) << "Avg # of iterations/sample: " << avg_sample_iterations 
+            << "/" << cutoff << "\n\n";
+    }
     if (algorithm == "mlemstop") {
         rfile << std::left << std::setw(sw) << "final J value: " << j_final << "/" << j_threshold << "\n\n";
     }
@@ -593,6 +745,34 @@ void UnfoldingReport::report_results(std::ofstream& rfile) {
     }
 }
 
+//----------------------------------------------------------------------------------------------
+// Performance (resources used by each phase, up to the generation of this report)
+//----------------------------------------------------------------------------------------------
+void UnfoldingReport::report_performance(std::ofstream& rfile) {
+    if (performance.phases.empty()) {
+        return;
+    }
+    rfile << SECTION_DIVIDE;
+    rfile << "Performance\n\n";
+    rfile << std::left << std::setw(sw) << "Wall time (phases):" << performance.totalWallSeconds()*1000 << " ms\n";
+    rfile << std::left << std::setw(sw) << "Peak RSS (process):" << performance.peakRssKb()/1024.0 << " MB\n\n";
+
+    rfile << std::left << std::setw(cw) << "Phase" << std::setw(cw) << "Wall time" << std::setw(cw) 
+        << "CPU time" << std::setw(cw) << "Peak RSS" << std::setw(cw) << "Iterations" << "Samples/s\n";
+    rfile << std::left << std::setw(cw) << "" << std::setw(cw) << "(ms)" << std::setw(cw) 
+        << "(ms)" << std::setw(cw) << "(MB)" << std::setw(cw) << "" << "\n";
+    rfile << std::left << std::setw(cw) << COLSTRING << std::setw(cw) << COLSTRING << std::setw(cw) 
+        << COLSTRING << std::setw(cw) << COLSTRING << std::setw(cw) << COLSTRING << COLSTRING << "\n";
+    for (size_t i_phase = 0; i_phase < performance.phases.size(); i_phase++) {
+        const PhaseRecord &phase = performance.phases[i_phase];
+        rfile << std::left << std::setw(cw) << phase.name << std::setw(cw) << phase.wall_seconds*1000 
+            << std::setw(cw) << phase.cpu_seconds*1000 << std::setw(cw) << phase.peak_rss_kb/1024.0 
+            << std::setw(cw) << phase.num_iterations << phase.samplesPerSecond() << "\n";
+    }
+    rfile << "\nCPU time is that of the thread running the phase, or of the process (all threads) for phases\n";
+    rfile << "run on several threads. Peak RSS is that of the process (in batch mode, all files so far).\n";
+}
+
 //--------------------------------------------------------------------------------------------------
 // Default constructor to be used to create J Uncertainty Manager object. Required when used as
 // a class member in other classes
@@ -614,44 +794,6 @@ UncertaintyManagerJ::UncertaintyManagerJ(double original_j_threshold, double sig
     dose_uncertainty = 0;
 }
 
-//--------------------------------------------------------------------------------------------------
-// Method used to calculate a single upper or lower uncertainty on a neutron fluence spectrum. The
-// MLEM-STOP method is used to determine the iteration number at which the J-threshold (scaled by
-// sigma_J) is attained. The spectral difference between this spectrum and the actual MLEM-STOP
-// spectrum is taken to be the uncertainty.
-//--------------------------------------------------------------------------------------------------
-void UncertaintyManagerJ::determineSpectrumUncertainty(std::vector<double> &mlemstop_spectrum, 
-    int cutoff, int num_measurements, int num_bins, std::vector<double> &measurements, 
-    std::vector<std::vector<double>> &nns_response, std::vector<double> &normalized_response,
-    std::vector<double> &initial_spectrum) 
-{
-    this->bound_spectrum = initial_spectrum;
-
-    std::vector<double> mlem_ratio;
-    std::vector<double> mlem_correction;
-    std::vector<double> mlem_estimate;
-
-    num_iterations = runMLEMSTOP(cutoff, num_measurements, num_bins, measurements,
-        this->bound_spectrum, nns_response, normalized_response, mlem_ratio, mlem_correction, mlem_estimate,
-        this->j_threshold, this->j_factor
-    );
-
-    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
-        spectrum_uncertainty.push_back(abs(bound_spectrum[i_bin]-mlemstop_spectrum[i_bin]));
-    }
-}
-
-//--------------------------------------------------------------------------------------------------
-// Calculate the uncertainty in dose by calculating the dose at the bound spectrum, and subtracting
-// the dose for the actual MLEM-STOP spectrum
-//--------------------------------------------------------------------------------------------------
-void UncertaintyManagerJ::determineDoseUncertainty(double dose, std::vector<double> &mlemstop_spectrum, int num_bins, 
-    std::vector<double> &icrp_factors)
-{
-    double dose_bound = calculateDose(num_bins,this->bound_spectrum,icrp_factors);
-    this->dose_uncertainty = abs(dose_bound-dose);
-}
-
 //--------------------------------------------------------------------------------------------------
 // Default Constructor for SpectraSettings
 //--------------------------------------------------------------------------------------------------
@@ -677,6 +819,7 @@ SpectraSettings::SpectraSettings() {
     error_style = "E2";
     error_fill_style = 3001;
     rows_per_spectrum = 3;
+    spectra_selection = {};
     line_style = {1};
     line_width = {5};
     border_width = 5;
@@ -749,6 +892,8 @@ void SpectraSettings::set_setting(std::string settings_name, std::string setting
         this->set_error_fill_style(settings_value);
     else if (settings_name == "rows_per_spectrum")
         this->set_rows_per_spectrum(settings_value);
+    else if (settings_name == "spectra_selection")
+        this->set_spectra_selection(settings_value);
     else if (settings_name == "line_style")
         this->set_line_style(settings_value);
     else if (settings_name == "line_width")
@@ -863,6 +1008,9 @@ void SpectraSettings::set_error_fill_style(std::string error_fill_style) {
 void SpectraSettings::set_rows_per_spectrum(std::string rows_per_spectrum) {
     this->rows_per_spectrum = stoi(rows_per_spectrum);
 }
+void SpectraSettings::set_spectra_selection(std::string spectra_selection) {
+    stringToSVector(spectra_selection,this->spectra_selection);
+}
 void SpectraSettings::set_line_style(std::string line_style) {
     stringToIVector(line_style,this->line_style);
 }
@@ -0,0 +1,220 @@
+//**************************************************************************************************
+// The functions & classes included in this module record an event trace of an application: when
+// each thread read a file, unfolded the measurements or a batch of sampled measurement sets, wrote
+// the report, plotted the figure, ... The trace is saved in the Chrome Trace Event format (JSON),
+// which can be viewed with chrome://tracing or Perfetto (ui.perfetto.dev), to find idle threads &
+// stragglers.
+//
+// The trace is enabled by the NNS_EVENT_TRACE environment variable (pathname of the trace file).
+// Each thread records its events in its own buffer, without locking, and the buffers are saved
+// once, when the application exits.
+//**************************************************************************************************
+
+#include "event_trace.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "phase_timer.h"
+
+// Event of the trace (complete event: start & duration [us], from the start of the trace)
+struct TraceEvent {
+    const char *name;
+    const char *category;
+    double start_us;
+    double duration_us;
+    std::string args;
+};
+
+// Events recorded by a thread. Threads are numbered in the order they record their first event
+// (0: the thread that started the trace).
+struct ThreadEvents {
+    int thread_id;
+    std::vector<TraceEvent> events;
+};
+
+static bool trace_enabled = false;
+static std::string trace_path;
+static std::chrono::steady_clock::time_point trace_start;
+
+// Buffers of all threads that recorded events (kept after the threads end, until the trace is
+// saved). The mutex guards the list, not the buffers: each buffer is only written by its thread.
+static std::mutex thread_events_mutex;
+static std::vector<std::unique_ptr<ThreadEvents>> thread_events;
+static thread_local ThreadEvents *current_thread_events = NULL;
+
+//==================================================================================================
+// Return the buffer of the calling thread (created on its first event)
+//==================================================================================================
+static ThreadEvents& getThreadEvents() {
+    if (current_thread_events == NULL) {
+        std::lock_guard<std::mutex> lock(thread_events_mutex);
+        thread_events.push_back(std::unique_ptr<ThreadEvents>(new ThreadEvents()));
+        current_thread_events = thread_events.back().get();
+        current_thread_events->thread_id = thread_events.size() - 1;
+        current_thread_events->events.reserve(256);
+    }
+    return *current_thread_events;
+}
+
+//==================================================================================================
+// Save the trace when the application exits (errors are displayed: it is too late to throw)
+//==================================================================================================
+static void saveEventTraceAtExit() {
+    try {
+        saveEventTrace();
+    }
+    catch (std::exception &e) {
+        std::cerr << "Unable to save the event trace: " << e.what() << "\n";
+    }
+}
+
+//==================================================================================================
+// Enable the event trace if the NNS_EVENT_TRACE environment variable is set (pathname of the trace
+// file). To be called at the start of the application, before any thread is started: the trace is
+// saved when the application exits (returns from main, or calls exit).
+//==================================================================================================
+void startEventTrace() {
+    const char *env_path = getenv("NNS_EVENT_TRACE");
+    if (trace_enabled || env_path == NULL || env_path[0] == '\0') {
+        return;
+    }
+    trace_path = env_path;
+    trace_start = std::chrono::steady_clock::now();
+    trace_enabled = true;
+    getThreadEvents(); // the calling thread is thread 0
+    atexit(saveEventTraceAtExit);
+}
+
+//==================================================================================================
+// Return whether the event trace is enabled
+//==================================================================================================
+bool eventTraceEnabled() {
+    return trace_enabled;
+}
+
+//==================================================================================================
+// Save the events of all threads to the trace file (Chrome Trace Event format), and disable the
+// trace. The threads that recorded events must have ended, or be idle.
+//==================================================================================================
+void saveEventTrace() {
+    if (!trace_enabled) {
+        return;
+    }
+    trace_enabled = false;
+
+    std::lock_guard<std::mutex> lock(thread_events_mutex);
+    std::ofstream output(trace_path);
+    if (!output.is_open()) {
+        throw std::logic_error("Unable to open file: " + trace_path);
+    }
+    int pid = getpid();
+    long long num_events = 0;
+    output << std::fixed << std::setprecision(3);
+    output << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    for (size_t i_thread = 0; i_thread < thread_events.size(); i_thread++) {
+        const ThreadEvents &thread = *thread_events[i_thread];
+        std::string thread_name = "main";
+        if (thread.thread_id > 0) {
+            thread_name = "thread " + std::to_string(thread.thread_id);
+        }
+        output << (i_thread > 0 ? ",\n" : "") << "{\"name\": \"thread_name\", \"ph\": \"M\", "
+            << "\"pid\": " << pid << ", \"tid\": " << thread.thread_id << ", \"args\": {\"name\": "
+            << toJSONString(thread_name) << "}}";
+        for (size_t i_event = 0; i_event < thread.events.size(); i_event++) {
+            const TraceEvent &event = thread.events[i_event];
+            output << ",\n{\"name\": " << toJSONString(event.name) << ", \"cat\": "
+                << toJSONString(event.category) << ", \"ph\": \"X\", \"ts\": " << event.start_us
+                << ", \"dur\": " << event.duration_us << ", \"pid\": " << pid << ", \"tid\": "
+                << thread.thread_id << ", \"args\": {" << event.args << "}}";
+        }
+        num_events += thread.events.size();
+    }
+    output << "\n]}\n";
+    output.close();
+    std::cout << "Saved event trace to " << trace_path << " (" << num_events << " events, "
+        << thread_events.size() << " threads)\n";
+}
+
+//--------------------------------------------------------------------------------------------------
+// Start an event
+//--------------------------------------------------------------------------------------------------
+EventSpan::EventSpan(const char *name, const char *category) {
+    this->name = name;
+    this->category = category;
+    begin();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Start an event with a detail (e.g. the pathname of the file read)
+//--------------------------------------------------------------------------------------------------
+EventSpan::EventSpan(const char *name, const char *category, const std::string &detail) {
+    this->name = name;
+    this->category = category;
+    begin();
+    if (recording) {
+        args = "\"detail\": " + toJSONString(detail);
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Start an event on a range of sampled measurement sets (first_sample, first_sample+1, ...)
+//--------------------------------------------------------------------------------------------------
+EventSpan::EventSpan(const char *name, const char *category, long long first_sample,
+    long long num_samples)
+{
+    this->name = name;
+    this->category = category;
+    begin();
+    if (recording) {
+        args = "\"first_sample\": " + std::to_string(first_sample) + ", \"samples\": "
+            + std::to_string(num_samples);
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Record the start time (if the trace is enabled)
+//--------------------------------------------------------------------------------------------------
+void EventSpan::begin() {
+    recording = trace_enabled;
+    if (recording) {
+        start = std::chrono::steady_clock::now();
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// End the event (if not already ended)
+//--------------------------------------------------------------------------------------------------
+EventSpan::~EventSpan() {
+    stop();
+}
+
+//--------------------------------------------------------------------------------------------------
+// End the event, and add it to the buffer of the thread. Later calls have no effect.
+//--------------------------------------------------------------------------------------------------
+void EventSpan::stop() {
+    if (!recording) {
+        return;
+    }
+    recording = false;
+    if (!trace_enabled) {
+        return; // already saved
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    TraceEvent event;
+    event.name = name;
+    event.category = category;
+    event.start_us = std::chrono::duration<double, std::micro>(start - trace_start).count();
+    event.duration_us = std::chrono::duration<double, std::micro>(end - start).count();
+    event.args.swap(args);
+    getThreadEvents().events.push_back(event);
+}
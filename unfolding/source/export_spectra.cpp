@@ -0,0 +1,74 @@
+//**************************************************************************************************
+// This program exports the spectra of a spectra store (see SpectraStore, path_spectra_store) to a
+// CSV file in one of the legacy layouts:
+//  - rows: the layout of output_spectra.csv (energy bins on the first row, then 3 rows per spectrum:
+//    the spectrum & its 2 uncertainties), as read by plot_spectra.exe (rows_per_spectrum=3)
+//  - columns: energy bins in the first column, then the spectrum & its uncertainty in 2 columns per
+//    spectrum (facilitates import into a spreadsheet)
+//
+// Usage:
+//     export_spectra.exe --store <store> --output <CSV file> [--layout rows|columns]
+//         [--selection <irradiation conditions>,...]
+// Without --selection, all spectra are exported in the order they were saved. With --selection,
+// the most recent spectrum saved under each of the (comma-separated) irradiation conditions is
+// exported.
+//**************************************************************************************************
+
+#include <iostream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// Local
+#include "fileio.h"
+#include "handle_args.h"
+#include "spectra_store.h"
+
+int main(int argc, char* argv[])
+{
+    // Put arguments in vector for easier processing
+    std::vector<std::string> arg_vector;
+    for (int i = 1; i < argc; i++) {
+        arg_vector.push_back(argv[i]);
+    }
+
+    std::vector<std::string> input_file_flags;
+    input_file_flags.push_back("--store");
+    input_file_flags.push_back("--output");
+    input_file_flags.push_back("--layout");
+    input_file_flags.push_back("--selection");
+    std::string store_file, output_file, layout, selection_string;
+    setfile(arg_vector, "--store", "", store_file);
+    setfile(arg_vector, "--output", "", output_file);
+    setfile(arg_vector, "--layout", "rows", layout);
+    setfile(arg_vector, "--selection", "", selection_string);
+    checkUnknownParameters(arg_vector, input_file_flags);
+
+    if (store_file.empty() || output_file.empty()) {
+        throw std::logic_error("Usage: export_spectra.exe --store <store> --output <CSV file> "
+            "[--layout rows|columns] [--selection <irradiation conditions>,...]");
+    }
+    if (layout != "rows" && layout != "columns") {
+        throw std::logic_error("Unrecognized layout: " + layout + ". Please select 'rows' or 'columns'.");
+    }
+
+    SpectraStore store;
+    store.open(store_file);
+
+    std::vector<std::string> selection;
+    stringToSVector(selection_string, selection);
+    std::vector<int> selected_entries = store.select(selection);
+
+    if (layout == "rows") {
+        store.exportRows(output_file, selected_entries);
+    }
+    else {
+        store.exportColumns(output_file, selected_entries);
+    }
+
+    std::cout << "Exported " << selected_entries.size() << " of " << store.numEntries() << " spectra from "
+        << store_file << " to " << output_file << " (" << layout << ")\n";
+
+    return 0;
+}
@@ -3,6 +3,7 @@
 //**************************************************************************************************
 
 #include "fileio.h"
+#include "csv_reader.h"
 
 #include <iostream>
 #include <iomanip>
@@ -12,6 +13,7 @@
 #include <stdlib.h>
 #include <vector>
 #include <map>
+#include <glob.h>
 
 // Constants
 std::string DOSE_HEADERS[] = {
@@ -221,46 +223,38 @@ bool checkStringMap(std::string test_key, std::map<std::string, std::string>& te
 //==================================================================================================
 std::vector<double> getMeasurements(UnfoldingSettings &settings) 
 {
-    std::ifstream ifile(settings.path_measurements);
-    if (!ifile.is_open()) {
+    CsvReader reader;
+    if (!reader.open(settings.path_measurements)) {
         //throw error
         throw std::logic_error("Unable to access open measurement file: " + settings.path_measurements);
     }
 
-    // Load header information from 'ifile'
-    std::string temp_irradiation_conditions;
-    getline(ifile,temp_irradiation_conditions);
-    // removes: carriage return '\r' from the string (which causes weird string overwriting)
-    temp_irradiation_conditions.erase( std::remove(temp_irradiation_conditions.begin(), 
-        temp_irradiation_conditions.end(), '\r'), temp_irradiation_conditions.end() );
-    settings.irradiation_conditions = temp_irradiation_conditions;
+    // Load header information (line ending, incl. carriage return, is removed by the reader)
+    reader.nextLine();
+    settings.irradiation_conditions = reader.lineString();
 
     // If measurements in nC, extract dose, doserate, and duration information
     if (settings.meas_units == "nc") {
-        std::string dose_string;
-        getline(ifile,dose_string);
-        settings.dose_mu = atoi(dose_string.c_str());
+        reader.nextLine();
+        reader.nextField();
+        settings.dose_mu = (int)reader.fieldDouble();
 
-        std::string doserate_string;
-        getline(ifile,doserate_string);
-        settings.doserate_mu = atoi(doserate_string.c_str());
+        reader.nextLine();
+        reader.nextField();
+        settings.doserate_mu = (int)reader.fieldDouble();
 
-        std::string t_string;
-        getline(ifile,t_string);
-        settings.duration = atoi(t_string.c_str());
+        reader.nextLine();
+        reader.nextField();
+        settings.duration = (int)reader.fieldDouble();
     }
 
     // Loop through file, get measurement data
-    std::string line;
     std::vector<double> data_vector;
-    while (getline(ifile,line)) {
-        std::istringstream line_stream(line);
-        std::string stoken; // store individual values between delimiters on a line
-
+    while (reader.nextLine()) {
         // Loop through each line, delimiting at commas
-        while (getline(line_stream, stoken, ',')) {
+        while (reader.nextField()) {
             // Convert negative measurements to positive
-            double measurement = atof(stoken.c_str());
+            double measurement = reader.fieldDouble();
             if (measurement < 0) {
                 measurement *= -1;
             }
@@ -268,11 +262,66 @@ std::vector<double> getMeasurements(UnfoldingSettings &settings)
         }
     }
 
-    ifile.close();
-    std::cout << "Measurements successfully retrieved from " + settings.path_measurements + '\n';
+    reader.close();
     return data_vector;
 }
 
+//==================================================================================================
+// Get the measurement files of a batch (unfold_spectrum --batch). batch_source is either:
+//  - a pattern (containing *, ? or [), e.g. input/campaign/*.txt: the matching files, sorted
+//  - a manifest file: one measurement file per line. Blank lines & lines starting with # are
+//      ignored, as are leading & trailing spaces.
+// Paths are used as they are (relative paths are relative to the working directory, as for
+// path_measurements).
+//==================================================================================================
+std::vector<std::string> getBatchFiles(std::string batch_source) {
+    std::vector<std::string> batch_files;
+
+    if (batch_source.find_first_of("*?[") != std::string::npos) {
+        glob_t matches;
+        int status = glob(batch_source.c_str(), 0, NULL, &matches);
+        if (status == 0) {
+            for (size_t i_match = 0; i_match < matches.gl_pathc; i_match++) {
+                batch_files.push_back(matches.gl_pathv[i_match]);
+            }
+        }
+        globfree(&matches);
+        if (status != 0 && status != GLOB_NOMATCH) {
+            throw std::logic_error("Unable to expand batch pattern: " + batch_source);
+        }
+        return batch_files;
+    }
+
+    std::ifstream manifest(batch_source);
+    if (!manifest) {
+        throw std::logic_error("Unable to open batch manifest: " + batch_source);
+    }
+    std::string line;
+    while (getline(manifest, line)) {
+        size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos || line[begin] == '#') {
+            continue;
+        }
+        size_t end = line.find_last_not_of(" \t\r");
+        batch_files.push_back(line.substr(begin, end - begin + 1));
+    }
+    return batch_files;
+}
+
+//==================================================================================================
+// Insert a suffix before the extension of the file name of a path (e.g. output/trend.csv &
+// _total_dose: output/trend_total_dose.csv). The suffix is appended to a file name without an
+// extension (dots in directory names are not extensions).
+//==================================================================================================
+std::string insertBeforeExtension(const std::string &path, const std::string &suffix) {
+    size_t extension = path.find_last_of('.');
+    size_t directory = path.find_last_of('/');
+    if (extension == std::string::npos || (directory != std::string::npos && extension < directory)) {
+        return path + suffix;
+    }
+    return path.substr(0, extension) + suffix + path.substr(extension);
+}
+
 
 //==================================================================================================
 // Save calculated spectrum (and uncertainty spectrum) to file (append to existing data in the file)
@@ -426,53 +475,74 @@ int saveSpectrumAsColumn(std::string spectrum_file, std::string irradiation_cond
 //      by reference)
 //==================================================================================================
 int readInputFile1D(std::string file_name, std::vector<double>& input_vector) {
-    std::ifstream ifile(file_name);
-    std::string iline;
+    CsvReader reader;
 
-    if (!ifile.is_open()) {
+    if (!reader.open(file_name)) {
         //throw error
         throw std::logic_error("Unable to open input file: " + file_name);
     }
-    while (getline(ifile,iline)) {
-        std::istringstream line_stream(iline);
-        std::string stoken; // store individual values between delimiters on a line
-
-        // Delimit line at trailing comma
-        getline(line_stream, stoken, ',');
-        input_vector.push_back(atof(stoken.c_str()));
+    while (reader.nextLine()) {
+        // Delimit line at trailing comma (skip blank lines)
+        if (reader.nextField()) {
+            input_vector.push_back(reader.fieldDouble());
+        }
     }
     return 1;
 }
 
 
 //==================================================================================================
-// Read a CSV file and store the data in a 2D vector
+// Read a CSV file and store the data in a response matrix. Each line of the file becomes a row of
+// the matrix. All lines must contain the same number of values.
 // Args:
 //  - file_name: the name of the file to be read
-//  - input_vector: the vector that will be assigned values read in from the input file (note passed
+//  - input_matrix: the matrix that will be assigned values read in from the input file (note passed
 //      by reference)
 //==================================================================================================
-int readInputFile2D(std::string file_name, std::vector<std::vector<double>>& input_vector) {
-    std::ifstream ifile(file_name);
-    std::string iline;
+int readInputFile2D(std::string file_name, ResponseMatrix& input_matrix) {
+    CsvReader reader;
 
-    if (!ifile.is_open()) {
+    if (!reader.open(file_name)) {
         //throw error
         throw std::logic_error("Unable to open input file: " + file_name);
     }
 
-    // Loop through each line in the file
-    while (getline(ifile,iline)) {
-        std::vector<double> new_column;
+    // Values are gathered row after row in a single flat vector, then copied into the matrix once
+    // its dimensions are known
+    std::vector<double> values;
+    int num_rows = 0;
+    int num_columns = 0;
 
-        std::istringstream line_stream(iline);
-        std::string stoken; // store individual values between delimiters on a line
+    // Loop through each line in the file
+    while (reader.nextLine()) {
+        int row_size = 0;
 
         // Loop through the line, delimiting at commas
-        while (getline(line_stream, stoken, ',')) {
-            new_column.push_back(atof(stoken.c_str())); // add data to the vector
+        while (reader.nextField()) {
+            values.push_back(reader.fieldDouble()); // add data to the vector
+            row_size++;
+        }
+
+        // Skip blank lines
+        if (row_size == 0) {
+            continue;
+        }
+
+        if (num_rows == 0) {
+            num_columns = row_size;
+        }
+        else {
+            checkDimensions(num_columns, "row 1 of " + file_name, row_size, 
+                "row " + std::to_string(num_rows+1) + " of " + file_name);
+        }
+        num_rows++;
+    }
+
+    input_matrix.resize(num_rows, num_columns);
+    for (int i_row = 0; i_row < num_rows; i_row++) {
+        for (int i_col = 0; i_col < num_columns; i_col++) {
+            input_matrix.set(i_row, i_col, values[i_row*num_columns + i_col]);
         }
-        input_vector.push_back(new_column);
     }
     return 1;
 }
@@ -495,10 +565,9 @@ int readSpectra(std::string file_name, std::vector<std::string>& header_vector,
     std::vector<std::vector<double>>& error_upper_vector, bool plot_per_mu, std::vector<int>& number_mu, 
     std::vector<int>& duration, int rows_per_spectrum) 
 {
-    std::ifstream ifile(file_name);
-    std::string iline;
+    CsvReader reader;
 
-    if (!ifile.is_open()) {
+    if (!reader.open(file_name)) {
         //throw error
         throw std::logic_error("Unable to open spectrum file: " + file_name);
     }
@@ -506,18 +575,16 @@ int readSpectra(std::string file_name, std::vector<std::string>& header_vector,
     // Loop through each line in the file
     int i_row = 0;
     int i_group = 0; // index that is incremented after processing each spectrum & its uncertainties
-    while (getline(ifile,iline)) {
+    while (reader.nextLine()) {
         std::vector<double> new_row;
-        std::istringstream line_stream(iline);
-        std::string stoken; // store individual values between delimiters on a line
 
-        // Loop through the line, delimiting at commas
+        // Loop through the line, delimiting at commas (skip blank lines)
         int i_col = 0;
-        while (getline(line_stream, stoken, ',')) {
+        while (reader.nextField()) {
             // The first token is the header
             if (i_col == 0) {
                 if (i_row % rows_per_spectrum == 1) {
-                    header_vector.push_back(stoken);
+                    header_vector.push_back(reader.fieldString());
                 }
             }
             // Add data to the vector
@@ -527,20 +594,23 @@ int readSpectra(std::string file_name, std::vector<std::string>& header_vector,
                     //1st row is the energies
                     if (i_row !=0) {
                         new_row.push_back(
-                            atof(stoken.c_str())*duration[i_group%duration.size()]/number_mu[i_group%number_mu.size()]
+                            reader.fieldDouble()*duration[i_group%duration.size()]/number_mu[i_group%number_mu.size()]
                         );
                     }
                     else {
-                        new_row.push_back(atof(stoken.c_str()));
+                        new_row.push_back(reader.fieldDouble());
                     }
                 }
                 // If plotting per second
                 else {
-                    new_row.push_back(atof(stoken.c_str()));
+                    new_row.push_back(reader.fieldDouble());
                 }
             }
             i_col += 1;
         }
+        if (i_col == 0) {
+            continue;
+        }
 
         //
         if (rows_per_spectrum == 3) {
@@ -676,10 +746,9 @@ void stringToDVector(std::string test_string, std::vector<float>& result_vector)
 int readXYYCSV(std::string file_name, std::vector<std::string>& header_vector,
     std::vector<std::vector<double>>& x_data, std::vector<std::vector<double>>& y_data) 
 {
-    std::ifstream ifile(file_name);
-    std::string iline;
+    CsvReader reader;
 
-    if (!ifile.is_open()) {
+    if (!reader.open(file_name)) {
         //throw error
         throw std::logic_error("Unable to open data file: " + file_name);
     }
@@ -688,27 +757,28 @@ int readXYYCSV(std::string file_name, std::vector<std::string>& header_vector,
 
     // Loop through each line in the file
     int i_row = 0;
-    while (getline(ifile,iline)) {
+    while (reader.nextLine()) {
         std::vector<double> new_row;
-        std::istringstream line_stream(iline);
-        std::string stoken; // store individual values between delimiters on a line
 
-        // Loop through the line, delimiting at commas
+        // Loop through the line, delimiting at commas (skip blank lines)
         int i_col = 0;
-        while (getline(line_stream, stoken, ',')) {
+        while (reader.nextField()) {
             // The first token is the header
             if (i_col == 0) {
                 // Only add y-row headers to the header vector
                 if (i_row > 0) {
-                    header_vector.push_back(stoken);
+                    header_vector.push_back(reader.fieldString());
                 }
             }
             // Add data to the vector
             else {
-                new_row.push_back(atof(stoken.c_str()));
+                new_row.push_back(reader.fieldDouble());
             }
             i_col += 1;
         }
+        if (i_col == 0) {
+            continue;
+        }
 
         // The first row contains the x data
         if (i_row == 0) {
@@ -744,37 +814,37 @@ int readXYYCSV(std::string file_name, std::vector<std::string>& header_vector,
 int readXYXYCSV(std::string file_name, std::vector<std::string>& header_vector, 
     std::vector<std::vector<double>>& x_data, std::vector<std::vector<double>>& y_data) 
 {
-    std::ifstream ifile(file_name);
-    std::string iline;
+    CsvReader reader;
 
-    if (!ifile.is_open()) {
+    if (!reader.open(file_name)) {
         //throw error
         throw std::logic_error("Unable to open data file: " + file_name);
     }
 
     // Loop through each line in the file
     int i_row = 0;
-    while (getline(ifile,iline)) {
+    while (reader.nextLine()) {
         std::vector<double> new_row;
-        std::istringstream line_stream(iline);
-        std::string stoken; // store individual values between delimiters on a line
 
-        // Loop through the line, delimiting at commas
+        // Loop through the line, delimiting at commas (skip blank lines)
         int i_col = 0;
-        while (getline(line_stream, stoken, ',')) {
+        while (reader.nextField()) {
             // The first token is the header
             if (i_col == 0) {
                 // Only add y-row headers to the header vector
                 if (i_row % 2 == 1) {
-                    header_vector.push_back(stoken);
+                    header_vector.push_back(reader.fieldString());
                 }
             }
             // Add data to the vector
             else {
-                new_row.push_back(atof(stoken.c_str()));
+                new_row.push_back(reader.fieldDouble());
             }
             i_col += 1;
         }
+        if (i_col == 0) {
+            continue;
+        }
 
         // Even rows (starting at 0) contain the x data
         if (i_row % 2 == 0) {
@@ -0,0 +1,232 @@
+//**************************************************************************************************
+// This program generates synthetic measurement files (e.g. to measure the throughput of
+// unfold_spectrum in batch mode under a realistic load). Each file holds the readings expected from
+// a reference spectrum: the spectrum is projected through the NNS response of the configuration
+// (as the unfolding algorithms do), the resulting count rates are converted to counts over the
+// measurement duration & sampled from a Poisson distribution, then converted to the units of the
+// configuration (meas_units) with its f_factor & nns_normalization. The files are written in the
+// format read by unfold_spectrum (see getMeasurements), along with a manifest listing them (for
+// unfold_spectrum --batch).
+//
+// Usage:
+//     generate_measurements.exe [--configuration <file>] [--spectra <file>,...] [--number <#>]
+//         [--output <directory>] [--fluence_rate <n cm^-2 s^-1>] [--dose <MU>]
+//         [--doserate <MU/min>] [--duration <s>] [--seed <seed>]
+// --spectra are reference spectra (one value per energy bin, as path_input_spectrum), used in turn
+// by the generated files. By default, a spectrum with thermal, epithermal & fast components (as
+// that of a moderated source) is used. Each is scaled to a total fluence rate of --fluence_rate.
+// The files of a given --seed are reproducible (a seed is drawn at random, and displayed, if none
+// is given).
+//**************************************************************************************************
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+// Local
+#include "counter_rng.h"
+#include "custom_classes.h"
+#include "fileio.h"
+#include "handle_args.h"
+#include "instrument_profile.h"
+#include "projection_kernels.h"
+
+//==================================================================================================
+// Return the name of a file, without its directory & extension
+//==================================================================================================
+static std::string getBaseName(const std::string &path) {
+    std::string name = path.substr(path.find_last_of('/') + 1);
+    return name.substr(0, name.find_last_of('.'));
+}
+
+//==================================================================================================
+// Default reference spectrum (fluence rate per bin) at the given energy bins [MeV]: thermal peak,
+// epithermal (1/E, i.e. flat per logarithmic bin) & fast (evaporation) components
+//==================================================================================================
+static std::vector<double> defaultReferenceSpectrum(const std::vector<double> &energy_bins) {
+    std::vector<double> spectrum(energy_bins.size());
+    for (size_t i_bin = 0; i_bin < energy_bins.size(); i_bin++) {
+        double log_energy = log10(energy_bins[i_bin]);
+        spectrum[i_bin] = exp(-0.5*pow((log_energy+7.6)/0.4, 2)) + 0.2
+            + 2*exp(-0.5*pow((log_energy-0.2)/0.5, 2));
+    }
+    return spectrum;
+}
+
+//==================================================================================================
+// Write a measurements file: header (irradiation conditions and, for measurements in nC, dose,
+// dose rate & duration), then one value per line, from the outermost moderator shell to the bare
+// detector (the order in which getMeasurements expects them)
+//==================================================================================================
+static void saveMeasurements(const std::string &path, const std::string &irradiation_conditions,
+    const UnfoldingSettings &settings, int dose, int doserate, int duration,
+    const std::vector<double> &values)
+{
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        throw std::logic_error("Unable to open file: " + path);
+    }
+    file << irradiation_conditions << "\n";
+    if (settings.meas_units == "nc") {
+        file << dose << "\n";
+        file << doserate << "\n";
+        file << duration << "\n";
+    }
+    file << std::setprecision(10);
+    for (int i_value = values.size()-1; i_value >= 0; i_value--) {
+        file << values[i_value] << "\n";
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    // Put arguments in vector for easier processing
+    std::vector<std::string> arg_vector;
+    for (int i = 1; i < argc; i++) {
+        arg_vector.push_back(argv[i]);
+    }
+
+    std::vector<std::string> input_file_flags;
+    input_file_flags.push_back("--configuration");
+    input_file_flags.push_back("--spectra");
+    input_file_flags.push_back("--number");
+    input_file_flags.push_back("--output");
+    input_file_flags.push_back("--fluence_rate");
+    input_file_flags.push_back("--dose");
+    input_file_flags.push_back("--doserate");
+    input_file_flags.push_back("--duration");
+    input_file_flags.push_back("--seed");
+    std::string config_file, spectra_string, number_string, output_dir, fluence_rate_string,
+        dose_string, doserate_string, duration_string, seed_string;
+    setfile(arg_vector, "--configuration", "input/unfold_spectrum.cfg", config_file);
+    setfile(arg_vector, "--spectra", "", spectra_string);
+    setfile(arg_vector, "--number", "100", number_string);
+    setfile(arg_vector, "--output", "output/synthetic", output_dir);
+    setfile(arg_vector, "--fluence_rate", "50000", fluence_rate_string);
+    setfile(arg_vector, "--dose", "100", dose_string);
+    setfile(arg_vector, "--doserate", "600", doserate_string);
+    setfile(arg_vector, "--duration", "60", duration_string);
+    setfile(arg_vector, "--seed", "-1", seed_string);
+    checkUnknownParameters(arg_vector, input_file_flags);
+
+    int num_files = atoi(number_string.c_str());
+    double fluence_rate = atof(fluence_rate_string.c_str());
+    int dose = atoi(dose_string.c_str());
+    int doserate = atoi(doserate_string.c_str());
+    int duration = atoi(duration_string.c_str());
+    long long seed = atoll(seed_string.c_str());
+    if (num_files < 1 || fluence_rate <= 0 || duration < 1) {
+        throw std::logic_error("--number, --fluence_rate & --duration must be positive");
+    }
+    if (seed < 0) {
+        seed = generateRandomSeed();
+    }
+
+    UnfoldingSettings settings;
+    setSettings(config_file, settings);
+    double f_factor = settings.f_factor / 1e6; // Convert f_factor from fA/cps to nA/cps
+    if (settings.meas_units != "nc" && settings.meas_units != "cps") {
+        throw std::logic_error("Unrecognized measurement units: " + settings.meas_units);
+    }
+    if (settings.num_meas_per_shell < 1) {
+        throw std::logic_error("Number of measurements per shell must be >= 1");
+    }
+
+    InstrumentProfile profile;
+    readInstrumentProfile(settings, profile);
+    int num_measurements = profile.nns_response.num_measurements();
+    int num_bins = profile.energy_bins.size();
+
+    // Reference spectra, scaled to the total fluence rate, and the count rates they produce
+    std::vector<std::string> spectrum_files;
+    stringToSVector(spectra_string, spectrum_files);
+    std::vector<std::string> spectrum_names;
+    for (size_t i_spectrum = 0; i_spectrum < spectrum_files.size(); i_spectrum++) {
+        spectrum_names.push_back(getBaseName(spectrum_files[i_spectrum]));
+    }
+    if (spectrum_files.empty()) {
+        spectrum_names.push_back("reference");
+    }
+    std::vector<std::vector<double>> expected_cps(spectrum_names.size(), std::vector<double>(num_measurements));
+    for (size_t i_spectrum = 0; i_spectrum < spectrum_names.size(); i_spectrum++) {
+        std::vector<double> spectrum;
+        if (spectrum_files.empty()) {
+            spectrum = defaultReferenceSpectrum(profile.energy_bins);
+        }
+        else {
+            readInputFile1D(spectrum_files[i_spectrum], spectrum);
+            checkDimensions(num_bins, "number of energy bins", spectrum.size(), spectrum_files[i_spectrum]);
+        }
+        double total = 0;
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            total += spectrum[i_bin];
+        }
+        if (total <= 0) {
+            throw std::logic_error("Reference spectrum with no fluence: " + spectrum_names[i_spectrum]);
+        }
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            spectrum[i_bin] *= fluence_rate/total;
+        }
+        forwardProject(profile.nns_response, spectrum.data(), expected_cps[i_spectrum].data());
+    }
+
+    if (mkdir(output_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw std::logic_error("Unable to create directory " + output_dir + ": " + std::string(strerror(errno)));
+    }
+    std::string manifest_file = output_dir + "/manifest.txt";
+    std::ofstream manifest(manifest_file);
+    if (!manifest.is_open()) {
+        throw std::logic_error("Unable to open file: " + manifest_file);
+    }
+    manifest << "# Synthetic measurements generated by generate_measurements.exe (seed " << seed << ")\n";
+
+    //----------------------------------------------------------------------------------------------
+    // Generate the files. The unfolding converts a reading (nC) to a count rate (CPS) with
+    //     cps = nC * nns_normalization / f_factor / duration
+    // so the counts behind an expected count rate are cps * duration / nns_normalization (Poisson
+    // distributed), and each count contributes f_factor nC. Each file has its own random stream.
+    //----------------------------------------------------------------------------------------------
+    for (int i_file = 0; i_file < num_files; i_file++) {
+        int i_spectrum = i_file % spectrum_names.size();
+        CounterRng rng(seed, i_file);
+
+        std::vector<double> values; // 0-7, num_meas_per_shell values per shell
+        for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+            double expected_counts = expected_cps[i_spectrum][i_meas]*duration/settings.norm;
+            std::poisson_distribution<long long> counts_distribution(expected_counts);
+            for (int i_value = 0; i_value < settings.num_meas_per_shell; i_value++) {
+                double counts = expected_counts > 0 ? counts_distribution(rng) : 0;
+                if (settings.meas_units == "nc") {
+                    values.push_back(counts*f_factor);
+                }
+                else {
+                    values.push_back(counts*settings.norm/duration);
+                }
+            }
+        }
+
+        char file_number[16];
+        snprintf(file_number, sizeof(file_number), "%05d", i_file);
+        std::string irradiation_conditions = "synthetic_" + std::string(file_number) + "_"
+            + spectrum_names[i_spectrum];
+        std::string path = output_dir + "/" + irradiation_conditions + ".txt";
+        saveMeasurements(path, irradiation_conditions, settings, dose, doserate, duration, values);
+        manifest << path << "\n";
+    }
+
+    std::cout << "Generated " << num_files << " measurement files (" << settings.meas_units << ", "
+        << settings.num_meas_per_shell << " per shell, seed " << seed << ") in " << output_dir << "\n";
+    std::cout << "Manifest: " << manifest_file << "\n";
+
+    return 0;
+}
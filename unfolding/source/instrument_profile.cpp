@@ -0,0 +1,378 @@
+//**************************************************************************************************
+// The functions included in this module read the inputs describing the instrument (energy bins, NNS
+// response, ICRP factors & input spectrum), and save/load them as a compiled instrument profile.
+//
+// Instrument profile file format (native byte order, version INSTRUMENT_PROFILE_VERSION):
+//  - header (48 bytes): magic "NNSPROF\0", version, byte order mark (0x01020304), # of measurements,
+//    # of bins, # of source files, reserved (0) [all uint32], payload size [bytes], FNV-1a checksum
+//    of the payload [uint64]
+//  - payload: energy bins, ICRP factors, input spectrum, normalized response [# bins doubles each],
+//    response [measurements x bins doubles], transposed response [bins x measurements doubles], then
+//    for each source file: size [int64], modification time [int64, ns], path length [uint32], path
+//**************************************************************************************************
+
+#include "instrument_profile.h"
+#include "fileio.h"
+#include "physics_calculations.h"
+
+#include <fcntl.h>
+#include <iostream>
+#include <limits.h>
+#include <sstream>
+#include <stdexcept>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+const char PROFILE_MAGIC[8] = {'N','N','S','P','R','O','F','\0'};
+const uint32_t PROFILE_BYTE_ORDER = 0x01020304;
+const size_t PROFILE_HEADER_SIZE = 48;
+
+//==================================================================================================
+// Return the FNV-1a (64 bit) hash of size bytes at data
+//==================================================================================================
+static uint64_t checksumFNV1a(const char *data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+//==================================================================================================
+// Get the size & modification time (ns since epoch) of the file at path. Returns false if the file
+// does not exist.
+//==================================================================================================
+static bool getFileStatus(const std::string &path, int64_t &size, int64_t &modification_time) {
+    struct stat file_status;
+    if (stat(path.c_str(), &file_status) != 0) {
+        return false;
+    }
+    size = file_status.st_size;
+#ifdef __APPLE__
+    modification_time = (int64_t)file_status.st_mtimespec.tv_sec*1000000000 + file_status.st_mtimespec.tv_nsec;
+#else
+    modification_time = (int64_t)file_status.st_mtim.tv_sec*1000000000 + file_status.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+//==================================================================================================
+// Return the absolute, normalized form of path: the canonical path (symbolic links resolved) if the
+// file exists, or else the path made absolute (from the current directory) with its "." & ".."
+// components removed. Used to compare paths written differently (e.g. "input/a.csv" &
+// "./input/a.csv").
+//==================================================================================================
+static std::string normalizePath(const std::string &path) {
+    char resolved_path[PATH_MAX];
+    if (realpath(path.c_str(), resolved_path) != NULL) {
+        return resolved_path;
+    }
+    std::string absolute_path = path;
+    if (path.empty() || path[0] != '/') {
+        char current_directory[PATH_MAX];
+        if (getcwd(current_directory, sizeof(current_directory)) != NULL) {
+            absolute_path = std::string(current_directory) + "/" + path;
+        }
+    }
+    std::vector<std::string> components;
+    std::istringstream path_stream(absolute_path);
+    std::string component;
+    while (getline(path_stream, component, '/')) {
+        if (component.empty() || component == ".") {
+            continue;
+        }
+        if (component == "..") {
+            if (!components.empty()) {
+                components.pop_back();
+            }
+            continue;
+        }
+        components.push_back(component);
+    }
+    std::string normalized_path;
+    for (size_t i_component = 0; i_component < components.size(); i_component++) {
+        normalized_path += "/" + components[i_component];
+    }
+    return normalized_path.empty() ? "/" : normalized_path;
+}
+
+//==================================================================================================
+// Append size bytes at data to buffer
+//==================================================================================================
+static void appendBytes(std::vector<char> &buffer, const void *data, size_t size) {
+    const char *bytes = (const char*)data;
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+//==================================================================================================
+// Copy size bytes at position offset of the payload to data, checking that they are within the
+// payload
+//==================================================================================================
+static void readBytes(const char *payload, size_t payload_size, size_t &offset, void *data, size_t size,
+    const std::string &path)
+{
+    if (size > payload_size || offset > payload_size - size) {
+        throw std::logic_error("Corrupt instrument profile (truncated): " + path);
+    }
+    memcpy(data, payload + offset, size);
+    offset += size;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Read the energy bins, NNS response, input spectrum & ICRP factors from the CSV files specified in
+// settings, validate their dimensions, and calculate the normalized response
+//--------------------------------------------------------------------------------------------------
+void InstrumentProfile::readCSV(const UnfoldingSettings &settings) {
+    source_files.clear();
+
+    energy_bins.clear();
+    readInputFile1D(settings.path_energy_bins,energy_bins);
+    addSourceFile(settings.path_energy_bins);
+    int num_bins = energy_bins.size();
+
+    readInputFile2D(settings.path_system_response,nns_response);
+    addSourceFile(settings.path_system_response);
+    checkDimensions(num_bins, "number of energy bins", nns_response.num_bins(), "NNS response");
+    int num_measurements = nns_response.num_measurements();
+
+    initial_spectrum.clear();
+    readInputFile1D(settings.path_input_spectrum,initial_spectrum);
+    addSourceFile(settings.path_input_spectrum);
+    checkDimensions(num_bins, "number of energy bins", initial_spectrum.size(), "Input spectrum");
+
+    icrp_factors.clear();
+    readInputFile1D(settings.path_icrp_factors,icrp_factors);
+    addSourceFile(settings.path_icrp_factors);
+    checkDimensions(num_bins, "number of energy bins", icrp_factors.size(), "Number of ICRP factors");
+
+    normalized_response = normalizeResponse(num_bins, num_measurements, nns_response);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Record the (normalized) path, size & modification time of a CSV file that was read. Files are
+// recorded in the order they are read (see checkSourceFiles).
+//--------------------------------------------------------------------------------------------------
+void InstrumentProfile::addSourceFile(const std::string &path) {
+    SourceFile source_file;
+    source_file.path = normalizePath(path);
+    if (!getFileStatus(path, source_file.size, source_file.modification_time)) {
+        source_file.size = -1;
+        source_file.modification_time = -1;
+    }
+    source_files.push_back(source_file);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Save the profile as a compiled instrument profile at path. The file is written under a temporary
+// name, then renamed, so that processes loading the profile never see a partially written file.
+//--------------------------------------------------------------------------------------------------
+void InstrumentProfile::save(const std::string &path) const {
+    uint32_t num_measurements = nns_response.num_measurements();
+    uint32_t num_bins = nns_response.num_bins();
+
+    std::vector<char> payload;
+    appendBytes(payload, energy_bins.data(), sizeof(double)*num_bins);
+    appendBytes(payload, icrp_factors.data(), sizeof(double)*num_bins);
+    appendBytes(payload, initial_spectrum.data(), sizeof(double)*num_bins);
+    appendBytes(payload, normalized_response.data(), sizeof(double)*num_bins);
+    for (uint32_t i_meas = 0; i_meas < num_measurements; i_meas++) {
+        appendBytes(payload, nns_response.row(i_meas), sizeof(double)*num_bins);
+    }
+    for (uint32_t i_bin = 0; i_bin < num_bins; i_bin++) {
+        appendBytes(payload, nns_response.column(i_bin), sizeof(double)*num_measurements);
+    }
+    for (size_t i_file = 0; i_file < source_files.size(); i_file++) {
+        uint32_t path_length = source_files[i_file].path.size();
+        appendBytes(payload, &source_files[i_file].size, sizeof(int64_t));
+        appendBytes(payload, &source_files[i_file].modification_time, sizeof(int64_t));
+        appendBytes(payload, &path_length, sizeof(uint32_t));
+        appendBytes(payload, source_files[i_file].path.data(), path_length);
+    }
+
+    std::vector<char> header;
+    uint32_t num_sources = source_files.size();
+    uint32_t reserved = 0;
+    uint64_t payload_size = payload.size();
+    uint64_t checksum = checksumFNV1a(payload.data(), payload.size());
+    appendBytes(header, PROFILE_MAGIC, sizeof(PROFILE_MAGIC));
+    appendBytes(header, &INSTRUMENT_PROFILE_VERSION, sizeof(uint32_t));
+    appendBytes(header, &PROFILE_BYTE_ORDER, sizeof(uint32_t));
+    appendBytes(header, &num_measurements, sizeof(uint32_t));
+    appendBytes(header, &num_bins, sizeof(uint32_t));
+    appendBytes(header, &num_sources, sizeof(uint32_t));
+    appendBytes(header, &reserved, sizeof(uint32_t));
+    appendBytes(header, &payload_size, sizeof(uint64_t));
+    appendBytes(header, &checksum, sizeof(uint64_t));
+
+    std::string temporary_path = path + ".tmp";
+    FILE *file = fopen(temporary_path.c_str(), "wb");
+    if (file == NULL) {
+        throw std::logic_error("Unable to write instrument profile: " + temporary_path);
+    }
+    bool written = fwrite(header.data(), 1, header.size(), file) == header.size()
+        && fwrite(payload.data(), 1, payload.size(), file) == payload.size();
+    if (fclose(file) != 0 || !written || rename(temporary_path.c_str(), path.c_str()) != 0) {
+        remove(temporary_path.c_str());
+        throw std::logic_error("Unable to write instrument profile: " + path);
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Load the compiled instrument profile at path (memory-mapped). Throws if the file is not a valid
+// profile of the current version, if its checksum does not match, or if it is stale.
+//--------------------------------------------------------------------------------------------------
+void InstrumentProfile::load(const std::string &path) {
+    int file_descriptor = open(path.c_str(), O_RDONLY);
+    if (file_descriptor < 0) {
+        throw std::logic_error("Unable to open instrument profile: " + path + " (build it with build_profile.exe)");
+    }
+    struct stat file_status;
+    if (fstat(file_descriptor, &file_status) != 0 || (size_t)file_status.st_size < PROFILE_HEADER_SIZE) {
+        close(file_descriptor);
+        throw std::logic_error("Invalid instrument profile: " + path);
+    }
+    size_t file_size = file_status.st_size;
+    void *address = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    close(file_descriptor);
+    if (address == MAP_FAILED) {
+        throw std::logic_error("Unable to map instrument profile: " + path);
+    }
+    const char *data = (const char*)address;
+
+    try {
+        // Header
+        char magic[8];
+        uint32_t version, byte_order, num_measurements, num_bins, num_sources, reserved;
+        uint64_t payload_size, checksum;
+        size_t offset = 0;
+        readBytes(data, PROFILE_HEADER_SIZE, offset, magic, sizeof(magic), path);
+        readBytes(data, PROFILE_HEADER_SIZE, offset, &version, sizeof(uint32_t), path);
+        readBytes(data, PROFILE_HEADER_SIZE, offset, &byte_order, sizeof(uint32_t), path);
+        readBytes(data, PROFILE_HEADER_SIZE, offset, &num_measurements, sizeof(uint32_t), path);
+        readBytes(data, PROFILE_HEADER_SIZE, offset, &num_bins, sizeof(uint32_t), path);
+        readBytes(data, PROFILE_HEADER_SIZE, offset, &num_sources, sizeof(uint32_t), path);
+        readBytes(data, PROFILE_HEADER_SIZE, offset, &reserved, sizeof(uint32_t), path);
+        readBytes(data, PROFILE_HEADER_SIZE, offset, &payload_size, sizeof(uint64_t), path);
+        readBytes(data, PROFILE_HEADER_SIZE, offset, &checksum, sizeof(uint64_t), path);
+
+        if (memcmp(magic, PROFILE_MAGIC, sizeof(magic)) != 0 || byte_order != PROFILE_BYTE_ORDER) {
+            throw std::logic_error("Invalid instrument profile: " + path);
+        }
+        if (version != INSTRUMENT_PROFILE_VERSION) {
+            std::ostringstream error_message;
+            error_message << "Instrument profile " << path << " has version " << version << " (expected "
+                << INSTRUMENT_PROFILE_VERSION << "); rebuild it with build_profile.exe";
+            throw std::logic_error(error_message.str());
+        }
+        const char *payload = data + PROFILE_HEADER_SIZE;
+        if (payload_size != file_size - PROFILE_HEADER_SIZE) {
+            throw std::logic_error("Corrupt instrument profile (truncated): " + path);
+        }
+        if (checksumFNV1a(payload, payload_size) != checksum) {
+            throw std::logic_error("Corrupt instrument profile (checksum mismatch): " + path);
+        }
+
+        // Payload
+        if ((uint64_t)num_bins*(4 + 2*(uint64_t)num_measurements)*sizeof(double) > payload_size) {
+            throw std::logic_error("Corrupt instrument profile (truncated): " + path);
+        }
+        offset = 0;
+        energy_bins.resize(num_bins);
+        icrp_factors.resize(num_bins);
+        initial_spectrum.resize(num_bins);
+        normalized_response.resize(num_bins);
+        readBytes(payload, payload_size, offset, energy_bins.data(), sizeof(double)*num_bins, path);
+        readBytes(payload, payload_size, offset, icrp_factors.data(), sizeof(double)*num_bins, path);
+        readBytes(payload, payload_size, offset, initial_spectrum.data(), sizeof(double)*num_bins, path);
+        readBytes(payload, payload_size, offset, normalized_response.data(), sizeof(double)*num_bins, path);
+
+        // The response & its transpose are copied from the file as they are (both are 8-byte aligned
+        // within the mapping, as the header & all preceding arrays are multiples of 8 bytes)
+        size_t response_size = sizeof(double)*num_measurements*num_bins;
+        nns_response.resize(num_measurements, num_bins);
+        nns_response.assign((const double*)(payload + offset), (const double*)(payload + offset + response_size));
+        offset += 2*response_size;
+
+        source_files.clear();
+        for (uint32_t i_file = 0; i_file < num_sources; i_file++) {
+            SourceFile source_file;
+            uint32_t path_length;
+            readBytes(payload, payload_size, offset, &source_file.size, sizeof(int64_t), path);
+            readBytes(payload, payload_size, offset, &source_file.modification_time, sizeof(int64_t), path);
+            readBytes(payload, payload_size, offset, &path_length, sizeof(uint32_t), path);
+            if (path_length > payload_size - offset) {
+                throw std::logic_error("Corrupt instrument profile (truncated): " + path);
+            }
+            source_file.path.assign(payload + offset, path_length);
+            offset += path_length;
+            source_files.push_back(source_file);
+        }
+    }
+    catch (...) {
+        munmap(address, file_size);
+        throw;
+    }
+    munmap(address, file_size);
+
+    // Reject stale profiles (CSV files modified since the profile was built). CSV files that no
+    // longer exist (or were recorded relative to another directory) cannot be checked.
+    for (size_t i_file = 0; i_file < source_files.size(); i_file++) {
+        int64_t size, modification_time;
+        if (!getFileStatus(source_files[i_file].path, size, modification_time)) {
+            std::cerr << "Warning: cannot check whether instrument profile " << path << " is stale: "
+                << source_files[i_file].path << ", from which it was built, was not found\n";
+        }
+        else if (size != source_files[i_file].size || modification_time != source_files[i_file].modification_time) {
+            throw std::logic_error("Stale instrument profile: " + path + " (" + source_files[i_file].path
+                + " has changed since it was built); rebuild it with build_profile.exe");
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Check that the profile was built from the CSV files specified in settings (path_energy_bins,
+// path_system_response, path_input_spectrum & path_icrp_factors), so that changing one of them
+// (e.g. the response of another NNS) is not silently ignored. Paths are compared once normalized.
+// path is the pathname of the profile (for messages).
+//--------------------------------------------------------------------------------------------------
+void InstrumentProfile::checkSourceFiles(const UnfoldingSettings &settings, const std::string &path) const {
+    const int num_sources = 4;
+    std::string setting_names[num_sources] = {"path_energy_bins", "path_system_response",
+        "path_input_spectrum", "path_icrp_factors"};
+    std::string setting_paths[num_sources] = {settings.path_energy_bins, settings.path_system_response,
+        settings.path_input_spectrum, settings.path_icrp_factors};
+
+    if (source_files.size() != (size_t)num_sources) {
+        throw std::logic_error("Instrument profile " + path + " does not record the "
+            + std::to_string(num_sources) + " CSV files it was built from; rebuild it with build_profile.exe");
+    }
+    for (int i_source = 0; i_source < num_sources; i_source++) {
+        if (normalizePath(setting_paths[i_source]) != normalizePath(source_files[i_source].path)) {
+            throw std::logic_error("Instrument profile " + path + " was built from "
+                + source_files[i_source].path + ", but " + setting_names[i_source] + " is "
+                + setting_paths[i_source] + "; rebuild it with build_profile.exe (or unset path_instrument_profile)");
+        }
+    }
+}
+
+//==================================================================================================
+// Fill profile from the compiled instrument profile path_instrument_profile if it is set (which must
+// have been built from the CSV files specified in settings), or else from those CSV files
+//==================================================================================================
+void readInstrumentProfile(const UnfoldingSettings &settings, InstrumentProfile &profile) {
+    if (settings.path_instrument_profile.empty()) {
+        profile.readCSV(settings);
+    }
+    else {
+        profile.load(settings.path_instrument_profile);
+        profile.checkSourceFiles(settings, settings.path_instrument_profile);
+    }
+}
@@ -0,0 +1,66 @@
+//**************************************************************************************************
+// The functions included in this module report the state of an unfolding algorithm at selected
+// iterations, so that trends can be calculated from a single run of the algorithm.
+//**************************************************************************************************
+
+#include "iteration_observer.h"
+
+#include <functional>
+#include <stdexcept>
+#include <stdlib.h>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Observe the algorithm after the provided numbers of iterations, which must be >= 1 and strictly
+// ascending.
+//--------------------------------------------------------------------------------------------------
+IterationObserver::IterationObserver(const std::vector<int> &checkpoints, 
+    const IterationCallback &callback) 
+{
+    for (size_t i_check = 0; i_check < checkpoints.size(); i_check++) {
+        if (checkpoints[i_check] < 1 || (i_check > 0 && checkpoints[i_check] <= checkpoints[i_check-1])) {
+            throw std::logic_error("Iteration checkpoints must be >= 1 and strictly ascending");
+        }
+    }
+    this->checkpoints = checkpoints;
+    this->callback = callback;
+    next_checkpoint = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Prepare observing a new run of the algorithm (from its first checkpoint)
+//--------------------------------------------------------------------------------------------------
+void IterationObserver::reset() {
+    next_checkpoint = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the last checkpoint, i.e. the # of iterations the algorithm must run to reach all
+// checkpoints (0 if there are none)
+//--------------------------------------------------------------------------------------------------
+int IterationObserver::lastCheckpoint() const {
+    if (checkpoints.empty()) {
+        return 0;
+    }
+    return checkpoints.back();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return true if the callback was invoked (and returned) for every checkpoint
+//--------------------------------------------------------------------------------------------------
+bool IterationObserver::complete() const {
+    return next_checkpoint == checkpoints.size();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Invoke the callback for the checkpoints that were not reached, with the final state of the
+// algorithm
+//--------------------------------------------------------------------------------------------------
+void IterationObserver::notifyRemaining(const std::vector<double> &spectrum, 
+    const MlemWorkspace &workspace) 
+{
+    while (next_checkpoint < checkpoints.size()) {
+        callback(checkpoints[next_checkpoint], spectrum, workspace);
+        next_checkpoint++;
+    }
+}
@@ -0,0 +1,274 @@
+//**************************************************************************************************
+// The functions included in this module perform MLEM-style unfolding (MLEM, MLEM-STOP, MAP) on a
+// batch of measurement sets at once. Every sample follows exactly the same sequence of operations
+// as the single-sample algorithms in physics_calculations, so results are identical; only the
+// order in which samples are processed differs.
+//**************************************************************************************************
+
+#include "mlem_batch.h"
+#include "physics_calculations.h"
+#include "projection_kernels.h"
+
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+enum BatchAlgorithm {
+    BATCH_MLEM,
+    BATCH_MLEMSTOP,
+    BATCH_MAP
+};
+
+//--------------------------------------------------------------------------------------------------
+// Create a batch able to hold up to capacity samples of the given dimensions. All memory used by
+// the batched algorithms is allocated here.
+//--------------------------------------------------------------------------------------------------
+MlemBatch::MlemBatch(int num_measurements, int num_bins, int capacity) {
+    if (num_measurements < 1 || num_bins < 1 || capacity < 1) {
+        std::ostringstream error_message;
+        error_message << "Invalid batch dimensions: " << capacity << " samples of " << num_measurements 
+            << " measurements x " << num_bins << " energy bins";
+        throw std::logic_error(error_message.str());
+    }
+    int block = getProjectionBatchBlock();
+
+    this->num_measurements = num_measurements;
+    this->num_bins = num_bins;
+    this->capacity = capacity;
+    this->stride = ((capacity + block - 1) / block) * block;
+    this->num_samples = 0;
+    this->num_active = 0;
+
+    spectra.assign(num_bins*stride, 0);
+    measurements.assign(num_measurements*stride, 0);
+    estimates.assign(num_measurements*stride, 0);
+    ratios.assign(num_measurements*stride, 0);
+    corrections.assign(num_bins*stride, 0);
+    energy_corrections.assign(num_bins*stride, 0);
+    column_j_threshold.assign(stride, 0);
+    column_j_factor.assign(stride, 0);
+    column_sample.assign(stride, 0);
+
+    result_spectra.assign(capacity, std::vector<double>(num_bins, 0));
+    num_iterations.assign(capacity, 0);
+    j_factors.assign(capacity, 0);
+    converged.assign(capacity, 0);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Start a new batch of num_samples samples (<= capacity). Each sample must then be set with
+// setSample before running one of the batched algorithms.
+//--------------------------------------------------------------------------------------------------
+void MlemBatch::reset(int num_samples) {
+    if (num_samples < 0 || num_samples > capacity) {
+        std::ostringstream error_message;
+        error_message << "Cannot fit " << num_samples << " samples in a batch of capacity " << capacity;
+        throw std::logic_error(error_message.str());
+    }
+    this->num_samples = num_samples;
+    this->num_active = num_samples;
+    for (int i_samp = 0; i_samp < num_samples; i_samp++) {
+        column_sample[i_samp] = i_samp;
+        column_j_factor[i_samp] = 0;
+        num_iterations[i_samp] = 0;
+        j_factors[i_samp] = 0;
+        converged[i_samp] = 0;
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Set the measurements and initial spectrum of a sample. The J threshold is only used by
+// MLEM-STOP.
+//--------------------------------------------------------------------------------------------------
+void MlemBatch::setSample(int i_samp, std::vector<double> &sample_measurements, 
+    std::vector<double> &initial_spectrum, double j_threshold) 
+{
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        measurements[i_meas*stride + i_samp] = sample_measurements[i_meas];
+    }
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        spectra[i_bin*stride + i_samp] = initial_spectrum[i_bin];
+    }
+    column_j_threshold[i_samp] = j_threshold;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Store the results of the sample held in column i_col, and remove it from the active columns by
+// moving the last active column in its place. Columns beyond i_col are not affected, so columns
+// should be visited from last to first when finishing several in one pass.
+//--------------------------------------------------------------------------------------------------
+void MlemBatch::finishColumn(int i_col, int num_iterations, bool converged) {
+    int i_samp = column_sample[i_col];
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        result_spectra[i_samp][i_bin] = spectra[i_bin*stride + i_col];
+    }
+    this->num_iterations[i_samp] = num_iterations;
+    this->j_factors[i_samp] = column_j_factor[i_col];
+    this->converged[i_samp] = converged;
+
+    // Only the values carried between iterations need to be moved
+    int i_last = num_active-1;
+    if (i_col != i_last) {
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            spectra[i_bin*stride + i_col] = spectra[i_bin*stride + i_last];
+        }
+        for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+            measurements[i_meas*stride + i_col] = measurements[i_meas*stride + i_last];
+        }
+        column_j_threshold[i_col] = column_j_threshold[i_last];
+        column_j_factor[i_col] = column_j_factor[i_last];
+        column_sample[i_col] = column_sample[i_last];
+    }
+    num_active--;
+}
+
+//==================================================================================================
+// Calculate the J factor of the sample held in column i_col (see calculateJFactor)
+//==================================================================================================
+static double calculateColumnJFactor(MlemBatch &batch, int i_col) {
+    double numerator = 0;
+    double denominator = 0;
+    for (int i_meas = 0; i_meas < batch.num_measurements; i_meas++) {
+        double measurement = batch.measurements[i_meas*batch.stride + i_col];
+        double estimate = batch.estimates[i_meas*batch.stride + i_col];
+        numerator += pow(measurement - estimate,2);
+        denominator += estimate;
+    }
+
+    return numerator/denominator;
+}
+
+//==================================================================================================
+// Check whether any ratio of the sample held in column i_col is outside the tolerance (error)
+//==================================================================================================
+static bool columnRatioOutsideError(MlemBatch &batch, int i_col, double error) {
+    for (int i_meas = 0; i_meas < batch.num_measurements; i_meas++) {
+        double ratio = batch.ratios[i_meas*batch.stride + i_col];
+        if (ratio >= (1+error) || ratio <= (1-error)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//==================================================================================================
+// Advance all samples of the batch together until each meets its stopping criterion (or cutoff).
+// Per sample, the operations are those of runMLEM, runMLEMSTOP and runMAP respectively.
+//==================================================================================================
+static int runBatch(BatchAlgorithm algorithm, double beta, MapPrior prior, int cutoff, double error,
+    const ResponseMatrix &nns_response, std::vector<double> &normalized_response, MlemBatch &batch)
+{
+    if (nns_response.num_measurements() != batch.num_measurements || nns_response.num_bins() != batch.num_bins) {
+        throw std::logic_error("Batch dimensions do not match the NNS response");
+    }
+    int num_measurements = batch.num_measurements;
+    int num_bins = batch.num_bins;
+    int stride = batch.stride;
+    double* spectra = batch.spectra.data();
+    double* measurements = batch.measurements.data();
+    double* estimates = batch.estimates.data();
+    double* ratios = batch.ratios.data();
+    double* corrections = batch.corrections.data();
+    double* energy_corrections = batch.energy_corrections.data();
+
+    for (int mlem_index = 0; mlem_index < cutoff && batch.num_active > 0; mlem_index++) {
+        int num_active = batch.num_active;
+
+        // Apply system matrix to the current spectral estimates to get MLEM-estimated data
+        forwardProjectBatch(nns_response, spectra, num_active, stride, estimates);
+
+        // Calculate ratio between each measured data point and corresponding MLEM-estimated data point
+        for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+            for (int i_col = 0; i_col < num_active; i_col++) {
+                int index = i_meas*stride + i_col;
+                ratios[index] = measurements[index]/estimates[index];
+            }
+        }
+
+        // Create the correction factors & apply them to get new spectral estimates
+        if (algorithm == BATCH_MAP) {
+            backProjectBatch(nns_response, ratios, num_active, stride, NULL, corrections);
+            for (int i_col = 0; i_col < num_active; i_col++) {
+                calculateEnergyCorrection(prior, beta, num_bins, spectra+i_col, energy_corrections+i_col, stride);
+            }
+            for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+                for (int i_col = 0; i_col < num_active; i_col++) {
+                    int index = i_bin*stride + i_col;
+                    spectra[index] = spectra[index]*corrections[index]/(normalized_response[i_bin]+energy_corrections[index]);
+                }
+            }
+        }
+        else {
+            backProjectBatch(nns_response, ratios, num_active, stride, normalized_response.data(), corrections);
+            for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+                for (int i_col = 0; i_col < num_active; i_col++) {
+                    int index = i_bin*stride + i_col;
+                    spectra[index] = (spectra[index]*corrections[index]);
+                }
+            }
+        }
+
+        // Remove samples that met their stopping criterion. Visit columns from last to first, as
+        // finishing a column moves the last active column in its place
+        for (int i_col = num_active-1; i_col >= 0; i_col--) {
+            bool stop;
+            if (algorithm == BATCH_MLEMSTOP) {
+                batch.column_j_factor[i_col] = calculateColumnJFactor(batch, i_col);
+                stop = batch.column_j_factor[i_col] <= batch.column_j_threshold[i_col];
+            }
+            else {
+                stop = !columnRatioOutsideError(batch, i_col, error);
+            }
+            if (stop) {
+                batch.finishColumn(i_col, mlem_index, true);
+            }
+        }
+    }
+
+    // Remaining samples reached the cutoff. For MLEM-STOP, this means the J threshold was not met
+    // (runMLEMSTOP throws in this case)
+    while (batch.num_active > 0) {
+        int i_col = batch.num_active-1;
+        bool converged = true;
+        if (algorithm == BATCH_MLEMSTOP && batch.column_j_factor[i_col] > batch.column_j_threshold[i_col]) {
+            converged = false;
+        }
+        batch.finishColumn(i_col, cutoff, converged);
+    }
+
+    return 1;
+}
+
+//==================================================================================================
+// Perform the MLEM algorithm (see runMLEM) on every sample of the batch. Unfolded spectra &
+// iteration counts are stored per sample in the batch.
+//==================================================================================================
+int runMLEMBatch(int cutoff, double error, const ResponseMatrix &nns_response, 
+    std::vector<double> &normalized_response, MlemBatch &batch)
+{
+    return runBatch(BATCH_MLEM, 0, PRIOR_MRP, cutoff, error, nns_response, normalized_response, batch);
+}
+
+//==================================================================================================
+// Perform the MLEM-STOP algorithm (see runMLEMSTOP) on every sample of the batch, using the J
+// threshold set for each sample. Instead of throwing, samples that reach the cutoff before their J
+// threshold are flagged as not converged.
+//==================================================================================================
+int runMLEMSTOPBatch(int cutoff, const ResponseMatrix &nns_response, 
+    std::vector<double> &normalized_response, MlemBatch &batch)
+{
+    return runBatch(BATCH_MLEMSTOP, 0, PRIOR_MRP, cutoff, 0, nns_response, normalized_response, batch);
+}
+
+//==================================================================================================
+// Perform the MAP algorithm (see runMAP) on every sample of the batch
+//==================================================================================================
+int runMAPBatch(double beta, const std::string &prior, int cutoff, double error, 
+    const ResponseMatrix &nns_response, std::vector<double> &normalized_response, MlemBatch &batch)
+{
+    MapPrior map_prior = parseMapPrior(prior);
+    return runBatch(BATCH_MAP, beta, map_prior, cutoff, error, nns_response, normalized_response, batch);
+}
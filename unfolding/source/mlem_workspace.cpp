@@ -0,0 +1,64 @@
+//**************************************************************************************************
+// The functions included in this module manage the working memory used by the MLEM-style unfolding
+// algorithms.
+//**************************************************************************************************
+
+#include "mlem_workspace.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Default constructor for MlemWorkspace (empty workspace)
+//--------------------------------------------------------------------------------------------------
+MlemWorkspace::MlemWorkspace() {
+    num_measurements = 0;
+    num_bins = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Create a workspace sized for the given number of measurements and energy bins
+//--------------------------------------------------------------------------------------------------
+MlemWorkspace::MlemWorkspace(int num_measurements, int num_bins) {
+    this->num_measurements = 0;
+    this->num_bins = 0;
+    resize(num_measurements, num_bins);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Set the dimensions of the workspace. All values are reset to zero.
+//--------------------------------------------------------------------------------------------------
+void MlemWorkspace::resize(int num_measurements, int num_bins) {
+    if (num_measurements < 0 || num_bins < 0) {
+        std::ostringstream error_message;
+        error_message << "Invalid workspace dimensions: " << num_measurements << " measurements x "
+            << num_bins << " energy bins";
+        throw std::logic_error(error_message.str());
+    }
+    this->num_measurements = num_measurements;
+    this->num_bins = num_bins;
+
+    mlem_ratio.assign(num_measurements, 0);
+    mlem_correction.assign(num_bins, 0);
+    mlem_estimate.assign(num_measurements, 0);
+    energy_correction.assign(num_bins, 0);
+    accel_spectrum_1.assign(num_bins, 0);
+    accel_spectrum_2.assign(num_bins, 0);
+    sampled_measurements.assign(num_measurements, 0);
+    sampled_spectrum.assign(num_bins, 0);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Complain if the workspace was not sized for the given number of measurements and energy bins
+//--------------------------------------------------------------------------------------------------
+void MlemWorkspace::checkDimensions(int num_measurements, int num_bins) const {
+    if (num_measurements != this->num_measurements || num_bins != this->num_bins) {
+        std::ostringstream error_message;
+        error_message << "Workspace dimensions (" << this->num_measurements << " measurements x "
+            << this->num_bins << " energy bins) do not match the unfolding problem ("
+            << num_measurements << " measurements x " << num_bins << " energy bins)";
+        throw std::logic_error(error_message.str());
+    }
+}
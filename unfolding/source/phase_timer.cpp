@@ -0,0 +1,179 @@
+//**************************************************************************************************
+// The functions & classes included in this module measure the resources (wall time, CPU time, peak
+// memory) used by the phases of the applications, and save them for monitoring (JSON file).
+//**************************************************************************************************
+
+#include "phase_timer.h"
+
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/resource.h>
+#include <time.h>
+#include <vector>
+
+//==================================================================================================
+// Return the CPU time [s] used so far by the process (all threads)
+//==================================================================================================
+double getProcessCpuSeconds() {
+    timespec cpu_time;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_time) != 0) {
+        return 0;
+    }
+    return cpu_time.tv_sec + cpu_time.tv_nsec*1e-9;
+}
+
+//==================================================================================================
+// Return the CPU time [s] used so far by the calling thread
+//==================================================================================================
+double getThreadCpuSeconds() {
+    timespec cpu_time;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_time) != 0) {
+        return 0;
+    }
+    return cpu_time.tv_sec + cpu_time.tv_nsec*1e-9;
+}
+
+//==================================================================================================
+// Return the peak resident set size [kB] of the process so far (all threads)
+//==================================================================================================
+long getPeakRssKb() {
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return usage.ru_maxrss; // kB on Linux
+}
+
+//==================================================================================================
+// Return a string as a JSON string (quoted, with quotes, backslashes & control characters escaped)
+//==================================================================================================
+std::string toJSONString(const std::string &value) {
+    std::string result = "\"";
+    for (size_t i_char = 0; i_char < value.size(); i_char++) {
+        char c = value[i_char];
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        }
+        else if ((unsigned char)c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            result += escaped;
+        }
+        else {
+            result += c;
+        }
+    }
+    return result + "\"";
+}
+
+//--------------------------------------------------------------------------------------------------
+// Add a phase
+//--------------------------------------------------------------------------------------------------
+void PerformanceLog::add(const PhaseRecord &record) {
+    phases.push_back(record);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the (first) phase with the given name, or NULL if there is none
+//--------------------------------------------------------------------------------------------------
+PhaseRecord* PerformanceLog::find(const std::string &name) {
+    for (size_t i_phase = 0; i_phase < phases.size(); i_phase++) {
+        if (phases[i_phase].name == name) {
+            return &phases[i_phase];
+        }
+    }
+    return NULL;
+}
+const PhaseRecord* PerformanceLog::find(const std::string &name) const {
+    return const_cast<PerformanceLog*>(this)->find(name);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Save the phases as a JSON object, along with the program, the git commit, the date, the
+// irradiation conditions & the # of threads of the run
+//--------------------------------------------------------------------------------------------------
+void PerformanceLog::saveJSON(const std::string &path, const std::string &program,
+    const std::string &irradiation_conditions, int num_threads) const
+{
+    std::ofstream output(path);
+    if (!output.is_open()) {
+        throw std::logic_error("Unable to open file: " + path);
+    }
+    auto t = std::time(nullptr);
+    auto tm = *std::localtime(&t);
+    std::ostringstream date;
+    date << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
+
+    output << std::setprecision(9);
+    output << "{\n";
+    output << "  \"program\": " << toJSONString(program) << ",\n";
+    output << "  \"git_commit\": " << toJSONString(GIT_COMMIT) << ",\n";
+    output << "  \"date\": " << toJSONString(date.str()) << ",\n";
+    output << "  \"irradiation_conditions\": " << toJSONString(irradiation_conditions) << ",\n";
+    output << "  \"num_threads\": " << num_threads << ",\n";
+    output << "  \"total_wall_seconds\": " << totalWallSeconds() << ",\n";
+    output << "  \"process_peak_rss_kb\": " << peakRssKb() << ",\n";
+    output << "  \"phases\": [\n";
+    for (size_t i_phase = 0; i_phase < phases.size(); i_phase++) {
+        const PhaseRecord &phase = phases[i_phase];
+        output << "    {\"name\": " << toJSONString(phase.name) << ", \"threads\": " << phase.num_threads
+            << ", \"wall_seconds\": " << phase.wall_seconds << ", \"cpu_seconds\": " << phase.cpu_seconds
+            << ", \"process_peak_rss_kb\": " << phase.peak_rss_kb << ", \"iterations\": "
+            << phase.num_iterations << ", \"samples\": " << phase.num_samples
+            << ", \"samples_per_second\": " << phase.samplesPerSecond() << "}"
+            << (i_phase+1 < phases.size() ? "," : "") << "\n";
+    }
+    output << "  ]\n";
+    output << "}\n";
+}
+
+//--------------------------------------------------------------------------------------------------
+// Start timing a phase that runs on num_threads threads (incl. the calling thread)
+//--------------------------------------------------------------------------------------------------
+PhaseTimer::PhaseTimer(PerformanceLog *log, const std::string &name, int num_threads) {
+    this->log = log;
+    record.name = name;
+    record.num_threads = num_threads;
+    running = log != NULL;
+    if (running) {
+        cpu_start = getCpuSeconds();
+        wall_start = std::chrono::steady_clock::now();
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// End the phase (if not already ended)
+//--------------------------------------------------------------------------------------------------
+PhaseTimer::~PhaseTimer() {
+    stop();
+}
+
+//--------------------------------------------------------------------------------------------------
+// End the phase, and add it to the log. Later calls have no effect.
+//--------------------------------------------------------------------------------------------------
+void PhaseTimer::stop() {
+    if (!running) {
+        return;
+    }
+    running = false;
+    record.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    record.cpu_seconds = getCpuSeconds() - cpu_start;
+    record.peak_rss_kb = getPeakRssKb();
+    log->add(record);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the CPU time [s] the phase is charged: that of the process if it runs on several threads,
+// that of the calling thread otherwise
+//--------------------------------------------------------------------------------------------------
+double PhaseTimer::getCpuSeconds() const {
+    return record.num_threads > 1 ? getProcessCpuSeconds() : getThreadCpuSeconds();
+}
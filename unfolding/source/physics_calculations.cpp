@@ -4,21 +4,20 @@
 //**************************************************************************************************
 
 #include "physics_calculations.h"
+#include "custom_classes.h"
+#include "projection_kernels.h"
 
 #include <iostream>
 #include <iomanip>
 #include <fstream>
 #include <sstream>
-#include <random>
+#include <stdexcept>
 #include <cmath>
+#include <numeric>
 #include <stdlib.h>
 #include <algorithm>
 #include <vector>
 
-// mt19937 is a random number generator class based on the Mersenne Twister algorithm
-// Create an mt19937 object, called mrand, that is seeded with the current time in seconds
-std::mt19937 mrand(std::time(0));
-
 //==================================================================================================
 // Process Measurements: obtain sample mean measured value and standard error of sample mean for 
 // each shell
@@ -91,30 +90,6 @@ double getSampleMeanStandardErrorD(std::vector<double>& data, double mean) {
     return sample_mean_standard_error;
 }
 
-//==================================================================================================
-// Return a 1D normalized vector of a system matrix used in MLEM-style reconstruction algorithms
-//==================================================================================================
-std::vector<double> normalizeResponse(int num_bins, int num_measurements, std::vector<std::vector<double>>& system_response)
-{
-    std::vector<double> normalized_vector;
-    // Create the normalization factors to be applied to MLEM-estimated spectral values:
-    //  - each element of f stores the sum of 8 elements of the transpose system (response)
-    //    matrix. The 8 elements correspond to the relative contributions of each MLEM-estimated
-    //    data point to the MLEM-estimated spectral value.
-    for(int i_bin = 0; i_bin < num_bins; i_bin++)
-    {
-        double temp_value = 0;
-        for(int i_meas = 0; i_meas < num_measurements; i_meas++)
-        {
-            temp_value += system_response[i_meas][i_bin];
-        }
-        normalized_vector.push_back(temp_value);
-    }
-
-    return normalized_vector;
-}
-
-
 //==================================================================================================
 // Normalize a vector of doubles such that the largest value in the vector is set as one. The vector
 // passed to this function is unaffected; a new normalized vector is returned.
@@ -140,23 +115,10 @@ std::vector<double> normalizeVector(std::vector<double>& unnormalized_vector)
 }
 
 
-//==================================================================================================
-// Return a poisson_distribution object, d that can be sampled from
-//  - accept a parameter 'lamda', that is used as the mean & std. dev of the poisson distribution
-//  - use the 'mrand' generator as the random number generator for the distribution
-//==================================================================================================
-double poisson(double lambda)
-{
-    std::poisson_distribution<int> d(lambda); // initialization
-
-    return d(mrand); // sample
-}
-
-
 //==================================================================================================
 // Calculate the root-mean-square deviation of a vector of values from a "true" value.
 //==================================================================================================
-double calculateRMSEstimator(int size, std::vector<double> &true_vector, std::vector<double> &estimate_vector) {
+double calculateRMSEstimator(int size, std::vector<double> &true_vector, const std::vector<double> &estimate_vector) {
     double sum_sq_diff = 0;
 
     // Sum the square difference of poisson sampled values from the true value
@@ -173,7 +135,7 @@ double calculateRMSEstimator(int size, std::vector<double> &true_vector, std::ve
 //==================================================================================================
 // Calculate the normalized root mean square deviation (NRMSD) from Gaitanis et al.
 //==================================================================================================
-double calculateNRMSD(int size, std::vector<double> &true_vector, std::vector<double> &estimate_vector) {
+double calculateNRMSD(int size, std::vector<double> &true_vector, const std::vector<double> &estimate_vector) {
     double sum_sq_diff = 0;
 
     // Sum the square difference of poisson sampled values from the true value
@@ -192,7 +154,7 @@ double calculateNRMSD(int size, std::vector<double> &true_vector, std::vector<do
 //==================================================================================================
 // Calculate chi-square from Gaitanis et al.
 //==================================================================================================
-double calculateChiSquaredG(int size, std::vector<double> &true_vector, std::vector<double> &estimate_vector) {
+double calculateChiSquaredG(int size, std::vector<double> &true_vector, const std::vector<double> &estimate_vector) {
     double running_sum = 0;
 
     // Sum the square difference of poisson sampled values from the true value
@@ -250,7 +212,7 @@ int calculateRMSD_vector(int num_samples, std::vector<double> &true_vector,
 // Calculate the total ambient dose equivalent rate associated with the provided spectrum using
 // weighting factors (binned by energy) provided in ICRP 74.
 //==================================================================================================
-double calculateDose(int num_bins, std::vector<double> &spectrum, std::vector<double> &icrp_factors) {
+double calculateDose(int num_bins, const std::vector<double> &spectrum, std::vector<double> &icrp_factors) {
     double ambient_dose_eq = 0;
     int s_to_hr = 3600;
     double msv_to_psv = 1e-9;
@@ -284,7 +246,7 @@ double calculateTotalCharge(int num_measurements, std::vector<double> measuremen
 //==================================================================================================
 // Calculate the total neutron flux of a neutron flux spectrum
 //==================================================================================================
-double calculateTotalFlux(int num_bins, std::vector<double> &spectrum) {
+double calculateTotalFlux(int num_bins, const std::vector<double> &spectrum) {
     double total_flux = 0;
 
     for (int i_bin=0; i_bin < num_bins; i_bin++) {
@@ -298,7 +260,7 @@ double calculateTotalFlux(int num_bins, std::vector<double> &spectrum) {
 //==================================================================================================
 // Calculate the total energy correction for the MAP algorithm
 //==================================================================================================
-double calculateTotalEnergyCorrection(std::vector<double> &energy_correction) {
+double calculateTotalEnergyCorrection(const std::vector<double> &energy_correction) {
     double total_energy_correction = 0;
     for (auto& n : energy_correction)
         total_energy_correction += n;
@@ -311,7 +273,7 @@ double calculateTotalEnergyCorrection(std::vector<double> &energy_correction) {
 // Calculate the maximum deviation from 1.0 among the ratio between reconstructed CPS measurements
 // measured CPS measurements
 //==================================================================================================
-double calculateMaxRatio(int num_measurements, std::vector<double> &mlem_ratio) {
+double calculateMaxRatio(int num_measurements, const std::vector<double> &mlem_ratio) {
     double max_mlem_ratio = 0;
     for (int i=0; i < num_measurements; i++) {
         if (abs(1.0-mlem_ratio[i]) > max_mlem_ratio) {
@@ -326,7 +288,7 @@ double calculateMaxRatio(int num_measurements, std::vector<double> &mlem_ratio)
 // Calculate the average deviation from 1.0 among the ratio between reconstructed CPS measurements
 // measured CPS measurements
 //==================================================================================================
-double calculateAvgRatio(int num_measurements, std::vector<double> &mlem_ratio) {
+double calculateAvgRatio(int num_measurements, const std::vector<double> &mlem_ratio) {
     double avg_mlem_ratio = 0.0;
     for (int i=0; i < num_measurements; i++) {
         avg_mlem_ratio += abs(1.0-mlem_ratio[i]);
@@ -437,7 +399,7 @@ double calculateSourceStrength(int num_bins, std::vector<double> &spectrum, int
 // is used in the MLEM-STOP approach as a stopping criterion when J=1.
 //==================================================================================================
 double calculateJFactor(int num_measurements, std::vector<double> &measurements,
-    std::vector<double> &mlem_estimate) 
+    const std::vector<double> &mlem_estimate) 
 {
     double numerator = 0;
     double denominator = 0;
@@ -457,7 +419,7 @@ double calculateJFactor(int num_measurements, std::vector<double> &measurements,
 // reconstructions. 
 //==================================================================================================
 double calculateJFactor2(int num_measurements, std::vector<double> &measurements,
-    std::vector<double> &mlem_estimate) 
+    const std::vector<double> &mlem_estimate) 
 {
     double numerator = 0;
     double denominator = 0;
@@ -478,7 +440,7 @@ double calculateJFactor2(int num_measurements, std::vector<double> &measurements
 // Calculate the noise figure of merit in a spectrum. The noise is taken to be the relative
 // standard deviation of spectral values in a region defined by the start and end energy bins
 //==================================================================================================
-double calculateNoise(int start_bin, int end_bin, std::vector<double>& spectrum) {
+double calculateNoise(int start_bin, int end_bin, const std::vector<double>& spectrum) {
     double mean = 0.0;
     for (int i_bin=start_bin; i_bin<=end_bin; i_bin++) {
         mean += spectrum[i_bin];
@@ -498,8 +460,8 @@ double calculateNoise(int start_bin, int end_bin, std::vector<double>& spectrum)
 //==================================================================================================
 // Calculate the reduced Chi-squared parameter, promulgated by T. D. Jackson in his 2015 PhD thesis.
 //==================================================================================================
-double calculateChiSquared(int i_num, int num_bins, int num_measurements, std::vector<double> &spectrum, 
-    std::vector<double> &measurements, std::vector<double> &mlem_ratio) 
+double calculateChiSquared(int i_num, int num_bins, int num_measurements, const std::vector<double> &spectrum, 
+    std::vector<double> &measurements, const std::vector<double> &mlem_ratio) 
 {
     std::vector<double> mlem_estimate;
 
@@ -520,6 +482,87 @@ double calculateChiSquared(int i_num, int num_bins, int num_measurements, std::v
     return running_sum / (num_measurements-1);
 }
 
+//==================================================================================================
+// Convert the name of a parameter of interest (unfold_trend) into the corresponding TrendParameter
+// value. Done once per trend, so that the parameters are not compared as strings at every
+// checkpoint.
+//==================================================================================================
+TrendParameter parseTrendParameter(const std::string &parameter) {
+    if (parameter == "total_fluence")
+        return TREND_TOTAL_FLUENCE;
+    else if (parameter == "total_dose")
+        return TREND_TOTAL_DOSE;
+    else if (parameter == "total_energy_correction")
+        return TREND_TOTAL_ENERGY_CORRECTION;
+    else if (parameter == "max_mlem_ratio")
+        return TREND_MAX_MLEM_RATIO;
+    else if (parameter == "avg_mlem_ratio")
+        return TREND_AVG_MLEM_RATIO;
+    else if (parameter == "j_factor")
+        return TREND_J_FACTOR;
+    else if (parameter == "j_factor2")
+        return TREND_J_FACTOR2;
+    else if (parameter == "noise")
+        return TREND_NOISE;
+    else if (parameter == "reduced_chi_squared")
+        return TREND_REDUCED_CHI_SQUARED;
+    else if (parameter == "rms")
+        return TREND_RMS;
+    else if (parameter == "nrmsd")
+        return TREND_NRMSD;
+    else if (parameter == "chi_squared_g")
+        return TREND_CHI_SQUARED_G;
+
+    throw std::logic_error("Unrecognized parameter of interest: " + parameter 
+        + ". Please refer to the README for allowed parameters"
+    );
+}
+
+//==================================================================================================
+// Return true if the parameter of interest compares the spectrum with a reference spectrum
+//==================================================================================================
+bool trendParameterNeedsReference(TrendParameter parameter) {
+    return parameter == TREND_RMS || parameter == TREND_NRMSD || parameter == TREND_CHI_SQUARED_G;
+}
+
+//==================================================================================================
+// Calculate a parameter of interest from the state of an unfolding algorithm (spectrum & workspace)
+// at the checkpoint of index i_num of a trend. ref_spectrum is only used by the parameters that
+// need a reference spectrum (see trendParameterNeedsReference).
+//==================================================================================================
+double calculateTrendParameter(TrendParameter parameter, int i_num, int num_measurements, int num_bins, 
+    std::vector<double> &measurements, const std::vector<double> &spectrum, 
+    const MlemWorkspace &workspace, std::vector<double> &icrp_factors, std::vector<double> &ref_spectrum)
+{
+    switch (parameter) {
+        case TREND_TOTAL_FLUENCE:
+            return calculateTotalFlux(num_bins,spectrum);
+        case TREND_TOTAL_DOSE:
+            return calculateDose(num_bins, spectrum, icrp_factors);
+        case TREND_TOTAL_ENERGY_CORRECTION:
+            return calculateTotalEnergyCorrection(workspace.energy_correction);
+        case TREND_MAX_MLEM_RATIO:
+            return calculateMaxRatio(num_measurements,workspace.mlem_ratio);
+        case TREND_AVG_MLEM_RATIO:
+            return calculateAvgRatio(num_measurements,workspace.mlem_ratio);
+        case TREND_J_FACTOR:
+            return calculateJFactor(num_measurements,measurements,workspace.mlem_estimate);
+        case TREND_J_FACTOR2:
+            return calculateJFactor2(num_measurements,measurements,workspace.mlem_estimate);
+        case TREND_NOISE:
+            return calculateNoise(15,30,spectrum);
+        case TREND_REDUCED_CHI_SQUARED:
+            return calculateChiSquared(i_num,num_bins,num_measurements,spectrum,measurements,workspace.mlem_ratio);
+        case TREND_RMS:
+            return calculateRMSEstimator(num_bins,ref_spectrum,spectrum);
+        case TREND_NRMSD:
+            return calculateNRMSD(num_bins,ref_spectrum,spectrum);
+        case TREND_CHI_SQUARED_G:
+            return calculateChiSquaredG(num_bins,ref_spectrum,spectrum);
+    }
+    throw std::logic_error("Unrecognized parameter of interest");
+}
+
 void calculateDerivatives(std::vector<double> &derivatives, int num_points, std::vector<int> &x_data, 
     std::vector<double> &y_data) 
 {
@@ -542,55 +585,38 @@ void calculateDerivatives(std::vector<double> &derivatives, int num_points, std:
 // Accept a series of measurements and an estimated input spectrum and perform the MLEM algorithm
 // until the true spectrum has been unfolded. Use the provided target error (error) and the maximum
 // number of MLEM iterations (cutoff) to determine when to cease execution of the algorithm. Note
-// that spectrum is updated as the algorithm progresses (passed by reference). Similarly for 
-// mlem_ratio
+// that spectrum is updated as the algorithm progresses (passed by reference). The ratio, correction
+// and estimate of the final iteration are left in the workspace, which must be sized for
+// num_measurements x num_bins (no memory is allocated here). The observer & trace (if any) are
+// notified after every iteration.
 //==================================================================================================
 int runMLEM(int cutoff, double error, int num_measurements, int num_bins, std::vector<double> &measurements, 
-    std::vector<double> &spectrum, std::vector<std::vector<double>> &nns_response, std::vector<double> &normalized_response, 
-    std::vector<double> &mlem_ratio, std::vector<double> &mlem_correction, std::vector<double> &mlem_estimate) 
+    std::vector<double> &spectrum, const ResponseMatrix &nns_response, std::vector<double> &normalized_response, 
+    MlemWorkspace &workspace, IterationObserver *observer, ConvergenceTrace *trace) 
 {
+    workspace.checkDimensions(num_measurements, num_bins);
+    std::vector<double> &mlem_ratio = workspace.mlem_ratio;
+    std::vector<double> &mlem_correction = workspace.mlem_correction;
+    std::vector<double> &mlem_estimate = workspace.mlem_estimate;
+
     int mlem_index; // index of MLEM iteration
 
     for (mlem_index = 0; mlem_index < cutoff; mlem_index++) {
-        mlem_ratio.clear(); // wipe previous ratios for each iteration
-        mlem_correction.clear(); // wipe previous corrections for each iteration
-        mlem_estimate.clear();
-        // vector that stores the MLEM-estimated data to be compared with measured data
-        // std::vector<double> mlem_estimate;
-
         // Apply system matrix, the nns_response, to current spectral estimate to get MLEM-estimated
         // data. Save results in mlem_estimate
         // Units: mlem_estimate [cps] = nns_response [cm^2] x spectru  [cps / cm^2]
-        for(int i_meas = 0; i_meas < num_measurements; i_meas++)
-        {
-            double temp_value = 0;
-            for(int i_bin = 0; i_bin < num_bins; i_bin++)
-            {
-                temp_value += nns_response[i_meas][i_bin]*spectrum[i_bin];
-            }
-            mlem_estimate.push_back(temp_value);
-        }
+        forwardProject(nns_response, spectrum.data(), mlem_estimate.data());
 
         // Calculate ratio between each measured data point and corresponding MLEM-estimated data point
         for(int i_meas = 0; i_meas < num_measurements; i_meas++)
         {
-            mlem_ratio.push_back(measurements[i_meas]/mlem_estimate[i_meas]);
+            mlem_ratio[i_meas] = measurements[i_meas]/mlem_estimate[i_meas];
         }
 
-        // matrix that stores the correction factor to be applied to each MLEM-estimated spectral value
-        // std::vector<double> mlem_correction;
-
         // Create the correction factors to be applied to MLEM-estimated spectral values:
         //  - multiply transpose system matrix by ratio values
-        for(int i_bin = 0; i_bin < num_bins; i_bin++)
-        {
-            double temp_value = 0;
-            for(int i_meas = 0; i_meas < num_measurements; i_meas++)
-            {
-                temp_value += nns_response[i_meas][i_bin]*mlem_ratio[i_meas]/normalized_response[i_bin];
-            }
-            mlem_correction.push_back(temp_value);
-        }
+        //  - divide by the normalization (once per bin, after summation)
+        backProject(nns_response, mlem_ratio.data(), normalized_response.data(), mlem_correction.data());
 
         // Apply correction factors and normalization to get new spectral estimate
         for(int i_bin=0; i_bin < num_bins; i_bin++)
@@ -598,6 +624,14 @@ int runMLEM(int cutoff, double error, int num_measurements, int num_bins, std::v
             spectrum[i_bin] = (spectrum[i_bin]*mlem_correction[i_bin]);
         }
 
+        // Report the state after this iteration to the observer & trace (if any)
+        if (observer != NULL) {
+            observer->notify(mlem_index+1, spectrum, workspace);
+        }
+        if (trace != NULL) {
+            trace->notify(mlem_index+1, measurements, spectrum, workspace);
+        }
+
         // End MLEM iterations if ratio between measured and MLEM-estimated data points is within
         // tolerace specified by 'error'
         bool continue_mlem = false;
@@ -612,6 +646,11 @@ int runMLEM(int cutoff, double error, int num_measurements, int num_bins, std::v
         }
     }
 
+    // Record the final state (if not already recorded)
+    if (trace != NULL) {
+        trace->finish(std::min(mlem_index+1, cutoff), measurements, spectrum, workspace);
+    }
+
     return mlem_index;
 }
 
@@ -619,54 +658,36 @@ int runMLEM(int cutoff, double error, int num_measurements, int num_bins, std::v
 //==================================================================================================
 // A modified version of the MLEM algorithm. A J value (Bouallegue et al 2013) is calculated at each
 // iteration and unfolding is terminated when J is less than the pre-determined J threshold value.
+// The observer & trace (if any) are notified after every iteration.
 //==================================================================================================
 int runMLEMSTOP(int cutoff, int num_measurements, int num_bins, std::vector<double> &measurements, 
-    std::vector<double> &spectrum, std::vector<std::vector<double>> &nns_response, std::vector<double> &normalized_response, 
-    std::vector<double> &mlem_ratio, std::vector<double> &mlem_correction, std::vector<double> &mlem_estimate,
-    double j_threshold, double& j_factor) 
+    std::vector<double> &spectrum, const ResponseMatrix &nns_response, std::vector<double> &normalized_response, 
+    MlemWorkspace &workspace, double j_threshold, double& j_factor, IterationObserver *observer,
+    ConvergenceTrace *trace) 
 {
+    workspace.checkDimensions(num_measurements, num_bins);
+    std::vector<double> &mlem_ratio = workspace.mlem_ratio;
+    std::vector<double> &mlem_correction = workspace.mlem_correction;
+    std::vector<double> &mlem_estimate = workspace.mlem_estimate;
+
     int mlem_index; // index of MLEM iteration
 
     for (mlem_index = 0; mlem_index < cutoff; mlem_index++) {
-        mlem_ratio.clear(); // wipe previous ratios for each iteration
-        mlem_correction.clear(); // wipe previous corrections for each iteration
-        mlem_estimate.clear();
-        // vector that stores the MLEM-estimated data to be compared with measured data
-        // std::vector<double> mlem_estimate;
-
         // Apply system matrix, the nns_response, to current spectral estimate to get MLEM-estimated
         // data. Save results in mlem_estimate
         // Units: mlem_estimate [cps] = nns_response [cm^2] x spectru  [cps / cm^2]
-        for(int i_meas = 0; i_meas < num_measurements; i_meas++)
-        {
-            double temp_value = 0;
-            for(int i_bin = 0; i_bin < num_bins; i_bin++)
-            {
-                temp_value += nns_response[i_meas][i_bin]*spectrum[i_bin];
-            }
-            mlem_estimate.push_back(temp_value);
-        }
+        forwardProject(nns_response, spectrum.data(), mlem_estimate.data());
 
         // Calculate ratio between each measured data point and corresponding MLEM-estimated data point
         for(int i_meas = 0; i_meas < num_measurements; i_meas++)
         {
-            mlem_ratio.push_back(measurements[i_meas]/mlem_estimate[i_meas]);
+            mlem_ratio[i_meas] = measurements[i_meas]/mlem_estimate[i_meas];
         }
 
-        // matrix that stores the correction factor to be applied to each MLEM-estimated spectral value
-        // std::vector<double> mlem_correction;
-
         // Create the correction factors to be applied to MLEM-estimated spectral values:
         //  - multiply transpose system matrix by ratio values
-        for(int i_bin = 0; i_bin < num_bins; i_bin++)
-        {
-            double temp_value = 0;
-            for(int i_meas = 0; i_meas < num_measurements; i_meas++)
-            {
-                temp_value += nns_response[i_meas][i_bin]*mlem_ratio[i_meas]/normalized_response[i_bin];
-            }
-            mlem_correction.push_back(temp_value);
-        }
+        //  - divide by the normalization (once per bin, after summation)
+        backProject(nns_response, mlem_ratio.data(), normalized_response.data(), mlem_correction.data());
 
         // Apply correction factors and normalization to get new spectral estimate
         for(int i_bin=0; i_bin < num_bins; i_bin++)
@@ -674,6 +695,14 @@ int runMLEMSTOP(int cutoff, int num_measurements, int num_bins, std::vector<doub
             spectrum[i_bin] = (spectrum[i_bin]*mlem_correction[i_bin]);
         }
 
+        // Report the state after this iteration to the observer & trace (if any)
+        if (observer != NULL) {
+            observer->notify(mlem_index+1, spectrum, workspace);
+        }
+        if (trace != NULL) {
+            trace->notify(mlem_index+1, measurements, spectrum, workspace);
+        }
+
         // End MLEM iterations if the calculated j factor is below the threshold j value
         bool continue_mlem = true;
         j_factor = calculateJFactor(num_measurements,measurements,mlem_estimate);
@@ -686,6 +715,11 @@ int runMLEMSTOP(int cutoff, int num_measurements, int num_bins, std::vector<doub
         }
     }
 
+    // Record the final state (if not already recorded), also when the J threshold was not reached
+    if (trace != NULL) {
+        trace->finish(std::min(mlem_index+1, cutoff), measurements, spectrum, workspace);
+    }
+
     if (mlem_index >= cutoff && j_factor > j_threshold) {
         // Commented out 2019-11-26 b/c was printed for each poisson sample
         // std::cout << "J factor:" << j_factor << "\n";
@@ -716,173 +750,228 @@ double determineJThreshold(int num_measurements, std::vector<double>& measuremen
 }
 
 
-//==================================================================================================
-// Accept a series of measurements and an estimated input spectrum and perform the MLEM algorithm
-// until the true spectrum has been unfolded. Use the provided target error (error) and the maximum
-// number of MLEM iterations (cutoff) to determine when to cease execution of the algorithm. Note
-// that spectrum is updated as the algorithm progresses (passed by reference). Similarly for 
-// mlem_ratio
-//==================================================================================================
-int runMAP(std::vector<double> &energy_correction, double beta, std::string prior, int cutoff, double error, 
-    int num_measurements, int num_bins, std::vector<double> &measurements, std::vector<double> &spectrum, 
-    std::vector<std::vector<double>> &nns_response, std::vector<double> &normalized_response, std::vector<double> &mlem_ratio) 
+//--------------------------------------------------------------------------------------------------
+// Method used to calculate a single upper or lower uncertainty on a neutron fluence spectrum. The
+// MLEM-STOP method is used to determine the iteration number at which the J-threshold (scaled by
+// sigma_J) is attained. The spectral difference between this spectrum and the actual MLEM-STOP
+// spectrum is taken to be the uncertainty.
+//--------------------------------------------------------------------------------------------------
+void UncertaintyManagerJ::determineSpectrumUncertainty(std::vector<double> &mlemstop_spectrum, 
+    int cutoff, int num_measurements, int num_bins, std::vector<double> &measurements, 
+    const ResponseMatrix &nns_response, std::vector<double> &normalized_response,
+    std::vector<double> &initial_spectrum) 
 {
-    int mlem_index; // index of MLEM iteration
+    this->bound_spectrum = initial_spectrum;
 
-    for (mlem_index = 0; mlem_index < cutoff; mlem_index++) {
-        mlem_ratio.clear(); // wipe previous ratios for each iteration
+    MlemWorkspace workspace(num_measurements, num_bins);
 
-        // vector that stores the MLEM-estimated data to be compared with measured data
-        std::vector<double> mlem_estimate;
+    num_iterations = runMLEMSTOP(cutoff, num_measurements, num_bins, measurements,
+        this->bound_spectrum, nns_response, normalized_response, workspace,
+        this->j_threshold, this->j_factor
+    );
 
-        // Apply system matrix, the nns_response, to current spectral estimate to get MLEM-estimated
-        // data. Save results in mlem_estimate
-        // Units: mlem_estimate [cps] = nns_response [cm^2] x spectru  [cps / cm^2]
-        for(int i_meas = 0; i_meas < num_measurements; i_meas++)
-        {
-            double temp_value = 0;
-            for(int i_bin = 0; i_bin < num_bins; i_bin++)
-            {
-                temp_value += nns_response[i_meas][i_bin]*spectrum[i_bin];
-            }
-            mlem_estimate.push_back(temp_value);
-        }
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        spectrum_uncertainty.push_back(abs(bound_spectrum[i_bin]-mlemstop_spectrum[i_bin]));
+    }
+}
 
-        // Calculate ratio between each measured data point and corresponding MLEM-estimated data point
-        for(int i_meas = 0; i_meas < num_measurements; i_meas++)
-        {
-            mlem_ratio.push_back(measurements[i_meas]/mlem_estimate[i_meas]);
-        }
+//--------------------------------------------------------------------------------------------------
+// Calculate the uncertainty in dose by calculating the dose at the bound spectrum, and subtracting
+// the dose for the actual MLEM-STOP spectrum
+//--------------------------------------------------------------------------------------------------
+void UncertaintyManagerJ::determineDoseUncertainty(double dose, std::vector<double> &mlemstop_spectrum, int num_bins, 
+    std::vector<double> &icrp_factors)
+{
+    double dose_bound = calculateDose(num_bins,this->bound_spectrum,icrp_factors);
+    this->dose_uncertainty = abs(dose_bound-dose);
+}
 
-        // matrix that stores the correction factor to be applied to each MLEM-estimated spectral value
-        std::vector<double> mlem_correction;
 
-        // Create the correction factors to be applied to MLEM-estimated spectral values:
-        //  - multiply transpose system matrix by ratio values
-        for(int i_bin = 0; i_bin < num_bins; i_bin++)
+//==================================================================================================
+// Convert the name of a MAP prior into the corresponding MapPrior value. Done once per unfolding,
+// rather than comparing strings at every iteration.
+//==================================================================================================
+MapPrior parseMapPrior(const std::string &prior) {
+    if (prior == "quadratic")
+        return PRIOR_QUADRATIC;
+    else if (prior == "quadratic_normalized")
+        return PRIOR_QUADRATIC_NORMALIZED;
+    else if (prior == "mrp")
+        return PRIOR_MRP;
+    else if (prior == "meanrp")
+        return PRIOR_MEANRP;
+    else if (prior == "gaussians")
+        return PRIOR_GAUSSIANS;
+    else
+        throw std::logic_error("Unrecognized prior: " + prior + ". Please refer to the README for allowed priors");
+}
+
+
+//==================================================================================================
+// Calculate the MAP energy correction factors (to be incorporated in the normalization) for a
+// spectrum, according to the prior. The value of bin i_bin is read from spectrum[i_bin*stride] and
+// its correction written to energy_correction[i_bin*stride]. stride is 1 for a single spectrum, or
+// the batch stride for a spectrum stored in a column of a (bin-major) batch of spectra.
+//==================================================================================================
+void calculateEnergyCorrection(MapPrior prior, double beta, int num_bins, const double* spectrum, 
+    double* energy_correction, int stride) 
+{
+    const int num_adjacent = 1; // on either side (mrp, meanrp & gaussians)
+    const int num_neighbours = 2*num_adjacent+1;
+    int last = (num_bins-1)*stride; // index of the last bin
+
+    // Quadratic prior (smoothing, no edge preservation):
+    if (prior == PRIOR_QUADRATIC) {
+        energy_correction[0] = beta*pow(spectrum[0]-spectrum[stride],2);
+        for (int i_bin=1; i_bin < num_bins-1; i_bin++)
         {
+            double value = spectrum[i_bin*stride];
             double temp_value = 0;
-            for(int i_meas = 0; i_meas < num_measurements; i_meas++)
-            {
-                temp_value += nns_response[i_meas][i_bin]*mlem_ratio[i_meas];
-            }
-            mlem_correction.push_back(temp_value);
+            temp_value = beta * (pow(value-spectrum[(i_bin-1)*stride],2)+pow(value-spectrum[(i_bin+1)*stride],2));          
+            energy_correction[i_bin*stride] = temp_value;
+        }
+        energy_correction[last] = beta*pow(spectrum[last]-spectrum[last-stride],2);
+    }
+    // Normalized quadratic prior
+    else if (prior == PRIOR_QUADRATIC_NORMALIZED) {
+        energy_correction[0] = beta*sqrt(pow(spectrum[0]-spectrum[stride],2))/spectrum[0];
+        for (int i_bin=1; i_bin < num_bins-1; i_bin++)
+        {
+            double value = spectrum[i_bin*stride];
+            double temp_value = 0;
+            temp_value = beta * 
+                sqrt(pow(value-spectrum[(i_bin-1)*stride],2)+pow(value-spectrum[(i_bin+1)*stride],2))
+                / (2*value);          
+            energy_correction[i_bin*stride] = temp_value;
         }
+        energy_correction[last] = beta*sqrt(pow(spectrum[last]-spectrum[last-stride],2))/spectrum[last];
+    }
+    // Median Root Prior (edge preservation by not penalizing areas of monotonic increase or decrease)
+    else if (prior == PRIOR_MRP) {
+        energy_correction[0] = 0; // no correction for first term
+        for (int i_bin=num_adjacent; i_bin < num_bins-num_adjacent; i_bin++)
+        {
+            double median;
 
-        //------------------------------------------------------------------------------------------
-        // Create the MAP energy correction factors to be incorporated in the normalization
-        // std::vector<double> energy_correction;
-        energy_correction.clear();
-
-        // Quadratic prior (smoothing, no edge preservation):
-        if (prior == "quadratic") {
-            energy_correction.push_back(beta*pow(spectrum[0]-spectrum[1],2));
-            for (int i_bin=1; i_bin < num_bins-1; i_bin++)
-            {
-                double temp_value = 0;
-                temp_value = beta * (pow(spectrum[i_bin]-spectrum[i_bin-1],2)+pow(spectrum[i_bin]-spectrum[i_bin+1],2));          
-                energy_correction.push_back(temp_value);
+            double neighbours[num_neighbours];
+            for (int i_n=0; i_n < num_neighbours; i_n++) {
+                neighbours[i_n] = spectrum[(i_bin-num_adjacent+i_n)*stride];
             }
-            energy_correction.push_back(beta*pow(spectrum[num_bins-1]-spectrum[num_bins-2],2));
-        }
-        // Normalized quadratic prior
-        else if (prior == "quadratic_normalized") {
-            energy_correction.push_back(beta*sqrt(pow(spectrum[0]-spectrum[1],2))/spectrum[0]);
-            for (int i_bin=1; i_bin < num_bins-1; i_bin++)
-            {
-                double temp_value = 0;
-                temp_value = beta * 
-                    sqrt(pow(spectrum[i_bin]-spectrum[i_bin-1],2)+pow(spectrum[i_bin]-spectrum[i_bin+1],2))
-                    / (2*spectrum[i_bin]);          
-                energy_correction.push_back(temp_value);
+
+            // Determine if spectrum is monotonically increasing or decreasing by comparing
+            // current value with its neighbours
+            bool increasing = std::is_sorted(neighbours, neighbours+num_neighbours);
+            std::reverse(neighbours, neighbours+num_neighbours);
+            bool decreasing = std::is_sorted(neighbours, neighbours+num_neighbours);
+
+            // if values are monotonically increasing or decreasing, no energy correction
+            if (increasing || decreasing) {
+                energy_correction[i_bin*stride] = 0;
             }
-            energy_correction.push_back(beta*sqrt(pow(spectrum[num_bins-1]-spectrum[num_bins-2],2))/spectrum[num_bins-1]);
-        }
-        // Median Root Prior (edge preservation by not penalizing areas of monotonic increase or decrease)
-        else if (prior == "mrp") {
-            int num_adjacent = 1; // on either side
-            energy_correction.push_back(0); // no correction for first term
-            for (int i_bin=num_adjacent; i_bin < num_bins-num_adjacent; i_bin++)
-            {
-                double median;
-
-                std::vector<double> neighbours(spectrum.begin()+i_bin-num_adjacent,spectrum.begin()+i_bin+num_adjacent+1);
-
-                // Determine if spectrum is monotonically increasing or decreasing by comparing
-                // current value with its neighbours
-                bool increasing = std::is_sorted(neighbours.begin(), neighbours.end());
-                std::reverse(neighbours.begin(),neighbours.end());
-                bool decreasing = std::is_sorted(neighbours.begin(), neighbours.end());
-
-                // if values are monotonically increasing or decreasing, no energy correction
-                if (increasing || decreasing) {
-                    energy_correction.push_back(0);
-                }
-                // Otherwise, apply energy correction 
-                else {
-                    std::sort(neighbours.begin(),neighbours.end());
-                    median = neighbours[num_adjacent];
-                    double temp_value = beta*(spectrum[i_bin]-median)/median;
-                    energy_correction.push_back(temp_value);
-                }
+            // Otherwise, apply energy correction 
+            else {
+                std::sort(neighbours, neighbours+num_neighbours);
+                median = neighbours[num_adjacent];
+                double temp_value = beta*(spectrum[i_bin*stride]-median)/median;
+                energy_correction[i_bin*stride] = temp_value;
             }
-            energy_correction.push_back(0); // no correction for last term
-        }
-        // Custom Mean Root Prior
-        else if (prior == "meanrp") {
-            int num_adjacent = 1; // on either side
-            energy_correction.push_back(0); // no correction for first term
-            for (int i_bin=num_adjacent; i_bin < num_bins-num_adjacent; i_bin++)
-            {
-                double mean = 0.0;
-
-                for (int i_n=i_bin-num_adjacent; i_n <= i_bin+num_adjacent; i_n++) {
-                    mean += spectrum[i_n];
-                }
+        }
+        energy_correction[last] = 0; // no correction for last term
+    }
+    // Custom Mean Root Prior
+    else if (prior == PRIOR_MEANRP) {
+        energy_correction[0] = 0; // no correction for first term
+        for (int i_bin=num_adjacent; i_bin < num_bins-num_adjacent; i_bin++)
+        {
+            double mean = 0.0;
 
-                std::vector<double> neighbours(spectrum.begin()+i_bin-num_adjacent,spectrum.begin()+i_bin+num_adjacent+1);
+            double neighbours[num_neighbours];
+            for (int i_n=0; i_n < num_neighbours; i_n++) {
+                neighbours[i_n] = spectrum[(i_bin-num_adjacent+i_n)*stride];
+                mean += neighbours[i_n];
+            }
 
-                // Determine if spectrum is monotonically increasing or decreasing by comparing
-                // current value with its neighbours
-                bool increasing = std::is_sorted(neighbours.begin(), neighbours.end());
-                std::reverse(neighbours.begin(),neighbours.end());
-                bool decreasing = std::is_sorted(neighbours.begin(), neighbours.end());
+            // Determine if spectrum is monotonically increasing or decreasing by comparing
+            // current value with its neighbours
+            bool increasing = std::is_sorted(neighbours, neighbours+num_neighbours);
+            std::reverse(neighbours, neighbours+num_neighbours);
+            bool decreasing = std::is_sorted(neighbours, neighbours+num_neighbours);
 
-                // if values are monotonically increasing or decreasing, no energy correction
-                if (increasing || decreasing) {
-                    energy_correction.push_back(0);
-                }
-                // Otherwise, apply energy correction 
-                else {
-                    double temp_value = beta*(spectrum[i_bin]-mean)/mean;
-                    energy_correction.push_back(temp_value);
-                }
+            // if values are monotonically increasing or decreasing, no energy correction
+            if (increasing || decreasing) {
+                energy_correction[i_bin*stride] = 0;
             }
-            energy_correction.push_back(0); // no correction for last term
-        }
-        // Custom Mean Root Prior
-        else if (prior == "gaussians") {
-            int num_adjacent = 1; // on either side
-            energy_correction.push_back(0); // no correction for first term
-            for (int i_bin=num_adjacent; i_bin < num_bins-num_adjacent; i_bin++)
-            {
-                double mean = 0.0;
-
-                for (int i_n=i_bin-num_adjacent; i_n <= i_bin+num_adjacent; i_n++) {
-                    mean += spectrum[i_n];
-                }
-                
-                mean = mean / ((2*num_adjacent)+1);
+            // Otherwise, apply energy correction 
+            else {
+                double temp_value = beta*(spectrum[i_bin*stride]-mean)/mean;
+                energy_correction[i_bin*stride] = temp_value;
+            }
+        }
+        energy_correction[last] = 0; // no correction for last term
+    }
+    // Custom Mean Root Prior
+    else if (prior == PRIOR_GAUSSIANS) {
+        energy_correction[0] = 0; // no correction for first term
+        for (int i_bin=num_adjacent; i_bin < num_bins-num_adjacent; i_bin++)
+        {
+            double mean = 0.0;
 
-                double temp_value = beta*(spectrum[i_bin]-mean)/mean;
-                energy_correction.push_back(temp_value);
+            for (int i_n=i_bin-num_adjacent; i_n <= i_bin+num_adjacent; i_n++) {
+                mean += spectrum[i_n*stride];
             }
-            energy_correction.push_back(0); // no correction for last term
+            
+            mean = mean / ((2*num_adjacent)+1);
+
+            double temp_value = beta*(spectrum[i_bin*stride]-mean)/mean;
+            energy_correction[i_bin*stride] = temp_value;
         }
-        else {
-            throw std::logic_error("Unrecognized prior: " + prior + ". Please refer to the README for allowed priors");
+        energy_correction[last] = 0; // no correction for last term
+    }
+}
+
+
+//==================================================================================================
+// Accept a series of measurements and an estimated input spectrum and perform the MLEM algorithm
+// until the true spectrum has been unfolded. Use the provided target error (error) and the maximum
+// number of MLEM iterations (cutoff) to determine when to cease execution of the algorithm. Note
+// that spectrum is updated as the algorithm progresses (passed by reference). The ratio, estimate,
+// correction and energy correction of the final iteration are left in the workspace, which must be
+// sized for num_measurements x num_bins (no memory is allocated here). The observer & trace (if
+// any) are notified after every iteration.
+//==================================================================================================
+int runMAP(double beta, const std::string &prior, int cutoff, double error, int num_measurements, 
+    int num_bins, std::vector<double> &measurements, std::vector<double> &spectrum, 
+    const ResponseMatrix &nns_response, std::vector<double> &normalized_response, MlemWorkspace &workspace, 
+    IterationObserver *observer, ConvergenceTrace *trace) 
+{
+    workspace.checkDimensions(num_measurements, num_bins);
+    std::vector<double> &mlem_ratio = workspace.mlem_ratio;
+    std::vector<double> &mlem_correction = workspace.mlem_correction;
+    std::vector<double> &mlem_estimate = workspace.mlem_estimate;
+    std::vector<double> &energy_correction = workspace.energy_correction;
+
+    MapPrior map_prior = parseMapPrior(prior);
+
+    int mlem_index; // index of MLEM iteration
+
+    for (mlem_index = 0; mlem_index < cutoff; mlem_index++) {
+        // Apply system matrix, the nns_response, to current spectral estimate to get MLEM-estimated
+        // data. Save results in mlem_estimate
+        // Units: mlem_estimate [cps] = nns_response [cm^2] x spectru  [cps / cm^2]
+        forwardProject(nns_response, spectrum.data(), mlem_estimate.data());
+
+        // Calculate ratio between each measured data point and corresponding MLEM-estimated data point
+        for(int i_meas = 0; i_meas < num_measurements; i_meas++)
+        {
+            mlem_ratio[i_meas] = measurements[i_meas]/mlem_estimate[i_meas];
         }
-        //------------------------------------------------------------------------------------------
+
+        // Create the correction factors to be applied to MLEM-estimated spectral values:
+        //  - multiply transpose system matrix by ratio values (normalization is applied below)
+        backProject(nns_response, mlem_ratio.data(), NULL, mlem_correction.data());
+
+        // Create the MAP energy correction factors to be incorporated in the normalization
+        calculateEnergyCorrection(map_prior, beta, num_bins, spectrum.data(), energy_correction.data(), 1);
 
         // Apply correction factors and normalization to get new spectral estimate
         for(int i_bin=0; i_bin < num_bins; i_bin++)
@@ -890,6 +979,14 @@ int runMAP(std::vector<double> &energy_correction, double beta, std::string prio
             spectrum[i_bin] = spectrum[i_bin]*mlem_correction[i_bin]/(normalized_response[i_bin]+energy_correction[i_bin]);
         }
 
+        // Report the state after this iteration to the observer & trace (if any)
+        if (observer != NULL) {
+            observer->notify(mlem_index+1, spectrum, workspace);
+        }
+        if (trace != NULL) {
+            trace->notify(mlem_index+1, measurements, spectrum, workspace);
+        }
+
         // End MLEM iterations if ratio between measured and MLEM-estimated data points is within
         // tolerace specified by 'error'
         bool continue_mlem = false;
@@ -904,9 +1001,222 @@ int runMAP(std::vector<double> &energy_correction, double beta, std::string prio
         }
     }
 
+    // Record the final state (if not already recorded)
+    if (trace != NULL) {
+        trace->finish(std::min(mlem_index+1, cutoff), measurements, spectrum, workspace);
+    }
+
+    return mlem_index;
+}
+
+
+//==================================================================================================
+// Perform one MLEM (or, if map is true, MAP) update of spectrum_in into spectrum_out, with exactly
+// the operations of an iteration of runMLEM (runMAP). The ratio & estimate of spectrum_in are left
+// in the workspace. If calculate_likelihood is true, returns the Poisson log-likelihood of the
+// measurements given spectrum_in (up to a constant), otherwise 0.
+//==================================================================================================
+static double updateSpectrumEM(bool map, MapPrior map_prior, double beta, int num_measurements, 
+    int num_bins, std::vector<double> &measurements, const double* spectrum_in, double* spectrum_out,
+    const ResponseMatrix &nns_response, std::vector<double> &normalized_response, MlemWorkspace &workspace,
+    bool calculate_likelihood)
+{
+    std::vector<double> &mlem_ratio = workspace.mlem_ratio;
+    std::vector<double> &mlem_correction = workspace.mlem_correction;
+    std::vector<double> &mlem_estimate = workspace.mlem_estimate;
+    std::vector<double> &energy_correction = workspace.energy_correction;
+
+    forwardProject(nns_response, spectrum_in, mlem_estimate.data());
+
+    double log_likelihood = 0;
+    for(int i_meas = 0; i_meas < num_measurements; i_meas++)
+    {
+        mlem_ratio[i_meas] = measurements[i_meas]/mlem_estimate[i_meas];
+    }
+    if (calculate_likelihood) {
+        for(int i_meas = 0; i_meas < num_measurements; i_meas++)
+        {
+            log_likelihood += measurements[i_meas]*log(mlem_estimate[i_meas]) - mlem_estimate[i_meas];
+        }
+    }
+
+    if (!map) {
+        backProject(nns_response, mlem_ratio.data(), normalized_response.data(), mlem_correction.data());
+        for(int i_bin=0; i_bin < num_bins; i_bin++)
+        {
+            spectrum_out[i_bin] = (spectrum_in[i_bin]*mlem_correction[i_bin]);
+        }
+    }
+    else {
+        backProject(nns_response, mlem_ratio.data(), NULL, mlem_correction.data());
+        calculateEnergyCorrection(map_prior, beta, num_bins, spectrum_in, energy_correction.data(), 1);
+        for(int i_bin=0; i_bin < num_bins; i_bin++)
+        {
+            spectrum_out[i_bin] = spectrum_in[i_bin]*mlem_correction[i_bin]/(normalized_response[i_bin]+energy_correction[i_bin]);
+        }
+    }
+
+    return log_likelihood;
+}
+
+//==================================================================================================
+// Return true if the ratios between measured and estimated data (left in the workspace by the last
+// update) are all within the tolerance specified by 'error' (stopping criterion of runMLEM)
+//==================================================================================================
+static bool ratioWithinError(int num_measurements, double error, MlemWorkspace &workspace) {
+    for (int i_meas=0; i_meas < num_measurements; i_meas++) {
+        if (workspace.mlem_ratio[i_meas] >= (1+error) || workspace.mlem_ratio[i_meas] <= (1-error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//==================================================================================================
+// MLEM (or MAP) accelerated by squared extrapolation (SQUAREM, scheme S3; Varadhan & Roland 2008).
+// Each cycle performs two regular updates x0 -> x1 -> x2, then extrapolates along the fitted path:
+//      x' = x0 - 2*alpha*r + alpha^2*v,  r = x1-x0, v = x2-2*x1+x0,  alpha = -|r|/|v| (<= -1)
+// followed by a regular (stabilizing) update of x'. alpha = -1 gives x' = x2 (no acceleration).
+//  - non-negativity: alpha is moved halfway towards -1 until no bin of x' is negative
+//  - the extrapolated spectrum is discarded (cycle continues from x2) if its Poisson
+//    log-likelihood is lower than that of x1 (also for MAP: the prior is not included)
+// The stopping criterion is checked at every regular update, as in runMLEM/runMAP, and the returned
+// value is, as for those, the index of the last update (i.e. the # of updates performed, -1 if
+// converged), so iteration counts can be compared directly.
+//==================================================================================================
+static int runSQUAREM(bool map, double beta, const std::string &prior, int cutoff, double error, 
+    int num_measurements, int num_bins, std::vector<double> &measurements, std::vector<double> &spectrum, 
+    const ResponseMatrix &nns_response, std::vector<double> &normalized_response, MlemWorkspace &workspace)
+{
+    const int max_step_halvings = 10;
+
+    workspace.checkDimensions(num_measurements, num_bins);
+    std::vector<double> &x1 = workspace.accel_spectrum_1;
+    std::vector<double> &x2 = workspace.accel_spectrum_2;
+
+    MapPrior map_prior = PRIOR_QUADRATIC;
+    if (map) {
+        map_prior = parseMapPrior(prior);
+    }
+
+    int mlem_index = 0; // index of MLEM iteration (regular update)
+
+    while (mlem_index < cutoff) {
+        // Two regular updates: spectrum (x0) -> x1 -> x2
+        updateSpectrumEM(map, map_prior, beta, num_measurements, num_bins, measurements, spectrum.data(), 
+            x1.data(), nns_response, normalized_response, workspace, false);
+        if (ratioWithinError(num_measurements, error, workspace)) {
+            spectrum = x1;
+            return mlem_index;
+        }
+        mlem_index++;
+        if (mlem_index >= cutoff) {
+            spectrum = x1;
+            break;
+        }
+
+        double log_likelihood_1 = updateSpectrumEM(map, map_prior, beta, num_measurements, num_bins, 
+            measurements, x1.data(), x2.data(), nns_response, normalized_response, workspace, true);
+        if (ratioWithinError(num_measurements, error, workspace)) {
+            spectrum = x2;
+            return mlem_index;
+        }
+        mlem_index++;
+        if (mlem_index >= cutoff) {
+            spectrum = x2;
+            break;
+        }
+
+        // Step length
+        double r_norm_sq = 0;
+        double v_norm_sq = 0;
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            double r = x1[i_bin] - spectrum[i_bin];
+            double v = x2[i_bin] - 2*x1[i_bin] + spectrum[i_bin];
+            r_norm_sq += r*r;
+            v_norm_sq += v*v;
+        }
+        double alpha = -1;
+        if (v_norm_sq > 0) {
+            alpha = std::min(-sqrt(r_norm_sq/v_norm_sq), -1.0);
+        }
+
+        // Shorten the step until the extrapolated spectrum is non-negative
+        for (int i_halving = 0; alpha < -1; i_halving++) {
+            if (i_halving == max_step_halvings) {
+                alpha = -1;
+                break;
+            }
+            bool non_negative = true;
+            for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+                double r = x1[i_bin] - spectrum[i_bin];
+                double v = x2[i_bin] - 2*x1[i_bin] + spectrum[i_bin];
+                if (spectrum[i_bin] - 2*alpha*r + alpha*alpha*v < 0) {
+                    non_negative = false;
+                    break;
+                }
+            }
+            if (non_negative) {
+                break;
+            }
+            alpha = (alpha - 1)/2;
+        }
+        if (alpha == -1) {
+            spectrum = x2;
+            continue;
+        }
+
+        // Extrapolate (in place: spectrum holds x0), then stabilize with a regular update
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            double r = x1[i_bin] - spectrum[i_bin];
+            double v = x2[i_bin] - 2*x1[i_bin] + spectrum[i_bin];
+            spectrum[i_bin] = spectrum[i_bin] - 2*alpha*r + alpha*alpha*v;
+        }
+        double log_likelihood = updateSpectrumEM(map, map_prior, beta, num_measurements, num_bins, 
+            measurements, spectrum.data(), x1.data(), nns_response, normalized_response, workspace, true);
+        if (ratioWithinError(num_measurements, error, workspace)) {
+            spectrum = x1;
+            return mlem_index;
+        }
+        mlem_index++;
+
+        if (log_likelihood < log_likelihood_1) {
+            spectrum = x2;
+        }
+        else {
+            spectrum = x1;
+        }
+    }
+
     return mlem_index;
 }
 
+//==================================================================================================
+// Accelerated version of runMLEM (algorithm=mlem_accel). Same arguments, stopping criterion and
+// return value; see runSQUAREM.
+//==================================================================================================
+int runMLEMAccel(int cutoff, double error, int num_measurements, int num_bins, 
+    std::vector<double> &measurements, std::vector<double> &spectrum, const ResponseMatrix &nns_response, 
+    std::vector<double> &normalized_response, MlemWorkspace &workspace)
+{
+    return runSQUAREM(false, 0, "", cutoff, error, num_measurements, num_bins, measurements, spectrum, 
+        nns_response, normalized_response, workspace
+    );
+}
+
+//==================================================================================================
+// Accelerated version of runMAP (algorithm=map_accel). Same arguments, stopping criterion and
+// return value; see runSQUAREM.
+//==================================================================================================
+int runMAPAccel(double beta, const std::string &prior, int cutoff, double error, int num_measurements, 
+    int num_bins, std::vector<double> &measurements, std::vector<double> &spectrum, 
+    const ResponseMatrix &nns_response, std::vector<double> &normalized_response, MlemWorkspace &workspace) 
+{
+    return runSQUAREM(true, beta, prior, cutoff, error, num_measurements, num_bins, measurements, spectrum, 
+        nns_response, normalized_response, workspace
+    );
+}
+
 
 //==================================================================================================
 // Create a linearly interpolated vector of doubles with a minimum value a and a maximum value b 
@@ -0,0 +1,99 @@
+//**************************************************************************************************
+// The functions included in this module load the plotting backend on demand. unfold_spectrum is
+// built without ROOT: the ROOT plotting functions (root_helpers) are compiled into a separate shared
+// library (plot_root.so) that is only loaded (dlopen) the first time a figure is plotted. Runs that
+// do not plot (generate_figure=0) therefore never load ROOT's libraries.
+//
+// The backend is looked up in the following order:
+//  - the file named by the NNS_PLOT_PLUGIN environment variable, if set
+//  - plot_root.so in the directory the applications were built in (_PLOT_PLUGIN_DIR, set by make)
+//  - plot_root.so found by the dynamic loader (e.g. on LD_LIBRARY_PATH)
+//**************************************************************************************************
+
+#include "plot_plugin.h"
+
+#include <chrono>
+#include <dlfcn.h>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Entry point of the loaded backend (null until it is loaded)
+static std::mutex plugin_mutex;
+static PlotPluginSpectrumFunction plugin_plot_spectrum = NULL;
+
+//==================================================================================================
+// Load the plotting backend (once per process) and resolve its entry points. The time spent
+// loading it (i.e. loading ROOT's libraries) is printed, as it is the cost that non-plotting runs
+// no longer pay at startup.
+//==================================================================================================
+static void loadPlotPlugin() {
+    std::lock_guard<std::mutex> lock(plugin_mutex);
+    if (plugin_plot_spectrum) {
+        return;
+    }
+
+    std::string path = plotPluginPath();
+    std::chrono::steady_clock::time_point load_start = std::chrono::steady_clock::now();
+    // RTLD_LOCAL: ROOT's symbols are not made available to (and cannot clash with) the application
+    void *handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        std::string error = dlerror();
+        throw std::logic_error("Unable to load the plotting backend " + path + " (" + error + "). "
+            "Build it with 'make plot_root.so' (requires ROOT), or set generate_figure=0.");
+    }
+    double load_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - load_start).count();
+
+    PlotPluginVersionFunction plugin_version = (PlotPluginVersionFunction)dlsym(handle, "nnsPlotPluginVersion");
+    PlotPluginSpectrumFunction plot_spectrum = (PlotPluginSpectrumFunction)dlsym(handle, "nnsPlotSpectrum");
+    if (!plugin_version || !plot_spectrum) {
+        dlclose(handle);
+        throw std::logic_error("Invalid plotting backend " + path + ": missing entry points.");
+    }
+    if (plugin_version() != PLOT_PLUGIN_VERSION) {
+        int version = plugin_version();
+        dlclose(handle);
+        throw std::logic_error("Plotting backend " + path + " has version " + std::to_string(version)
+            + " (expected " + std::to_string(PLOT_PLUGIN_VERSION) + "). Please rebuild it.");
+    }
+
+    // The backend stays loaded until the process exits (ROOT does not support being unloaded)
+    plugin_plot_spectrum = plot_spectrum;
+    std::cout << "Loaded plotting backend " << path << " in " << load_time * 1000 << " ms\n";
+}
+
+//==================================================================================================
+// Return the pathname of the plotting backend to be loaded (see the module description)
+//==================================================================================================
+std::string plotPluginPath() {
+    const char *env_path = getenv("NNS_PLOT_PLUGIN");
+    if (env_path && env_path[0] != '\0') {
+        return env_path;
+    }
+#ifdef _PLOT_PLUGIN_DIR
+    std::string build_path = std::string(_PLOT_PLUGIN_DIR) + "/" + PLOT_PLUGIN_NAME;
+    if (access(build_path.c_str(), R_OK) == 0) {
+        return build_path;
+    }
+#endif
+    return PLOT_PLUGIN_NAME;
+}
+
+//==================================================================================================
+// Plot a single flux spectrum (and its uncertainty) as a function of energy, using the plotting
+// backend (see plotSpectrum in root_helpers). The backend is loaded on the first call.
+//==================================================================================================
+int plotSpectrumWithPlugin(std::string path_figure, std::string irradiation_conditions,
+    int num_measurements, int num_bins, std::vector<double> &energy_bins, std::vector<double> &spectrum,
+    std::vector<double> &spectrum_uncertainty_upper, std::vector<double> &spectrum_uncertainty_lower)
+{
+    loadPlotPlugin();
+    return plugin_plot_spectrum(path_figure.c_str(), irradiation_conditions.c_str(), num_measurements,
+        num_bins, energy_bins.data(), spectrum.data(), spectrum_uncertainty_upper.data(),
+        spectrum_uncertainty_lower.data()
+    );
+}
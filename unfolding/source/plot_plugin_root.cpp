@@ -0,0 +1,40 @@
+//**************************************************************************************************
+// ROOT plotting backend (plot_root.so), loaded on demand by the applications that plot figures
+// without being linked to ROOT (see plot_plugin). Exports the plotting functions of root_helpers
+// with C linkage, so that they can be resolved by name (dlsym).
+//**************************************************************************************************
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// Local
+#include "plot_plugin.h"
+#include "root_helpers.h"
+
+extern "C" {
+
+//==================================================================================================
+// Version of the interface implemented by this backend (compared to PLOT_PLUGIN_VERSION)
+//==================================================================================================
+int nnsPlotPluginVersion() {
+    return PLOT_PLUGIN_VERSION;
+}
+
+//==================================================================================================
+// See plotSpectrum (root_helpers)
+//==================================================================================================
+int nnsPlotSpectrum(const char *path_figure, const char *irradiation_conditions, int num_measurements,
+    int num_bins, const double *energy_bins, const double *spectrum,
+    const double *spectrum_uncertainty_upper, const double *spectrum_uncertainty_lower)
+{
+    std::vector<double> energy_bins_vector(energy_bins, energy_bins + num_bins);
+    std::vector<double> spectrum_vector(spectrum, spectrum + num_bins);
+    std::vector<double> upper_vector(spectrum_uncertainty_upper, spectrum_uncertainty_upper + num_bins);
+    std::vector<double> lower_vector(spectrum_uncertainty_lower, spectrum_uncertainty_lower + num_bins);
+    return plotSpectrum(path_figure, irradiation_conditions, num_measurements, num_bins,
+        energy_bins_vector, spectrum_vector, upper_vector, lower_vector
+    );
+}
+
+}
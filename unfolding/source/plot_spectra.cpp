@@ -15,6 +15,7 @@
 #include "custom_classes.h"
 #include "fileio.h"
 #include "root_helpers.h"
+#include "spectra_store.h"
 
 // Root
 #include "TApplication.h"
@@ -51,8 +52,14 @@ int main(int argc, char* argv[])
     std::vector<std::vector<double>> spectra_array;
     std::vector<std::vector<double>> error_upper_array;
     std::vector<std::vector<double>> error_lower_array;
-    readSpectra(settings.path_input_data, headers, energy_bins, spectra_array, error_lower_array, error_upper_array,
-        settings.plot_per_mu, settings.number_mu, settings.duration, settings.rows_per_spectrum);
+    if (isSpectraStore(settings.path_input_data)) {
+        readSpectraStore(settings.path_input_data, settings.spectra_selection, headers, energy_bins, spectra_array,
+            error_lower_array, error_upper_array, settings.plot_per_mu, settings.number_mu, settings.duration);
+    }
+    else {
+        readSpectra(settings.path_input_data, headers, energy_bins, spectra_array, error_lower_array, error_upper_array,
+            settings.plot_per_mu, settings.number_mu, settings.duration, settings.rows_per_spectrum);
+    }
 
     int num_spectra = spectra_array.size();
     int num_bins = energy_bins.size() - 1;
@@ -0,0 +1,675 @@
+//**************************************************************************************************
+// The functions included in this module perform the forward projection (response x spectrum) and
+// the back projection (transposed response x ratios) that make up the bulk of the work in every
+// MLEM-style iteration. A scalar version and vectorized versions (SSE2, AVX2, AVX-512) are provided.
+// The version used is selected at runtime from the features of the CPU, and can be overridden via
+// setProjectionKernel (e.g. to force the scalar reference). Batched versions project several spectra
+// (e.g. uncertainty samples) at once, loading each response value once for the whole batch.
+//
+// Reproducibility: every version accumulates each output element in the same order as the scalar
+// reference (one vector lane per output element, summing over the inner index in increasing order),
+// and uses separate multiply and add instructions (no fused multiply-add). The vectorized versions
+// therefore reproduce the scalar results exactly, i.e. the tolerance between versions is 0 ULP.
+//**************************************************************************************************
+
+#include "projection_kernels.h"
+
+#include <atomic>
+#include <sstream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NNS_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+// Number of doubles handled per block of output values. Rows and columns of a ResponseMatrix are
+// zero-padded to a multiple of this length, so a block can always be loaded in full.
+static const int BLOCK = ResponseMatrix::ALIGNMENT / sizeof(double);
+
+typedef void (*ForwardKernel)(const ResponseMatrix&, const double*, double*);
+typedef void (*BackKernel)(const ResponseMatrix&, const double*, const double*, double*);
+typedef void (*ForwardBatchKernel)(const ResponseMatrix&, const double*, int, int, double*);
+typedef void (*BackBatchKernel)(const ResponseMatrix&, const double*, int, int, const double*, double*);
+
+struct ProjectionKernel {
+    const char* name;
+    ForwardKernel forward;
+    BackKernel back;
+    ForwardBatchKernel forward_batch;
+    BackBatchKernel back_batch;
+    bool (*supported)();
+    bool automatic; // eligible for automatic selection
+};
+
+//==================================================================================================
+// Copy the valid portion of a block of forward-projected values into the estimate
+//==================================================================================================
+static void storeForwardBlock(const double* block, int i_block, int num_measurements, double* estimate) {
+    for (int i_lane = 0; i_lane < BLOCK && i_block+i_lane < num_measurements; i_lane++) {
+        estimate[i_block+i_lane] = block[i_lane];
+    }
+}
+
+//==================================================================================================
+// Copy the valid portion of a block of back-projected values into the correction, applying the
+// normalization (if any)
+//==================================================================================================
+static void storeBackBlock(const double* block, int i_block, int num_bins, const double* normalization,
+    double* correction)
+{
+    for (int i_lane = 0; i_lane < BLOCK && i_block+i_lane < num_bins; i_lane++) {
+        if (normalization) {
+            correction[i_block+i_lane] = block[i_lane]/normalization[i_block+i_lane];
+        }
+        else {
+            correction[i_block+i_lane] = block[i_lane];
+        }
+    }
+}
+
+//==================================================================================================
+// Scalar reference forward projection:
+//  estimate[i_meas] = sum over i_bin of response(i_meas,i_bin)*spectrum[i_bin]
+// Units: estimate [cps] = response [cm^2] x spectrum [cps / cm^2]
+//==================================================================================================
+void forwardProjectScalar(const ResponseMatrix& response, const double* spectrum, double* estimate) {
+    int num_measurements = response.num_measurements();
+    int num_bins = response.num_bins();
+
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        const double* response_row = response.row(i_meas);
+        double temp_value = 0;
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            temp_value += response_row[i_bin]*spectrum[i_bin];
+        }
+        estimate[i_meas] = temp_value;
+    }
+}
+
+//==================================================================================================
+// Scalar reference back projection:
+//  correction[i_bin] = (sum over i_meas of response(i_meas,i_bin)*ratio[i_meas]) / normalization[i_bin]
+// The normalization is applied once per bin (after summation). Pass NULL to skip normalization.
+//==================================================================================================
+void backProjectScalar(const ResponseMatrix& response, const double* ratio, const double* normalization,
+    double* correction)
+{
+    int num_measurements = response.num_measurements();
+    int num_bins = response.num_bins();
+
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        const double* response_column = response.column(i_bin);
+        double temp_value = 0;
+        for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+            temp_value += response_column[i_meas]*ratio[i_meas];
+        }
+        if (normalization) {
+            correction[i_bin] = temp_value/normalization[i_bin];
+        }
+        else {
+            correction[i_bin] = temp_value;
+        }
+    }
+}
+
+//==================================================================================================
+// Scalar reference batched forward projection. Spectra are stored bin-major (the values of all
+// samples for bin i_bin start at spectra[i_bin*stride]) and estimates measurement-major:
+//  estimates[i_meas*stride + i_samp] = sum over i_bin of response(i_meas,i_bin)*spectra[i_bin*stride + i_samp]
+// Each sample is summed in the same order as forwardProjectScalar, so results are identical.
+//==================================================================================================
+void forwardProjectBatchScalar(const ResponseMatrix& response, const double* spectra, int num_samples,
+    int stride, double* estimates)
+{
+    int num_measurements = response.num_measurements();
+    int num_bins = response.num_bins();
+
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        const double* response_row = response.row(i_meas);
+        for (int i_samp = 0; i_samp < num_samples; i_samp++) {
+            double temp_value = 0;
+            for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+                temp_value += response_row[i_bin]*spectra[i_bin*stride + i_samp];
+            }
+            estimates[i_meas*stride + i_samp] = temp_value;
+        }
+    }
+}
+
+//==================================================================================================
+// Scalar reference batched back projection. Ratios are stored measurement-major and corrections
+// bin-major (see forwardProjectBatchScalar). Pass NULL as the normalization to skip normalization.
+//==================================================================================================
+void backProjectBatchScalar(const ResponseMatrix& response, const double* ratios, int num_samples,
+    int stride, const double* normalization, double* corrections)
+{
+    int num_measurements = response.num_measurements();
+    int num_bins = response.num_bins();
+
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        const double* response_column = response.column(i_bin);
+        for (int i_samp = 0; i_samp < num_samples; i_samp++) {
+            double temp_value = 0;
+            for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+                temp_value += response_column[i_meas]*ratios[i_meas*stride + i_samp];
+            }
+            if (normalization) {
+                corrections[i_bin*stride + i_samp] = temp_value/normalization[i_bin];
+            }
+            else {
+                corrections[i_bin*stride + i_samp] = temp_value;
+            }
+        }
+    }
+}
+
+static bool alwaysSupported() {
+    return true;
+}
+
+#ifdef NNS_X86_KERNELS
+//==================================================================================================
+// SSE2 kernels: a block of 8 output values is held in 4 registers of 2 doubles.
+// The forward projection walks columns of the response (i.e. rows of the transposed copy), the back
+// projection walks rows of the response; both read contiguous, aligned memory.
+//==================================================================================================
+__attribute__((target("sse2")))
+static void forwardProjectSSE2(const ResponseMatrix& response, const double* spectrum, double* estimate) {
+    int num_measurements = response.num_measurements();
+    int num_bins = response.num_bins();
+
+    for (int i_block = 0; i_block < num_measurements; i_block += BLOCK) {
+        __m128d sum0 = _mm_setzero_pd();
+        __m128d sum1 = _mm_setzero_pd();
+        __m128d sum2 = _mm_setzero_pd();
+        __m128d sum3 = _mm_setzero_pd();
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            const double* response_column = response.column(i_bin) + i_block;
+            __m128d value = _mm_set1_pd(spectrum[i_bin]);
+            sum0 = _mm_add_pd(sum0, _mm_mul_pd(_mm_load_pd(response_column), value));
+            sum1 = _mm_add_pd(sum1, _mm_mul_pd(_mm_load_pd(response_column+2), value));
+            sum2 = _mm_add_pd(sum2, _mm_mul_pd(_mm_load_pd(response_column+4), value));
+            sum3 = _mm_add_pd(sum3, _mm_mul_pd(_mm_load_pd(response_column+6), value));
+        }
+        alignas(64) double block[BLOCK];
+        _mm_store_pd(block, sum0);
+        _mm_store_pd(block+2, sum1);
+        _mm_store_pd(block+4, sum2);
+        _mm_store_pd(block+6, sum3);
+        storeForwardBlock(block, i_block, num_measurements, estimate);
+    }
+}
+
+__attribute__((target("sse2")))
+static void backProjectSSE2(const ResponseMatrix& response, const double* ratio, const double* normalization,
+    double* correction)
+{
+    int num_measurements = response.num_measurements();
+    int num_bins = response.num_bins();
+
+    for (int i_block = 0; i_block < num_bins; i_block += BLOCK) {
+        __m128d sum0 = _mm_setzero_pd();
+        __m128d sum1 = _mm_setzero_pd();
+        __m128d sum2 = _mm_setzero_pd();
+        __m128d sum3 = _mm_setzero_pd();
+        for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+            const double* response_row = response.row(i_meas) + i_block;
+            __m128d value = _mm_set1_pd(ratio[i_meas]);
+            sum0 = _mm_add_pd(sum0, _mm_mul_pd(_mm_load_pd(response_row), value));
+            sum1 = _mm_add_pd(sum1, _mm_mul_pd(_mm_load_pd(response_row+2), value));
+            sum2 = _mm_add_pd(sum2, _mm_mul_pd(_mm_load_pd(response_row+4), value));
+            sum3 = _mm_add_pd(sum3, _mm_mul_pd(_mm_load_pd(response_row+6), value));
+        }
+        alignas(64) double block[BLOCK];
+        _mm_store_pd(block, sum0);
+        _mm_store_pd(block+2, sum1);
+        _mm_store_pd(block+4, sum2);
+        _mm_store_pd(block+6, sum3);
+        storeBackBlock(block, i_block, num_bins, normalization, correction);
+    }
+}
+
+//==================================================================================================
+// AVX2 kernels: a block of 8 output values is held in 2 registers of 4 doubles.
+// Note: FMA is deliberately not enabled, to keep results identical to the scalar reference.
+//==================================================================================================
+__attribute__((target("avx2")))
+static void forwardProjectAVX2(const ResponseMatrix& response, const double* spectrum, double* estimate) {
+    int num_measurements = response.num_measurements();
+    int num_bins = response.num_bins();
+
+    for (int i_block = 0; i_block < num_measurements; i_block += BLOCK) {
+        __m256d sum0 = _mm256_setzero_pd();
+        __m256d sum1 = _mm256_setzero_pd();
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            const double* response_column = response.column(i_bin) + i_block;
+            __m256d value = _mm256_set1_pd(spectrum[i_bin]);
+            sum0 = _mm256_add_pd(sum0, _mm256_mul_pd(_mm256_load_pd(response_column), value));
+            sum1 = _mm256_add_pd(sum1, _mm256_mul_pd(_mm256_load_pd(response_column+4), value));
+        }
+        alignas(64) double block[BLOCK];
+        _mm256_store_pd(block, sum0);
+        _mm256_store_pd(block+4, sum1);
+        _mm256_zeroupper(); // avoid AVX-SSE transition penalty in storeForwardBlock
+        storeForwardBlock(block, i_block, num_measurements, estimate);
+    }
+}
+
+__attribute__((target("avx2")))
+static void backProjectAVX2(const ResponseMatrix& response, const double* ratio, const double* normalization,
+    double* correction)
+{
+    int num_measurements = response.num_measurements();
+    int num_bins = response.num_bins();
+
+    for (int i_block = 0; i_block < num_bins; i_block += BLOCK) {
+        __m256d sum0 = _mm256_setzero_pd();
+        __m256d sum1 = _mm256_setzero_pd();
+        for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+            const double* response_row = response.row(i_meas) + i_block;
+            __m256d value = _mm256_set1_pd(ratio[i_meas]);
+            sum0 = _mm256_add_pd(sum0, _mm256_mul_pd(_mm256_load_pd(response_row), value));
+            sum1 = _mm256_add_pd(sum1, _mm256_mul_pd(_mm256_load_pd(response_row+4), value));
+        }
+        alignas(64) double block[BLOCK];
+        _mm256_store_pd(block, sum0);
+        _mm256_store_pd(block+4, sum1);
+        _mm256_zeroupper(); // avoid AVX-SSE transition penalty in storeBackBlock
+        storeBackBlock(block, i_block, num_bins, normalization, correction);
+    }
+}
+
+//==================================================================================================
+// AVX-512 kernels: a block of 8 output values is held in a single register.
+//==================================================================================================
+__attribute__((target("avx512f")))
+static void forwardProjectAVX512(const ResponseMatrix& response, const double* spectrum, double* estimate) {
+    int num_measurements = response.num_measurements();
+    int num_bins = response.num_bins();
+
+    for (int i_block = 0; i_block < num_measurements; i_block += BLOCK) {
+        __m512d sum = _mm512_setzero_pd();
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            const double* response_column = response.column(i_bin) + i_block;
+            sum = _mm512_add_pd(sum, _mm512_mul_pd(_mm512_load_pd(response_column), _mm512_set1_pd(spectrum[i_bin])));
+        }
+        alignas(64) double block[BLOCK];
+        _mm512_store_pd(block, sum);
+        _mm256_zeroupper(); // avoid AVX-SSE transition penalty in storeForwardBlock
+        storeForwardBlock(block, i_block, num_measurements, estimate);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void backProjectAVX512(const ResponseMatrix& response, const double* ratio, const double* normalization,
+    double* correction)
+{
+    int num_measurements = response.num_measurements();
+    int num_bins = response.num_bins();
+
+    for (int i_block = 0; i_block < num_bins; i_block += BLOCK) {
+        __m512d sum = _mm512_setzero_pd();
+        for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+            const double* response_row = response.row(i_meas) + i_block;
+            sum = _mm512_add_pd(sum, _mm512_mul_pd(_mm512_load_pd(response_row), _mm512_set1_pd(ratio[i_meas])));
+        }
+        alignas(64) double block[BLOCK];
+        _mm512_store_pd(block, sum);
+        _mm256_zeroupper(); // avoid AVX-SSE transition penalty in storeBackBlock
+        storeBackBlock(block, i_block, num_bins, normalization, correction);
+    }
+}
+
+//==================================================================================================
+// Batched kernels: the lanes of a block hold BLOCK samples (columns) of the same bin/measurement.
+// The stride is a multiple of BLOCK, so the last block may be loaded & stored in full; lanes past
+// num_samples hold values that are not used.
+//==================================================================================================
+__attribute__((target("sse2")))
+static void forwardProjectBatchSSE2(const ResponseMatrix& response, const double* spectra, int num_samples,
+    int stride, double* estimates)
+{
+    int num_measurements = response.num_measurements();
+    int num_bins = response.num_bins();
+
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        const double* response_row = response.row(i_meas);
+        for (int i_block = 0; i_block < num_samples; i_block += BLOCK) {
+            __m128d sum0 = _mm_setzero_pd();
+            __m128d sum1 = _mm_setzero_pd();
+            __m128d sum2 = _mm_setzero_pd();
+            __m128d sum3 = _mm_setzero_pd();
+            for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+                const double* values = spectra + i_bin*stride + i_block;
+                __m128d value = _mm_set1_pd(response_row[i_bin]);
+                sum0 = _mm_add_pd(sum0, _mm_mul_pd(value, _mm_loadu_pd(values)));
+                sum1 = _mm_add_pd(sum1, _mm_mul_pd(value, _mm_loadu_pd(values+2)));
+                sum2 = _mm_add_pd(sum2, _mm_mul_pd(value, _mm_loadu_pd(values+4)));
+                sum3 = _mm_add_pd(sum3, _mm_mul_pd(value, _mm_loadu_pd(values+6)));
+            }
+            double* output = estimates + i_meas*stride + i_block;
+            _mm_storeu_pd(output, sum0);
+            _mm_storeu_pd(output+2, sum1);
+            _mm_storeu_pd(output+4, sum2);
+            _mm_storeu_pd(output+6, sum3);
+        }
+    }
+}
+
+__attribute__((target("sse2")))
+static void backProjectBatchSSE2(const ResponseMatrix& response, const double* ratios, int num_samples,
+    int stride, const double* normalization, double* corrections)
+{
+    int num_measurements = response.num_measurements();
+    int num_bins = response.num_bins();
+
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        const double* response_column = response.column(i_bin);
+        for (int i_block = 0; i_block < num_samples; i_block += BLOCK) {
+            __m128d sum0 = _mm_setzero_pd();
+            __m128d sum1 = _mm_setzero_pd();
+            __m128d sum2 = _mm_setzero_pd();
+            __m128d sum3 = _mm_setzero_pd();
+            for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+                const double* values = ratios + i_meas*stride + i_block;
+                __m128d value = _mm_set1_pd(response_column[i_meas]);
+                sum0 = _mm_add_pd(sum0, _mm_mul_pd(value, _mm_loadu_pd(values)));
+                sum1 = _mm_add_pd(sum1, _mm_mul_pd(value, _mm_loadu_pd(values+2)));
+                sum2 = _mm_add_pd(sum2, _mm_mul_pd(value, _mm_loadu_pd(values+4)));
+                sum3 = _mm_add_pd(sum3, _mm_mul_pd(value, _mm_loadu_pd(values+6)));
+            }
+            if (normalization) {
+                __m128d norm = _mm_set1_pd(normalization[i_bin]);
+                sum0 = _mm_div_pd(sum0, norm);
+                sum1 = _mm_div_pd(sum1, norm);
+                sum2 = _mm_div_pd(sum2, norm);
+                sum3 = _mm_div_pd(sum3, norm);
+            }
+            double* output = corrections + i_bin*stride + i_block;
+            _mm_storeu_pd(output, sum0);
+            _mm_storeu_pd(output+2, sum1);
+            _mm_storeu_pd(output+4, sum2);
+            _mm_storeu_pd(output+6, sum3);
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void forwardProjectBatchAVX2(const ResponseMatrix& response, const double* spectra, int num_samples,
+    int stride, double* estimates)
+{
+    int num_measurements = response.num_measurements();
+    int num_bins = response.num_bins();
+
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        const double* response_row = response.row(i_meas);
+        for (int i_block = 0; i_block < num_samples; i_block += BLOCK) {
+            __m256d sum0 = _mm256_setzero_pd();
+            __m256d sum1 = _mm256_setzero_pd();
+            for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+                const double* values = spectra + i_bin*stride + i_block;
+                __m256d value = _mm256_set1_pd(response_row[i_bin]);
+                sum0 = _mm256_add_pd(sum0, _mm256_mul_pd(value, _mm256_loadu_pd(values)));
+                sum1 = _mm256_add_pd(sum1, _mm256_mul_pd(value, _mm256_loadu_pd(values+4)));
+            }
+            double* output = estimates + i_meas*stride + i_block;
+            _mm256_storeu_pd(output, sum0);
+            _mm256_storeu_pd(output+4, sum1);
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void backProjectBatchAVX2(const ResponseMatrix& response, const double* ratios, int num_samples,
+    int stride, const double* normalization, double* corrections)
+{
+    int num_measurements = response.num_measurements();
+    int num_bins = response.num_bins();
+
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        const double* response_column = response.column(i_bin);
+        for (int i_block = 0; i_block < num_samples; i_block += BLOCK) {
+            __m256d sum0 = _mm256_setzero_pd();
+            __m256d sum1 = _mm256_setzero_pd();
+            for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+                const double* values = ratios + i_meas*stride + i_block;
+                __m256d value = _mm256_set1_pd(response_column[i_meas]);
+                sum0 = _mm256_add_pd(sum0, _mm256_mul_pd(value, _mm256_loadu_pd(values)));
+                sum1 = _mm256_add_pd(sum1, _mm256_mul_pd(value, _mm256_loadu_pd(values+4)));
+            }
+            if (normalization) {
+                __m256d norm = _mm256_set1_pd(normalization[i_bin]);
+                sum0 = _mm256_div_pd(sum0, norm);
+                sum1 = _mm256_div_pd(sum1, norm);
+            }
+            double* output = corrections + i_bin*stride + i_block;
+            _mm256_storeu_pd(output, sum0);
+            _mm256_storeu_pd(output+4, sum1);
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+static void forwardProjectBatchAVX512(const ResponseMatrix& response, const double* spectra, int num_samples,
+    int stride, double* estimates)
+{
+    int num_measurements = response.num_measurements();
+    int num_bins = response.num_bins();
+
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        const double* response_row = response.row(i_meas);
+        for (int i_block = 0; i_block < num_samples; i_block += BLOCK) {
+            __m512d sum = _mm512_setzero_pd();
+            for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+                const double* values = spectra + i_bin*stride + i_block;
+                sum = _mm512_add_pd(sum, _mm512_mul_pd(_mm512_set1_pd(response_row[i_bin]), _mm512_loadu_pd(values)));
+            }
+            _mm512_storeu_pd(estimates + i_meas*stride + i_block, sum);
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+static void backProjectBatchAVX512(const ResponseMatrix& response, const double* ratios, int num_samples,
+    int stride, const double* normalization, double* corrections)
+{
+    int num_measurements = response.num_measurements();
+    int num_bins = response.num_bins();
+
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        const double* response_column = response.column(i_bin);
+        for (int i_block = 0; i_block < num_samples; i_block += BLOCK) {
+            __m512d sum = _mm512_setzero_pd();
+            for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+                const double* values = ratios + i_meas*stride + i_block;
+                sum = _mm512_add_pd(sum, _mm512_mul_pd(_mm512_set1_pd(response_column[i_meas]), _mm512_loadu_pd(values)));
+            }
+            if (normalization) {
+                sum = _mm512_div_pd(sum, _mm512_set1_pd(normalization[i_bin]));
+            }
+            _mm512_storeu_pd(corrections + i_bin*stride + i_block, sum);
+        }
+    }
+}
+
+static bool cpuSupportsSSE2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+}
+
+static bool cpuSupportsAVX2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+static bool cpuSupportsAVX512() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+}
+#endif
+
+// Available kernels, ordered from least to most preferred
+static const ProjectionKernel KERNELS[] = {
+    {"scalar", forwardProjectScalar, backProjectScalar, forwardProjectBatchScalar, backProjectBatchScalar,
+        alwaysSupported, true},
+#ifdef NNS_X86_KERNELS
+    {"sse2", forwardProjectSSE2, backProjectSSE2, forwardProjectBatchSSE2, backProjectBatchSSE2,
+        cpuSupportsSSE2, true},
+    {"avx2", forwardProjectAVX2, backProjectAVX2, forwardProjectBatchAVX2, backProjectBatchAVX2,
+        cpuSupportsAVX2, true},
+    // Not selected automatically: with 8-value blocks AVX-512 offers no extra parallelism over AVX2,
+    // and on some CPUs lowers the clock frequency. Measured slower than AVX2 for the NNS responses.
+    {"avx512", forwardProjectAVX512, backProjectAVX512, forwardProjectBatchAVX512, backProjectBatchAVX512,
+        cpuSupportsAVX512, false},
+#endif
+};
+static const int NUM_KERNELS = sizeof(KERNELS)/sizeof(KERNELS[0]);
+
+//==================================================================================================
+// Return the most preferred kernel supported by the CPU (among those eligible for automatic
+// selection). Resolved once; the initialization of the local static is thread-safe.
+//==================================================================================================
+static const ProjectionKernel* bestKernel() {
+    static const ProjectionKernel* const best = []() {
+        const ProjectionKernel* kernel = NULL;
+        for (int i = 0; i < NUM_KERNELS; i++) {
+            if (KERNELS[i].automatic && KERNELS[i].supported()) {
+                kernel = &KERNELS[i];
+            }
+        }
+        return kernel;
+    }();
+    return best;
+}
+
+// The kernel currently in use. Resolved on first use if not explicitly set.
+static std::atomic<const ProjectionKernel*> active_kernel(NULL);
+
+static const ProjectionKernel* activeKernel() {
+    const ProjectionKernel* kernel = active_kernel.load(std::memory_order_relaxed);
+    if (!kernel) {
+        kernel = bestKernel();
+        active_kernel.store(kernel, std::memory_order_relaxed);
+    }
+    return kernel;
+}
+
+//==================================================================================================
+// Forward projection using the active kernel. estimate must hold num_measurements values.
+//==================================================================================================
+void forwardProject(const ResponseMatrix& response, const double* spectrum, double* estimate) {
+    activeKernel()->forward(response, spectrum, estimate);
+}
+
+//==================================================================================================
+// Back projection using the active kernel. correction must hold num_bins values. Pass NULL as the
+// normalization to obtain the unnormalized back projection.
+//==================================================================================================
+void backProject(const ResponseMatrix& response, const double* ratio, const double* normalization,
+    double* correction)
+{
+    activeKernel()->back(response, ratio, normalization, correction);
+}
+
+//==================================================================================================
+// Complain if a batch stride is not a multiple of the block length (required by the batched kernels)
+//==================================================================================================
+static void checkBatchStride(int num_samples, int stride) {
+    if (stride % BLOCK != 0 || num_samples > stride) {
+        std::ostringstream error_message;
+        error_message << "Invalid batch layout: " << num_samples << " samples with a stride of " << stride
+            << " (stride must be a multiple of " << BLOCK << ")";
+        throw std::logic_error(error_message.str());
+    }
+}
+
+//==================================================================================================
+// Batched forward projection using the active kernel. Projects num_samples spectra at once, so each
+// response value is loaded once per batch. See forwardProjectBatchScalar for the layout. stride must
+// be a multiple of getProjectionBatchBlock().
+//==================================================================================================
+void forwardProjectBatch(const ResponseMatrix& response, const double* spectra, int num_samples, int stride,
+    double* estimates)
+{
+    checkBatchStride(num_samples, stride);
+    activeKernel()->forward_batch(response, spectra, num_samples, stride, estimates);
+}
+
+//==================================================================================================
+// Batched back projection using the active kernel. See backProjectBatchScalar for the layout.
+//==================================================================================================
+void backProjectBatch(const ResponseMatrix& response, const double* ratios, int num_samples, int stride,
+    const double* normalization, double* corrections)
+{
+    checkBatchStride(num_samples, stride);
+    activeKernel()->back_batch(response, ratios, num_samples, stride, normalization, corrections);
+}
+
+//==================================================================================================
+// Return the number of samples processed together by the batched kernels. Batch strides must be a
+// multiple of this value.
+//==================================================================================================
+int getProjectionBatchBlock() {
+    return BLOCK;
+}
+
+//==================================================================================================
+// Check whether the named kernel exists and is supported by the CPU
+//==================================================================================================
+bool projectionKernelSupported(std::string kernel) {
+    if (kernel == "auto") {
+        return true;
+    }
+    for (int i = 0; i < NUM_KERNELS; i++) {
+        if (kernel == KERNELS[i].name) {
+            return KERNELS[i].supported();
+        }
+    }
+    return false;
+}
+
+//==================================================================================================
+// Select the kernel used for projections: "auto" (best supported by the CPU), "scalar", "sse2",
+// "avx2" or "avx512". Throws if the kernel is unknown or unsupported by the CPU.
+//==================================================================================================
+void setProjectionKernel(std::string kernel) {
+    if (kernel == "auto") {
+        active_kernel.store(bestKernel(), std::memory_order_relaxed);
+        return;
+    }
+    for (int i = 0; i < NUM_KERNELS; i++) {
+        if (kernel == KERNELS[i].name) {
+            if (!KERNELS[i].supported()) {
+                throw std::logic_error("Projection kernel not supported by this CPU: " + kernel);
+            }
+            active_kernel.store(&KERNELS[i], std::memory_order_relaxed);
+            return;
+        }
+    }
+    throw std::logic_error("Unrecognized projection kernel: " + kernel
+        + ". Please refer to the README for allowed kernels");
+}
+
+//==================================================================================================
+// Return the name of the kernel currently used for projections
+//==================================================================================================
+std::string getProjectionKernel() {
+    return activeKernel()->name;
+}
+
+//==================================================================================================
+// Return the names of all kernels supported by the CPU (least to most preferred)
+//==================================================================================================
+std::vector<std::string> getSupportedProjectionKernels() {
+    std::vector<std::string> kernels;
+    for (int i = 0; i < NUM_KERNELS; i++) {
+        if (KERNELS[i].supported()) {
+            kernels.push_back(KERNELS[i].name);
+        }
+    }
+    return kernels;
+}
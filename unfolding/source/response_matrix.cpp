@@ -0,0 +1,161 @@
+//**************************************************************************************************
+// The functions included in this module manage storage of the NNS response (system) matrix in a
+// layout suited to the projections performed by the unfolding algorithms, and its normalization.
+//**************************************************************************************************
+
+#include "response_matrix.h"
+
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string.h>
+
+//==================================================================================================
+// Round a number of doubles up such that the corresponding number of bytes is a multiple of the
+// alignment of the matrix buffer
+//==================================================================================================
+static int paddedLength(int length) {
+    int doubles_per_block = ResponseMatrix::ALIGNMENT / sizeof(double);
+    return ((length + doubles_per_block - 1) / doubles_per_block) * doubles_per_block;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Default constructor for ResponseMatrix (empty matrix)
+//--------------------------------------------------------------------------------------------------
+ResponseMatrix::ResponseMatrix() {
+    n_meas = 0;
+    n_bins = 0;
+    row_stride = 0;
+    column_stride = 0;
+    values = NULL;
+    values_transposed = NULL;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Create a zero-filled matrix with the given dimensions
+//--------------------------------------------------------------------------------------------------
+ResponseMatrix::ResponseMatrix(int num_measurements, int num_bins) {
+    n_meas = 0;
+    n_bins = 0;
+    row_stride = 0;
+    column_stride = 0;
+    values = NULL;
+    values_transposed = NULL;
+    resize(num_measurements, num_bins);
+}
+
+ResponseMatrix::ResponseMatrix(const ResponseMatrix& other) {
+    n_meas = 0;
+    n_bins = 0;
+    row_stride = 0;
+    column_stride = 0;
+    values = NULL;
+    values_transposed = NULL;
+    *this = other;
+}
+
+ResponseMatrix& ResponseMatrix::operator=(const ResponseMatrix& other) {
+    if (this != &other) {
+        resize(other.n_meas, other.n_bins);
+        if (!empty()) {
+            memcpy(values, other.values, sizeof(double)*n_meas*row_stride);
+            memcpy(values_transposed, other.values_transposed, sizeof(double)*n_bins*column_stride);
+        }
+    }
+    return *this;
+}
+
+ResponseMatrix::~ResponseMatrix() {
+    release();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Set the dimensions of the matrix. Any existing values are discarded and all elements (including
+// padding) are set to zero.
+//--------------------------------------------------------------------------------------------------
+void ResponseMatrix::resize(int num_measurements, int num_bins) {
+    if (num_measurements < 0 || num_bins < 0) {
+        std::ostringstream error_message;
+        error_message << "Invalid response matrix dimensions: " << num_measurements << " x " << num_bins;
+        throw std::logic_error(error_message.str());
+    }
+    release();
+    n_meas = num_measurements;
+    n_bins = num_bins;
+    row_stride = paddedLength(n_bins);
+    column_stride = paddedLength(n_meas);
+    allocate();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Assign a single response value. Both the row-major and the transposed copies are updated.
+//--------------------------------------------------------------------------------------------------
+void ResponseMatrix::set(int i_meas, int i_bin, double value) {
+    values[i_meas*row_stride + i_bin] = value;
+    values_transposed[i_bin*column_stride + i_meas] = value;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Assign all response values at once, from unpadded row-major (measurements x bins) values and
+// their (precomputed) transpose (bins x measurements)
+//--------------------------------------------------------------------------------------------------
+void ResponseMatrix::assign(const double* row_values, const double* column_values) {
+    for (int i_meas = 0; i_meas < n_meas; i_meas++) {
+        memcpy(values + i_meas*row_stride, row_values + i_meas*n_bins, sizeof(double)*n_bins);
+    }
+    for (int i_bin = 0; i_bin < n_bins; i_bin++) {
+        memcpy(values_transposed + i_bin*column_stride, column_values + i_bin*n_meas, sizeof(double)*n_meas);
+    }
+}
+
+void ResponseMatrix::allocate() {
+    if (empty()) {
+        return;
+    }
+    void* buffer = NULL;
+    void* buffer_transposed = NULL;
+    if (posix_memalign(&buffer, ALIGNMENT, sizeof(double)*n_meas*row_stride) != 0
+        || posix_memalign(&buffer_transposed, ALIGNMENT, sizeof(double)*n_bins*column_stride) != 0)
+    {
+        free(buffer);
+        n_meas = 0;
+        n_bins = 0;
+        throw std::bad_alloc();
+    }
+    values = static_cast<double*>(buffer);
+    values_transposed = static_cast<double*>(buffer_transposed);
+    memset(values, 0, sizeof(double)*n_meas*row_stride);
+    memset(values_transposed, 0, sizeof(double)*n_bins*column_stride);
+}
+
+void ResponseMatrix::release() {
+    free(values);
+    free(values_transposed);
+    values = NULL;
+    values_transposed = NULL;
+}
+
+//==================================================================================================
+// Return a 1D normalized vector of a system matrix used in MLEM-style reconstruction algorithms
+//==================================================================================================
+std::vector<double> normalizeResponse(int num_bins, int num_measurements, const ResponseMatrix& system_response)
+{
+    std::vector<double> normalized_vector;
+    // Create the normalization factors to be applied to MLEM-estimated spectral values:
+    //  - each element of f stores the sum of 8 elements of the transpose system (response)
+    //    matrix. The 8 elements correspond to the relative contributions of each MLEM-estimated
+    //    data point to the MLEM-estimated spectral value.
+    for(int i_bin = 0; i_bin < num_bins; i_bin++)
+    {
+        const double* response_column = system_response.column(i_bin);
+        double temp_value = 0;
+        for(int i_meas = 0; i_meas < num_measurements; i_meas++)
+        {
+            temp_value += response_column[i_meas];
+        }
+        normalized_vector.push_back(temp_value);
+    }
+
+    return normalized_vector;
+}
@@ -0,0 +1,687 @@
+//**************************************************************************************************
+// The functions included in this module append unfolded spectra to a spectra store, look them up &
+// read them back, and export them to the legacy CSV layouts (see SpectraStore).
+//
+// Spectra store file format (native byte order, version SPECTRA_STORE_VERSION):
+//  - header (40 bytes): magic "NNSSPEC\0", version, byte order mark (0x01020304), # of bins,
+//    reserved (0) [all uint32], # of entries, end of the last entry [bytes] [uint64]
+//  - energy bins [# bins doubles]
+//  - for each entry: name length [uint32], name, spectrum, lower uncertainty, upper uncertainty
+//    [# bins doubles each]
+// Index file format (<store>.idx):
+//  - header (32 bytes): magic "NNSSIDX\0", version, byte order mark [uint32], # of entries, end of
+//    the last entry [bytes] [uint64]
+//  - for each entry: position in the store [uint64], name length [uint32], name
+//
+// An entry is appended by writing it after the last entry, then updating the header (the # of
+// entries & the end of the last entry), so that an interrupted append leaves the store as it was.
+// The index is updated in the same way afterwards. Appends hold an exclusive lock on the store
+// (readers a shared lock), so that concurrent unfold_spectrum runs can append to the same store.
+//**************************************************************************************************
+
+#include "spectra_store.h"
+#include "fileio.h"
+
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+const char STORE_MAGIC[8] = {'N','N','S','S','P','E','C','\0'};
+const char INDEX_MAGIC[8] = {'N','N','S','S','I','D','X','\0'};
+const uint32_t STORE_BYTE_ORDER = 0x01020304;
+const size_t STORE_HEADER_SIZE = 40;
+const size_t INDEX_HEADER_SIZE = 32;
+
+extern std::string UNCERTAINTY_SUFFIX;
+
+// Fields of the store & index headers that vary
+struct StoreHeader {
+    uint32_t num_bins;
+    uint64_t num_entries;
+    uint64_t data_end;
+};
+
+//==================================================================================================
+// Read size bytes at position offset of the file to data. Returns false if the file ends before.
+//==================================================================================================
+static bool readAt(int file_descriptor, void *data, size_t size, uint64_t offset) {
+    char *bytes = (char*)data;
+    while (size > 0) {
+        ssize_t num_read = pread(file_descriptor, bytes, size, offset);
+        if (num_read <= 0) {
+            return false;
+        }
+        bytes += num_read;
+        size -= num_read;
+        offset += num_read;
+    }
+    return true;
+}
+
+//==================================================================================================
+// Write size bytes at data to position offset of the file. Throws on failure.
+//==================================================================================================
+static void writeAt(int file_descriptor, const void *data, size_t size, uint64_t offset,
+    const std::string &path)
+{
+    const char *bytes = (const char*)data;
+    while (size > 0) {
+        ssize_t num_written = pwrite(file_descriptor, bytes, size, offset);
+        if (num_written <= 0) {
+            throw std::logic_error("Unable to write to spectra store: " + path);
+        }
+        bytes += num_written;
+        size -= num_written;
+        offset += num_written;
+    }
+}
+
+//==================================================================================================
+// Append size bytes at data to buffer
+//==================================================================================================
+static void appendBytes(std::vector<char> &buffer, const void *data, size_t size) {
+    const char *bytes = (const char*)data;
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+//==================================================================================================
+// Return the size of an entry named name, for spectra of num_bins bins
+//==================================================================================================
+static uint64_t entrySize(size_t name_length, uint32_t num_bins) {
+    return sizeof(uint32_t) + name_length + 3*sizeof(double)*(uint64_t)num_bins;
+}
+
+//==================================================================================================
+// Serialize a store or index header (magic & fields) to buffer
+//==================================================================================================
+static void packHeader(std::vector<char> &buffer, const char *magic, const StoreHeader &header,
+    bool is_store)
+{
+    uint32_t reserved = 0;
+    buffer.clear();
+    appendBytes(buffer, magic, 8);
+    appendBytes(buffer, &SPECTRA_STORE_VERSION, sizeof(uint32_t));
+    appendBytes(buffer, &STORE_BYTE_ORDER, sizeof(uint32_t));
+    if (is_store) {
+        appendBytes(buffer, &header.num_bins, sizeof(uint32_t));
+        appendBytes(buffer, &reserved, sizeof(uint32_t));
+    }
+    appendBytes(buffer, &header.num_entries, sizeof(uint64_t));
+    appendBytes(buffer, &header.data_end, sizeof(uint64_t));
+}
+
+//==================================================================================================
+// Read & validate the header of a spectra store. Throws if the file is not a valid store of the
+// current version.
+//==================================================================================================
+static void readStoreHeader(int file_descriptor, const std::string &path, StoreHeader &header) {
+    char buffer[STORE_HEADER_SIZE];
+    if (!readAt(file_descriptor, buffer, STORE_HEADER_SIZE, 0)
+        || memcmp(buffer, STORE_MAGIC, sizeof(STORE_MAGIC)) != 0)
+    {
+        throw std::logic_error("Invalid spectra store: " + path);
+    }
+    uint32_t version, byte_order;
+    memcpy(&version, buffer + 8, sizeof(uint32_t));
+    memcpy(&byte_order, buffer + 12, sizeof(uint32_t));
+    memcpy(&header.num_bins, buffer + 16, sizeof(uint32_t));
+    memcpy(&header.num_entries, buffer + 24, sizeof(uint64_t));
+    memcpy(&header.data_end, buffer + 32, sizeof(uint64_t));
+    if (byte_order != STORE_BYTE_ORDER) {
+        throw std::logic_error("Invalid spectra store: " + path);
+    }
+    if (version != SPECTRA_STORE_VERSION) {
+        std::ostringstream error_message;
+        error_message << "Spectra store " << path << " has version " << version << " (expected "
+            << SPECTRA_STORE_VERSION << ")";
+        throw std::logic_error(error_message.str());
+    }
+    uint64_t data_begin = STORE_HEADER_SIZE + sizeof(double)*(uint64_t)header.num_bins;
+    struct stat file_status;
+    if (fstat(file_descriptor, &file_status) != 0 || header.data_end < data_begin
+        || header.data_end > (uint64_t)file_status.st_size)
+    {
+        throw std::logic_error("Corrupt spectra store (truncated): " + path);
+    }
+}
+
+//==================================================================================================
+// Read the header of the index of a spectra store. Returns false if the index is not valid.
+//==================================================================================================
+static bool readIndexHeader(int file_descriptor, StoreHeader &header) {
+    char buffer[INDEX_HEADER_SIZE];
+    if (!readAt(file_descriptor, buffer, INDEX_HEADER_SIZE, 0)
+        || memcmp(buffer, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0)
+    {
+        return false;
+    }
+    uint32_t version, byte_order;
+    memcpy(&version, buffer + 8, sizeof(uint32_t));
+    memcpy(&byte_order, buffer + 12, sizeof(uint32_t));
+    memcpy(&header.num_entries, buffer + 16, sizeof(uint64_t));
+    memcpy(&header.data_end, buffer + 24, sizeof(uint64_t));
+    struct stat file_status;
+    return version == SPECTRA_STORE_VERSION && byte_order == STORE_BYTE_ORDER
+        && fstat(file_descriptor, &file_status) == 0 && header.data_end >= INDEX_HEADER_SIZE
+        && header.data_end <= (uint64_t)file_status.st_size;
+}
+
+//==================================================================================================
+// Read the names & positions of the entries of a spectra store from its index file. Returns false
+// if the index is missing, invalid or out of date (does not list all entries of the store).
+//==================================================================================================
+static bool readIndex(const std::string &path, const StoreHeader &store_header,
+    std::vector<std::string> &names, std::vector<uint64_t> &offsets)
+{
+    std::string index_path = path + ".idx";
+    int file_descriptor = open(index_path.c_str(), O_RDONLY);
+    if (file_descriptor < 0) {
+        return false;
+    }
+    StoreHeader index_header;
+    std::vector<char> data;
+    bool valid = readIndexHeader(file_descriptor, index_header)
+        && index_header.num_entries == store_header.num_entries;
+    if (valid) {
+        data.resize(index_header.data_end - INDEX_HEADER_SIZE);
+        valid = readAt(file_descriptor, data.data(), data.size(), INDEX_HEADER_SIZE);
+    }
+    close(file_descriptor);
+    if (!valid) {
+        return false;
+    }
+
+    names.clear();
+    offsets.clear();
+    size_t position = 0;
+    uint64_t data_begin = STORE_HEADER_SIZE + sizeof(double)*(uint64_t)store_header.num_bins;
+    for (uint64_t i_entry = 0; i_entry < index_header.num_entries; i_entry++) {
+        uint64_t offset;
+        uint32_t name_length;
+        if (data.size() - position < sizeof(uint64_t) + sizeof(uint32_t)) {
+            return false;
+        }
+        memcpy(&offset, data.data() + position, sizeof(uint64_t));
+        memcpy(&name_length, data.data() + position + sizeof(uint64_t), sizeof(uint32_t));
+        position += sizeof(uint64_t) + sizeof(uint32_t);
+        if (data.size() - position < name_length || offset < data_begin
+            || offset + entrySize(name_length, store_header.num_bins) > store_header.data_end)
+        {
+            return false;
+        }
+        names.push_back(std::string(data.data() + position, name_length));
+        offsets.push_back(offset);
+        position += name_length;
+    }
+    return true;
+}
+
+//==================================================================================================
+// Read the names & positions of the entries of a spectra store from the store itself (reading the
+// name of every entry). Used when its index is missing or out of date.
+//==================================================================================================
+static void scanStore(int file_descriptor, const std::string &path, const StoreHeader &header,
+    std::vector<std::string> &names, std::vector<uint64_t> &offsets)
+{
+    names.clear();
+    offsets.clear();
+    uint64_t offset = STORE_HEADER_SIZE + sizeof(double)*(uint64_t)header.num_bins;
+    for (uint64_t i_entry = 0; i_entry < header.num_entries; i_entry++) {
+        uint32_t name_length;
+        std::string name;
+        if (!readAt(file_descriptor, &name_length, sizeof(uint32_t), offset)
+            || offset + entrySize(name_length, header.num_bins) > header.data_end)
+        {
+            throw std::logic_error("Corrupt spectra store (truncated): " + path);
+        }
+        name.resize(name_length);
+        if (name_length > 0 && !readAt(file_descriptor, &name[0], name_length, offset + sizeof(uint32_t))) {
+            throw std::logic_error("Corrupt spectra store (truncated): " + path);
+        }
+        names.push_back(name);
+        offsets.push_back(offset);
+        offset += entrySize(name_length, header.num_bins);
+    }
+}
+
+//==================================================================================================
+// Rewrite the index file of a spectra store listing the given entries
+//==================================================================================================
+static void writeIndex(int file_descriptor, const std::string &index_path,
+    const std::vector<std::string> &names, const std::vector<uint64_t> &offsets)
+{
+    std::vector<char> entries;
+    for (size_t i_entry = 0; i_entry < names.size(); i_entry++) {
+        uint32_t name_length = names[i_entry].size();
+        appendBytes(entries, &offsets[i_entry], sizeof(uint64_t));
+        appendBytes(entries, &name_length, sizeof(uint32_t));
+        appendBytes(entries, names[i_entry].data(), name_length);
+    }
+    StoreHeader index_header;
+    index_header.num_bins = 0;
+    index_header.num_entries = names.size();
+    index_header.data_end = INDEX_HEADER_SIZE + entries.size();
+    std::vector<char> header;
+    packHeader(header, INDEX_MAGIC, index_header, false);
+
+    if (ftruncate(file_descriptor, 0) != 0) {
+        throw std::logic_error("Unable to write to spectra store: " + index_path);
+    }
+    writeAt(file_descriptor, entries.data(), entries.size(), INDEX_HEADER_SIZE, index_path);
+    writeAt(file_descriptor, header.data(), header.size(), 0, index_path);
+}
+
+//==================================================================================================
+// Return true if the file at path is a spectra store (rather than e.g. a CSV spectra file)
+//==================================================================================================
+bool isSpectraStore(const std::string &path) {
+    int file_descriptor = open(path.c_str(), O_RDONLY);
+    if (file_descriptor < 0) {
+        return false;
+    }
+    char magic[sizeof(STORE_MAGIC)];
+    bool is_store = readAt(file_descriptor, magic, sizeof(magic), 0)
+        && memcmp(magic, STORE_MAGIC, sizeof(magic)) == 0;
+    close(file_descriptor);
+    return is_store;
+}
+
+//==================================================================================================
+// Append a spectrum & its uncertainties to the spectra store at path (created if it does not
+// exist). Throws if the energy bins differ from those of the spectra already in the store.
+//
+// Args:
+//  - path: the spectra store
+//  - irradiation_conditions: string that specifies measurement conditions (name of the entry)
+//  - energy_bins: the energy bins corresponding to spectral values
+//  - spectrum: the unfolded neutron flux spectrum
+//  - error_lower: the lower uncertainty spectrum for the neutron flux
+//  - error_upper: the upper uncertainty spectrum for the neutron flux
+//==================================================================================================
+void appendToSpectraStore(const std::string &path, const std::string &irradiation_conditions,
+    const std::vector<double> &energy_bins, const std::vector<double> &spectrum,
+    const std::vector<double> &error_lower, const std::vector<double> &error_upper)
+{
+    uint32_t num_bins = energy_bins.size();
+    checkDimensions(num_bins, "number of energy bins", spectrum.size(), "Spectrum");
+    checkDimensions(num_bins, "number of energy bins", error_lower.size(), "Lower uncertainty");
+    checkDimensions(num_bins, "number of energy bins", error_upper.size(), "Upper uncertainty");
+
+    int file_descriptor = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (file_descriptor < 0) {
+        throw std::logic_error("Unable to open spectra store: " + path);
+    }
+    int index_descriptor = -1;
+    std::string index_path = path + ".idx";
+
+    try {
+        if (flock(file_descriptor, LOCK_EX) != 0) {
+            throw std::logic_error("Unable to lock spectra store: " + path);
+        }
+
+        // New store: write the header & energy bins. Existing store: check the energy bins.
+        StoreHeader header;
+        struct stat file_status;
+        if (fstat(file_descriptor, &file_status) != 0) {
+            throw std::logic_error("Unable to open spectra store: " + path);
+        }
+        if (file_status.st_size == 0) {
+            header.num_bins = num_bins;
+            header.num_entries = 0;
+            header.data_end = STORE_HEADER_SIZE + sizeof(double)*(uint64_t)num_bins;
+            std::vector<char> buffer;
+            packHeader(buffer, STORE_MAGIC, header, true);
+            appendBytes(buffer, energy_bins.data(), sizeof(double)*num_bins);
+            writeAt(file_descriptor, buffer.data(), buffer.size(), 0, path);
+        }
+        else {
+            readStoreHeader(file_descriptor, path, header);
+            std::vector<double> store_bins(header.num_bins);
+            if (header.num_bins != num_bins
+                || !readAt(file_descriptor, store_bins.data(), sizeof(double)*num_bins, STORE_HEADER_SIZE)
+                || memcmp(store_bins.data(), energy_bins.data(), sizeof(double)*num_bins) != 0)
+            {
+                throw std::logic_error("Energy bins of " + irradiation_conditions
+                    + " differ from those of spectra store: " + path);
+            }
+        }
+
+        // Write the entry after the last entry, then commit it by updating the header
+        uint32_t name_length = irradiation_conditions.size();
+        uint64_t offset = header.data_end;
+        std::vector<char> entry;
+        appendBytes(entry, &name_length, sizeof(uint32_t));
+        appendBytes(entry, irradiation_conditions.data(), name_length);
+        appendBytes(entry, spectrum.data(), sizeof(double)*num_bins);
+        appendBytes(entry, error_lower.data(), sizeof(double)*num_bins);
+        appendBytes(entry, error_upper.data(), sizeof(double)*num_bins);
+        writeAt(file_descriptor, entry.data(), entry.size(), offset, path);
+
+        StoreHeader previous_header = header;
+        header.num_entries++;
+        header.data_end += entry.size();
+        std::vector<char> buffer;
+        packHeader(buffer, STORE_MAGIC, header, true);
+        writeAt(file_descriptor, buffer.data(), buffer.size(), 0, path);
+
+        // Append the entry to the index if it was up to date, or else rebuild it
+        index_descriptor = open(index_path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (index_descriptor < 0) {
+            throw std::logic_error("Unable to open spectra store: " + index_path);
+        }
+        StoreHeader index_header;
+        if (readIndexHeader(index_descriptor, index_header)
+            && index_header.num_entries == previous_header.num_entries)
+        {
+            std::vector<char> index_entry;
+            appendBytes(index_entry, &offset, sizeof(uint64_t));
+            appendBytes(index_entry, &name_length, sizeof(uint32_t));
+            appendBytes(index_entry, irradiation_conditions.data(), name_length);
+            writeAt(index_descriptor, index_entry.data(), index_entry.size(), index_header.data_end, index_path);
+            index_header.num_entries++;
+            index_header.data_end += index_entry.size();
+            packHeader(buffer, INDEX_MAGIC, index_header, false);
+            writeAt(index_descriptor, buffer.data(), buffer.size(), 0, index_path);
+        }
+        else {
+            std::vector<std::string> names;
+            std::vector<uint64_t> offsets;
+            scanStore(file_descriptor, path, header, names, offsets);
+            writeIndex(index_descriptor, index_path, names, offsets);
+        }
+    }
+    catch (...) {
+        if (index_descriptor >= 0) {
+            close(index_descriptor);
+        }
+        close(file_descriptor);
+        throw;
+    }
+    close(index_descriptor);
+    close(file_descriptor); // releases the lock
+}
+
+//--------------------------------------------------------------------------------------------------
+// Default constructor for SpectraStore (no store open)
+//--------------------------------------------------------------------------------------------------
+SpectraStore::SpectraStore() {
+    file_descriptor = -1;
+}
+
+SpectraStore::~SpectraStore() {
+    close();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Open the spectra store at path, reading its energy bins & the names of its entries (from its
+// index, or from the store itself if the index is missing or out of date). Throws if the file is
+// not a valid store of the current version.
+//--------------------------------------------------------------------------------------------------
+void SpectraStore::open(const std::string &path) {
+    close();
+    this->path = path;
+
+    file_descriptor = ::open(path.c_str(), O_RDONLY);
+    if (file_descriptor < 0) {
+        throw std::logic_error("Unable to open spectra store: " + path);
+    }
+
+    // Hold a shared lock while reading the header & index, so that no entry is half appended
+    flock(file_descriptor, LOCK_SH);
+    std::vector<std::string> names;
+    std::vector<uint64_t> offsets;
+    try {
+        StoreHeader header;
+        readStoreHeader(file_descriptor, path, header);
+        energy_bins.resize(header.num_bins);
+        if (!readAt(file_descriptor, energy_bins.data(), sizeof(double)*header.num_bins, STORE_HEADER_SIZE)) {
+            throw std::logic_error("Corrupt spectra store (truncated): " + path);
+        }
+        if (!readIndex(path, header, names, offsets)) {
+            scanStore(file_descriptor, path, header, names, offsets);
+        }
+    }
+    catch (...) {
+        close();
+        throw;
+    }
+    flock(file_descriptor, LOCK_UN);
+
+    entries.resize(names.size());
+    for (size_t i_entry = 0; i_entry < names.size(); i_entry++) {
+        entries[i_entry].name = names[i_entry];
+        entries[i_entry].offset = offsets[i_entry];
+        entries_by_name[names[i_entry]].push_back(i_entry);
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Close the store (if any)
+//--------------------------------------------------------------------------------------------------
+void SpectraStore::close() {
+    if (file_descriptor >= 0) {
+        ::close(file_descriptor);
+        file_descriptor = -1;
+    }
+    energy_bins.clear();
+    entries.clear();
+    entries_by_name.clear();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the index of the most recent entry named irradiation_conditions, or -1 if there is none
+//--------------------------------------------------------------------------------------------------
+int SpectraStore::find(const std::string &irradiation_conditions) const {
+    std::map<std::string, std::vector<int>>::const_iterator match = entries_by_name.find(irradiation_conditions);
+    if (match == entries_by_name.end()) {
+        return -1;
+    }
+    return match->second.back();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the indices of all entries named irradiation_conditions, in the order they were appended
+//--------------------------------------------------------------------------------------------------
+std::vector<int> SpectraStore::findAll(const std::string &irradiation_conditions) const {
+    std::map<std::string, std::vector<int>>::const_iterator match = entries_by_name.find(irradiation_conditions);
+    if (match == entries_by_name.end()) {
+        return std::vector<int>();
+    }
+    return match->second;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the indices of the entries selected by their irradiation conditions (the most recent
+// entry of each), in the order of selection. If selection is empty, all entries are selected.
+// Throws if no entry matches one of the irradiation conditions.
+//--------------------------------------------------------------------------------------------------
+std::vector<int> SpectraStore::select(const std::vector<std::string> &selection) const {
+    std::vector<int> selected_entries;
+    if (selection.empty()) {
+        for (int i_entry = 0; i_entry < (int)entries.size(); i_entry++) {
+            selected_entries.push_back(i_entry);
+        }
+        return selected_entries;
+    }
+    for (size_t i_selected = 0; i_selected < selection.size(); i_selected++) {
+        int i_entry = find(selection[i_selected]);
+        if (i_entry < 0) {
+            throw std::logic_error("No spectrum \"" + selection[i_selected] + "\" in spectra store: " + path);
+        }
+        selected_entries.push_back(i_entry);
+    }
+    return selected_entries;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Read the spectrum & uncertainties of entry i_entry (reading only that entry from the store)
+//--------------------------------------------------------------------------------------------------
+void SpectraStore::read(int i_entry, std::vector<double> &spectrum, std::vector<double> &error_lower,
+    std::vector<double> &error_upper) const
+{
+    if (i_entry < 0 || i_entry >= (int)entries.size()) {
+        throw std::logic_error("Spectra store entry " + std::to_string(i_entry) + " out of range: " + path);
+    }
+    size_t num_bins = energy_bins.size();
+    std::vector<double> values(3*num_bins);
+    uint64_t offset = entries[i_entry].offset + sizeof(uint32_t) + entries[i_entry].name.size();
+    if (!readAt(file_descriptor, values.data(), sizeof(double)*values.size(), offset)) {
+        throw std::logic_error("Corrupt spectra store (truncated): " + path);
+    }
+    spectrum.assign(values.begin(), values.begin() + num_bins);
+    error_lower.assign(values.begin() + num_bins, values.begin() + 2*num_bins);
+    error_upper.assign(values.begin() + 2*num_bins, values.end());
+}
+
+//--------------------------------------------------------------------------------------------------
+// Export the selected entries to csv_path in the row layout of saveSpectrumAsRow (energy bins on the
+// first row, then 3 rows per entry). The uncertainties are written in the order unfold_spectrum has
+// always saved them (upper uncertainty on the 2nd row of each entry, lower on the 3rd), which is the
+// order in which readSpectra reads them, so that exported files are interchangeable with existing
+// output spectra files.
+//--------------------------------------------------------------------------------------------------
+void SpectraStore::exportRows(const std::string &csv_path, const std::vector<int> &selected_entries) const {
+    std::ofstream csv_file(csv_path);
+    if (!csv_file) {
+        throw std::logic_error("Unable to write spectra file: " + csv_path);
+    }
+    int num_bins = energy_bins.size();
+
+    std::ostringstream line_stream;
+    line_stream << "Energy (MeV)" << ",";
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        line_stream << energy_bins[i_bin];
+        if (i_bin < num_bins-1) {
+            line_stream << ",";
+        }
+    }
+    csv_file << line_stream.str();
+
+    std::vector<double> spectrum, error_lower, error_upper;
+    for (size_t i_selected = 0; i_selected < selected_entries.size(); i_selected++) {
+        int i_entry = selected_entries[i_selected];
+        read(i_entry, spectrum, error_lower, error_upper);
+
+        std::ostringstream spectrum_stream;
+        std::ostringstream error_upper_stream;
+        std::ostringstream error_lower_stream;
+        spectrum_stream << entries[i_entry].name << ",";
+        error_upper_stream << "Lower uncertainty" << ",";
+        error_lower_stream << "Upper uncertainty" << ",";
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            spectrum_stream << spectrum[i_bin];
+            error_upper_stream << error_upper[i_bin];
+            error_lower_stream << error_lower[i_bin];
+            if (i_bin < num_bins-1) {
+                spectrum_stream << ",";
+                error_upper_stream << ",";
+                error_lower_stream << ",";
+            }
+        }
+        csv_file << "\r\n" << spectrum_stream.str();
+        csv_file << "\r\n" << error_upper_stream.str();
+        csv_file << "\r\n" << error_lower_stream.str();
+    }
+
+    if (!csv_file.flush()) {
+        throw std::logic_error("Unable to write spectra file: " + csv_path);
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Export the selected entries to csv_path in the column layout of saveSpectrumAsColumn (energy bins
+// in the first column, then 2 columns per entry: the spectrum & its (upper) uncertainty). The file
+// is written in a single pass, rather than rewritten for every entry.
+//--------------------------------------------------------------------------------------------------
+void SpectraStore::exportColumns(const std::string &csv_path, const std::vector<int> &selected_entries) const {
+    std::ofstream csv_file(csv_path);
+    if (!csv_file) {
+        throw std::logic_error("Unable to write spectra file: " + csv_path);
+    }
+    int num_bins = energy_bins.size();
+    int num_selected = selected_entries.size();
+
+    std::vector<std::vector<double>> spectra(num_selected);
+    std::vector<std::vector<double>> uncertainties(num_selected);
+    std::vector<double> error_lower;
+    csv_file << "Energy (MeV)";
+    for (int i_selected = 0; i_selected < num_selected; i_selected++) {
+        int i_entry = selected_entries[i_selected];
+        read(i_entry, spectra[i_selected], error_lower, uncertainties[i_selected]);
+        csv_file << "," << entries[i_entry].name << "," << entries[i_entry].name << UNCERTAINTY_SUFFIX;
+    }
+    csv_file << "\n";
+
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        std::ostringstream line_stream;
+        line_stream << energy_bins[i_bin];
+        for (int i_selected = 0; i_selected < num_selected; i_selected++) {
+            line_stream << "," << spectra[i_selected][i_bin] << "," << uncertainties[i_selected][i_bin];
+        }
+        csv_file << line_stream.str() << "\n";
+    }
+
+    if (!csv_file.flush()) {
+        throw std::logic_error("Unable to write spectra file: " + csv_path);
+    }
+}
+
+//==================================================================================================
+// Read the selected spectra (& their uncertainties) of a spectra store. Equivalent to readSpectra
+// for CSV spectra files, except that only the selected entries are read from the file.
+//
+// Args:
+//  - file_name: the spectra store to be read
+//  - selection: the irradiation conditions of the spectra to read (the most recent entry of each).
+//      If empty, all entries are read.
+//  - header_vector: the vector that will be assigned the irradiation conditions of each spectrum
+//  - energy_bins: the vector that will house the energy bins
+//  - spectra_vector: the vector that will be assigned spectra values from the store
+//  - error_lower_vector: the vector that will be assigned lower uncertainties from the store
+//  - error_upper_vector: the vector that will be assigned upper uncertainties from the store
+//  - plot_per_mu, number_mu, duration: as for readSpectra
+//==================================================================================================
+int readSpectraStore(std::string file_name, std::vector<std::string>& selection,
+    std::vector<std::string>& header_vector, std::vector<double>& energy_bins,
+    std::vector<std::vector<double>>& spectra_vector, std::vector<std::vector<double>>& error_lower_vector,
+    std::vector<std::vector<double>>& error_upper_vector, bool plot_per_mu, std::vector<int>& number_mu,
+    std::vector<int>& duration)
+{
+    SpectraStore store;
+    store.open(file_name);
+
+    std::vector<int> selected_entries = store.select(selection);
+
+    energy_bins = store.energyBins();
+    for (size_t i_group = 0; i_group < selected_entries.size(); i_group++) {
+        std::vector<double> spectrum, error_lower, error_upper;
+        store.read(selected_entries[i_group], spectrum, error_lower, error_upper);
+
+        // If plotting per MU
+        if (plot_per_mu) {
+            int group_duration = duration[i_group%duration.size()];
+            int group_number_mu = number_mu[i_group%number_mu.size()];
+            for (size_t i_bin = 0; i_bin < spectrum.size(); i_bin++) {
+                spectrum[i_bin] = spectrum[i_bin]*group_duration/group_number_mu;
+                error_lower[i_bin] = error_lower[i_bin]*group_duration/group_number_mu;
+                error_upper[i_bin] = error_upper[i_bin]*group_duration/group_number_mu;
+            }
+        }
+
+        header_vector.push_back(store.name(selected_entries[i_group]));
+        spectra_vector.push_back(spectrum);
+        error_lower_vector.push_back(error_lower);
+        error_upper_vector.push_back(error_upper);
+    }
+
+    return 1;
+}
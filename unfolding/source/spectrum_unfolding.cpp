@@ -0,0 +1,305 @@
+//**************************************************************************************************
+// The functions included in this module unfold a set of measurements into a neutron fluence
+// spectrum, and calculate the quantities of interest (dose, total flux, average energy) & their
+// uncertainties. They hold no I/O: the applications (unfold_spectrum, unfold_server) read the
+// measurements, and display & save the results, each in their own way. The only exception is the
+// convergence trace (a debugging aid, see trace_stride), saved as soon as the algorithm ends.
+//**************************************************************************************************
+
+#include "spectrum_unfolding.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// Local
+#include "convergence_trace.h"
+#include "counter_rng.h"
+#include "event_trace.h"
+#include "fileio.h"
+#include "mlem_workspace.h"
+#include "physics_calculations.h"
+#include "uncertainty_accumulator.h"
+#include "uncertainty_sampler.h"
+
+//==================================================================================================
+// Prepare measurements (as read from a measurements file, see getMeasurements) for unfolding:
+//  - reorder them from 7-0 (order of the file) to 0-7
+//  - if in nC, save the nC values (for the report) in measurements_nc, and convert them to CPS
+//      (settings.f_factor must be in nA/cps)
+//  - if several measurements were acquired for each shell, replace them with their mean and
+//      calculate their standard errors (std_errors)
+//==================================================================================================
+void prepareMeasurements(const UnfoldingSettings &settings, std::vector<double> &measurements,
+    std::vector<double> &measurements_nc, std::vector<double> &std_errors)
+{
+    int num_measurements = measurements.size();
+    std::reverse(measurements.begin(),measurements.end()); // readin 7-0 but want 0-7
+
+    // Handle nC input (save nC values for report, then convert to CPS)
+    if (settings.meas_units == "nc") {
+        measurements_nc = measurements;
+        for (int i_meas=0; i_meas < num_measurements; i_meas++) {
+            measurements[i_meas] = measurements[i_meas]*settings.norm/settings.f_factor/settings.duration;
+        }
+    }
+
+    // Process data wherein multiple measurements were acquired for each shell
+    if (settings.num_meas_per_shell > 1) {
+        processMeasurements(num_measurements,settings.num_meas_per_shell,measurements,std_errors);
+    }
+    // Do not allow use of gaussian sampling technique if only one measurement per shell is
+    // provided, as the standard deviation is unknown.
+    else if (settings.num_meas_per_shell == 1 && settings.uncertainty_type == "gaussian"){
+        throw std::logic_error("Cannot generate Gaussian-sampled pseudo-measurements with only single measurement per shell.");
+    }
+    // Require at least 1 measurement per shell
+    else if (settings.num_meas_per_shell < 1) { // if settings.num_meas_per_shell is 0 or negative
+        throw std::logic_error("Number of measurements per shell must be >= 1");
+    }
+}
+
+//==================================================================================================
+// Unfold the (prepared, see prepareMeasurements) measurements with the algorithm of the settings,
+// starting from the input spectrum of the instrument profile, then determine the uncertainty of the
+// unfolded spectrum (uncertainty_type) and calculate the quantities of interest & their
+// uncertainties. Sampled measurement sets are unfolded on the threads of pool. The "unfold" &
+// "uncertainty" phases are added to performance (if not NULL).
+//==================================================================================================
+void unfoldSpectrum(const UnfoldingSettings &settings, InstrumentProfile &profile, ThreadPool &pool,
+    std::vector<double> &measurements, std::vector<double> &std_errors, UnfoldingResult &result,
+    PerformanceLog *performance)
+{
+    int num_measurements = measurements.size();
+    std::vector<double> &energy_bins = profile.energy_bins;
+    int num_bins = energy_bins.size();
+    const ResponseMatrix &nns_response = profile.nns_response;
+    checkDimensions(num_measurements, "number of measurements", nns_response.num_measurements(), "NNS response");
+    // Sampled uncertainties (& the average # of iterations per sample) require at least 1 sample
+    if ((settings.uncertainty_type == "poisson" || settings.uncertainty_type == "gaussian")
+        && settings.num_uncertainty_samples < 1)
+    {
+        throw std::logic_error("The # of uncertainty samples (num_uncertainty_samples) must be >= 1 with uncertainty_type="
+            + settings.uncertainty_type);
+    }
+    std::vector<double> &initial_spectrum = profile.initial_spectrum;
+    std::vector<double> &icrp_factors = profile.icrp_factors;
+    std::vector<double> &normalized_response = profile.normalized_response;
+
+    PhaseTimer unfold_timer(performance, "unfold");
+    EventSpan unfold_event("unfold", "unfold");
+    std::vector<double> &spectrum = result.spectrum;
+    spectrum = initial_spectrum;
+
+    //----------------------------------------------------------------------------------------------
+    // Run the unfolding algorithm, iterating <cutoff> times.
+    // Note: the normalized system matrix is calculated first (with the instrument profile). It is
+    // required in unfolding, and is a constant value.
+    //----------------------------------------------------------------------------------------------
+    // Working vectors of the unfolding algorithm (ratio between measured data and MLEM estimated data,
+    // correction factors applied in each spectral bin, MLEM estimated data, ...). Allocated once.
+    MlemWorkspace workspace(num_measurements, num_bins);
+    int num_iterations;
+
+    // MLEM-STOP specific parameters
+    double j_factor = 0;
+    double j_threshold = 0;
+
+    // Convergence of the algorithm (if trace_stride is set), saved whether or not it succeeds. The
+    // accelerated algorithms are not traced.
+    ConvergenceTrace *trace = NULL;
+    ConvergenceTrace convergence_trace(settings.trace_stride > 0 ? settings.trace_capacity : 1,
+        std::max(settings.trace_stride, 1));
+    if (settings.trace_stride > 0 && settings.algorithm != "mlem_accel" && settings.algorithm != "map_accel") {
+        trace = &convergence_trace;
+        result.path_trace = getTracePath(settings.path_trace, settings.irradiation_conditions);
+    }
+
+    // Unfold spectrum according to user-specified algorithm
+    try {
+        if (settings.algorithm == "mlem") {
+            num_iterations = runMLEM(settings.cutoff, settings.error, num_measurements, num_bins,
+                measurements, spectrum, nns_response, normalized_response, workspace, NULL, trace
+            );
+        }
+        else if (settings.algorithm == "mlemstop") {
+            j_threshold = determineJThreshold(num_measurements,measurements,settings.cps_crossover);
+
+            num_iterations = runMLEMSTOP(settings.cutoff, num_measurements, num_bins, measurements,
+                spectrum, nns_response, normalized_response, workspace, j_threshold, j_factor, NULL, trace
+            );
+        }
+        else if (settings.algorithm == "map") {
+            num_iterations = runMAP(settings.beta, settings.prior, settings.cutoff, settings.error,
+                num_measurements, num_bins, measurements, spectrum, nns_response, normalized_response,
+                workspace, NULL, trace
+            );
+        }
+        else if (settings.algorithm == "mlem_accel") {
+            num_iterations = runMLEMAccel(settings.cutoff, settings.error, num_measurements, num_bins,
+                measurements, spectrum, nns_response, normalized_response, workspace
+            );
+        }
+        else if (settings.algorithm == "map_accel") {
+            num_iterations = runMAPAccel(settings.beta, settings.prior, settings.cutoff, settings.error,
+                num_measurements, num_bins, measurements, spectrum, nns_response, normalized_response,
+                workspace
+            );
+        }
+        else {
+            //throw error
+            throw std::logic_error("Unrecognized unfolding algorithm: " + settings.algorithm);
+        }
+    }
+    catch (std::exception &e) {
+        if (trace != NULL) {
+            trace->save(result.path_trace, "failed: " + std::string(e.what()));
+        }
+        throw;
+    }
+    if (trace != NULL) {
+        std::ostringstream outcome;
+        outcome << "completed (" << settings.algorithm;
+        if (settings.algorithm == "mlemstop") {
+            outcome << ", J threshold " << j_threshold;
+        }
+        outcome << ")";
+        trace->save(result.path_trace, outcome.str());
+    }
+
+    result.mlem_estimate = workspace.mlem_estimate;
+    result.mlem_ratio = workspace.mlem_ratio;
+    result.num_iterations = num_iterations;
+    result.j_factor = j_factor;
+    result.j_threshold = j_threshold;
+
+    //----------------------------------------------------------------------------------------------
+    // Calculate quantities of interest (e.g. dose & its uncertainty)
+    //----------------------------------------------------------------------------------------------
+    result.dose = calculateDose(num_bins, spectrum, icrp_factors);
+    result.total_flux = calculateTotalFlux(num_bins,spectrum);
+    result.avg_energy = calculateAverageEnergy(num_bins,spectrum,energy_bins);
+    unfold_timer.setIterations(num_iterations);
+    unfold_timer.stop();
+    unfold_event.stop();
+
+    //----------------------------------------------------------------------------------------------
+    // Determine the uncertainty in the unfolded spectrum using one of the available methods
+    //----------------------------------------------------------------------------------------------
+    PhaseTimer uncertainty_timer(performance, "uncertainty", pool.size());
+    EventSpan uncertainty_event("uncertainty", "uncertainty");
+    // MLEM-STOP specific parameters
+    result.j_manager_low = UncertaintyManagerJ(j_threshold,1+settings.sigma_j);
+    result.j_manager_high = UncertaintyManagerJ(j_threshold,1-settings.sigma_j);
+    result.num_uncertainty_samples = settings.num_uncertainty_samples;
+
+    // This approach generates a series of sampled measurements (using original measurements as the
+    // means). Unfolding is performed for each of these spectra. The uncertainty in the unfolded
+    // spectrum is taken to be the Root-Mean-Square-Deviation between the unfolded spectrum and each
+    // sampled spectrum. The number of samples is set by the user via num_uncertainty_samples, or,
+    // if uncertainty_target_error is set, samples are added until the uncertainties are determined
+    // to that relative error
+    if (settings.uncertainty_type == "poisson" || settings.uncertainty_type == "gaussian") {
+        // Each sample is drawn from its own random stream, determined by the seed & sample number,
+        // so that a run can be reproduced (whatever the # of threads) by reusing its seed
+        result.seed = settings.seed;
+        if (result.seed < 0) {
+            result.seed = generateRandomSeed();
+        }
+
+        // Each sampled spectrum is accumulated (deviations from the unfolded spectrum & the
+        // quantities calculated from it) as soon as it is unfolded, and is not stored
+        UncertaintyAccumulator accumulator(spectrum, icrp_factors);
+
+        // Sampled measurement sets are unfolded from the input spectrum (as the measurements were),
+        // or from the unfolded spectrum. The latter saves the iterations spent reaching the unfolded
+        // spectrum, but the samples then do not start from the same point as the unfolding whose
+        // uncertainty they estimate (compare the report of both, with the same seed)
+        std::vector<double> sample_initial_spectrum;
+        if (settings.sample_initialization == "input") {
+            sample_initial_spectrum = initial_spectrum;
+        }
+        else if (settings.sample_initialization == "central") {
+            sample_initial_spectrum = spectrum;
+        }
+        else {
+            throw std::logic_error("Unrecognized sample initialization: " + settings.sample_initialization);
+        }
+
+        // Sampled measurement sets are unfolded in batches that advance together (each pass over
+        // the NNS response is shared by all samples of a batch), and the batches are distributed
+        // across threads
+        UncertaintySampler sampler(settings, result.seed, pool, measurements, std_errors,
+            sample_initial_spectrum, nns_response, normalized_response
+        );
+        if (settings.uncertainty_target_error > 0) {
+            result.num_toss = sampler.unfoldUntilConverged(settings.uncertainty_target_error,
+                settings.num_uncertainty_samples, settings.max_uncertainty_samples, accumulator
+            );
+        }
+        else {
+            result.num_toss = sampler.unfoldSamples(0, settings.num_uncertainty_samples, accumulator);
+        }
+        result.num_uncertainty_samples = accumulator.num_samples();
+        result.dose_uncertainty_error = accumulator.dose.rmsdRelativeError();
+        result.spectrum_uncertainty_error = accumulator.spectrumRelativeError();
+        result.avg_sample_iterations = (double)sampler.num_iterations/(result.num_uncertainty_samples + result.num_toss);
+        uncertainty_timer.setIterations(sampler.num_iterations);
+        uncertainty_timer.setSamples(result.num_uncertainty_samples + result.num_toss);
+
+        // Calculate the spectrum uncertainty (same upper & lower)
+        accumulator.calculateSpectrumRMSD(result.spectrum_uncertainty_lower);
+        result.spectrum_uncertainty_upper = result.spectrum_uncertainty_lower;
+
+        // Calculate the dose uncertainty (same upper & lower)
+        result.dose_uncertainty_upper = accumulator.dose.rmsd();
+        result.dose_uncertainty_lower = result.dose_uncertainty_upper;
+    }
+
+    // This approach uses a known uncertainty around J=1, specified by sigma_j. An "upper" and "lower"
+    // spectrum estimate are generated using the user-defined sigma_j parameter. A unique j_threshold
+    // is determined for both upper and lower, and MLEM-STOP is performed using both thresholds. The
+    // upper uncertainty is then the difference betwen the "upper" spectrum and the MLEM-STOP estimated
+    // spectrum. Similarly for the lower uncertainty. This is all handled in the UncertaintyManagerJ
+    // class.
+    else if (settings.uncertainty_type == "j_bounds") {
+        UncertaintyManagerJ &j_manager_low = result.j_manager_low;
+        UncertaintyManagerJ &j_manager_high = result.j_manager_high;
+
+        j_manager_low.determineSpectrumUncertainty(spectrum,settings.cutoff,num_measurements,
+            num_bins,measurements,nns_response,normalized_response,initial_spectrum
+        );
+        result.spectrum_uncertainty_lower = j_manager_low.spectrum_uncertainty;
+
+        j_manager_high.determineSpectrumUncertainty(spectrum,settings.cutoff,num_measurements,
+            num_bins,measurements,nns_response,normalized_response,initial_spectrum
+        );
+        result.spectrum_uncertainty_upper = j_manager_high.spectrum_uncertainty;
+
+        j_manager_low.determineDoseUncertainty(result.dose,spectrum,num_bins,icrp_factors);
+        result.dose_uncertainty_lower = j_manager_low.dose_uncertainty;
+
+        j_manager_high.determineDoseUncertainty(result.dose,spectrum,num_bins,icrp_factors);
+        result.dose_uncertainty_upper = j_manager_high.dose_uncertainty;
+        uncertainty_timer.setIterations(j_manager_low.num_iterations + j_manager_high.num_iterations);
+    }
+    else {
+        throw std::logic_error("Unrecognized uncertainty type: " + settings.uncertainty_type);
+    }
+
+    //----------------------------------------------------------------------------------------------
+    // Calculate uncertainties in quantities of interest
+    //----------------------------------------------------------------------------------------------
+    result.total_flux_uncertainty_upper = calculateSumUncertainty(num_bins,result.spectrum_uncertainty_upper);
+    result.total_flux_uncertainty_lower = calculateSumUncertainty(num_bins,result.spectrum_uncertainty_lower);
+
+    result.avg_energy_uncertainty_upper = calculateEnergyUncertainty(num_bins,energy_bins,spectrum,
+        result.spectrum_uncertainty_upper,result.total_flux,result.total_flux_uncertainty_upper
+    );
+    result.avg_energy_uncertainty_lower = calculateEnergyUncertainty(num_bins,energy_bins,spectrum,
+        result.spectrum_uncertainty_lower,result.total_flux,result.total_flux_uncertainty_lower
+    );
+}
@@ -0,0 +1,436 @@
+//**************************************************************************************************
+// This program checks the numerical kernels of the unfolding ("make test"). Every projection kernel
+// supported by the CPU (scalar, sse2, avx2, avx512) must reproduce the scalar reference exactly
+// (0 ULP, the tolerance documented in projection_kernels), with the NNS response functions provided
+// in the "input/" directory (He-3 & gold) and synthetic responses of odd sizes (7x53 & 8x201, which
+// exercise the remainders & padding of the vector blocks), for single spectra & batches of
+// spectra. Kernels the CPU does not support are skipped. It also checks that the unfolding algorithms (runMLEM, runMLEMSTOP & runMAP with each
+// prior) make no heap allocation once their MlemWorkspace is set up, and that the
+// UncertaintySampler makes none per sampled measurement set (for each algorithm), with the He-3 &
+// gold responses. The exit status is non-zero if any check fails.
+//
+// Usage:
+//     test_unfolding.exe
+//**************************************************************************************************
+
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// Local
+#include "custom_classes.h"
+#include "fileio.h"
+#include "mlem_workspace.h"
+#include "physics_calculations.h"
+#include "projection_kernels.h"
+#include "response_matrix.h"
+#include "thread_pool.h"
+#include "uncertainty_accumulator.h"
+#include "uncertainty_sampler.h"
+
+// Energy range [MeV] of the synthetic responses
+const double SYNTHETIC_MIN_ENERGY = 1e-9;
+const double SYNTHETIC_MAX_ENERGY = 20;
+
+// # of spectra projected together in the check of the batched projection kernels: a single
+// spectrum, a partial block, and several blocks ending with a partial one
+const int NUM_CHECK_BATCH_SIZES = 3;
+const int CHECK_BATCH_SIZES[NUM_CHECK_BATCH_SIZES] = {1, 5, 13};
+
+// MAP strength used for every prior
+const double MAP_BETA = 1e-8;
+
+// # of iterations of each unfolding in the check of heap allocations
+const int CHECK_ITERATIONS = 50;
+
+//==================================================================================================
+// Heap allocations (through operator new) since the start of the program. The replacement
+// operators below count them for the whole program; the checks are single-threaded.
+//==================================================================================================
+static long num_allocations = 0;
+
+void* operator new(size_t size) {
+    num_allocations++;
+    void *pointer = malloc(size == 0 ? 1 : size);
+    if (pointer == NULL) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept {
+    free(pointer);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Inputs of the kernels for one response function: the response, energy bins, ICRP factors (read
+// responses only) & normalized response, and the measurements obtained by projecting the reference
+// spectrum through the response
+//--------------------------------------------------------------------------------------------------
+struct TestInput {
+    std::string name;
+    ResponseMatrix nns_response;
+    std::vector<double> energy_bins;
+    std::vector<double> icrp_factors;
+    std::vector<double> normalized_response;
+    std::vector<double> measurements;
+    std::vector<double> initial_spectrum;
+};
+
+//==================================================================================================
+// Reference spectrum (fluence rate per bin) at the given energy bins: thermal, epithermal (1/E) &
+// fast components, as in the spectrum of a moderated source
+//==================================================================================================
+static std::vector<double> referenceSpectrum(const std::vector<double> &energy_bins) {
+    std::vector<double> spectrum(energy_bins.size());
+    for (size_t i_bin = 0; i_bin < energy_bins.size(); i_bin++) {
+        double log_energy = log10(energy_bins[i_bin]);
+        spectrum[i_bin] = 1000*exp(-0.5*pow((log_energy+7.6)/0.4, 2)) + 200
+            + 2000*exp(-0.5*pow((log_energy-0.2)/0.5, 2));
+    }
+    return spectrum;
+}
+
+//==================================================================================================
+// Complete an input whose response & energy bins are set: normalized response, measurements
+// (projection of the reference spectrum) & uniform initial spectrum
+//==================================================================================================
+static void prepareInput(TestInput &input) {
+    int num_measurements = input.nns_response.num_measurements();
+    int num_bins = input.nns_response.num_bins();
+    input.normalized_response = normalizeResponse(num_bins, num_measurements, input.nns_response);
+    std::vector<double> reference_spectrum = referenceSpectrum(input.energy_bins);
+    input.measurements.assign(num_measurements, 0);
+    forwardProjectScalar(input.nns_response, reference_spectrum.data(), input.measurements.data());
+    input.initial_spectrum.assign(num_bins, 1);
+}
+
+//==================================================================================================
+// Read one of the NNS response functions provided in the "input/" directory
+//==================================================================================================
+static void readInput(const std::string &name, const std::string &response_file, TestInput &input) {
+    input.name = name;
+    readInputFile2D(response_file, input.nns_response);
+    readInputFile1D("input/energy_bins.csv", input.energy_bins);
+    readInputFile1D("input/icrp_conversion_coefficients.csv", input.icrp_factors);
+    checkDimensions(input.nns_response.num_bins(), "number of energy bins", input.energy_bins.size(),
+        "Energy bins");
+    checkDimensions(input.nns_response.num_bins(), "number of energy bins", input.icrp_factors.size(),
+        "Number of ICRP factors");
+    prepareInput(input);
+}
+
+//==================================================================================================
+// Generate a synthetic response of num_measurements measurements & num_bins log-spaced energy bins:
+// the response of each measurement (moderator configuration) is a Gaussian in log(energy),
+// centered at higher energies for thicker moderators
+//==================================================================================================
+static void generateInput(int num_measurements, int num_bins, TestInput &input) {
+    input.name = "synthetic";
+    double log_min = log10(SYNTHETIC_MIN_ENERGY);
+    double log_max = log10(SYNTHETIC_MAX_ENERGY);
+
+    input.energy_bins.resize(num_bins);
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        input.energy_bins[i_bin] = pow(10, log_min + (log_max-log_min)*i_bin/(num_bins-1));
+    }
+
+    input.nns_response.resize(num_measurements, num_bins);
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        double center = log_min + (log_max-log_min)*(i_meas+0.5)/num_measurements;
+        for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+            double log_energy = log10(input.energy_bins[i_bin]);
+            input.nns_response.set(i_meas, i_bin, 2*exp(-0.5*pow((log_energy-center)/2.0, 2)));
+        }
+    }
+    prepareInput(input);
+}
+
+//==================================================================================================
+// Return whether values are identical (bit for bit) to the reference values, printing the first
+// difference
+//==================================================================================================
+static bool checkIdentical(const std::string &description, const std::vector<double> &reference,
+    const std::vector<double> &values)
+{
+    for (size_t i_value = 0; i_value < reference.size(); i_value++) {
+        if (memcmp(&reference[i_value], &values[i_value], sizeof(double)) != 0) {
+            std::cout << "    FAILED: " << description << ", value " << i_value << ": "
+                << std::setprecision(17) << values[i_value] << ", expected " << reference[i_value]
+                << std::setprecision(6) << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+//==================================================================================================
+// Check the projections of the active kernel against the scalar reference with the given input:
+// forward & back projections (normalized & not) of a single spectrum, and of batches of spectra.
+// Returns the # of projections that differ.
+//==================================================================================================
+static int checkProjectionKernel(const TestInput &input) {
+    const ResponseMatrix &response = input.nns_response;
+    int num_measurements = response.num_measurements();
+    int num_bins = response.num_bins();
+    const double *normalization = input.normalized_response.data();
+    std::string description = input.name + " " + std::to_string(num_measurements) + "x"
+        + std::to_string(num_bins);
+    int num_failures = 0;
+
+    // Ratios close to 1, as near convergence of MLEM
+    std::vector<double> spectrum = referenceSpectrum(input.energy_bins);
+    std::vector<double> ratio(num_measurements);
+    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+        ratio[i_meas] = 1 + 0.1*sin(i_meas+1);
+    }
+    std::vector<double> reference(num_measurements), values(num_measurements);
+    forwardProjectScalar(response, spectrum.data(), reference.data());
+    forwardProject(response, spectrum.data(), values.data());
+    num_failures += !checkIdentical(description + " forwardProject", reference, values);
+    for (int normalized = 0; normalized <= 1; normalized++) {
+        const double *bin_normalization = normalized ? normalization : NULL;
+        reference.assign(num_bins, 0);
+        values.assign(num_bins, 0);
+        backProjectScalar(response, ratio.data(), bin_normalization, reference.data());
+        backProject(response, ratio.data(), bin_normalization, values.data());
+        num_failures += !checkIdentical(description + " backProject"
+            + (normalized ? "" : " (not normalized)"), reference, values);
+    }
+
+    // Batches: each sample is a scaled copy of the single spectrum (ratio). The padding of the
+    // batch (samples num_samples to stride-1) is filled too, but not compared.
+    int block = getProjectionBatchBlock();
+    for (int i_size = 0; i_size < NUM_CHECK_BATCH_SIZES; i_size++) {
+        int num_samples = CHECK_BATCH_SIZES[i_size];
+        int stride = (num_samples+block-1)/block*block;
+        std::string batch = " (" + std::to_string(num_samples) + " samples)";
+        std::vector<double> spectra(num_bins*stride), ratios(num_measurements*stride);
+        for (int i_samp = 0; i_samp < stride; i_samp++) {
+            for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+                spectra[i_bin*stride + i_samp] = spectrum[i_bin]*(1 + 0.01*i_samp);
+            }
+            for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+                ratios[i_meas*stride + i_samp] = ratio[i_meas]*(1 - 0.01*i_samp);
+            }
+        }
+
+        std::vector<double> reference_batch(num_measurements*stride), batch_values(num_measurements*stride);
+        forwardProjectBatchScalar(response, spectra.data(), num_samples, stride, reference_batch.data());
+        forwardProjectBatch(response, spectra.data(), num_samples, stride, batch_values.data());
+        reference.clear();
+        values.clear();
+        for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+            for (int i_samp = 0; i_samp < num_samples; i_samp++) {
+                reference.push_back(reference_batch[i_meas*stride + i_samp]);
+                values.push_back(batch_values[i_meas*stride + i_samp]);
+            }
+        }
+        num_failures += !checkIdentical(description + " forwardProjectBatch" + batch, reference, values);
+
+        for (int normalized = 0; normalized <= 1; normalized++) {
+            const double *bin_normalization = normalized ? normalization : NULL;
+            reference_batch.assign(num_bins*stride, 0);
+            batch_values.assign(num_bins*stride, 0);
+            backProjectBatchScalar(response, ratios.data(), num_samples, stride, bin_normalization,
+                reference_batch.data());
+            backProjectBatch(response, ratios.data(), num_samples, stride, bin_normalization,
+                batch_values.data());
+            reference.clear();
+            values.clear();
+            for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+                for (int i_samp = 0; i_samp < num_samples; i_samp++) {
+                    reference.push_back(reference_batch[i_bin*stride + i_samp]);
+                    values.push_back(batch_values[i_bin*stride + i_samp]);
+                }
+            }
+            num_failures += !checkIdentical(description + " backProjectBatch" + batch
+                + (normalized ? "" : " (not normalized)"), reference, values);
+        }
+    }
+    return num_failures;
+}
+
+//==================================================================================================
+// Check that every projection kernel supported by the CPU reproduces the scalar reference exactly.
+// Returns the # of failed checks.
+//==================================================================================================
+static int checkProjectionKernels() {
+    const int num_inputs = 4;
+    TestInput inputs[num_inputs];
+    readInput("he3", "input/response_nns_he3.csv", inputs[0]);
+    readInput("gold", "input/response_nns_gold.csv", inputs[1]);
+    generateInput(7, 53, inputs[2]);
+    generateInput(8, 201, inputs[3]);
+
+    std::cout << "Projection kernels (tolerance: 0 ULP from the scalar reference)\n";
+    int num_failures = 0;
+    const int num_kernels = 4;
+    std::string kernels[num_kernels] = {"scalar", "sse2", "avx2", "avx512"};
+    for (int i_kernel = 0; i_kernel < num_kernels; i_kernel++) {
+        const std::string &kernel = kernels[i_kernel];
+        if (!projectionKernelSupported(kernel)) {
+            std::cout << "  " << kernel << ": skipped (not supported by this CPU)\n";
+            continue;
+        }
+        setProjectionKernel(kernel);
+        int kernel_failures = 0;
+        for (int i_input = 0; i_input < num_inputs; i_input++) {
+            kernel_failures += checkProjectionKernel(inputs[i_input]);
+        }
+        std::cout << "  " << kernel << ": " << (kernel_failures == 0 ? "passed" : "FAILED") << "\n";
+        num_failures += kernel_failures;
+    }
+    setProjectionKernel("auto");
+    return num_failures;
+}
+
+//==================================================================================================
+// Return whether a call makes no heap allocation, printing the # of allocations otherwise. The call
+// is made once beforehand, so that only the allocations of a warm call are counted.
+//==================================================================================================
+static bool checkNoAllocation(const std::string &description, const std::function<void()> &call) {
+    call();
+    long allocations_before = num_allocations;
+    call();
+    long allocations = num_allocations - allocations_before;
+    if (allocations != 0) {
+        std::cout << "    FAILED: " << description << ": " << allocations << " heap allocations\n";
+        return false;
+    }
+    return true;
+}
+
+//==================================================================================================
+// Check that the unfolding algorithms make no heap allocation once their workspace is set up, and
+// that the UncertaintySampler makes none per sampled measurement set: unfolding a block of
+// SAMPLES_PER_BLOCK samples must allocate as much as unfolding a single sample (the allocations of
+// a call, e.g. of its block accumulators, do not depend on the # of samples). Returns the # of
+// failed checks.
+//==================================================================================================
+static int checkAllocations(TestInput &input) {
+    int num_measurements = input.nns_response.num_measurements();
+    int num_bins = input.nns_response.num_bins();
+    MlemWorkspace workspace(num_measurements, num_bins);
+    std::vector<double> spectrum(num_bins);
+    int num_failures = 0;
+
+    num_failures += !checkNoAllocation(input.name + " runMLEM", [&]() {
+        spectrum = input.initial_spectrum;
+        runMLEM(CHECK_ITERATIONS, 0, num_measurements, num_bins, input.measurements, spectrum,
+            input.nns_response, input.normalized_response, workspace
+        );
+    });
+
+    // J threshold: the J factor reached after CHECK_ITERATIONS MLEM iterations
+    spectrum = input.initial_spectrum;
+    runMLEM(CHECK_ITERATIONS, 0, num_measurements, num_bins, input.measurements, spectrum,
+        input.nns_response, input.normalized_response, workspace
+    );
+    double j_threshold = calculateJFactor(num_measurements, input.measurements, workspace.mlem_estimate);
+    double j_factor;
+    num_failures += !checkNoAllocation(input.name + " runMLEMSTOP", [&]() {
+        spectrum = input.initial_spectrum;
+        runMLEMSTOP(CHECK_ITERATIONS, num_measurements, num_bins, input.measurements, spectrum,
+            input.nns_response, input.normalized_response, workspace, j_threshold, j_factor
+        );
+    });
+
+    const int num_priors = 5;
+    std::string priors[num_priors] = {"quadratic", "quadratic_normalized", "mrp", "meanrp", "gaussians"};
+    for (int i_prior = 0; i_prior < num_priors; i_prior++) {
+        const std::string &prior = priors[i_prior];
+        num_failures += !checkNoAllocation(input.name + " runMAP/" + prior, [&]() {
+            spectrum = input.initial_spectrum;
+            runMAP(MAP_BETA, prior, CHECK_ITERATIONS, 0, num_measurements, num_bins,
+                input.measurements, spectrum, input.nns_response, input.normalized_response, workspace
+            );
+        });
+    }
+
+    // Sampled measurement sets (poisson), unfolded on the calling thread only
+    ThreadPool pool(1);
+    std::vector<double> std_errors(num_measurements, 0);
+    std::vector<double> central_spectrum = referenceSpectrum(input.energy_bins);
+    const int num_algorithms = 5;
+    std::string algorithms[num_algorithms] = {"mlem", "mlemstop", "map", "mlem_accel", "map_accel"};
+    for (int i_algorithm = 0; i_algorithm < num_algorithms; i_algorithm++) {
+        UnfoldingSettings settings;
+        settings.set_algorithm(algorithms[i_algorithm]);
+        settings.set_uncertainty_type("poisson");
+        // MLEM-STOP samples that reach the cutoff before their J threshold are redrawn, so MLEM-STOP
+        // keeps the default cutoff
+        if (algorithms[i_algorithm] != "mlemstop") {
+            settings.set_cutoff(CHECK_ITERATIONS);
+        }
+        settings.set_beta(MAP_BETA);
+        UncertaintySampler sampler(settings, 1, pool, input.measurements, std_errors,
+            input.initial_spectrum, input.nns_response, input.normalized_response
+        );
+        UncertaintyAccumulator accumulator(central_spectrum, input.icrp_factors);
+
+        long allocations[2];
+        int num_samples[2] = {1, SAMPLES_PER_BLOCK};
+        for (int i_call = 0; i_call < 2; i_call++) {
+            sampler.unfoldSamples(0, num_samples[i_call], accumulator);
+            long allocations_before = num_allocations;
+            sampler.unfoldSamples(0, num_samples[i_call], accumulator);
+            allocations[i_call] = num_allocations - allocations_before;
+        }
+        if (allocations[1] != allocations[0]) {
+            std::cout << "    FAILED: " << input.name << " UncertaintySampler/" << algorithms[i_algorithm]
+                << ": " << allocations[0] << " heap allocations for 1 sample, " << allocations[1]
+                << " for " << SAMPLES_PER_BLOCK << "\n";
+            num_failures++;
+        }
+    }
+    return num_failures;
+}
+
+//==================================================================================================
+// Check the heap allocations of the unfolding algorithms & of the UncertaintySampler with the He-3
+// & gold responses. Returns the # of failed checks.
+//==================================================================================================
+static int checkAllAllocations() {
+    const int num_inputs = 2;
+    TestInput inputs[num_inputs];
+    readInput("he3", "input/response_nns_he3.csv", inputs[0]);
+    readInput("gold", "input/response_nns_gold.csv", inputs[1]);
+
+    std::cout << "Heap allocations (none once the workspace is set up, none per sampled measurement set)\n";
+    int num_failures = 0;
+    for (int i_input = 0; i_input < num_inputs; i_input++) {
+        int input_failures = checkAllocations(inputs[i_input]);
+        std::cout << "  " << inputs[i_input].name << ": " << (input_failures == 0 ? "passed" : "FAILED")
+            << "\n";
+        num_failures += input_failures;
+    }
+    return num_failures;
+}
+
+int main()
+{
+    int num_failures = checkProjectionKernels();
+    num_failures += checkAllAllocations();
+    if (num_failures > 0) {
+        std::cout << "Check FAILED (" << num_failures << " failures)\n";
+        return 1;
+    }
+    std::cout << "Check passed\n";
+    return 0;
+}
@@ -0,0 +1,151 @@
+//**************************************************************************************************
+// The functions included in this module distribute independent tasks (e.g. batches of sampled
+// measurement sets to be unfolded) across multiple threads.
+//**************************************************************************************************
+
+#include "thread_pool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Start the worker threads. num_threads <= 0 uses one thread per hardware thread.
+//--------------------------------------------------------------------------------------------------
+ThreadPool::ThreadPool(int num_threads) {
+    job = NULL;
+    num_tasks = 0;
+    next_task = 0;
+    num_busy = 0;
+    generation = 0;
+    stopping = false;
+
+    num_threads = resolveNumThreads(num_threads);
+    for (int i_thread = 1; i_thread < num_threads; i_thread++) {
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this, i_thread));
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Stop & join the worker threads
+//--------------------------------------------------------------------------------------------------
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    start_condition.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the # of threads that execute tasks (including the calling thread)
+//--------------------------------------------------------------------------------------------------
+int ThreadPool::size() const {
+    return workers.size() + 1;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Execute task(i_task, i_thread) for each i_task in 0..num_tasks-1 and wait for completion. If
+// any task throws, the remaining tasks are skipped and the (first) exception is rethrown here.
+//--------------------------------------------------------------------------------------------------
+void ThreadPool::run(int num_tasks, const std::function<void(int, int)>& task) {
+    if (num_tasks <= 0) {
+        return;
+    }
+    if (workers.empty()) {
+        for (int i_task = 0; i_task < num_tasks; i_task++) {
+            task(i_task, 0);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->job = &task;
+        this->num_tasks = num_tasks;
+        this->next_task = 0;
+        this->num_busy = workers.size();
+        this->error = std::exception_ptr();
+        this->generation++;
+    }
+    start_condition.notify_all();
+
+    executeTasks(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done_condition.wait(lock, [this] { return num_busy == 0; });
+    job = NULL;
+    if (error) {
+        std::exception_ptr task_error = error;
+        error = std::exception_ptr();
+        std::rethrow_exception(task_error);
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Main loop of a worker thread: wait for a job, take part in it, report completion
+//--------------------------------------------------------------------------------------------------
+void ThreadPool::workerLoop(int i_thread) {
+    int last_generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_condition.wait(lock, [&] { return stopping || generation != last_generation; });
+            if (stopping) {
+                return;
+            }
+            last_generation = generation;
+        }
+
+        executeTasks(i_thread);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            num_busy--;
+            if (num_busy == 0) {
+                done_condition.notify_all();
+            }
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Execute tasks of the current job until none are left
+//--------------------------------------------------------------------------------------------------
+void ThreadPool::executeTasks(int i_thread) {
+    while (true) {
+        int i_task = next_task.fetch_add(1);
+        if (i_task >= num_tasks) {
+            return;
+        }
+        try {
+            (*job)(i_task, i_thread);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+            next_task = num_tasks; // skip remaining tasks
+        }
+    }
+}
+
+//==================================================================================================
+// Return the # of threads to use for a num_threads setting (<= 0: one per hardware thread)
+//==================================================================================================
+int resolveNumThreads(int num_threads) {
+    if (num_threads > 0) {
+        return num_threads;
+    }
+    int num_hardware_threads = std::thread::hardware_concurrency();
+    return num_hardware_threads > 0 ? num_hardware_threads : 1;
+}
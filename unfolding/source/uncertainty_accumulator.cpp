@@ -0,0 +1,204 @@
+//**************************************************************************************************
+// The functions included in this module accumulate statistics of sampled spectra (and of the
+// quantities calculated from them) on the fly, to determine uncertainties without storing samples.
+//**************************************************************************************************
+
+#include "uncertainty_accumulator.h"
+#include "physics_calculations.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdlib.h>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// Create empty statistics of a quantity whose deviations are measured from reference
+//--------------------------------------------------------------------------------------------------
+RunningStatistic::RunningStatistic(double reference) {
+    this->reference = reference;
+    reset();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Remove all values (the reference is kept)
+//--------------------------------------------------------------------------------------------------
+void RunningStatistic::reset() {
+    count = 0;
+    mean = 0;
+    m2 = 0;
+    sum_sq_deviation = 0;
+    sq_deviation_m2 = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Add a value
+//--------------------------------------------------------------------------------------------------
+void RunningStatistic::add(double value) {
+    count++;
+    double delta = value - mean;
+    mean += delta/count;
+    m2 += delta*(value - mean);
+
+    double sq_deviation = (reference - value)*(reference - value);
+    double sq_deviation_delta = sq_deviation - (count > 1 ? sum_sq_deviation/(count-1) : 0);
+    sum_sq_deviation += sq_deviation;
+    sq_deviation_m2 += sq_deviation_delta*(sq_deviation - sum_sq_deviation/count);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Add all values of other (which must have the same reference)
+//--------------------------------------------------------------------------------------------------
+void RunningStatistic::merge(const RunningStatistic &other) {
+    if (other.count == 0) {
+        return;
+    }
+    if (count == 0) {
+        count = other.count;
+        mean = other.mean;
+        m2 = other.m2;
+        sum_sq_deviation = other.sum_sq_deviation;
+        sq_deviation_m2 = other.sq_deviation_m2;
+        return;
+    }
+    int total_count = count + other.count;
+    double weight = (double)count*other.count/total_count;
+    double delta = other.mean - mean;
+    mean += delta*other.count/total_count;
+    m2 += other.m2 + delta*delta*weight;
+
+    double sq_deviation_delta = other.sum_sq_deviation/other.count - sum_sq_deviation/count;
+    sum_sq_deviation += other.sum_sq_deviation;
+    sq_deviation_m2 += other.sq_deviation_m2 + sq_deviation_delta*sq_deviation_delta*weight;
+    count = total_count;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the sample variance of the values
+//--------------------------------------------------------------------------------------------------
+double RunningStatistic::variance() const {
+    if (count < 2) {
+        return 0;
+    }
+    return m2/(count-1);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the standard error of the mean of the values
+//--------------------------------------------------------------------------------------------------
+double RunningStatistic::standardError() const {
+    if (count < 2) {
+        return 0;
+    }
+    return sqrt(variance()/count);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the root-mean-square deviation of the values from the reference (see calculateRMSD)
+//--------------------------------------------------------------------------------------------------
+double RunningStatistic::rmsd() const {
+    double avg_sq_diff = sum_sq_deviation/count;
+    double rms_diff = sqrt(avg_sq_diff);
+
+    return rms_diff;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the relative standard error of the root-mean-square deviation (i.e. how precisely the
+// values determine it). With y the squared deviations, RMSD = sqrt(mean(y)), and propagating the
+// standard error of mean(y) gives SE(RMSD)/RMSD = SE(mean(y))/(2*mean(y)). Returns 0 if there is
+// no deviation from the reference (or fewer than 2 values).
+//--------------------------------------------------------------------------------------------------
+double RunningStatistic::rmsdRelativeError() const {
+    if (count < 2 || sum_sq_deviation <= 0) {
+        return 0;
+    }
+    double mean_sq_deviation = sum_sq_deviation/count;
+    double std_error = sqrt(sq_deviation_m2/(count-1)/count);
+    return std_error/(2*mean_sq_deviation);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Default constructor for UncertaintyAccumulator (no energy bins)
+//--------------------------------------------------------------------------------------------------
+UncertaintyAccumulator::UncertaintyAccumulator() {
+    num_bins = 0;
+    icrp_factors = NULL;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Create an empty accumulator of deviations from the central spectrum (and the dose calculated from
+// it). The ICRP factors must outlive the accumulator.
+//--------------------------------------------------------------------------------------------------
+UncertaintyAccumulator::UncertaintyAccumulator(std::vector<double> &central_spectrum, 
+    std::vector<double> &icrp_factors)
+{
+    num_bins = central_spectrum.size();
+    this->icrp_factors = &icrp_factors;
+
+    spectrum.clear();
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        spectrum.push_back(RunningStatistic(central_spectrum[i_bin]));
+    }
+    dose = RunningStatistic(calculateDose(num_bins, central_spectrum, icrp_factors));
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the # of sampled spectra added
+//--------------------------------------------------------------------------------------------------
+int UncertaintyAccumulator::num_samples() const {
+    return dose.count;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Remove all sampled spectra (the central values are kept)
+//--------------------------------------------------------------------------------------------------
+void UncertaintyAccumulator::reset() {
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        spectrum[i_bin].reset();
+    }
+    dose.reset();
+}
+
+//--------------------------------------------------------------------------------------------------
+// Add a sampled spectrum
+//--------------------------------------------------------------------------------------------------
+void UncertaintyAccumulator::addSample(std::vector<double> &sampled_spectrum) {
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        spectrum[i_bin].add(sampled_spectrum[i_bin]);
+    }
+    dose.add(calculateDose(num_bins, sampled_spectrum, *icrp_factors));
+}
+
+//--------------------------------------------------------------------------------------------------
+// Add all sampled spectra of other (which must have the same central spectrum). Merging in a
+// fixed order gives reproducible results.
+//--------------------------------------------------------------------------------------------------
+void UncertaintyAccumulator::merge(const UncertaintyAccumulator &other) {
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        spectrum[i_bin].merge(other.spectrum[i_bin]);
+    }
+    dose.merge(other.dose);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Calculate the root-mean-square deviation of the sampled spectra from the central spectrum, for
+// each energy bin (see calculateRMSD_vector)
+//--------------------------------------------------------------------------------------------------
+void UncertaintyAccumulator::calculateSpectrumRMSD(std::vector<double> &rms_differences) const {
+    rms_differences.clear();
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        rms_differences.push_back(spectrum[i_bin].rmsd());
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Return the largest relative standard error among the root-mean-square deviations of the energy
+// bins (see RunningStatistic::rmsdRelativeError)
+//--------------------------------------------------------------------------------------------------
+double UncertaintyAccumulator::spectrumRelativeError() const {
+    double max_relative_error = 0;
+    for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+        max_relative_error = std::max(max_relative_error, spectrum[i_bin].rmsdRelativeError());
+    }
+    return max_relative_error;
+}
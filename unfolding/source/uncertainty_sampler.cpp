@@ -0,0 +1,331 @@
+//**************************************************************************************************
+// The functions included in this module generate and unfold the sampled measurement sets used to
+// estimate the uncertainty of an unfolded spectrum, in parallel and reproducibly.
+//**************************************************************************************************
+
+#include "uncertainty_sampler.h"
+#include "event_trace.h"
+#include "physics_calculations.h"
+
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// # of blocks unfolded (in parallel) before their accumulators are merged
+const int MERGE_GROUP_BLOCKS = 256;
+
+//--------------------------------------------------------------------------------------------------
+// Prepare sampling of the provided measurements (and standard errors, used by gaussian sampling).
+// The referenced vectors and pool must outlive the sampler. Working memory for each thread of the
+// pool is allocated here.
+//--------------------------------------------------------------------------------------------------
+UncertaintySampler::UncertaintySampler(const UnfoldingSettings &settings, uint64_t seed, 
+    ThreadPool &pool, std::vector<double> &measurements, std::vector<double> &std_errors, 
+    std::vector<double> &initial_spectrum, const ResponseMatrix &nns_response, 
+    std::vector<double> &normalized_response)
+{
+    if (settings.uncertainty_type != "poisson" && settings.uncertainty_type != "gaussian") {
+        throw std::logic_error("Cannot generate sampled measurements for uncertainty type: " + settings.uncertainty_type);
+    }
+    if (settings.uncertainty_batch_size < 1) {
+        throw std::logic_error("The uncertainty batch size must be >= 1");
+    }
+    this->settings = settings;
+    this->seed = seed;
+    this->num_measurements = nns_response.num_measurements();
+    this->num_bins = nns_response.num_bins();
+    this->batch_size = std::min(settings.uncertainty_batch_size, SAMPLES_PER_BLOCK);
+    this->num_iterations = 0;
+
+    this->pool = &pool;
+    this->measurements = &measurements;
+    this->std_errors = &std_errors;
+    this->initial_spectrum = &initial_spectrum;
+    this->nns_response = &nns_response;
+    this->normalized_response = &normalized_response;
+
+    int num_threads = pool.size();
+    batches.assign(num_threads, MlemBatch(num_measurements, num_bins, batch_size));
+    workspaces.assign(num_threads, MlemWorkspace(num_measurements, num_bins));
+    thread_measurements.assign(num_threads, std::vector<double>(num_measurements, 0));
+    block_spectra.assign(num_threads, std::vector<std::vector<double>>(SAMPLES_PER_BLOCK, std::vector<double>(num_bins, 0)));
+    pending_samples.assign(num_threads, std::vector<int>(batch_size, 0));
+    pending_attempts.assign(num_threads, std::vector<int>(batch_size, 0));
+    thread_iterations.assign(num_threads, 0);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Generate the sampled measurement set of sample i_samp (attempt # attempt):
+//  - poisson: each value is the average of num_meas_per_shell Poisson samples whose mean is the
+//    measured value
+//  - gaussian: each value is sampled from a normal distribution with the measured value as mean and
+//    its standard error as standard deviation
+//--------------------------------------------------------------------------------------------------
+void UncertaintySampler::sampleMeasurements(int i_samp, int attempt, 
+    std::vector<double> &sampled_measurements) 
+{
+    CounterRng generator(seed, i_samp, attempt);
+
+    if (settings.uncertainty_type == "poisson") {
+        for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+            std::poisson_distribution<int> distribution((*measurements)[i_meas]);
+            double sampled_value = 0;
+            for (int i_samp_shell = 0; i_samp_shell < settings.num_meas_per_shell; i_samp_shell++) {
+                sampled_value += distribution(generator);
+            }
+            sampled_value /= settings.num_meas_per_shell;
+            sampled_measurements[i_meas] = sampled_value;
+        }
+    }
+    else {
+        std::normal_distribution<double> distribution;
+        for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+            std::normal_distribution<double>::param_type parameters((*measurements)[i_meas], (*std_errors)[i_meas]);
+            sampled_measurements[i_meas] = distribution(generator, parameters);
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Unfold samples first_sample..first_sample+num_samples-1 and add their spectra to accumulator.
+// Returns the # of samples that were discarded & redrawn because MLEM-STOP did not converge. The
+// iterations spent are added to num_iterations.
+//--------------------------------------------------------------------------------------------------
+int UncertaintySampler::unfoldSamples(int first_sample, int num_samples, 
+    UncertaintyAccumulator &accumulator) 
+{
+    int num_blocks = (num_samples + SAMPLES_PER_BLOCK - 1) / SAMPLES_PER_BLOCK;
+    int group_size = std::min(MERGE_GROUP_BLOCKS, num_blocks);
+    block_accumulators.assign(group_size, accumulator);
+    block_tosses.assign(group_size, 0);
+
+    int num_toss = 0;
+    for (int first_block = 0; first_block < num_blocks; first_block += group_size) {
+        int num_group_blocks = std::min(group_size, num_blocks - first_block);
+
+        pool->run(num_group_blocks, [&](int i_group_block, int i_thread) {
+            int block_first = first_sample + (first_block + i_group_block)*SAMPLES_PER_BLOCK;
+            int block_num_samples = std::min(SAMPLES_PER_BLOCK, first_sample + num_samples - block_first);
+            UncertaintyAccumulator &block_accumulator = block_accumulators[i_group_block];
+            EventSpan block_event("block", "uncertainty", block_first, block_num_samples);
+            block_accumulator.reset();
+            block_tosses[i_group_block] = unfoldBlock(block_first, block_num_samples, i_thread, block_accumulator);
+        });
+
+        for (int i_group_block = 0; i_group_block < num_group_blocks; i_group_block++) {
+            accumulator.merge(block_accumulators[i_group_block]);
+            num_toss += block_tosses[i_group_block];
+        }
+    }
+    for (size_t i_thread = 0; i_thread < thread_iterations.size(); i_thread++) {
+        num_iterations += thread_iterations[i_thread];
+        thread_iterations[i_thread] = 0;
+    }
+    return num_toss;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Unfold samples 0,1,2,... and add their spectra to accumulator until the relative standard errors
+// of the dose uncertainty and of the spectrum uncertainty (largest among the energy bins) are both
+// <= target_error, using at least min_samples and at most max_samples samples. Samples are unfolded
+// in rounds that grow with the # of samples used so far (by 25%); the errors are checked after
+// each round, so the # of samples used is reproducible. Returns the # of samples that were
+// discarded & redrawn because MLEM-STOP did not converge.
+//--------------------------------------------------------------------------------------------------
+int UncertaintySampler::unfoldUntilConverged(double target_error, int min_samples, int max_samples, 
+    UncertaintyAccumulator &accumulator)
+{
+    if (min_samples < 2) {
+        throw std::logic_error("At least 2 uncertainty samples are required to estimate their error");
+    }
+    if (max_samples < min_samples) {
+        std::ostringstream error_message;
+        error_message << "The maximum # of uncertainty samples (" << max_samples << ") is lower than "
+            << "the minimum (" << min_samples << ")";
+        throw std::logic_error(error_message.str());
+    }
+
+    int num_toss = 0;
+    int num_samples = 0;
+    int num_round = min_samples;
+    while (num_round > 0) {
+        num_toss += unfoldSamples(num_samples, num_round, accumulator);
+        num_samples += num_round;
+
+        if (accumulator.dose.rmsdRelativeError() <= target_error 
+            && accumulator.spectrumRelativeError() <= target_error) 
+        {
+            break;
+        }
+        num_round = std::min(max_samples - num_samples, std::max(SAMPLES_PER_BLOCK, num_samples/4));
+    }
+    return num_toss;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Unfold a block of consecutive samples (in batches), using the working memory of thread i_thread,
+// and add their spectra to block_accumulator in sample order
+//--------------------------------------------------------------------------------------------------
+int UncertaintySampler::unfoldBlock(int first_sample, int num_samples, int i_thread,
+    UncertaintyAccumulator &block_accumulator)
+{
+    std::vector<std::vector<double>> &sampled_spectra = block_spectra[i_thread];
+
+    int num_toss = 0;
+    for (int i_first = 0; i_first < num_samples; i_first += batch_size) {
+        int num_batch_samples = std::min(batch_size, num_samples - i_first);
+        num_toss += unfoldBatch(first_sample + i_first, num_batch_samples, i_thread, sampled_spectra, 
+            first_sample
+        );
+    }
+
+    for (int i_block = 0; i_block < num_samples; i_block++) {
+        block_accumulator.addSample(sampled_spectra[i_block]);
+    }
+    return num_toss;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Unfold consecutive samples together as a batch. MLEM-STOP samples that do not converge are
+// redrawn (next attempt) and unfolded again until all samples of the batch converge. The spectrum
+// of sample i is stored in sampled_spectra[i - block_first]. The accelerated algorithms have no
+// batch solver: their samples are unfolded one after the other.
+//--------------------------------------------------------------------------------------------------
+int UncertaintySampler::unfoldBatch(int first_sample, int num_samples, int i_thread,
+    std::vector<std::vector<double>> &sampled_spectra, int block_first)
+{
+    if (settings.algorithm == "mlem_accel" || settings.algorithm == "map_accel") {
+        MlemWorkspace &workspace = workspaces[i_thread];
+        for (int i_samp = first_sample; i_samp < first_sample + num_samples; i_samp++) {
+            std::vector<double> &sampled_spectrum = sampled_spectra[i_samp - block_first];
+            EventSpan sample_event("sample", "uncertainty", i_samp, 1);
+            sampleMeasurements(i_samp, 0, workspace.sampled_measurements);
+            sampled_spectrum = *initial_spectrum; // same size, no allocation
+
+            if (settings.algorithm == "mlem_accel") {
+                thread_iterations[i_thread] += runMLEMAccel(settings.cutoff, settings.error, num_measurements, num_bins, 
+                    workspace.sampled_measurements, sampled_spectrum, *nns_response, 
+                    *normalized_response, workspace
+                );
+            }
+            else {
+                thread_iterations[i_thread] += runMAPAccel(settings.beta, settings.prior, settings.cutoff, settings.error, 
+                    num_measurements, num_bins, workspace.sampled_measurements, sampled_spectrum, 
+                    *nns_response, *normalized_response, workspace
+                );
+            }
+        }
+        return 0;
+    }
+
+    MlemBatch &batch = batches[i_thread];
+    std::vector<double> &sampled_measurements = thread_measurements[i_thread];
+    std::vector<int> &samples = pending_samples[i_thread];
+    std::vector<int> &attempts = pending_attempts[i_thread];
+
+    int num_pending = num_samples;
+    for (int i_batch = 0; i_batch < num_samples; i_batch++) {
+        samples[i_batch] = first_sample + i_batch;
+        attempts[i_batch] = 0;
+    }
+
+    int num_toss = 0;
+    for (int i_round = 0; num_pending > 0; i_round++) {
+        // Rounds after the first unfold the redrawn samples (not consecutive: the first one is given)
+        EventSpan batch_event(i_round == 0 ? "batch" : "redrawn batch", "uncertainty", samples[0],
+            num_pending);
+        batch.reset(num_pending);
+        for (int i_batch = 0; i_batch < num_pending; i_batch++) {
+            sampleMeasurements(samples[i_batch], attempts[i_batch], sampled_measurements);
+
+            // MLEM-STOP uses a unique J threshold for each sample
+            double sampled_j_threshold = 0;
+            if (settings.algorithm == "mlemstop") {
+                sampled_j_threshold = determineJThreshold(num_measurements,sampled_measurements,settings.cps_crossover);
+            }
+            batch.setSample(i_batch, sampled_measurements, *initial_spectrum, sampled_j_threshold);
+        }
+
+        // Do unfolding on the initial spectrum & sampled measurement values
+        if (settings.algorithm == "mlem") {
+            runMLEMBatch(settings.cutoff, settings.error, *nns_response, *normalized_response, batch);
+        }
+        // MLEM-STOP requires special handling of unfolding the sampled measurement sets.
+        // Despite best efforts, sometimes MLEM-STOP will never converge for some samples. 
+        // Current best approach is to discard those samples. A record is kept of the number
+        // of samples discarded and reported to the user so they may interpret the final
+        // uncertainty accordingly.
+        else if (settings.algorithm == "mlemstop") {
+            runMLEMSTOPBatch(settings.cutoff, *nns_response, *normalized_response, batch);
+        }
+        else if (settings.algorithm == "map") {
+            runMAPBatch(settings.beta, settings.prior, settings.cutoff, settings.error, *nns_response, 
+                *normalized_response, batch
+            );
+        }
+        else {
+            throw std::logic_error("Unrecognized unfolding algorithm: " + settings.algorithm);
+        }
+
+        // Keep converged samples; redraw the others
+        int num_redraw = 0;
+        for (int i_batch = 0; i_batch < num_pending; i_batch++) {
+            thread_iterations[i_thread] += batch.num_iterations[i_batch];
+            if (!batch.converged[i_batch]) {
+                if (settings.trace_stride > 0) {
+                    traceSample(samples[i_batch], attempts[i_batch]);
+                }
+                samples[num_redraw] = samples[i_batch];
+                attempts[num_redraw] = attempts[i_batch] + 1;
+                num_redraw++;
+                continue;
+            }
+            // same size, no allocation
+            sampled_spectra[samples[i_batch] - block_first] = batch.result_spectra[i_batch];
+        }
+        num_toss += num_redraw;
+        num_pending = num_redraw;
+    }
+    return num_toss;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Unfold a sample (attempt) again with MLEM-STOP (runMLEMSTOP), recording its convergence, and
+// save the trace to path_trace, suffixed with the sample & attempt numbers (e.g.
+// output/trace_<irradiation conditions>_sample12_attempt0.csv). Used for the samples that are
+// redrawn, which are rare: the memory is allocated here.
+//--------------------------------------------------------------------------------------------------
+void UncertaintySampler::traceSample(int i_samp, int attempt) {
+    EventSpan trace_event("trace sample", "uncertainty", i_samp, 1);
+    MlemWorkspace workspace(num_measurements, num_bins);
+    std::vector<double> sampled_measurements(num_measurements);
+    sampleMeasurements(i_samp, attempt, sampled_measurements);
+    std::vector<double> sampled_spectrum = *initial_spectrum;
+    double j_threshold = determineJThreshold(num_measurements, sampled_measurements, settings.cps_crossover);
+    double j_factor = 0;
+
+    ConvergenceTrace trace(settings.trace_capacity, settings.trace_stride);
+    std::string outcome = "completed";
+    try {
+        runMLEMSTOP(settings.cutoff, num_measurements, num_bins, sampled_measurements, sampled_spectrum,
+            *nns_response, *normalized_response, workspace, j_threshold, j_factor, NULL, &trace
+        );
+    }
+    catch (std::logic_error &e) {
+        outcome = "failed: " + std::string(e.what());
+    }
+
+    std::ostringstream suffix;
+    suffix << "_sample" << i_samp << "_attempt" << attempt;
+    std::ostringstream description;
+    description << outcome << " (sampled measurement set " << i_samp << ", attempt " << attempt 
+        << ", redrawn; J threshold " << j_threshold << ")";
+    trace.save(getTracePath(settings.path_trace, settings.irradiation_conditions, suffix.str()),
+        description.str()
+    );
+}
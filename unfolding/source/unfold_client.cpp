@@ -0,0 +1,233 @@
+//**************************************************************************************************
+// This program sends the measurements of a measurements file to the unfolding server
+// (unfold_server) and displays the unfolded spectrum & quantities of interest it returns. It can
+// also measure the latency & throughput of the server (--benchmark).
+//
+// Usage:
+//     unfold_client.exe [--socket <path>] [--measurements <file>] [--profile <name>]
+//         [--settings <name>=<value>,...] [--output <CSV file>]
+//         [--benchmark <# of requests per connection>] [--connections <# of connections>]
+// --settings override the settings of the server's configuration for this request (names of the
+// configuration file, e.g. algorithm=map,uncertainty_type=poisson). meas_units is also used to read
+// the measurements file. --output appends the unfolded spectrum to a CSV file (as
+// path_output_spectra of unfold_spectrum).
+// With --benchmark, the request is sent the given # of times over each connection (concurrently),
+// and the latency (round trip) of the requests is summarized.
+//**************************************************************************************************
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Local
+#include "custom_classes.h"
+#include "fileio.h"
+#include "handle_args.h"
+#include "unfold_service.h"
+
+//==================================================================================================
+// Send a request & receive its reply over a connection. Throws if the server replies with an error.
+//==================================================================================================
+static void sendRequest(ServiceConnection &connection, const ServiceMessage &request, ServiceMessage &reply) {
+    connection.send(request);
+    if (!connection.receive(reply)) {
+        throw std::logic_error("Connection closed by the server");
+    }
+    if (getServiceField(reply, "status") != "ok") {
+        throw std::logic_error("Server error: " + getServiceField(reply, "error"));
+    }
+}
+
+//==================================================================================================
+// Send the request num_requests times over each of num_connections concurrent connections, and
+// display the latency (round trip) & throughput
+//==================================================================================================
+static void runBenchmark(const std::string &socket_file, const ServiceMessage &request, int num_requests,
+    int num_connections)
+{
+    std::vector<std::vector<double>> latencies(num_connections); // per connection [s]
+    std::vector<std::vector<double>> server_times(num_connections); // time spent by the server [s]
+    std::vector<std::string> errors(num_connections);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i_connection = 0; i_connection < num_connections; i_connection++) {
+        threads.push_back(std::thread([&, i_connection]() {
+            try {
+                ServiceConnection connection(connectToServiceSocket(socket_file));
+                ServiceMessage reply;
+                for (int i_request = 0; i_request < num_requests; i_request++) {
+                    std::chrono::steady_clock::time_point request_start = std::chrono::steady_clock::now();
+                    sendRequest(connection, request, reply);
+                    latencies[i_connection].push_back(std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - request_start).count());
+                    server_times[i_connection].push_back(parseServiceValue("time", getServiceField(reply, "time")));
+                }
+            }
+            catch (std::exception &e) {
+                errors[i_connection] = e.what();
+            }
+        }));
+    }
+    for (size_t i_thread = 0; i_thread < threads.size(); i_thread++) {
+        threads[i_thread].join();
+    }
+    double wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (int i_connection = 0; i_connection < num_connections; i_connection++) {
+        if (!errors[i_connection].empty()) {
+            throw std::logic_error(errors[i_connection]);
+        }
+    }
+
+    // Gather & sort the latencies of all connections
+    std::vector<double> all_latencies;
+    std::vector<double> all_server_times;
+    for (int i_connection = 0; i_connection < num_connections; i_connection++) {
+        all_latencies.insert(all_latencies.end(), latencies[i_connection].begin(), latencies[i_connection].end());
+        all_server_times.insert(all_server_times.end(), server_times[i_connection].begin(), server_times[i_connection].end());
+    }
+    std::sort(all_latencies.begin(), all_latencies.end());
+    std::sort(all_server_times.begin(), all_server_times.end());
+    int num_total = all_latencies.size();
+
+    std::cout << "Requests: " << num_total << " (" << num_requests << " per connection x " << num_connections
+        << " connections)\n";
+    std::cout << "Wall time: " << wall_time << " s (" << num_total / wall_time << " requests/s)\n";
+    std::cout << "Latency (ms): min " << all_latencies[0] * 1000
+        << ", median " << all_latencies[num_total / 2] * 1000
+        << ", p95 " << all_latencies[std::min(num_total - 1, (int)(0.95 * num_total))] * 1000
+        << ", max " << all_latencies[num_total - 1] * 1000 << "\n";
+    std::cout << "Server unfolding time (ms): median " << all_server_times[num_total / 2] * 1000 << "\n";
+}
+
+int main(int argc, char* argv[])
+{
+    // Put arguments in vector for easier processing
+    std::vector<std::string> arg_vector;
+    for (int i = 1; i < argc; i++) {
+        arg_vector.push_back(argv[i]);
+    }
+
+    std::vector<std::string> input_file_flags;
+    input_file_flags.push_back("--socket");
+    input_file_flags.push_back("--measurements");
+    input_file_flags.push_back("--profile");
+    input_file_flags.push_back("--settings");
+    input_file_flags.push_back("--output");
+    input_file_flags.push_back("--benchmark");
+    input_file_flags.push_back("--connections");
+    std::string socket_file, measurements_file, profile, settings_string, output_file, benchmark_string,
+        connections_string;
+    setfile(arg_vector, "--socket", DEFAULT_SERVICE_SOCKET, socket_file);
+    setfile(arg_vector, "--measurements", "input/measurements.txt", measurements_file);
+    setfile(arg_vector, "--profile", "", profile);
+    setfile(arg_vector, "--settings", "", settings_string);
+    setfile(arg_vector, "--output", "", output_file);
+    setfile(arg_vector, "--benchmark", "0", benchmark_string);
+    setfile(arg_vector, "--connections", "1", connections_string);
+    checkUnknownParameters(arg_vector, input_file_flags);
+
+    signal(SIGPIPE, SIG_IGN); // a server that disconnects fails the write, not the client
+
+    //----------------------------------------------------------------------------------------------
+    // Read the measurements file (its header depends on meas_units), and build the request
+    //----------------------------------------------------------------------------------------------
+    std::vector<std::string> settings_entries;
+    stringToSVector(settings_string, settings_entries);
+    ServiceMessage request;
+    UnfoldingSettings settings;
+    std::vector<std::pair<std::string, std::string>> request_settings;
+    for (size_t i_entry = 0; i_entry < settings_entries.size(); i_entry++) {
+        size_t separator = settings_entries[i_entry].find('=');
+        if (separator == std::string::npos || separator == 0) {
+            throw std::logic_error("Invalid setting (expected <name>=<value>): " + settings_entries[i_entry]);
+        }
+        std::string name = settings_entries[i_entry].substr(0, separator);
+        std::string value = settings_entries[i_entry].substr(separator + 1);
+        if (name == "meas_units") {
+            settings.set_setting(name, value);
+        }
+        request_settings.push_back(std::make_pair(name, value));
+    }
+    settings.set_path_measurements(measurements_file);
+    std::vector<double> measurements = getMeasurements(settings);
+
+    if (!profile.empty()) {
+        request.push_back(std::make_pair("profile", profile));
+    }
+    request.push_back(std::make_pair("meas_units", settings.meas_units));
+    request.push_back(std::make_pair("irradiation_conditions", settings.irradiation_conditions));
+    if (settings.meas_units == "nc") {
+        request.push_back(std::make_pair("dose_mu", std::to_string(settings.dose_mu)));
+        request.push_back(std::make_pair("doserate_mu", std::to_string(settings.doserate_mu)));
+        request.push_back(std::make_pair("duration", std::to_string(settings.duration)));
+    }
+    request.insert(request.end(), request_settings.begin(), request_settings.end());
+    addServiceField(request, "measurements", measurements);
+
+    //----------------------------------------------------------------------------------------------
+    // Benchmark the server
+    //----------------------------------------------------------------------------------------------
+    int num_requests = atoi(benchmark_string.c_str());
+    if (num_requests > 0) {
+        runBenchmark(socket_file, request, num_requests, std::max(1, atoi(connections_string.c_str())));
+        return 0;
+    }
+
+    //----------------------------------------------------------------------------------------------
+    // Unfold the measurements, and display (& save) the results
+    //----------------------------------------------------------------------------------------------
+    ServiceConnection connection(connectToServiceSocket(socket_file));
+    ServiceMessage reply;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    sendRequest(connection, request, reply);
+    double round_trip = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> energy_bins = parseServiceVector("energy_bins", getServiceField(reply, "energy_bins"));
+    std::vector<double> spectrum = parseServiceVector("spectrum", getServiceField(reply, "spectrum"));
+    std::vector<double> spectrum_uncertainty_lower = parseServiceVector("spectrum_uncertainty_lower",
+        getServiceField(reply, "spectrum_uncertainty_lower"));
+    std::vector<double> spectrum_uncertainty_upper = parseServiceVector("spectrum_uncertainty_upper",
+        getServiceField(reply, "spectrum_uncertainty_upper"));
+    std::string irradiation_conditions = getServiceField(reply, "irradiation_conditions");
+
+    std::cout << "Unfolded " << irradiation_conditions << " (profile " << getServiceField(reply, "profile")
+        << ", " << getServiceField(reply, "algorithm") << ", " << getServiceField(reply, "num_iterations")
+        << " iterations) in " << parseServiceValue("time", getServiceField(reply, "time")) * 1000
+        << " ms (round trip " << round_trip * 1000 << " ms)\n";
+    std::cout << '\n';
+    std::cout << "The unfolded spectrum (energy [MeV], fluence rate, lower & upper uncertainties):" << '\n';
+    for (size_t i_bin = 0; i_bin < spectrum.size(); i_bin++) {
+        std::cout << energy_bins[i_bin] << ", " << spectrum[i_bin] << ", " << spectrum_uncertainty_lower[i_bin]
+            << ", " << spectrum_uncertainty_upper[i_bin] << '\n';
+    }
+    std::cout << '\n';
+    std::cout << "The equivalent dose is: " << parseServiceValue("dose", getServiceField(reply, "dose")) << " mSv/h\n";
+    std::cout << "Upper uncertainty: " << parseServiceValue("dose_uncertainty_upper", getServiceField(reply, "dose_uncertainty_upper")) << " mSv/h\n";
+    std::cout << "Lower uncertainty: " << parseServiceValue("dose_uncertainty_lower", getServiceField(reply, "dose_uncertainty_lower")) << " mSv/h\n";
+    std::cout << '\n';
+    std::cout << "The total neutron flux is: " << parseServiceValue("total_flux", getServiceField(reply, "total_flux")) << " n cm^-2 s^-1\n";
+    std::cout << "Upper uncertainty: " << parseServiceValue("total_flux_uncertainty_upper", getServiceField(reply, "total_flux_uncertainty_upper")) << " n cm^-2 s^-1\n";
+    std::cout << "Lower uncertainty: " << parseServiceValue("total_flux_uncertainty_lower", getServiceField(reply, "total_flux_uncertainty_lower")) << " n cm^-2 s^-1\n";
+    std::cout << '\n';
+    std::cout << "The average neutron energy is: " << parseServiceValue("avg_energy", getServiceField(reply, "avg_energy")) << " MeV\n";
+    std::cout << "Upper uncertainty: " << parseServiceValue("avg_energy_uncertainty_upper", getServiceField(reply, "avg_energy_uncertainty_upper")) << " MeV\n";
+    std::cout << "Lower uncertainty: " << parseServiceValue("avg_energy_uncertainty_lower", getServiceField(reply, "avg_energy_uncertainty_lower")) << " MeV\n";
+
+    if (!output_file.empty()) {
+        // Same layout (& order of the uncertainties) as the output spectra file of unfold_spectrum
+        saveSpectrumAsRow(output_file, energy_bins.size(), irradiation_conditions, spectrum,
+            spectrum_uncertainty_upper, spectrum_uncertainty_lower, energy_bins
+        );
+        std::cout << "\nSaved unfolded spectrum to " << output_file << "\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,308 @@
+//**************************************************************************************************
+// This program is a long-running unfolding server, for online monitoring (where unfolding is
+// requested every few seconds). It reads its configuration & instrument profiles once, keeps them
+// resident, and unfolds the measurements of the requests it receives over a Unix domain socket,
+// without reading or writing any file.
+//
+// Usage:
+//     unfold_server.exe [--configuration <file>] [--socket <path>]
+//         [--profiles <name>=<configuration file>,...]
+// The configuration file (as read by unfold_spectrum) sets the default settings of requests and the
+// instrument profile named "default". --profiles adds other profiles (e.g. other spectrometers),
+// each with its own configuration file. Requests are served by num_threads workers (one
+// connection at a time each); the sampled measurement sets of a request are unfolded sequentially.
+//
+// A request (see ServiceConnection) holds the measurements (in the order of a measurements file),
+// optionally the profile to unfold with, and settings (names of the configuration file) that
+// override those of the profile's configuration. The reply holds status=ok and the results
+// (spectrum, uncertainties, dose, total flux & average energy), or status=error and the error.
+//**************************************************************************************************
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Local
+#include "custom_classes.h"
+#include "fileio.h"
+#include "handle_args.h"
+#include "instrument_profile.h"
+#include "projection_kernels.h"
+#include "spectrum_unfolding.h"
+#include "thread_pool.h"
+#include "unfold_service.h"
+
+// Instrument profile kept resident by the server, with the settings of its configuration file
+struct ServerProfile {
+    std::string name;
+    UnfoldingSettings settings;
+    InstrumentProfile profile;
+};
+
+// Serializes the log lines of the workers
+static std::mutex log_mutex;
+
+// Pathname of the socket, removed when the server is stopped (SIGINT, SIGTERM)
+static char socket_path[256];
+
+//==================================================================================================
+// Remove the socket & exit (signal handler: only async-signal-safe functions)
+//==================================================================================================
+static void stopServer(int signal_number) {
+    unlink(socket_path);
+    _exit(0);
+}
+
+//==================================================================================================
+// Unfold the measurements of a request, and fill the reply with the results. Throws if the request
+// is invalid or cannot be unfolded.
+//==================================================================================================
+static void handleRequest(const ServiceMessage &request, std::vector<ServerProfile> &profiles,
+    ThreadPool &pool, ServiceMessage &reply)
+{
+    // Profile to unfold with
+    std::string profile_name = "default";
+    for (size_t i_field = 0; i_field < request.size(); i_field++) {
+        if (request[i_field].first == "profile") {
+            profile_name = request[i_field].second;
+        }
+    }
+    ServerProfile *server_profile = NULL;
+    for (size_t i_profile = 0; i_profile < profiles.size(); i_profile++) {
+        if (profiles[i_profile].name == profile_name) {
+            server_profile = &profiles[i_profile];
+        }
+    }
+    if (!server_profile) {
+        throw std::logic_error("Unknown profile: " + profile_name);
+    }
+
+    // Settings of the profile, overridden by those of the request. Files are neither read nor
+    // written, and the resources of the server are not for requests to set.
+    UnfoldingSettings settings = server_profile->settings;
+    std::vector<double> measurements;
+    bool has_measurements = false;
+    for (size_t i_field = 0; i_field < request.size(); i_field++) {
+        const std::string &name = request[i_field].first;
+        if (name == "profile") {
+            continue;
+        }
+        else if (name == "measurements") {
+            measurements = parseServiceVector(name, request[i_field].second);
+            has_measurements = true;
+        }
+        else if (name.compare(0, 5, "path_") == 0 || name.compare(0, 6, "trace_") == 0 
+            || name == "num_threads" || name == "projection_kernel") 
+        {
+            throw std::logic_error("Setting cannot be set by a request: " + name);
+        }
+        else {
+            settings.set_setting(name, request[i_field].second);
+        }
+    }
+    if (!has_measurements) {
+        throw std::logic_error("Missing field in message: measurements");
+    }
+    settings.set_f_factor(settings.f_factor / 1e6); // Convert f_factor from fA/cps to nA/cps
+
+    std::vector<double> measurements_nc;
+    std::vector<double> std_errors;
+    prepareMeasurements(settings, measurements, measurements_nc, std_errors);
+
+    UnfoldingResult result;
+    unfoldSpectrum(settings, server_profile->profile, pool, measurements, std_errors, result);
+
+    reply.push_back(std::make_pair("status", "ok"));
+    reply.push_back(std::make_pair("profile", profile_name));
+    reply.push_back(std::make_pair("irradiation_conditions", settings.irradiation_conditions));
+    reply.push_back(std::make_pair("algorithm", settings.algorithm));
+    addServiceField(reply, "num_iterations", result.num_iterations);
+    if (settings.uncertainty_type == "poisson" || settings.uncertainty_type == "gaussian") {
+        reply.push_back(std::make_pair("seed", std::to_string(result.seed)));
+        addServiceField(reply, "num_uncertainty_samples", result.num_uncertainty_samples);
+    }
+    addServiceField(reply, "energy_bins", server_profile->profile.energy_bins);
+    addServiceField(reply, "spectrum", result.spectrum);
+    addServiceField(reply, "spectrum_uncertainty_lower", result.spectrum_uncertainty_lower);
+    addServiceField(reply, "spectrum_uncertainty_upper", result.spectrum_uncertainty_upper);
+    addServiceField(reply, "dose", result.dose);
+    addServiceField(reply, "dose_uncertainty_lower", result.dose_uncertainty_lower);
+    addServiceField(reply, "dose_uncertainty_upper", result.dose_uncertainty_upper);
+    addServiceField(reply, "total_flux", result.total_flux);
+    addServiceField(reply, "total_flux_uncertainty_lower", result.total_flux_uncertainty_lower);
+    addServiceField(reply, "total_flux_uncertainty_upper", result.total_flux_uncertainty_upper);
+    addServiceField(reply, "avg_energy", result.avg_energy);
+    addServiceField(reply, "avg_energy_uncertainty_lower", result.avg_energy_uncertainty_lower);
+    addServiceField(reply, "avg_energy_uncertainty_upper", result.avg_energy_uncertainty_upper);
+}
+
+//==================================================================================================
+// Reply with an error (on a single line, as required by the messages)
+//==================================================================================================
+static void setErrorReply(const std::string &error, ServiceMessage &reply) {
+    std::string error_line = error;
+    std::replace(error_line.begin(), error_line.end(), '\n', ' ');
+    reply.clear();
+    reply.push_back(std::make_pair("status", "error"));
+    reply.push_back(std::make_pair("error", error_line));
+}
+
+//==================================================================================================
+// Worker: accept connections & serve their requests, one connection at a time, forever. A request
+// that fails gets an error reply; a connection that fails (e.g. malformed message) is closed.
+//==================================================================================================
+static void serveConnections(int i_worker, int listen_descriptor, std::vector<ServerProfile> &profiles) {
+    ThreadPool pool(1); // requests are unfolded concurrently, their samples sequentially
+
+    while (true) {
+        int connection_descriptor = accept(listen_descriptor, NULL, NULL);
+        if (connection_descriptor < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                std::lock_guard<std::mutex> lock(log_mutex);
+                std::cout << "[worker " << i_worker << "] Unable to accept connection: " << strerror(errno) << std::endl;
+            }
+            continue;
+        }
+
+        ServiceConnection connection(connection_descriptor);
+        ServiceMessage request;
+        ServiceMessage reply;
+        try {
+            while (connection.receive(request)) {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                reply.clear();
+                std::string error;
+                try {
+                    handleRequest(request, profiles, pool, reply);
+                }
+                catch (std::exception &e) {
+                    error = e.what();
+                    setErrorReply(error, reply);
+                }
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                addServiceField(reply, "time", seconds);
+                connection.send(reply);
+
+                std::lock_guard<std::mutex> lock(log_mutex);
+                std::cout << "[worker " << i_worker << "] ";
+                if (error.empty()) {
+                    std::cout << getServiceField(reply, "irradiation_conditions") << " ("
+                        << getServiceField(reply, "profile") << ", " << getServiceField(reply, "algorithm")
+                        << "): " << seconds * 1000 << " ms" << std::endl;
+                }
+                else {
+                    std::cout << "FAILED: " << error << std::endl;
+                }
+            }
+        }
+        catch (std::exception &e) {
+            {
+                std::lock_guard<std::mutex> lock(log_mutex);
+                std::cout << "[worker " << i_worker << "] Connection closed: " << e.what() << std::endl;
+            }
+            try {
+                setErrorReply(e.what(), reply);
+                connection.send(reply);
+            }
+            catch (std::exception &) {
+                // The client is gone
+            }
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    // Put arguments in vector for easier processing
+    std::vector<std::string> arg_vector;
+    for (int i = 1; i < argc; i++) {
+        arg_vector.push_back(argv[i]);
+    }
+
+    std::vector<std::string> input_file_flags;
+    input_file_flags.push_back("--configuration");
+    input_file_flags.push_back("--socket");
+    input_file_flags.push_back("--profiles");
+    std::string config_file, socket_file, profiles_string;
+    setfile(arg_vector, "--configuration", "input/unfold_spectrum.cfg", config_file);
+    setfile(arg_vector, "--socket", DEFAULT_SERVICE_SOCKET, socket_file);
+    setfile(arg_vector, "--profiles", "", profiles_string);
+    checkUnknownParameters(arg_vector, input_file_flags);
+
+    //----------------------------------------------------------------------------------------------
+    // Read the configuration & instrument profile of each profile, once
+    //----------------------------------------------------------------------------------------------
+    std::vector<std::string> profile_names;
+    std::vector<std::string> profile_configs;
+    profile_names.push_back("default");
+    profile_configs.push_back(config_file);
+    std::vector<std::string> profile_entries;
+    stringToSVector(profiles_string, profile_entries);
+    for (size_t i_entry = 0; i_entry < profile_entries.size(); i_entry++) {
+        size_t separator = profile_entries[i_entry].find('=');
+        if (separator == std::string::npos || separator == 0) {
+            throw std::logic_error("Invalid profile (expected <name>=<configuration file>): " + profile_entries[i_entry]);
+        }
+        std::string name = profile_entries[i_entry].substr(0, separator);
+        if (std::find(profile_names.begin(), profile_names.end(), name) != profile_names.end()) {
+            throw std::logic_error("Duplicate profile: " + name);
+        }
+        profile_names.push_back(name);
+        profile_configs.push_back(profile_entries[i_entry].substr(separator + 1));
+    }
+
+    std::vector<ServerProfile> profiles(profile_names.size());
+    for (size_t i_profile = 0; i_profile < profiles.size(); i_profile++) {
+        profiles[i_profile].name = profile_names[i_profile];
+        setSettings(profile_configs[i_profile], profiles[i_profile].settings);
+        profiles[i_profile].settings.set_trace_stride(0); // no files are written (convergence traces)
+        readInstrumentProfile(profiles[i_profile].settings, profiles[i_profile].profile);
+    }
+    UnfoldingSettings &settings = profiles[0].settings;
+
+    // Select the (vectorized) implementation of the response projections used by the algorithms
+    setProjectionKernel(settings.projection_kernel);
+
+    //----------------------------------------------------------------------------------------------
+    // Listen on the socket (removed when the server is stopped), and serve requests
+    //----------------------------------------------------------------------------------------------
+    int listen_descriptor = listenOnServiceSocket(socket_file);
+    strncpy(socket_path, socket_file.c_str(), sizeof(socket_path) - 1);
+    signal(SIGINT, stopServer);
+    signal(SIGTERM, stopServer);
+    signal(SIGPIPE, SIG_IGN); // a client that disconnects early fails the write, not the server
+
+    int num_workers = settings.num_threads;
+    if (num_workers <= 0) {
+        num_workers = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+
+    std::cout << "Unfolding server listening on " << socket_file << " (" << num_workers << " workers)\n";
+    for (size_t i_profile = 0; i_profile < profiles.size(); i_profile++) {
+        std::cout << "    profile " << profiles[i_profile].name << ": " << profile_configs[i_profile] << " ("
+            << profiles[i_profile].profile.nns_response.num_measurements() << " measurements x "
+            << profiles[i_profile].profile.energy_bins.size() << " energy bins)\n";
+    }
+    std::cout << std::flush;
+
+    // The main thread is worker 0
+    std::vector<std::thread> workers;
+    for (int i_worker = 1; i_worker < num_workers; i_worker++) {
+        workers.push_back(std::thread(serveConnections, i_worker, listen_descriptor, std::ref(profiles)));
+    }
+    serveConnections(0, listen_descriptor, profiles);
+
+    return 0;
+}
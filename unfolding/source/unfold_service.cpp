@@ -0,0 +1,272 @@
+//**************************************************************************************************
+// The functions & classes included in this module implement the protocol between unfold_server and
+// its clients (unfold_client): Unix domain sockets, and messages of "name=value" lines (see
+// ServiceConnection). Numbers are written with enough digits to be read back exactly.
+//**************************************************************************************************
+
+#include "unfold_service.h"
+#include "csv_reader.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+// Longest line accepted in a message (guards the server against clients that never end a line)
+static const size_t MAX_LINE_LENGTH = 1 << 20;
+
+//==================================================================================================
+// Fill the address of the Unix domain socket at path
+//==================================================================================================
+static void setSocketAddress(const std::string &path, sockaddr_un &address) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        throw std::logic_error("Invalid socket pathname (empty or longer than "
+            + std::to_string(sizeof(address.sun_path) - 1) + " characters): " + path);
+    }
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Take ownership of a connected socket
+//--------------------------------------------------------------------------------------------------
+ServiceConnection::ServiceConnection(int file_descriptor) {
+    this->file_descriptor = file_descriptor;
+    buffer_position = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Close the connection
+//--------------------------------------------------------------------------------------------------
+ServiceConnection::~ServiceConnection() {
+    if (file_descriptor >= 0) {
+        ::close(file_descriptor);
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Read the next line (without its line ending) from the connection. Returns false if the connection
+// was closed before a line was started.
+//--------------------------------------------------------------------------------------------------
+bool ServiceConnection::readLine(std::string &line) {
+    while (true) {
+        size_t line_end = buffer.find('\n', buffer_position);
+        if (line_end != std::string::npos) {
+            line.assign(buffer, buffer_position, line_end - buffer_position);
+            if (!line.empty() && line[line.size()-1] == '\r') {
+                line.erase(line.size()-1);
+            }
+            buffer_position = line_end + 1;
+            return true;
+        }
+        if (buffer.size() - buffer_position > MAX_LINE_LENGTH) {
+            throw std::logic_error("Message line longer than " + std::to_string(MAX_LINE_LENGTH) + " characters");
+        }
+
+        // Discard the lines already returned, then read more data
+        buffer.erase(0, buffer_position);
+        buffer_position = 0;
+        char chunk[65536];
+        ssize_t num_read = ::read(file_descriptor, chunk, sizeof(chunk));
+        if (num_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (num_read < 0) {
+            throw std::logic_error("Unable to read from socket: " + std::string(strerror(errno)));
+        }
+        if (num_read == 0) {
+            if (!buffer.empty()) {
+                throw std::logic_error("Connection closed in the middle of a message");
+            }
+            return false;
+        }
+        buffer.append(chunk, num_read);
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Receive the next message. Returns false if the connection was closed (between messages).
+//--------------------------------------------------------------------------------------------------
+bool ServiceConnection::receive(ServiceMessage &message) {
+    message.clear();
+    std::string line;
+    while (true) {
+        if (!readLine(line)) {
+            if (!message.empty()) {
+                throw std::logic_error("Connection closed in the middle of a message");
+            }
+            return false;
+        }
+        if (line.empty()) {
+            // Empty line: end of the message (empty lines before a message are ignored)
+            if (!message.empty()) {
+                return true;
+            }
+            continue;
+        }
+        size_t separator = line.find('=');
+        if (separator == std::string::npos) {
+            throw std::logic_error("Malformed message line (expected name=value): " + line);
+        }
+        message.push_back(std::make_pair(line.substr(0, separator), line.substr(separator + 1)));
+    }
+}
+
+//--------------------------------------------------------------------------------------------------
+// Send a message (its lines, then the terminating empty line)
+//--------------------------------------------------------------------------------------------------
+void ServiceConnection::send(const ServiceMessage &message) {
+    std::string data;
+    for (size_t i_field = 0; i_field < message.size(); i_field++) {
+        data += message[i_field].first + "=" + message[i_field].second + "\n";
+    }
+    data += "\n";
+
+    size_t num_sent = 0;
+    while (num_sent < data.size()) {
+        ssize_t num_written = ::write(file_descriptor, data.data() + num_sent, data.size() - num_sent);
+        if (num_written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (num_written < 0) {
+            throw std::logic_error("Unable to write to socket: " + std::string(strerror(errno)));
+        }
+        num_sent += num_written;
+    }
+}
+
+//==================================================================================================
+// Create the Unix domain socket at path & listen for connections on it. A socket file left by a
+// server that did not exit cleanly is replaced, but not the socket of a running server.
+//==================================================================================================
+int listenOnServiceSocket(const std::string &path) {
+    sockaddr_un address;
+    setSocketAddress(path, address);
+
+    struct stat status;
+    if (stat(path.c_str(), &status) == 0) {
+        if (!S_ISSOCK(status.st_mode)) {
+            throw std::logic_error("Unable to create socket: " + path + " exists and is not a socket");
+        }
+        int test_descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool in_use = test_descriptor >= 0
+            && connect(test_descriptor, (sockaddr*)&address, sizeof(address)) == 0;
+        if (test_descriptor >= 0) {
+            ::close(test_descriptor);
+        }
+        if (in_use) {
+            throw std::logic_error("A server is already listening on " + path);
+        }
+        unlink(path.c_str());
+    }
+
+    int file_descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (file_descriptor < 0) {
+        throw std::logic_error("Unable to create socket: " + std::string(strerror(errno)));
+    }
+    if (bind(file_descriptor, (sockaddr*)&address, sizeof(address)) != 0
+        || listen(file_descriptor, SOMAXCONN) != 0)
+    {
+        std::string error = strerror(errno);
+        ::close(file_descriptor);
+        throw std::logic_error("Unable to listen on socket " + path + ": " + error);
+    }
+    return file_descriptor;
+}
+
+//==================================================================================================
+// Connect to the server listening on the Unix domain socket at path
+//==================================================================================================
+int connectToServiceSocket(const std::string &path) {
+    sockaddr_un address;
+    setSocketAddress(path, address);
+
+    int file_descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (file_descriptor < 0) {
+        throw std::logic_error("Unable to create socket: " + std::string(strerror(errno)));
+    }
+    if (connect(file_descriptor, (sockaddr*)&address, sizeof(address)) != 0) {
+        std::string error = strerror(errno);
+        ::close(file_descriptor);
+        throw std::logic_error("Unable to connect to the server on " + path + ": " + error
+            + ". Is unfold_server.exe running?");
+    }
+    return file_descriptor;
+}
+
+//==================================================================================================
+// Return the value of the (first) field of a message with the given name
+//==================================================================================================
+const std::string& getServiceField(const ServiceMessage &message, const std::string &name) {
+    for (size_t i_field = 0; i_field < message.size(); i_field++) {
+        if (message[i_field].first == name) {
+            return message[i_field].second;
+        }
+    }
+    throw std::logic_error("Missing field in message: " + name);
+}
+
+//==================================================================================================
+// Add a numeric field (written so that it is read back exactly) to a message
+//==================================================================================================
+void addServiceField(ServiceMessage &message, const std::string &name, double value) {
+    std::ostringstream value_stream;
+    value_stream << std::setprecision(std::numeric_limits<double>::max_digits10) << value;
+    message.push_back(std::make_pair(name, value_stream.str()));
+}
+
+//==================================================================================================
+// Add a vector field (comma-delimited values) to a message
+//==================================================================================================
+void addServiceField(ServiceMessage &message, const std::string &name, const std::vector<double> &values) {
+    std::ostringstream values_stream;
+    values_stream << std::setprecision(std::numeric_limits<double>::max_digits10);
+    for (size_t i_value = 0; i_value < values.size(); i_value++) {
+        if (i_value > 0) {
+            values_stream << ',';
+        }
+        values_stream << values[i_value];
+    }
+    message.push_back(std::make_pair(name, values_stream.str()));
+}
+
+//==================================================================================================
+// Convert the value of a numeric field, independently of the locale (see parseDouble). Throws
+// unless the whole value is a number.
+//==================================================================================================
+double parseServiceValue(const std::string &name, const std::string &value_string) {
+    double value;
+    if (!parseDouble(value_string.data(), value_string.data() + value_string.size(), value)) {
+        throw std::logic_error("Invalid number in field " + name + ": " + value_string);
+    }
+    return value;
+}
+
+//==================================================================================================
+// Convert the value of a vector field (comma-delimited values). Throws if a value is not a number.
+//==================================================================================================
+std::vector<double> parseServiceVector(const std::string &name, const std::string &values_string) {
+    std::vector<double> values;
+    if (values_string.empty()) {
+        return values;
+    }
+    size_t begin = 0;
+    while (true) {
+        size_t end = values_string.find(',', begin);
+        values.push_back(parseServiceValue(name, values_string.substr(begin, end - begin)));
+        if (end == std::string::npos) {
+            return values;
+        }
+        begin = end + 1;
+    }
+}
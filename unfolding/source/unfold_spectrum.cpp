@@ -8,273 +8,264 @@
 //  - the dose and its uncertainty
 //  - the spectrum and its uncertainty (numeric and graphical forms)
 //  - a report that details the execution of this program for archival and reproducibility
+//
+// In batch mode (--batch <manifest or pattern>), all measurement files of a campaign are unfolded by
+// a single process: the configuration & instrument inputs are read once, and the files are unfolded
+// concurrently. A file that cannot be unfolded is reported at the end, without stopping the batch.
 //**************************************************************************************************
 
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include <fstream>
 #include <sstream>
 #include <cmath>
 #include <chrono>
+#include <functional>
+#include <limits>
+#include <mutex>
 #include <random>
+#include <stdexcept>
 #include <stdlib.h>
 #include <vector>
 
 // Local
 #include "custom_classes.h"
+#include "event_trace.h"
 #include "fileio.h"
 #include "handle_args.h"
-#include "root_helpers.h"
+#include "instrument_profile.h"
 #include "physics_calculations.h"
-
-int main(int argc, char* argv[])
+#include "plot_plugin.h"
+#include "projection_kernels.h"
+#include "response_matrix.h"
+#include "spectra_store.h"
+#include "spectrum_unfolding.h"
+#include "thread_pool.h"
+
+// Saves an unfolded spectrum & its lower & upper uncertainties (under settings.irradiation_conditions)
+typedef std::function<void(const UnfoldingSettings &settings, std::vector<double> &spectrum,
+    std::vector<double> &spectrum_uncertainty_lower, std::vector<double> &spectrum_uncertainty_upper)> SpectrumSaver;
+
+// Outcome of the unfolding of a measurement file in batch mode
+struct BatchItem {
+    bool done = false;
+    std::string error; // empty if the file was unfolded successfully
+    double seconds = 0; // wall time spent unfolding the file
+    PerformanceLog performance; // phases of the unfolding of the file (see unfoldMeasurementFile)
+    bool has_spectrum = false; // unfolding got as far as saving the spectrum (kept until saved)
+    UnfoldingSettings settings;
+    std::vector<double> spectrum;
+    std::vector<double> spectrum_uncertainty_lower;
+    std::vector<double> spectrum_uncertainty_upper;
+};
+
+//==================================================================================================
+// Return the wall time [s] elapsed since start
+//==================================================================================================
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//==================================================================================================
+// Return the wall time [s] of a phase of a performance log (0 if it was not recorded)
+//==================================================================================================
+static double phaseSeconds(const PerformanceLog &performance, const std::string &name) {
+    const PhaseRecord *phase = performance.find(name);
+    return phase ? phase->wall_seconds : 0;
+}
+
+//==================================================================================================
+// Display the distribution of a latency over the files of a batch [ms]: 50th, 90th & 99th
+// percentiles (nearest rank) and maximum. seconds is reordered.
+//==================================================================================================
+static void printLatency(const std::string &name, std::vector<double> &seconds) {
+    std::sort(seconds.begin(), seconds.end());
+    int num_values = seconds.size();
+    double percentiles[3] = {0.5, 0.9, 0.99};
+    std::cout << "    " << std::left << std::setw(14) << name << std::right << std::fixed
+        << std::setprecision(3);
+    for (int i_percentile = 0; i_percentile < 3; i_percentile++) {
+        int rank = (int)ceil(percentiles[i_percentile]*num_values);
+        std::cout << std::setw(12) << seconds[std::max(rank, 1) - 1]*1000;
+    }
+    std::cout << std::setw(12) << seconds[num_values-1]*1000 << std::defaultfloat << std::setprecision(6)
+        << "\n";
+}
+
+//==================================================================================================
+// Save an unfolded spectrum & its uncertainties to the spectra store (path_spectra_store) if one is
+// set, or else append them to the output spectra CSV file (path_output_spectra)
+//==================================================================================================
+static void saveUnfoldedSpectrum(const UnfoldingSettings &settings, std::vector<double> &energy_bins,
+    std::vector<double> &spectrum, std::vector<double> &spectrum_uncertainty_lower,
+    std::vector<double> &spectrum_uncertainty_upper, std::ostream &out)
 {
-    // Put arguments in vector for easier processing
-    std::vector<std::string> arg_vector;
-    for (int i = 1; i < argc; i++) {
-        arg_vector.push_back(argv[i]);
+    if (settings.path_spectra_store.empty()) {
+        saveSpectrumAsRow(settings.path_output_spectra, energy_bins.size(), settings.irradiation_conditions, 
+            spectrum, spectrum_uncertainty_upper, spectrum_uncertainty_lower, energy_bins
+        );
+        out << "Saved unfolded spectrum to " << settings.path_output_spectra << "\n";
     }
-
-    // NOTE: Indices are linked between the following arrays and vectors (i.e. input_files[0]
-    // corresponds to input_file_flags[0] and input_file_defaults[0])
-    // Array that stores the allowed options that specify input files
-    // Add new options at end of array
-    const int num_ifiles = 1;
-    std::string input_file_flags_arr[num_ifiles] = {
-        "--configuration"
-    };
-    // Array that stores default filename for each input file
-    std::string input_file_defaults_arr[num_ifiles] = {
-        "input/unfold_spectrum.cfg"
-    };
-
-    // Convert arrays to vectors b/c easier to work with
-    std::vector<std::string> input_files; // Store the actual input filenames to be used
-    std::vector<std::string> input_file_flags;
-    std::vector<std::string> input_file_defaults;
-    for (int i=0; i<num_ifiles; i++) {
-        input_files.push_back("");
-        input_file_flags.push_back(input_file_flags_arr[i]);
-        input_file_defaults.push_back(input_file_defaults_arr[i]);
+    else {
+        appendToSpectraStore(settings.path_spectra_store, settings.irradiation_conditions, energy_bins,
+            spectrum, spectrum_uncertainty_lower, spectrum_uncertainty_upper
+        );
+        out << "Saved unfolded spectrum to " << settings.path_spectra_store << "\n";
     }
-
-    // Use provided arguments (files) and/or defaults to determine the input files to be used
-    for (int i=0; i<num_ifiles; i++) {
-        setfile(arg_vector, input_file_flags[i], input_file_defaults[i], input_files[i]);
+}
+
+//==================================================================================================
+// Write a value of the results file (see saveUnfoldingResults)
+//==================================================================================================
+static void writeResult(std::ostream &output, const std::string &name, double value) {
+    output << name << "=" << value << "\n";
+}
+static void writeResult(std::ostream &output, const std::string &name, const std::vector<double> &values) {
+    output << name << "=";
+    for (size_t i_value = 0; i_value < values.size(); i_value++) {
+        output << (i_value > 0 ? "," : "") << values[i_value];
     }
-
-    // Notify user if unknown parameters were received
-    checkUnknownParameters(arg_vector, input_file_flags);
-
-    // Apply some settings read in from a config file
-    UnfoldingSettings settings;
-    setSettings(input_files[0], settings);
-
+    output << "\n";
+}
+
+//==================================================================================================
+// Save the results of an unfolding (iterations, quantities of interest, spectrum & their
+// uncertainties) as "name=value" lines, with enough digits to be read back exactly, so that runs
+// can be compared bit for bit (see compare_results & make regression). Values that do not apply to
+// the algorithm or uncertainty type are 0.
+//==================================================================================================
+static void saveUnfoldingResults(const std::string &path, const UnfoldingSettings &settings,
+    const UnfoldingResult &result, const std::vector<double> &energy_bins)
+{
+    std::ofstream output(path);
+    if (!output.is_open()) {
+        throw std::logic_error("Unable to open file: " + path);
+    }
+    output << std::setprecision(std::numeric_limits<double>::max_digits10);
+    output << "irradiation_conditions=" << settings.irradiation_conditions << "\n";
+    output << "algorithm=" << settings.algorithm << "\n";
+    output << "uncertainty_type=" << settings.uncertainty_type << "\n";
+    writeResult(output, "num_iterations", result.num_iterations);
+    writeResult(output, "j_factor", result.j_factor);
+    writeResult(output, "j_threshold", result.j_threshold);
+    output << "seed=" << result.seed << "\n";
+    writeResult(output, "num_uncertainty_samples", result.num_uncertainty_samples);
+    writeResult(output, "num_toss", result.num_toss);
+    writeResult(output, "avg_sample_iterations", result.avg_sample_iterations);
+    writeResult(output, "dose", result.dose);
+    writeResult(output, "dose_uncertainty_upper", result.dose_uncertainty_upper);
+    writeResult(output, "dose_uncertainty_lower", result.dose_uncertainty_lower);
+    writeResult(output, "total_flux", result.total_flux);
+    writeResult(output, "total_flux_uncertainty_upper", result.total_flux_uncertainty_upper);
+    writeResult(output, "total_flux_uncertainty_lower", result.total_flux_uncertainty_lower);
+    writeResult(output, "avg_energy", result.avg_energy);
+    writeResult(output, "avg_energy_uncertainty_upper", result.avg_energy_uncertainty_upper);
+    writeResult(output, "avg_energy_uncertainty_lower", result.avg_energy_uncertainty_lower);
+    writeResult(output, "energy_bins", energy_bins);
+    writeResult(output, "spectrum", result.spectrum);
+    writeResult(output, "spectrum_uncertainty_upper", result.spectrum_uncertainty_upper);
+    writeResult(output, "spectrum_uncertainty_lower", result.spectrum_uncertainty_lower);
+    writeResult(output, "mlem_ratio", result.mlem_ratio);
+}
+
+//==================================================================================================
+// Unfold the measurements of the file settings.path_measurements, calculate the quantities of
+// interest & their uncertainties, and write the results: the spectrum (through save_spectrum), the
+// results file (generate_results), the report & the figure.
+//
+// Args:
+//  - settings: the settings read from the configuration file (copied, as they are completed from the
+//      measurements file)
+//  - profile: the inputs describing the instrument (read once, shared by all files of a batch)
+//  - pool: threads across which the sampled measurement sets are unfolded
+//  - input_files, input_file_flags: input files listed in the report
+//  - out: stream to which progress & results are printed
+//  - plot_mutex: serializes the plotting of figures (ROOT)
+//  - save_spectrum: saves the unfolded spectrum & its uncertainties
+//  - performance: the phases (parse, unfold, uncertainty, save, report & figure) are added to it.
+//      They are listed in the report (up to the report), and saved to path_performance (JSON) if
+//      generate_performance is set.
+//==================================================================================================
+static void unfoldMeasurementFile(UnfoldingSettings settings, InstrumentProfile &profile, ThreadPool &pool,
+    std::vector<std::string> &input_files, std::vector<std::string> &input_file_flags, std::ostream &out,
+    std::mutex &plot_mutex, const SpectrumSaver &save_spectrum, PerformanceLog &performance)
+{
+    PhaseTimer parse_timer(&performance, "parse");
     double f_factor_report = settings.f_factor; // original value read in
     settings.set_f_factor(settings.f_factor / 1e6); // Convert f_factor from fA/cps to nA/cps
 
-    // Read in measurements from file
+    // Read in measurements from file, and prepare them for unfolding (convert nC to CPS, average
+    // multiple measurements per shell, ...)
     std::vector<double> measurements_nc;
-    std::vector<double> measurements;
-    int num_measurements = 0;
-    measurements = getMeasurements(settings);
-    num_measurements = measurements.size();
-    std::reverse(measurements.begin(),measurements.end()); // readin 7-0 but want 0-7
-
-    // Handle nC input (save nC values for report, then convert to CPS)
-    if (settings.meas_units == "nc") {
-        measurements_nc = measurements;
-        for (int i_meas=0; i_meas < num_measurements; i_meas++) {
-            measurements[i_meas] = measurements[i_meas]*settings.norm/settings.f_factor/settings.duration;
-        }
-    }
-
-    // Process data wherein multiple measurements were acquired for each shell
     std::vector<double> std_errors;
-    if (settings.num_meas_per_shell > 1) {
-        processMeasurements(num_measurements,settings.num_meas_per_shell,measurements,std_errors);
-        num_measurements = num_measurements / settings.num_meas_per_shell;
-    }
-    // Do not allow use of gaussian sampling technique if only one measurement per shell is
-    // provided, as the standard deviation is unknown.
-    else if (settings.num_meas_per_shell == 1 && settings.uncertainty_type == "gaussian"){
-        throw std::logic_error("Cannot generate Gaussian-sampled pseudo-measurements with only single measurement per shell.");
-    }
-    // Require at least 1 measurement per shell
-    else if (settings.num_meas_per_shell < 1) { // if settings.num_meas_per_shell is 0 or negative
-        throw std::logic_error("Number of measurements per shell must be >= 1");
-    }
-
-
-    // if (settings.meas_units == "cps") {
-    //     measurements = getMeasurements(settings);
-    //     num_measurements = measurements.size();
-    //     std::reverse(measurements.begin(),measurements.end());
-    // }
-    // // nC
-    // else {
-    //     measurements_nc = getMeasurements(settings);
-    //     num_measurements = measurements_nc.size();
-    //     // Convert to CPS
-    //     for (int index=0; index < num_measurements; index++) {
-    //         double measurement_cps = measurements_nc[num_measurements-index-1]*settings.norm/settings.f_factor/settings.duration;
-    //         measurements.push_back(measurement_cps);
-    //     }
-    // }
-
-    // Calculate average CPS value
-    double avg_cps = 0;
-    for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
-        avg_cps += measurements[i_meas];
-    }
-    avg_cps /= num_measurements;
+    EventSpan measurements_event("measurements", "file", settings.path_measurements);
+    std::vector<double> measurements = getMeasurements(settings);
+    measurements_event.stop();
+    out << "Measurements successfully retrieved from " + settings.path_measurements + '\n';
+    prepareMeasurements(settings, measurements, measurements_nc, std_errors);
+    int num_measurements = measurements.size();
+    parse_timer.stop();
 
     //----------------------------------------------------------------------------------------------
     // Print out the processed measured data matrix
     //----------------------------------------------------------------------------------------------
-    std::cout << '\n';
-    std::cout << "The measurements in CPS are:" << '\n'; // newline
+    out << '\n';
+    out << "The measurements in CPS are:" << '\n'; // newline
 
     //Loop over the data matrix, display each value
     for (int i = 0; i < num_measurements; ++i)
     {
-        std::cout << measurements[i] << '\n';
+        out << measurements[i] << '\n';
     }
-    std::cout << '\n';
+    out << '\n';
 
     if (settings.num_meas_per_shell > 1) {
-        std::cout << "The standard errors in CPS are:" << '\n'; // newline
+        out << "The standard errors in CPS are:" << '\n'; // newline
 
         //Loop over the data matrix, display each value
         for (int i = 0; i < num_measurements; ++i)
         {
-            std::cout << std_errors[i] << '\n';
+            out << std_errors[i] << '\n';
         }
-        std::cout << '\n';
+        out << '\n';
     }
 
-    // If doing MLEM-STOP: need ratio between "ideal" or "crossover" CPS value and the average
-    // measured CPS. Call this scale_factor
-    // double scale_factor = settings.cps_crossover/avg_cps;
-
-    // Apply scaling factor to the measured values so that their average value equals the ideal CPS
-    // Then MLEM-STOP can be done such that terminate when J=1 (rather than J=scale_factor)
-    // for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
-    //     measurements[i_meas] *= scale_factor;
-    // }
-
     //----------------------------------------------------------------------------------------------
-    // Generate the energy bins matrix:
-    //  - size = # of energy bins
-    // Input the energies from energy bins file
-    //  - values in units of [MeV]
+    // Inputs that describe the instrument (see InstrumentProfile):
+    //  - energy bins [MeV]
+    //  - NNS response [cm^2] (# of measurements x # of energy bins)
+    //  - initial (input) spectrum [neutrons cm^-2 s^-1], from which the unfolding starts
+    //  - ICRP factors [pSv cm^2], converting fluence to ambient dose equivalent
     //----------------------------------------------------------------------------------------------
-    std::vector<double> energy_bins;
-    readInputFile1D(settings.path_energy_bins,energy_bins);
-
+    std::vector<double> &energy_bins = profile.energy_bins;
     int num_bins = energy_bins.size();
+    const ResponseMatrix &nns_response = profile.nns_response;
+    std::vector<double> &initial_spectrum = profile.initial_spectrum;
+    std::vector<double> &icrp_factors = profile.icrp_factors;
 
     //----------------------------------------------------------------------------------------------
-    // Generate the detector response matrix (representing the dector response function):
-    //  - outer size = # of measurements
-    //  - inner size = # of energy bins
-    // Detector response value for each # of moderators for each energy (currently 52 energies)
-    // Input the response functions
-    //  - values in units of [cm^2]
-    //
-    // The response function accounts for variable number of (n,p) reactions in He-3 for each
-    // moderators, as a function of energy. Calculated by vendor using MC
+    // Unfold the spectrum, determine its uncertainty & calculate the quantities of interest
     //----------------------------------------------------------------------------------------------
-    std::vector<std::vector<double>> nns_response;
-    readInputFile2D(settings.path_system_response,nns_response);
-    checkDimensions(num_measurements, "number of measurements", nns_response.size(), "NNS response");
-    checkDimensions(num_bins, "number of energy bins", nns_response[0].size(), "NNS response");
+    UnfoldingResult result;
+    unfoldSpectrum(settings, profile, pool, measurements, std_errors, result, &performance);
 
-    //----------------------------------------------------------------------------------------------
-    // Generate the inital spectrum matrix to input into the unfolding algorithm:
-    //  - size = # of energy bins
-    // Input from the input spectrum file
-    //  - values are neutron fluence rates [neutrons cm^-2 s^-1])
-    //  - Currently (2017-08-16) input a step function (high at thermals & lower), because a flat 
-    //  spectrum underestimates (does not yield any) thermal neutrons
-    //----------------------------------------------------------------------------------------------
-    std::vector<double> initial_spectrum;
-    readInputFile1D(settings.path_input_spectrum,initial_spectrum);
-    checkDimensions(num_bins, "number of energy bins", initial_spectrum.size(), "Input spectrum");
-
-    std::vector<double> spectrum = initial_spectrum; // save the initial spectrum for report output
-
-    //----------------------------------------------------------------------------------------------
-    // Generate the ICRP conversion matrix (factors to convert fluence to ambient dose equivalent):
-    //  - size = # of energy bins
-    // Input from icrp factors file:
-    //  - values are in units of [pSv cm^2]
-    //  - H values were obtained by linearly interopolating tabulated data to match energy bins used
-    // Page 200 of document (ICRP 74 - ATables.pdf)
-    //----------------------------------------------------------------------------------------------
-    std::vector<double> icrp_factors;
-    readInputFile1D(settings.path_icrp_factors,icrp_factors);
-    checkDimensions(num_bins, "number of energy bins", icrp_factors.size(), "Number of ICRP factors");
-
-    //----------------------------------------------------------------------------------------------
-    // Run the unfolding algorithm, iterating <cutoff> times.
-    // Final result, i.e. unfolded spectrum, outputted in 'ini' matrix
-    // Note: the normalized system matrix is calculated first. It is required in unfolding, and is
-    // a constant value.
-    //----------------------------------------------------------------------------------------------
-    std::vector<double> normalized_response = normalizeResponse(num_bins, num_measurements, nns_response);
-
-    std::vector<double> mlem_ratio; // vector that stores the ratio between measured data and MLEM estimated data
-    std::vector<double> mlem_correction; // vector that stores the correction factors applied in each spectral bin
-    std::vector<double> mlem_estimate; // vector that stores the MLEM estimated data
-    int num_iterations;
-
-    // MLEM-STOP specific parameters, initialized here for use later
-    double j_factor = 0;
-    double j_threshold = 0;
-
-    // Unfold spectrum according to user-specified algorithm
-    if (settings.algorithm == "mlem") {
-        num_iterations = runMLEM(settings.cutoff, settings.error, num_measurements, num_bins,
-            measurements, spectrum, nns_response, normalized_response, mlem_ratio, mlem_correction, 
-            mlem_estimate
-        );
-    }
-    else if (settings.algorithm == "mlemstop") {
-        j_threshold = determineJThreshold(num_measurements,measurements,settings.cps_crossover);
-
-        num_iterations = runMLEMSTOP(settings.cutoff, num_measurements, num_bins, measurements,
-            spectrum, nns_response, normalized_response, mlem_ratio, mlem_correction, mlem_estimate,
-            j_threshold, j_factor
-        );
-    }
-    else if (settings.algorithm == "map") {
-        std::vector<double> energy_correction;
-        num_iterations = runMAP(energy_correction, settings.beta, settings.prior, settings.cutoff, 
-            settings.error, num_measurements, num_bins, measurements, spectrum, nns_response, 
-            normalized_response, mlem_ratio
-        );
-    }
-    else {
-        //throw error
-        throw std::logic_error("Unrecognized unfolding algorithm: " + settings.algorithm);
-        // std::cout << "No unfolding algorithm found for: " + settings.algorithm + '\n';
-    }
-
-    // Need to "unscale" spectrum back to true values in order to calculate quantities of interest
-    // for (int i_bin = 0; i_bin < num_bins; i_bin++) {
-    //     spectrum[i_bin] /= scale_factor;
-    // }
+    std::vector<double> &spectrum = result.spectrum;
+    std::vector<double> &mlem_ratio = result.mlem_ratio;
+    std::vector<double> &mlem_estimate = result.mlem_estimate;
+    int num_iterations = result.num_iterations;
+    double j_factor = result.j_factor;
+    double j_threshold = result.j_threshold;
 
     //----------------------------------------------------------------------------------------------
     // Display the result (output) matrix of the unfolding algorithm, which represents reconstructed 
     // spectral data.
     //----------------------------------------------------------------------------------------------
-    std::cout << "The unfolded spectrum:" << '\n';
+    out << "The unfolded spectrum:" << '\n';
 
     for (int i_bin = 0; i_bin < num_bins; i_bin++)
     {
-        std::cout << spectrum[i_bin] << '\n';
+        out << spectrum[i_bin] << '\n';
     }
 
     //----------------------------------------------------------------------------------------------
@@ -282,267 +273,118 @@ int main(int argc, char* argv[])
     // MLEM-generated measured charge values (which correspond to the above MLEM-generated measured 
     // spectrum) from the actual measured charge values. 
     //----------------------------------------------------------------------------------------------
-    std::cout << '\n';
-    std::cout << "The reconstructed measured values (CPS):" << '\n';
+    out << '\n';
+    out << "The reconstructed measured values (CPS):" << '\n';
 
     for (int i_meas = 0; i_meas < num_measurements; i_meas++)
     {
-        // std::cout << mlem_estimate[i_meas]/scale_factor << '\n';
-        std::cout << mlem_estimate[i_meas] << '\n';
+        out << mlem_estimate[i_meas] << '\n';
     }
 
-    std::cout << '\n';
-    std::cout << "The ratios between measurements and reconstructed measurements:" << '\n';
+    out << '\n';
+    out << "The ratios between measurements and reconstructed measurements:" << '\n';
 
     for (int i_meas = 0; i_meas < num_measurements; i_meas++)
     {
-        std::cout << mlem_ratio[i_meas] << '\n';
-        // std::cout << abs(1.0 - mlem_ratio[i_meas]) << '\n';
+        out << mlem_ratio[i_meas] << '\n';
     }
 
     //----------------------------------------------------------------------------------------------
     // Display the number of unfolding iterations that were actually executed (<= cutoff)
     //----------------------------------------------------------------------------------------------
-    std::cout << '\n';
-    std::cout << "The final number of unfolding iterations: " << num_iterations << std::endl;
+    out << '\n';
+    out << "The final number of unfolding iterations: " << num_iterations << std::endl;
     if (settings.algorithm == "mlemstop") {
-        std::cout << "J factor: " << j_factor << "\n";
-        std::cout << "J threshold: " << j_threshold << "\n";
+        out << "J factor: " << j_factor << "\n";
+        out << "J threshold: " << j_threshold << "\n";
+    }
+    if (!result.path_trace.empty()) {
+        out << "Saved convergence trace to " << result.path_trace << "\n";
     }
 
     //----------------------------------------------------------------------------------------------
-    // Calculate quantities of interest (e.g. dose & its uncertainty)
+    // Display the uncertainty determination (sampled measurement sets)
     //----------------------------------------------------------------------------------------------
-    double ambient_dose_eq = calculateDose(num_bins, spectrum, icrp_factors);
-    // double total_charge = calculateTotalCharge(num_measurements,measurements_nc);
-    double total_flux = calculateTotalFlux(num_bins,spectrum);
-    double avg_energy = calculateAverageEnergy(num_bins,spectrum,energy_bins);
-    // double source_strength = calculateSourceStrength(num_bins,spectrum,duration,dose_mu);
-
-    // Need to scale spectrum again in order to do uncertainty calculations
-    // for (int i_bin = 0; i_bin < num_bins; i_bin++) {
-    //     spectrum[i_bin] *= scale_factor;
-    // }
+    std::vector<double> &spectrum_uncertainty_lower = result.spectrum_uncertainty_lower;
+    std::vector<double> &spectrum_uncertainty_upper = result.spectrum_uncertainty_upper;
+    int num_toss = result.num_toss;
+    int num_uncertainty_samples = result.num_uncertainty_samples;
+    double dose_uncertainty_error = result.dose_uncertainty_error;
+    double spectrum_uncertainty_error = result.spectrum_uncertainty_error;
+    double avg_sample_iterations = result.avg_sample_iterations;
 
-    //----------------------------------------------------------------------------------------------
-    // Determine the uncertainty in the unfolded spectrum using one of the available methods
-    //----------------------------------------------------------------------------------------------
-    std::vector<double> spectrum_uncertainty;
-    std::vector<double> spectrum_uncertainty_lower;
-    std::vector<double> spectrum_uncertainty_upper;
-    double ambient_dose_eq_uncertainty_upper = 0;
-    double ambient_dose_eq_uncertainty_lower = 0;
-
-    // MLEM-STOP specific parameters, initialized here for use later
-    UncertaintyManagerJ j_manager_low(j_threshold,1+settings.sigma_j);
-    UncertaintyManagerJ j_manager_high(j_threshold,1-settings.sigma_j);
-    // The # of sampled measurement sets that are discarded b/c don't converge with MLEM-STOP
-    int num_toss = 0;
-
-    // This approach generates a series of sampled measurements (using original measurements as the
-    // means). Unfolding is performed for each of these spectra. The uncertainty in the unfolded
-    // spectrum is taken to be the Root-Mean-Square-Deviation between the unfolded spectrum and each
-    // sampled spectrum. The number of samples is set by the user via num_uncertainty_samples
     if (settings.uncertainty_type == "poisson" || settings.uncertainty_type == "gaussian") {
-        std::vector<std::vector<double>> sampled_spectra; // dimensions: num_uncertainty_samples x num_bins
-        std::vector<double> sampled_dose; // dimension: num_uncertainty_samples
-
-        for (int i_samp = 0; i_samp < settings.num_uncertainty_samples; i_samp++) {
-            std::vector<double> sampled_measurements; // dimension: num_measurements
-            std::vector<double> sampled_mlem_ratio; // dimension: num_measurements
-            std::vector<double> sampled_mlem_correction; // dimension: num_measurements
-            std::vector<double> sampled_mlem_estimate; // dimension: num_measurements
-            std::vector<double> sampled_spectrum = initial_spectrum; // dimension: num_bins
-
-            bool toss_sample = false; // Track if sample was tossed
-
-            // If doing Poisson-sampling to generate pseudo-measurement set:
-            if (settings.uncertainty_type == "poisson") {
-                for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
-                    double sampled_value = 0;
-                    for (int i_samp =0; i_samp < settings.num_meas_per_shell; i_samp++) {
-                        sampled_value += poisson(measurements[i_meas]);
-                    }
-                    sampled_value /= settings.num_meas_per_shell;
-                    sampled_measurements.push_back(sampled_value);
-                }
-            }
-            // If doing Gaussian-sampling to generate pseudo-measurement set
-            else if (settings.uncertainty_type == "gaussian") {
-                for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
-                    unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-                    std::default_random_engine generator (seed);
-                    std::normal_distribution<double> distribution(measurements[i_meas],std_errors[i_meas]);
-
-                    double new_sample = distribution(generator);
-                    sampled_measurements.push_back(new_sample);
-                }
-            }
-
-            // Do unfolding on the initial spectrum & sampled measurement values
-            if (settings.algorithm == "mlem") {
-                runMLEM(settings.cutoff, settings.error, num_measurements, num_bins, sampled_measurements, 
-                    sampled_spectrum, nns_response, normalized_response, sampled_mlem_ratio, 
-                    sampled_mlem_correction, sampled_mlem_estimate
-                );
-            }
-            // MLEM-STOP requires special handling of unfolding the sampled measurement sets.
-            // Despite best efforts, sometimes MLEM-STOP will never converge for some samples. 
-            // Current best approach is to discard those samples. A record is kept of the number
-            // of samples discarded and reported to the user so they may interpret the final
-            // uncertainty accordingly.
-            else if (settings.algorithm == "mlemstop") {
-                // Calculate unique J threshold for the current sample
-                double sampled_j_threshold = determineJThreshold(num_measurements,sampled_measurements,settings.cps_crossover);
-                double sampled_j_factor = 0;
-
-                // Try running MLEM-STOP for the current sample but catch an error if never
-                // converges. Increment num_toss if so, and decrement the sample index (i.e scrap
-                // the current sample and retry)
-                try {
-                    runMLEMSTOP(settings.cutoff, num_measurements, num_bins, sampled_measurements,
-                        sampled_spectrum, nns_response, normalized_response, sampled_mlem_ratio, sampled_mlem_correction, 
-                        sampled_mlem_estimate, sampled_j_threshold, sampled_j_factor
-                    );
-                }
-                catch (std::logic_error e) {
-                    i_samp = i_samp - 1;
-                    num_toss = num_toss + 1;
-                    toss_sample = true;
-                }
-            }
-            else if (settings.algorithm == "map") {
-                std::vector<double> sampled_energy_correction;
-                runMAP(sampled_energy_correction, settings.beta, settings.prior, settings.cutoff, 
-                    settings.error, num_measurements, num_bins, sampled_measurements, sampled_spectrum, 
-                    nns_response, normalized_response, sampled_mlem_ratio
-                );
-            }
-            else {
-                //throw error
-                throw std::logic_error("Unrecognized unfolding algorithm: " + settings.algorithm);
-            }
-
-            // Note the sampled CPS values were based on the scaled CPS, so need to scale back the
-            // sampled spectra to correct magnitude 
-            // for (int i_bin = 0; i_bin < num_bins; i_bin++) {
-            //     sampled_spectrum[i_bin] /= scale_factor;
-            // }
-
-            if (!toss_sample) {
-                sampled_spectra.push_back(sampled_spectrum); // add to growing array of sampled spectra
-            }
-
-            // Calculate the ambient dose equivalent associated with the sampled spectrum
-            double sdose = calculateDose(num_bins, sampled_spectrum, icrp_factors);
-
-            sampled_dose.push_back(sdose);
+        // Record the seed that was used (drawn at random if none was set), to reproduce the run
+        settings.set_seed(result.seed);
+        out << '\n';
+        out << "Random seed for sampled measurements: " << settings.seed << '\n';
+
+        out << "Number of sampled measurement sets used: " << num_uncertainty_samples << '\n';
+        out << "Average number of iterations per sampled measurement set (" 
+            << settings.sample_initialization << " initialization): " << avg_sample_iterations << '\n';
+        if (num_toss > 0) {
+            out << "Number of sampled measurement sets tossed: " << num_toss << '\n';
+        }
+        if (settings.uncertainty_target_error > 0) {
+            out << "Relative error of the dose uncertainty: " << dose_uncertainty_error << '\n';
+            out << "Relative error of the spectrum uncertainty (largest bin): " 
+                << spectrum_uncertainty_error << '\n';
         }
-
-        // Finally, "unscale" spectrum back to true values for remaining calculations & logging
-        // for (int i_bin = 0; i_bin < num_bins; i_bin++) {
-        //     spectrum[i_bin] /= scale_factor;
-        // }
-
-        // Calculate the spectrum uncertainty (same upper & lower)
-        calculateRMSD_vector(settings.num_uncertainty_samples, spectrum, sampled_spectra, spectrum_uncertainty_lower);
-        spectrum_uncertainty_upper = spectrum_uncertainty_lower;
-
-        // Calculate the dose uncertainty (same upper & lower)
-        ambient_dose_eq_uncertainty_upper = calculateRMSD(settings.num_uncertainty_samples, ambient_dose_eq, sampled_dose);
-        ambient_dose_eq_uncertainty_lower = ambient_dose_eq_uncertainty_upper;
-
-        // If want to print the number of sample sets kept vs tossed:
-        // std::cout << "Number of sampled measurement sets kept: " << settings.num_uncertainty_samples << "\n";
-        // std::cout << "Number of sampled measurement sets tossed: " << num_toss << "\n";
-    }
-
-    // if (settings.uncertainty_type == "gaussian") {
-    //     std::vector<std::vector<double>> sampled_spectra; // dimensions: num_uncertainty_samples x num_bins
-    //     std::vector<double> sampled_dose; // dimension: num_uncertainty_samples
-
-
-    // }
-
-    // This approach uses a known uncertainty around J=1, specified by sigma_j. An "upper" and "lower"
-    // spectrum estimate are generated using the user-defined sigma_j parameter. A unique j_threshold
-    // is determined for both upper and lower, and MLEM-STOP is performed using both thresholds. The
-    // upper uncertainty is then the difference betwen the "upper" spectrum and the MLEM-STOP estimated 
-    // spectrum. Similarly for the lower uncertainty. This is all handled in the UncertaintyManagerJ
-    // class.
-    else if (settings.uncertainty_type == "j_bounds") {
-        j_manager_low.determineSpectrumUncertainty(spectrum,settings.cutoff,num_measurements,
-            num_bins,measurements,nns_response,normalized_response,initial_spectrum
-        );
-        spectrum_uncertainty_lower = j_manager_low.spectrum_uncertainty;
-
-        j_manager_high.determineSpectrumUncertainty(spectrum,settings.cutoff,num_measurements,
-            num_bins,measurements,nns_response,normalized_response,initial_spectrum
-        );
-        spectrum_uncertainty_upper = j_manager_high.spectrum_uncertainty;
-
-        j_manager_low.determineDoseUncertainty(ambient_dose_eq,spectrum,num_bins,icrp_factors);
-        ambient_dose_eq_uncertainty_lower = j_manager_low.dose_uncertainty;
-
-        j_manager_high.determineDoseUncertainty(ambient_dose_eq,spectrum,num_bins,icrp_factors);
-        ambient_dose_eq_uncertainty_upper = j_manager_high.dose_uncertainty;
-    }
-    else {
-        throw std::logic_error("Unrecognized uncertainty type: " + settings.uncertainty_type);
     }
 
-    //----------------------------------------------------------------------------------------------
-    // Calculate uncertainties in quantities of interest
-    //----------------------------------------------------------------------------------------------
-    double total_flux_uncertainty_upper = calculateSumUncertainty(num_bins,spectrum_uncertainty_upper);
-    double total_flux_uncertainty_lower = calculateSumUncertainty(num_bins,spectrum_uncertainty_lower);
-
-    double avg_energy_uncertainty_upper = calculateEnergyUncertainty(num_bins,energy_bins,spectrum,
-        spectrum_uncertainty_upper,total_flux,total_flux_uncertainty_upper
-    );
-    double avg_energy_uncertainty_lower = calculateEnergyUncertainty(num_bins,energy_bins,spectrum,
-        spectrum_uncertainty_lower,total_flux,total_flux_uncertainty_lower
-    );
-
     //----------------------------------------------------------------------------------------------
     // Display calculated quantities
     //----------------------------------------------------------------------------------------------
-    std::cout << '\n';
-    std::cout << "The equivalent dose is: " << ambient_dose_eq << " mSv/h" << std::endl;
-    std::cout << "Upper uncertainty: " << ambient_dose_eq_uncertainty_upper << " mSv/h" << std::endl;
-    std::cout << "Lower uncertainty: " << ambient_dose_eq_uncertainty_lower << " mSv/h" << std::endl;
-    std::cout << '\n';
-
-    // std::cout << "The total measured charge is: " << total_charge << " nC" << std::endl;
-    // std::cout << '\n';
+    double ambient_dose_eq = result.dose;
+    double ambient_dose_eq_uncertainty_upper = result.dose_uncertainty_upper;
+    double ambient_dose_eq_uncertainty_lower = result.dose_uncertainty_lower;
+    double total_flux = result.total_flux;
+    double total_flux_uncertainty_upper = result.total_flux_uncertainty_upper;
+    double total_flux_uncertainty_lower = result.total_flux_uncertainty_lower;
+    double avg_energy = result.avg_energy;
+    double avg_energy_uncertainty_upper = result.avg_energy_uncertainty_upper;
+    double avg_energy_uncertainty_lower = result.avg_energy_uncertainty_lower;
 
-    std::cout << "The total neutron flux is: " << total_flux << " n cm^-2 s^-1" << std::endl;
-    std::cout << "Upper uncertainty: " << total_flux_uncertainty_upper << " n cm^-2 s^-1" << std::endl;
-    std::cout << "Lower uncertainty: " << total_flux_uncertainty_lower << " n cm^-2 s^-1" << std::endl;
-    std::cout << '\n';
+    out << '\n';
+    out << "The equivalent dose is: " << ambient_dose_eq << " mSv/h" << std::endl;
+    out << "Upper uncertainty: " << ambient_dose_eq_uncertainty_upper << " mSv/h" << std::endl;
+    out << "Lower uncertainty: " << ambient_dose_eq_uncertainty_lower << " mSv/h" << std::endl;
+    out << '\n';
 
-    std::cout << "The average neutron energy is: " << avg_energy << " MeV" << std::endl;
-    std::cout << "Upper uncertainty: " << avg_energy_uncertainty_upper << " MeV" << std::endl;
-    std::cout << "Lower uncertainty: " << avg_energy_uncertainty_lower << " MeV" << std::endl;
+    out << "The total neutron flux is: " << total_flux << " n cm^-2 s^-1" << std::endl;
+    out << "Upper uncertainty: " << total_flux_uncertainty_upper << " n cm^-2 s^-1" << std::endl;
+    out << "Lower uncertainty: " << total_flux_uncertainty_lower << " n cm^-2 s^-1" << std::endl;
+    out << '\n';
 
-    std::cout << '\n';
+    out << "The average neutron energy is: " << avg_energy << " MeV" << std::endl;
+    out << "Upper uncertainty: " << avg_energy_uncertainty_upper << " MeV" << std::endl;
+    out << "Lower uncertainty: " << avg_energy_uncertainty_lower << " MeV" << std::endl;
 
-    // std::cout << "The neutron source strength is: " << source_strength << " n Gy^-1" << std::endl;
-    // std::cout << '\n';
+    out << '\n';
 
 
     //----------------------------------------------------------------------------------------------
     // Save spectrum to file
     //----------------------------------------------------------------------------------------------
-    saveSpectrumAsRow(settings.path_output_spectra, num_bins, settings.irradiation_conditions, spectrum, 
-        spectrum_uncertainty_upper, spectrum_uncertainty_lower, energy_bins
-    );
-    std::cout << "Saved unfolded spectrum to " << settings.path_output_spectra << "\n";
+    PhaseTimer save_timer(&performance, "save");
+    EventSpan save_event("save", "output");
+    save_spectrum(settings, spectrum, spectrum_uncertainty_lower, spectrum_uncertainty_upper);
+    if (settings.generate_results) {
+        if (settings.path_results.empty()) {
+            settings.path_results = "output/results_" + settings.irradiation_conditions + ".txt";
+        }
+        saveUnfoldingResults(settings.path_results, settings, result, energy_bins);
+        out << "Saved results to " << settings.path_results << "\n";
+    }
+    save_timer.stop();
+    save_event.stop();
 
     //----------------------------------------------------------------------------------------------
     // Generate report
     //----------------------------------------------------------------------------------------------
     if (settings.generate_report) {
+        PhaseTimer report_timer(&performance, "report");
+        EventSpan report_event("report", "output");
         // std::vector<double> measurements_report;
         // if (settings.meas_units == "cps") {
         //     measurements_report = measurements;
@@ -569,7 +411,15 @@ int main(int argc, char* argv[])
         myreport.set_num_measurements(num_measurements);
         myreport.set_uncertainty_type(settings.uncertainty_type);
         myreport.set_num_bins(num_bins);
-        myreport.set_num_uncertainty_samples(settings.num_uncertainty_samples);
+        myreport.set_num_uncertainty_samples(num_uncertainty_samples);
+        if (settings.uncertainty_type == "poisson" || settings.uncertainty_type == "gaussian") {
+            myreport.set_seed(settings.seed);
+            myreport.set_uncertainty_target_error(settings.uncertainty_target_error);
+            myreport.set_dose_uncertainty_error(dose_uncertainty_error);
+            myreport.set_spectrum_uncertainty_error(spectrum_uncertainty_error);
+            myreport.set_sample_initialization(settings.sample_initialization);
+            myreport.set_avg_sample_iterations(avg_sample_iterations);
+        }
         myreport.set_git_commit(GIT_COMMIT);
         myreport.set_measurements(measurements);
         myreport.set_measurements_nc(measurements_nc);
@@ -599,28 +449,376 @@ int main(int argc, char* argv[])
             myreport.set_cps_crossover(settings.cps_crossover);
             myreport.set_j_threshold(j_threshold);
             myreport.set_j_final(j_factor);
-            myreport.set_j_manager_low(j_manager_low);
-            myreport.set_j_manager_high(j_manager_high);
+            myreport.set_j_manager_low(result.j_manager_low);
+            myreport.set_j_manager_high(result.j_manager_high);
             myreport.set_num_toss(num_toss);
         }
+        myreport.set_performance(performance);
         myreport.prepare_report();
 
-        std::cout << "Generated summary report: " << settings.path_report << "\n\n";
+        out << "Generated summary report: " << settings.path_report << "\n\n";
     }
 
     //----------------------------------------------------------------------------------------------
     // Plot the spectrum
     //----------------------------------------------------------------------------------------------
     if (settings.generate_figure) {
-        std::cout << "Plotting spectrum: \n";
+        PhaseTimer figure_timer(&performance, "figure");
+        out << "Plotting spectrum: \n";
         if (settings.path_figure.empty()) {
             settings.path_figure = "output/figure_" + settings.irradiation_conditions + ".png";
         }
-        plotSpectrum(settings.path_figure, settings.irradiation_conditions, num_measurements, 
+        // ROOT plotting is not thread-safe (in batch mode, files are unfolded concurrently). ROOT is
+        // loaded (plot_root.so) on the first plot only
+        std::lock_guard<std::mutex> plot_lock(plot_mutex);
+        EventSpan figure_event("figure", "output", settings.path_figure);
+        plotSpectrumWithPlugin(settings.path_figure, settings.irradiation_conditions, num_measurements, 
             num_bins, energy_bins, spectrum, spectrum_uncertainty_upper, spectrum_uncertainty_lower
         );
-        std::cout << "\n";
+        out << "\n";
+    }
+
+    //----------------------------------------------------------------------------------------------
+    // Save the resources used by each phase
+    //----------------------------------------------------------------------------------------------
+    if (settings.generate_performance) {
+        if (settings.path_performance.empty()) {
+            settings.path_performance = "output/performance_" + settings.irradiation_conditions + ".json";
+        }
+        performance.saveJSON(settings.path_performance, "unfold_spectrum", settings.irradiation_conditions,
+            settings.num_threads
+        );
+        out << "Saved performance data to " << settings.path_performance << "\n\n";
+    }
+}
+
+//==================================================================================================
+// Names of the output files of each measurement file of a batch: the file name without its
+// directory & extension (e.g. "input/run_07.txt" -> "run_07"). Files of different directories may
+// share a name, and files may share their irradiation conditions, so names that appear more than
+// once get the position of the file in the batch appended (e.g. "run_07_3"), so that files unfolded
+// concurrently never write the same report or figure.
+//==================================================================================================
+static std::vector<std::string> getBatchItemNames(const std::vector<std::string> &measurement_files)
+{
+    std::vector<std::string> names;
+    for (const std::string &file : measurement_files) {
+        std::string name = file;
+        size_t directory = name.find_last_of('/');
+        if (directory != std::string::npos) {
+            name = name.substr(directory + 1);
+        }
+        size_t extension = name.find_last_of('.');
+        if (extension != std::string::npos && extension > 0) {
+            name = name.substr(0, extension);
+        }
+        names.push_back(name);
+    }
+    std::vector<std::string> unique_names = names;
+    for (size_t i_file = 0; i_file < names.size(); i_file++) {
+        if (std::count(names.begin(), names.end(), names[i_file]) > 1) {
+            unique_names[i_file] = names[i_file] + "_" + std::to_string(i_file + 1);
+        }
+    }
+    return unique_names;
+}
+
+//==================================================================================================
+// Pathname of an output file of a measurement file of a batch: <prefix>_<name> (see
+// getBatchItemNames), in the directory & with the extension of the configured pathname (e.g.
+// path_report=reports/summary.txt: reports/report_run_07.txt). If no pathname is configured, the
+// file is in output/, with default_extension.
+//==================================================================================================
+static std::string getBatchItemPath(const std::string &configured_path, const std::string &prefix,
+    const std::string &name, const std::string &default_extension)
+{
+    if (configured_path.empty()) {
+        return "output/" + prefix + "_" + name + default_extension;
+    }
+    std::string directory;
+    std::string file_name = configured_path;
+    size_t separator = configured_path.find_last_of('/');
+    if (separator != std::string::npos) {
+        directory = configured_path.substr(0, separator + 1);
+        file_name = configured_path.substr(separator + 1);
+    }
+    std::string extension = default_extension;
+    size_t dot = file_name.find_last_of('.');
+    if (dot != std::string::npos && dot > 0) {
+        extension = file_name.substr(dot);
+    }
+    return directory + prefix + "_" + name + extension;
+}
+
+//==================================================================================================
+// Unfold every measurement file of a batch (see getBatchFiles): files are unfolded concurrently on
+// num_threads threads (the sampled measurement sets of each file are unfolded sequentially), with
+// the configuration & instrument profile shared by all. Each file gets its own report, figure,
+// performance, trace & results files, named after the file in the directories of the configured
+// pathnames (see getBatchItemPath), and the spectra are saved in the order of the batch as soon as
+// all preceding files are done. A file that fails (missing, malformed, ...) is reported without
+// stopping the batch. Prints a summary (throughput, latency of each phase & failures) and returns
+// the # of files that failed.
+//==================================================================================================
+static int unfoldBatch(const std::string &batch_source, UnfoldingSettings &settings, InstrumentProfile &profile,
+    std::vector<std::string> &input_files, std::vector<std::string> &input_file_flags, std::mutex &plot_mutex)
+{
+    std::vector<std::string> measurement_files = getBatchFiles(batch_source);
+    int num_files = measurement_files.size();
+    if (num_files == 0) {
+        throw std::logic_error("No measurement files in batch: " + batch_source);
+    }
+    std::vector<std::string> item_names = getBatchItemNames(measurement_files);
+
+    ThreadPool pool(settings.num_threads);
+    std::cout << "Unfolding " << num_files << " measurement files from " << batch_source << " on " 
+        << pool.size() << " threads\n";
+
+    std::vector<BatchItem> items(num_files);
+    std::mutex output_mutex; // guards the items, the saving of spectra & the console
+    int num_done = 0;
+    int next_to_save = 0; // spectra are saved in the order of the batch
+
+    std::chrono::steady_clock::time_point batch_start = std::chrono::steady_clock::now();
+    pool.run(num_files, [&](int i_file, int i_thread) {
+        BatchItem &item = items[i_file];
+        std::chrono::steady_clock::time_point item_start = std::chrono::steady_clock::now();
+        EventSpan item_event("measurement file", "batch", measurement_files[i_file]);
+
+        // Each file has its own settings & output files, and a copy of the input files (incl. the
+        // measurements file) for its report. Its progress output is discarded.
+        UnfoldingSettings item_settings = settings;
+        item_settings.set_path_measurements(measurement_files[i_file]);
+        const std::string &name = item_names[i_file];
+        item_settings.set_path_report(
+            getBatchItemPath(settings.path_report, "report", name, ".txt"));
+        item_settings.set_path_figure(
+            getBatchItemPath(settings.path_figure, "figure", name, ".png"));
+        item_settings.set_path_performance(
+            getBatchItemPath(settings.path_performance, "performance", name, ".json"));
+        item_settings.set_path_trace(
+            getBatchItemPath(settings.path_trace, "trace", name, ".csv"));
+        item_settings.set_path_results(
+            getBatchItemPath(settings.path_results, "results", name, ".txt"));
+        std::vector<std::string> item_input_files = input_files;
+        std::vector<std::string> item_input_file_flags = input_file_flags;
+        item_input_files.push_back(measurement_files[i_file]);
+        item_input_file_flags.push_back("--batch");
+        ThreadPool item_pool(1);
+        std::ostringstream item_output;
+
+        try {
+            unfoldMeasurementFile(item_settings, profile, item_pool, item_input_files, item_input_file_flags,
+                item_output, plot_mutex,
+                [&item](const UnfoldingSettings &unfolded_settings, std::vector<double> &spectrum,
+                    std::vector<double> &spectrum_uncertainty_lower, std::vector<double> &spectrum_uncertainty_upper)
+                {
+                    item.settings = unfolded_settings;
+                    item.spectrum = spectrum;
+                    item.spectrum_uncertainty_lower = spectrum_uncertainty_lower;
+                    item.spectrum_uncertainty_upper = spectrum_uncertainty_upper;
+                    item.has_spectrum = true;
+                },
+                item.performance
+            );
+        }
+        catch (std::exception &e) {
+            item.error = e.what();
+        }
+        item.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - item_start).count();
+        item_event.stop();
+
+        std::lock_guard<std::mutex> output_lock(output_mutex);
+        item.done = true;
+        num_done++;
+        std::cout << "[" << num_done << "/" << num_files << "] " << measurement_files[i_file];
+        if (item.error.empty()) {
+            std::cout << ": " << item.settings.irradiation_conditions << " (" << item.seconds << " s)\n";
+        }
+        else {
+            std::cout << ": FAILED: " << item.error << "\n";
+        }
+
+        // Save the spectra of the files done so far, up to the first file not yet done
+        while (next_to_save < num_files && items[next_to_save].done) {
+            BatchItem &next_item = items[next_to_save];
+            if (next_item.has_spectrum) {
+                std::chrono::steady_clock::time_point save_start = std::chrono::steady_clock::now();
+                EventSpan save_event("ordered save", "output", measurement_files[next_to_save]);
+                try {
+                    std::ostringstream save_output;
+                    saveUnfoldedSpectrum(next_item.settings, profile.energy_bins, next_item.spectrum,
+                        next_item.spectrum_uncertainty_lower, next_item.spectrum_uncertainty_upper, save_output
+                    );
+                }
+                catch (std::exception &e) {
+                    if (next_item.error.empty()) {
+                        next_item.error = e.what();
+                    }
+                    std::cout << "Unable to save the spectrum of " << measurement_files[next_to_save] << ": "
+                        << e.what() << "\n";
+                }
+                next_item.spectrum.clear();
+                next_item.spectrum_uncertainty_lower.clear();
+                next_item.spectrum_uncertainty_upper.clear();
+                PhaseRecord *save_phase = next_item.performance.find("save");
+                if (save_phase) {
+                    save_phase->wall_seconds += secondsSince(save_start);
+                }
+            }
+            next_to_save++;
+        }
+    });
+    double batch_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - batch_start).count();
+
+    // Summary
+    int num_failed = 0;
+    for (int i_file = 0; i_file < num_files; i_file++) {
+        if (!items[i_file].error.empty()) {
+            num_failed++;
+        }
+    }
+    std::cout << "\n";
+    std::cout << "Batch summary: " << num_files - num_failed << " of " << num_files 
+        << " measurement files unfolded, " << num_failed << " failed\n";
+    std::cout << "Wall time: " << batch_seconds << " s (" << num_files/batch_seconds << " files/s, "
+        << pool.size() << " threads)\n";
+    if (num_failed < num_files) {
+        // Latency of each phase, over the files unfolded successfully (saving the spectrum waits for
+        // the preceding files of the batch, and is not included in the file's time)
+        std::vector<double> parse, unfold, uncertainty, save, report, figure, total;
+        for (int i_file = 0; i_file < num_files; i_file++) {
+            if (items[i_file].error.empty()) {
+                const PerformanceLog &performance = items[i_file].performance;
+                parse.push_back(phaseSeconds(performance, "parse"));
+                unfold.push_back(phaseSeconds(performance, "unfold"));
+                uncertainty.push_back(phaseSeconds(performance, "uncertainty"));
+                save.push_back(phaseSeconds(performance, "save"));
+                report.push_back(phaseSeconds(performance, "report"));
+                figure.push_back(phaseSeconds(performance, "figure"));
+                total.push_back(items[i_file].seconds);
+            }
+        }
+        std::cout << "Latency per file (ms):\n";
+        std::cout << "    " << std::left << std::setw(14) << "phase" << std::right << std::setw(12) << "p50"
+            << std::setw(12) << "p90" << std::setw(12) << "p99" << std::setw(12) << "max" << "\n";
+        printLatency("parse", parse);
+        printLatency("unfold", unfold);
+        printLatency("uncertainty", uncertainty);
+        printLatency("save", save);
+        if (settings.generate_report) {
+            printLatency("report", report);
+        }
+        if (settings.generate_figure) {
+            printLatency("figure", figure);
+        }
+        printLatency("total", total);
+    }
+    if (!settings.path_spectra_store.empty()) {
+        std::cout << "Spectra saved to " << settings.path_spectra_store << "\n";
+    }
+    else {
+        std::cout << "Spectra saved to " << settings.path_output_spectra << "\n";
     }
+    if (num_failed > 0) {
+        std::cout << "Failed measurement files:\n";
+        for (int i_file = 0; i_file < num_files; i_file++) {
+            if (!items[i_file].error.empty()) {
+                std::cout << "    " << measurement_files[i_file] << ": " << items[i_file].error << "\n";
+            }
+        }
+    }
+    return num_failed;
+}
+
+int main(int argc, char* argv[])
+{
+    // Record an event trace if NNS_EVENT_TRACE is set (saved at exit)
+    startEventTrace();
+
+    // Put arguments in vector for easier processing
+    std::vector<std::string> arg_vector;
+    for (int i = 1; i < argc; i++) {
+        arg_vector.push_back(argv[i]);
+    }
+
+    // NOTE: Indices are linked between the following arrays and vectors (i.e. input_files[0]
+    // corresponds to input_file_flags[0] and input_file_defaults[0])
+    // Array that stores the allowed options that specify input files
+    // Add new options at end of array
+    const int num_ifiles = 1;
+    std::string input_file_flags_arr[num_ifiles] = {
+        "--configuration"
+    };
+    // Array that stores default filename for each input file
+    std::string input_file_defaults_arr[num_ifiles] = {
+        "input/unfold_spectrum.cfg"
+    };
+
+    // Convert arrays to vectors b/c easier to work with
+    std::vector<std::string> input_files; // Store the actual input filenames to be used
+    std::vector<std::string> input_file_flags;
+    std::vector<std::string> input_file_defaults;
+    for (int i=0; i<num_ifiles; i++) {
+        input_files.push_back("");
+        input_file_flags.push_back(input_file_flags_arr[i]);
+        input_file_defaults.push_back(input_file_defaults_arr[i]);
+    }
+
+    // Use provided arguments (files) and/or defaults to determine the input files to be used
+    for (int i=0; i<num_ifiles; i++) {
+        setfile(arg_vector, input_file_flags[i], input_file_defaults[i], input_files[i]);
+    }
+
+    // Batch mode: manifest (or pattern) of the measurement files to unfold, instead of path_measurements
+    std::string batch_source;
+    setfile(arg_vector, "--batch", "", batch_source);
+    std::vector<std::string> allowed_flags = input_file_flags;
+    allowed_flags.push_back("--batch");
+
+    // Notify user if unknown parameters were received
+    checkUnknownParameters(arg_vector, allowed_flags);
+
+    // Apply some settings read in from a config file
+    UnfoldingSettings settings;
+    EventSpan configuration_event("configuration", "file", input_files[0]);
+    setSettings(input_files[0], settings);
+    configuration_event.stop();
+
+    //----------------------------------------------------------------------------------------------
+    // Read the inputs that describe the instrument (energy bins, NNS response, input spectrum, ICRP
+    // factors & normalized response), from a compiled instrument profile (path_instrument_profile)
+    // or from their CSV files. Their dimensions are validated against the # of energy bins.
+    //----------------------------------------------------------------------------------------------
+    PerformanceLog performance;
+    PhaseTimer instrument_timer(&performance, "instrument");
+    InstrumentProfile profile;
+    EventSpan instrument_event("instrument profile", "file", settings.path_instrument_profile.empty()
+        ? "CSV files" : settings.path_instrument_profile);
+    readInstrumentProfile(settings, profile);
+    instrument_event.stop();
+
+    // Select the (vectorized) implementation of the response projections used by the algorithms
+    setProjectionKernel(settings.projection_kernel);
+    instrument_timer.stop();
+
+    std::mutex plot_mutex;
+    if (!batch_source.empty()) {
+        int num_failed = unfoldBatch(batch_source, settings, profile, input_files, input_file_flags, plot_mutex);
+        return num_failed > 0 ? 1 : 0;
+    }
+
+    ThreadPool pool(settings.num_threads);
+    unfoldMeasurementFile(settings, profile, pool, input_files, input_file_flags, std::cout, plot_mutex,
+        [&profile](const UnfoldingSettings &settings, std::vector<double> &spectrum,
+            std::vector<double> &spectrum_uncertainty_lower, std::vector<double> &spectrum_uncertainty_upper)
+        {
+            saveUnfoldedSpectrum(settings, profile.energy_bins, spectrum, spectrum_uncertainty_lower,
+                spectrum_uncertainty_upper, std::cout
+            );
+        },
+        performance
+    );
 
     return 0;
 }
\ No newline at end of file
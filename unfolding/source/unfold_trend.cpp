@@ -10,6 +10,10 @@
 //  - For MAP, a CSV file with the iteration numbers and corresponding POI values corresponding to
 //    a range of beta values are ouput. Each row in the output file correspond to a particular beta
 //    value. 
+//  - If generate_performance is set, a JSON file with the resources (wall time, CPU time, peak
+//    memory, iterations) used by each phase (parse, instrument, unfold & save).
+//  - If the NNS_EVENT_TRACE environment variable is set, an event trace (Chrome Trace Event JSON)
+//    of the files read & of the betas unfolded by each thread.
 //**************************************************************************************************
 
 #include <iostream>
@@ -22,13 +26,38 @@
 
 // Local
 #include "custom_classes.h"
+#include "event_trace.h"
 #include "fileio.h"
 #include "handle_args.h"
-#include "root_helpers.h"
+#include "instrument_profile.h"
+#include "iteration_observer.h"
+#include "mlem_workspace.h"
+#include "phase_timer.h"
 #include "physics_calculations.h"
+#include "projection_kernels.h"
+#include "response_matrix.h"
+#include "spectrum_unfolding.h"
+#include "thread_pool.h"
+
+//==================================================================================================
+// Return the path of the output file of a parameter of interest. If several parameters are
+// calculated, the name of the parameter is appended to the file name of path_output_trend (e.g.
+// output/trend_total_dose.csv), otherwise path_output_trend is used as is.
+//==================================================================================================
+std::string trendOutputPath(const std::string &path_output_trend, const std::string &parameter, 
+    int num_parameters) 
+{
+    if (num_parameters == 1) {
+        return path_output_trend;
+    }
+    return insertBeforeExtension(path_output_trend, "_" + parameter);
+}
 
 int main(int argc, char* argv[])
 {
+    // Record an event trace if NNS_EVENT_TRACE is set (saved at exit)
+    startEventTrace();
+
     // Put arguments in vector for easier processing
     std::vector<std::string> arg_vector;
     for (int i = 1; i < argc; i++) {
@@ -68,41 +97,26 @@ int main(int argc, char* argv[])
 
     // Apply some settings read in from a config file
     UnfoldingSettings settings;
+    EventSpan configuration_event("configuration", "file", input_files[0]);
     setSettings(input_files[0], settings);
+    configuration_event.stop();
 
     settings.set_f_factor(settings.f_factor / 1e6); // Convert f_factor from fA/cps to nA/cps
 
-    // Read in measurements from file
-    std::vector<double> measurements_nc;
-    std::vector<double> measurements;
-    int num_measurements = 0;
-    measurements = getMeasurements(settings);
-    num_measurements = measurements.size();
-    std::reverse(measurements.begin(),measurements.end()); // readin 7-0 but want 0-7
-
-    // Handle nC input (save nC values for report, then convert to CPS)
-    if (settings.meas_units == "nc") {
-        measurements_nc = measurements;
-        for (int i_meas=0; i_meas < num_measurements; i_meas++) {
-            measurements[i_meas] = measurements[i_meas]*settings.norm/settings.f_factor/settings.duration;
-        }
-    }
+    // Resources used by each phase
+    PerformanceLog performance;
+    PhaseTimer parse_timer(&performance, "parse");
 
-    // Process data wherein multiple measurements were acquired for each shell
+    // Read in measurements from file, and prepare them for unfolding (see prepareMeasurements)
+    std::vector<double> measurements_nc;
     std::vector<double> std_errors;
-    if (settings.num_meas_per_shell > 1) {
-        processMeasurements(num_measurements,settings.num_meas_per_shell,measurements,std_errors);
-        num_measurements = num_measurements / settings.num_meas_per_shell;
-    }
-    // Do not allow use of gaussian sampling technique if only one measurement per shell is
-    // provided, as the standard deviation is unknown.
-    else if (settings.num_meas_per_shell == 1 && settings.uncertainty_type == "gaussian"){
-        throw std::logic_error("Cannot generate Gaussian-sampled pseudo-measurements with only single measurement per shell.");
-    }
-    // Require at least 1 measurement per shell
-    else if (settings.num_meas_per_shell < 1) { // if settings.num_meas_per_shell is 0 or negative
-        throw std::logic_error("Number of measurements per shell must be >= 1");
-    }
+    EventSpan measurements_event("measurements", "file", settings.path_measurements);
+    std::vector<double> measurements = getMeasurements(settings);
+    measurements_event.stop();
+    std::cout << "Measurements successfully retrieved from " + settings.path_measurements + '\n';
+    prepareMeasurements(settings, measurements, measurements_nc, std_errors);
+    int num_measurements = measurements.size();
+    parse_timer.stop();
 
     // std::vector<double> measurements_nc = getMeasurements(input_files[0], irradiation_conditions, 
     //    dose_mu, doserate_mu, duration);
@@ -116,14 +130,25 @@ int main(int argc, char* argv[])
     //     measurements.push_back(measurement_cps);
     // }
 
+    //----------------------------------------------------------------------------------------------
+    // Read the inputs that describe the instrument (energy bins, NNS response, input spectrum, ICRP
+    // factors & normalized response), from a compiled instrument profile (path_instrument_profile)
+    // or from their CSV files. Their dimensions are validated against the # of energy bins.
+    //----------------------------------------------------------------------------------------------
+    PhaseTimer instrument_timer(&performance, "instrument");
+    InstrumentProfile profile;
+    EventSpan instrument_event("instrument profile", "file", settings.path_instrument_profile.empty()
+        ? "CSV files" : settings.path_instrument_profile);
+    readInstrumentProfile(settings, profile);
+    instrument_event.stop();
+
     //----------------------------------------------------------------------------------------------
     // Generate the energy bins matrix:
     //  - size = # of energy bins
     // Input the energies from energy bins file:
     //  - values in units of [MeV]
     //----------------------------------------------------------------------------------------------
-    std::vector<double> energy_bins;
-    readInputFile1D(settings.path_energy_bins,energy_bins);
+    std::vector<double> &energy_bins = profile.energy_bins;
 
     int num_bins = energy_bins.size();
 
@@ -138,10 +163,8 @@ int main(int argc, char* argv[])
     // The response function accounts for variable number of (n,p) reactions in He-3 for each
     // moderators, as a function of energy. Calculated by vendor using MC
     //----------------------------------------------------------------------------------------------
-    std::vector<std::vector<double>> nns_response;
-    readInputFile2D(settings.path_system_response,nns_response);
-    checkDimensions(num_measurements, "number of measurements", nns_response.size(), "NNS response");
-    checkDimensions(num_bins, "number of energy bins", nns_response[0].size(), "NNS response");
+    const ResponseMatrix &nns_response = profile.nns_response;
+    checkDimensions(num_measurements, "number of measurements", nns_response.num_measurements(), "NNS response");
 
     //----------------------------------------------------------------------------------------------
     // Generate the inital spectrum matrix to input into the unfolding algorithm:
@@ -151,9 +174,7 @@ int main(int argc, char* argv[])
     //  - Currently (2017-08-16) input a step function (high at thermals & lower), because a flat 
     //  spectrum underestimates (does not yield any) thermal neutrons
     //----------------------------------------------------------------------------------------------
-    std::vector<double> initial_spectrum;
-    readInputFile1D(settings.path_input_spectrum,initial_spectrum);
-    checkDimensions(num_bins, "number of energy bins", initial_spectrum.size(), "Input spectrum");
+    std::vector<double> &initial_spectrum = profile.initial_spectrum;
 
     std::vector<double> spectrum = initial_spectrum; // save the initial spectrum for report output
 
@@ -165,20 +186,25 @@ int main(int argc, char* argv[])
     //  - H values were obtained by linearly interopolating tabulated data to match energy bins used
     // Page 200 of document (ICRP 74 - ATables.pdf)
     //----------------------------------------------------------------------------------------------
-    std::vector<double> icrp_factors;
-    readInputFile1D(settings.path_icrp_factors,icrp_factors);
-    checkDimensions(num_bins, "number of energy bins", icrp_factors.size(), "Number of ICRP factors");
+    std::vector<double> &icrp_factors = profile.icrp_factors;
 
     //----------------------------------------------------------------------------------------------
     // Run the automatic unfolding algorithm.
-    // Note: the normalized system matrix is calculated first. It is required in unfolding, and is
-    // a constant value.
+    // Note: the normalized system matrix is calculated first (with the instrument profile). It is
+    // required in unfolding, and is a constant value.
     //----------------------------------------------------------------------------------------------
-    std::vector<double> normalized_response = normalizeResponse(num_bins, num_measurements, nns_response);
+    std::vector<double> &normalized_response = profile.normalized_response;
+
+    // Select the (vectorized) implementation of the response projections used by the algorithms
+    setProjectionKernel(settings.projection_kernel);
+    instrument_timer.stop();
+
+    // Working vectors of the unfolding algorithm (ratio between measured data and MLEM estimated data,
+    // correction factors, MLEM estimated data, ...). Allocated once & reused for every unfolding.
+    MlemWorkspace workspace(num_measurements, num_bins);
 
-    std::vector<double> mlem_ratio; // vector that stores the ratio between measured data and MLEM estimated data
-    std::vector<double> mlem_correction; // vector that stores the ratio between measured data and MLEM estimated data
-    std::vector<double> mlem_estimate;
+    // Each trend is calculated from a single run of the unfolding algorithm: an IterationObserver
+    // provides the state of the algorithm at each of the requested numbers of iterations
 
     //----------------------------------------------------------------------------------------------
     // Output correction factors (52 values applied to spectrum, NOT to measurements).
@@ -186,17 +212,19 @@ int main(int argc, char* argv[])
     // Visualize with plot_lines (logarithmic x-axis)
     //----------------------------------------------------------------------------------------------
     if (settings.algorithm == "correction_factors") {
+        PhaseTimer unfold_timer(&performance, "unfold");
+
         // Create vector of number of iterations
         int num_increments = ((settings.iteration_max - settings.iteration_min) / settings.iteration_increment)+1;
         std::vector<int> num_iterations_vector = linearSpacedIntegerVector(
             settings.iteration_min,settings.iteration_max,num_increments
         );
-        int num_iteration_samples = num_iterations_vector.size();
 
         std::vector<double> current_spectrum = initial_spectrum; // the reconstructed spectrum
 
         // Add the energy bins to the file
         std::ostringstream results_stream;
+        results_stream << std::setprecision(settings.trend_precision);
         results_stream << "Energy (MeV),";
         for (int i_bin = 0; i_bin < num_bins; i_bin++) {
             results_stream << energy_bins[i_bin];
@@ -205,35 +233,28 @@ int main(int argc, char* argv[])
         }
         results_stream << "\n";
 
-        int total_num_iterations = 0;
-        for (int i_num=0; i_num < num_iteration_samples; i_num++) {
-            int num_iterations;
-
-            // only do # of iterations since previous run (i.e. don't do 3000, then 4000. Do
-            // 3000 then iteration_size more, etc.)
-            if (i_num == 0)
-                num_iterations = num_iterations_vector[i_num];
-            else
-                num_iterations = num_iterations_vector[i_num]-num_iterations_vector[i_num-1];
-            runMLEM(num_iterations, settings.error, num_measurements, num_bins, measurements, 
-                current_spectrum, nns_response, normalized_response, mlem_ratio, mlem_correction, mlem_estimate
-            );
-
-            total_num_iterations += num_iterations;
-
-            // Add the reconstructed measured data for current number of iterations to the file
-            // Add the correction factors to the file
-            results_stream << "k = " << total_num_iterations << ",";
-            for (int i_bin = 0; i_bin < num_bins; i_bin++) {
-                results_stream << mlem_correction[i_bin];
+        // Add the correction factors for each number of iterations to the file
+        IterationObserver observer(num_iterations_vector, 
+            [&](int num_iterations, const std::vector<double> &spectrum, const MlemWorkspace &state) {
+                results_stream << "k = " << num_iterations << ",";
+                for (int i_bin = 0; i_bin < num_bins; i_bin++) {
+                    results_stream << state.mlem_correction[i_bin];
 
-                if (i_bin != num_bins-1)
-                    results_stream << ",";
+                    if (i_bin != num_bins-1)
+                        results_stream << ",";
+                }
+                results_stream << "\n";
             }
-            results_stream << "\n";
-        }        
+        );
+        runMLEM(observer.lastCheckpoint(), settings.error, num_measurements, num_bins, measurements, 
+            current_spectrum, nns_response, normalized_response, workspace, &observer
+        );
+        observer.notifyRemaining(current_spectrum, workspace);
+        unfold_timer.setIterations(observer.lastCheckpoint());
+        unfold_timer.stop();
 
         // Save results for parameter of interest to CSV file
+        PhaseTimer save_timer(&performance, "save");
         std::ofstream output_file;
         output_file.open(settings.path_output_trend, std::ios_base::out);
         std::string results_string = results_stream.str();
@@ -252,17 +273,19 @@ int main(int argc, char* argv[])
     // Visualize with plot_lines (scatter plots)
     //----------------------------------------------------------------------------------------------
     if (settings.algorithm == "trend") {
+        PhaseTimer unfold_timer(&performance, "unfold");
+
         // Create vector of number of iterations
         int num_increments = ((settings.iteration_max - settings.iteration_min) / settings.iteration_increment)+1;
         std::vector<int> num_iterations_vector = linearSpacedIntegerVector(
             settings.iteration_min,settings.iteration_max,num_increments
         );
-        int num_iteration_samples = num_iterations_vector.size();
 
         std::vector<double> current_spectrum = initial_spectrum; // the reconstructed spectrum
 
         // Add the Moderator numbers to the file
         std::ostringstream results_stream;
+        results_stream << std::setprecision(settings.trend_precision);
         results_stream << "Number of moderators,";
         for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
             results_stream << i_meas;
@@ -289,42 +312,37 @@ int main(int argc, char* argv[])
         }
         results_stream << "\n";
 
-        int total_num_iterations = 0;
-        for (int i_num=0; i_num < num_iteration_samples; i_num++) {
-            int num_iterations;
-
-            // only do # of iterations since previous run (i.e. don't do 3000, then 4000. Do
-            // 3000 then iteration_size more, etc.)
-            if (i_num == 0)
-                num_iterations = num_iterations_vector[i_num];
-            else
-                num_iterations = num_iterations_vector[i_num]-num_iterations_vector[i_num-1];
-            runMLEM(num_iterations, settings.error, num_measurements, num_bins, measurements, 
-                current_spectrum, nns_response, normalized_response, mlem_ratio, mlem_correction, mlem_estimate
-            );
-
-            total_num_iterations += num_iterations;
-            // Add the reconstructed measured data for current number of iterations to the file
-            results_stream << "N = " << total_num_iterations << ",";
-            for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
-                // If comparing CPS data, use the returned ratio to calculate the reconstructed measurement:
-                if (settings.trend_type == "cps") {
-                    double recon_meas = measurements[i_meas] / mlem_ratio[i_meas];
-                    results_stream << recon_meas;
-                }
-                // If comparing the reconstructed MLEM ratios:
-                else if (settings.trend_type == "ratio") {
-                    results_stream << mlem_ratio[i_meas];
+        // Add the reconstructed measured data for each number of iterations to the file
+        IterationObserver observer(num_iterations_vector, 
+            [&](int num_iterations, const std::vector<double> &spectrum, const MlemWorkspace &state) {
+                results_stream << "N = " << num_iterations << ",";
+                for (int i_meas = 0; i_meas < num_measurements; i_meas++) {
+                    // If comparing CPS data, use the returned ratio to calculate the reconstructed measurement:
+                    if (settings.trend_type == "cps") {
+                        double recon_meas = measurements[i_meas] / state.mlem_ratio[i_meas];
+                        results_stream << recon_meas;
+                    }
+                    // If comparing the reconstructed MLEM ratios:
+                    else if (settings.trend_type == "ratio") {
+                        results_stream << state.mlem_ratio[i_meas];
+                    }
+
+
+                    if (i_meas != num_measurements-1)
+                        results_stream << ",";
                 }
-
-
-                if (i_meas != num_measurements-1)
-                    results_stream << ",";
+                results_stream << "\n";
             }
-            results_stream << "\n";
-        }        
+        );
+        runMLEM(observer.lastCheckpoint(), settings.error, num_measurements, num_bins, measurements, 
+            current_spectrum, nns_response, normalized_response, workspace, &observer
+        );
+        observer.notifyRemaining(current_spectrum, workspace);
+        unfold_timer.setIterations(observer.lastCheckpoint());
+        unfold_timer.stop();
 
         // Save results for parameter of interest to CSV file
+        PhaseTimer save_timer(&performance, "save");
         std::ofstream output_file;
         output_file.open(settings.path_output_trend, std::ios_base::out);
         std::string results_string = results_stream.str();
@@ -335,16 +353,44 @@ int main(int argc, char* argv[])
     }
 
     //----------------------------------------------------------------------------------------------
-    // Calculate some parameter of interest (POI) at specified numbers of iterations (N). Iterate
-    // through N values as indicated by user. Append results to existing file if it exists. 
-    // Output:
+    // Parameters of interest (POI) of the mlem, mlemstop & map trends: parameter_of_interest is a
+    // comma-separated list. All are calculated at each checkpoint of the same run(s), and each is
+    // saved to its own file (see trendOutputPath).
+    //----------------------------------------------------------------------------------------------
+    std::vector<std::string> poi_names;
+    std::vector<TrendParameter> pois;
+    std::vector<double> ref_spectrum; // Used if calculating RMSD
+    if (settings.algorithm == "mlem" || settings.algorithm == "mlemstop" || settings.algorithm == "map") {
+        stringToSVector(settings.parameter_of_interest, poi_names);
+        bool need_ref_spectrum = false;
+        for (size_t i_poi = 0; i_poi < poi_names.size(); i_poi++) {
+            pois.push_back(parseTrendParameter(poi_names[i_poi]));
+            need_ref_spectrum = need_ref_spectrum || trendParameterNeedsReference(pois[i_poi]);
+        }
+        if (pois.empty()) {
+            throw std::logic_error("No parameter of interest specified");
+        }
+        if (need_ref_spectrum) {
+            readInputFile1D(settings.path_ref_spectrum,ref_spectrum);
+        }
+    }
+    int num_pois = pois.size();
+
+    //----------------------------------------------------------------------------------------------
+    // Calculate some parameters of interest (POI) at specified numbers of iterations (N), using MLEM
+    // or MLEM-STOP. Iterate through N values as indicated by user. Append results to existing file
+    // if it exists. MLEM-STOP terminates once the J threshold is reached: the POI values of the
+    // remaining N are those of the final spectrum.
+    // Output (one file per POI):
     // First row contains the iteration numbers (only done if output file is empty)
     // Other row contains the POI value at each N. A single execution of this program will only add
     //  one result line to the the output file. But can run mulitple times for different measured
     //  data to append to existing file
     // Visualize with plot_lines
     //----------------------------------------------------------------------------------------------
-    if (settings.algorithm == "mlem") {
+    if (settings.algorithm == "mlem" || settings.algorithm == "mlemstop") {
+        PhaseTimer unfold_timer(&performance, "unfold");
+
         // Create vector of number of iterations
         int num_increments = ((settings.iteration_max - settings.iteration_min) / settings.iteration_increment)+1;
         std::vector<int> num_iterations_vector = linearSpacedIntegerVector(
@@ -354,188 +400,197 @@ int main(int argc, char* argv[])
 
         std::vector<double> current_spectrum = initial_spectrum; // the reconstructed spectrum
 
-        std::vector<double> derivative_poi_values; // hold poi_values in vector if doing derivative calculations
-
-        // Create stream to append results. First row is number of iteration increments
-        // determine if file exists
-        // std::string map_filename = "output/poi_output_mlem.csv";
-        std::ifstream rfile(settings.path_output_trend);
-        bool file_empty = is_empty(rfile);
-        // bool file_exists = rfile.good();
-        rfile.close();
+        // POI values of each parameter at each number of iterations
+        std::vector<std::vector<double>> poi_values(num_pois, std::vector<double>(num_iteration_samples, 0));
 
-        // If the file is empty, make the first line the number of iterations
-        std::ostringstream results_stream;
-        if (file_empty) {
-            results_stream << "Number of iterations,";
-            for (int i_num = 0; i_num < num_iteration_samples; i_num++) {
-                results_stream << num_iterations_vector[i_num];
-                if (i_num != num_iteration_samples-1)
-                    results_stream << ",";
+        // Calculate the parameters of interest at each number of iterations
+        int i_num = 0; // index of the current number of iterations
+        IterationObserver observer(num_iterations_vector, 
+            [&](int num_iterations, const std::vector<double> &spectrum, const MlemWorkspace &state) {
+                for (int i_poi = 0; i_poi < num_pois; i_poi++) {
+                    poi_values[i_poi][i_num] = calculateTrendParameter(pois[i_poi], i_num, num_measurements, 
+                        num_bins, measurements, spectrum, state, icrp_factors, ref_spectrum
+                    );
+                }
+                i_num++;
             }
-            results_stream << "\n";
-        }
-        // Used if calculating RMSD
-        std::vector<double> ref_spectrum;
-        if (settings.parameter_of_interest == "rms" || settings.parameter_of_interest == "nrmsd" 
-            || settings.parameter_of_interest == "chi_squared_g") 
-        {
-            readInputFile1D(settings.path_ref_spectrum,ref_spectrum);
-        }
-
-        // Loop through number of iterations
-        for (int i_num=0; i_num < num_iteration_samples; i_num++) {
-            int num_iterations;
+        );
 
-            // only do # of iterations since previous run (i.e. don't do 3000, then 4000. Do
-            // 3000 then iteration_size more, etc.)
-            if (i_num == 0)
-                num_iterations = num_iterations_vector[i_num];
-            else
-                num_iterations = num_iterations_vector[i_num]-num_iterations_vector[i_num-1];
-            runMLEM(num_iterations, settings.error, num_measurements, num_bins, measurements, current_spectrum, 
-                nns_response, normalized_response, mlem_ratio, mlem_correction, mlem_estimate
+        int num_iterations = observer.lastCheckpoint();
+        if (settings.algorithm == "mlem") {
+            runMLEM(observer.lastCheckpoint(), settings.error, num_measurements, num_bins, measurements, 
+                current_spectrum, nns_response, normalized_response, workspace, &observer
             );
-        
-            // Calculate one of the following parameters of interest & save to results stream
-            double poi_value = 0;
-            // Total fluence
-            if (settings.parameter_of_interest == "total_fluence") {
-                if (i_num == 0)
-                    results_stream << settings.irradiation_conditions << ",";
-                poi_value = calculateTotalFlux(num_bins,current_spectrum);
-            }
-            // Total dose:
-            else if (settings.parameter_of_interest == "total_dose") {
-                if (i_num == 0)
-                    results_stream << "Total dose,";
-                poi_value = calculateDose(num_bins, current_spectrum, icrp_factors);
-            }
-            // Maximum "error" in MLEM ratio
-            else if (settings.parameter_of_interest == "max_mlem_ratio") {
-                if (i_num == 0)
-                    results_stream << settings.irradiation_conditions << ",";
-                poi_value = calculateMaxRatio(num_measurements,mlem_ratio);
-            }
-            // Average "error" in MLEM ratio
-            else if (settings.parameter_of_interest == "avg_mlem_ratio") {
-                if (i_num == 0)
-                    results_stream << settings.irradiation_conditions << ",";
-                poi_value = calculateAvgRatio(num_measurements,mlem_ratio);
-            }
-            else if (settings.parameter_of_interest == "j_factor") {
-                if (i_num == 0)
-                    results_stream << settings.irradiation_conditions << ",";
-                poi_value = calculateJFactor(num_measurements,measurements,mlem_estimate);
-            }
-            else if (settings.parameter_of_interest == "j_factor2") {
-                if (i_num == 0)
-                    results_stream << settings.irradiation_conditions << ",";
-                poi_value = calculateJFactor2(num_measurements,measurements,mlem_estimate);
-            }
-            else if (settings.parameter_of_interest == "noise") {
-                if (i_num == 0)
-                    results_stream << settings.irradiation_conditions << ",";
-                poi_value = calculateNoise(15,30,current_spectrum);
-            }
-            else if (settings.parameter_of_interest == "reduced_chi_squared") {
-                if (i_num == 0)
-                    results_stream << settings.irradiation_conditions << ",";
-                poi_value = calculateChiSquared(i_num,num_bins,num_measurements,current_spectrum,measurements,mlem_ratio);
-            }
-            else if (settings.parameter_of_interest == "rms") {
-                if (i_num == 0)
-                    results_stream << settings.irradiation_conditions << ",";
-                // std::vector<double> normalized_spectrum = normalizeVector(current_spectrum);
-                std::vector<double> normalized_spectrum = current_spectrum;
-                poi_value = calculateRMSEstimator(num_bins,ref_spectrum,normalized_spectrum);
-            }
-            else if (settings.parameter_of_interest == "nrmsd") {
-                if (i_num == 0)
-                    results_stream << settings.irradiation_conditions << ",";
-                // std::vector<double> normalized_spectrum = normalizeVector(current_spectrum);
-                std::vector<double> normalized_spectrum = current_spectrum;
-                poi_value = calculateNRMSD(num_bins,ref_spectrum,normalized_spectrum);
+        }
+        else {
+            double j_threshold = determineJThreshold(num_measurements,measurements,settings.cps_crossover);
+            double j_factor = 0;
+            try {
+                num_iterations = runMLEMSTOP(observer.lastCheckpoint(), num_measurements, num_bins, 
+                    measurements, current_spectrum, nns_response, normalized_response, workspace, 
+                    j_threshold, j_factor, &observer
+                ) + 1;
             }
-            else if (settings.parameter_of_interest == "chi_squared_g") {
-                if (i_num == 0)
-                    results_stream << settings.irradiation_conditions << ",";
-                // std::vector<double> normalized_spectrum = normalizeVector(current_spectrum);
-                std::vector<double> normalized_spectrum = current_spectrum;
-                poi_value = calculateChiSquaredG(num_bins,ref_spectrum,normalized_spectrum);
+            // Reaching the last # of iterations before the J threshold is not an error here: the
+            // trend simply covers the iterations before termination. Other errors are rethrown.
+            catch (std::logic_error &e) {
+                if (!observer.complete()) {
+                    throw;
+                }
+                std::cout << "MLEM-STOP did not reach the J threshold (" << j_threshold << ") within " 
+                    << observer.lastCheckpoint() << " iterations\n";
             }
-            else {
-                throw std::logic_error("Unrecognized parameter of interest: " 
-                    + settings.parameter_of_interest 
-                    + ". Please refer to the README for allowed parameters"
-                );
+        }
+        observer.notifyRemaining(current_spectrum, workspace);
+        unfold_timer.setIterations(num_iterations);
+        unfold_timer.stop();
+
+        PhaseTimer save_timer(&performance, "save");
+        for (int i_poi = 0; i_poi < num_pois; i_poi++) {
+            std::string path_output = trendOutputPath(settings.path_output_trend, poi_names[i_poi], num_pois);
+
+            // Create stream to append results. First row is number of iteration increments
+            // determine if file exists
+            std::ifstream rfile(path_output);
+            bool file_empty = is_empty(rfile);
+            rfile.close();
+
+            // If the file is empty, make the first line the number of iterations
+            std::ostringstream results_stream;
+            results_stream << std::setprecision(settings.trend_precision);
+            if (file_empty) {
+                results_stream << "Number of iterations,";
+                for (int i_num = 0; i_num < num_iteration_samples; i_num++) {
+                    results_stream << num_iterations_vector[i_num];
+                    if (i_num != num_iteration_samples-1)
+                        results_stream << ",";
+                }
+                results_stream << "\n";
             }
 
-            if (!settings.derivatives) {
-                results_stream << poi_value;
+            if (pois[i_poi] == TREND_TOTAL_DOSE)
+                results_stream << "Total dose,";
+            else
+                results_stream << settings.irradiation_conditions << ",";
+
+            std::vector<double> row_values = poi_values[i_poi];
+            if (settings.derivatives) {
+                calculateDerivatives(row_values, num_iteration_samples, num_iterations_vector, poi_values[i_poi]);
+            }
+            for (int i_num=0; i_num < num_iteration_samples; i_num++) {
+                results_stream << row_values[i_num];
                 if (i_num == num_iteration_samples-1)
                     results_stream << "\n";
-
                 else
                     results_stream << ",";
             }
+
+            // Save results for parameter of interest to CSV file
+            std::ofstream output_file;
+            output_file.open(path_output, std::ios_base::app);
+            std::string results_string = results_stream.str();
+            output_file << results_string;
+            output_file.close();
+
+            if (!settings.derivatives) {
+                std::cout << "Saved 2D matrix of " << poi_names[i_poi] << " values to " 
+                    << path_output << "\n";
+            }
             else {
-                derivative_poi_values.push_back(poi_value);
+                std::cout << "Saved 2D matrix of derivatives of " << poi_names[i_poi] 
+                    << " values to " << path_output << "\n";
             }
         }
+    }
 
-        if (settings.derivatives) {
-            std::vector<double> derivative_vector;
-            calculateDerivatives(derivative_vector, num_iteration_samples, num_iterations_vector, derivative_poi_values);
+    //----------------------------------------------------------------------------------------------
+    // MAP with continuation across beta values (beta_continuation=1): the betas are unfolded in
+    // ascending order, each starting from the spectrum unfolded for the previous beta (the first
+    // from the input spectrum), until the MAP stopping criterion (mlem_max_error) or mlem_cutoff is
+    // reached. The betas are dependent, so they are unfolded serially.
+    // Output (one file per POI):
+    // First row contains the column titles
+    // Other rows contain the beta value, the # of iterations spent on that beta and the POI value
+    //  of the spectrum unfolded for that beta
+    //----------------------------------------------------------------------------------------------
+    if (settings.algorithm == "map" && settings.beta_continuation) {
+        if (settings.error <= 0) {
+            throw std::logic_error("MAP continuation across beta values requires mlem_max_error > 0");
+        }
+        PhaseTimer unfold_timer(&performance, "unfold");
 
-            for (int i_num=0; i_num < num_iteration_samples; i_num++) {
-                results_stream << derivative_vector[i_num];
-                if (i_num == num_iteration_samples-1)
-                    results_stream << "\n";
-                else
-                    results_stream << ",";
-            }
+        // Create vector of beta values
+        int num_orders_magnitude = log10(settings.beta_max/settings.beta_min);
+        double current_beta = settings.beta_min;
+        std::vector<double> beta_vector;
+        for (int i=0; i<num_orders_magnitude; i++) {
+            std::vector<double> temp_vector = linearSpacedDoubleVector(current_beta,current_beta*10,10);
+            current_beta = current_beta*10;
+            beta_vector.insert(beta_vector.end(), temp_vector.begin(), temp_vector.end());
         }
+        int num_beta_samples = beta_vector.size();
 
-        // Save results for parameter of interest to CSV file
-        std::ofstream output_file;
-        output_file.open(settings.path_output_trend, std::ios_base::app);
-        std::string results_string = results_stream.str();
-        output_file << results_string;
-        output_file.close();
+        std::vector<double> current_spectrum = initial_spectrum; // the reconstructed spectrum
+        std::vector<int> beta_iterations(num_beta_samples, 0); // # of iterations spent on each beta
+        std::vector<std::vector<double>> poi_values(num_pois, std::vector<double>(num_beta_samples, 0));
 
-        if (!settings.derivatives) {
-            std::cout << "Saved 2D matrix of " << settings.parameter_of_interest << " values to " 
-                << settings.path_output_trend << "\n";
-        }
-        else {
-            std::cout << "Saved 2D matrix of derivatives of " << settings.parameter_of_interest 
-                << " values to " << settings.path_output_trend << "\n";
-        }
+        int total_iterations = 0;
+        for (int i_beta=0; i_beta < num_beta_samples; i_beta++) {
+            int mlem_index = runMAP(beta_vector[i_beta], settings.prior, settings.cutoff, 
+                settings.error, num_measurements, num_bins, measurements, current_spectrum, nns_response, 
+                normalized_response, workspace
+            );
+            // runMAP returns the index of the last iteration when the stopping criterion is reached
+            beta_iterations[i_beta] = mlem_index < settings.cutoff ? mlem_index+1 : mlem_index;
+            total_iterations += beta_iterations[i_beta];
 
-        // // Save results for parameter of interest to CSV file
-        // std::ofstream output_file;
-        // std::string settings.path_output_trend = settings.path_output_trend;
-        // output_file.open(settings.path_output_trend, std::ios_base::app);
-        // std::string results_string = results_stream.str();
-        // output_file << results_string;
-        // output_file.close();
+            for (int i_poi = 0; i_poi < num_pois; i_poi++) {
+                poi_values[i_poi][i_beta] = calculateTrendParameter(pois[i_poi], 0, num_measurements, 
+                    num_bins, measurements, current_spectrum, workspace, icrp_factors, ref_spectrum
+                );
+            }
+        }
+        unfold_timer.setIterations(total_iterations);
+        unfold_timer.stop();
+
+        PhaseTimer save_timer(&performance, "save");
+        for (int i_poi = 0; i_poi < num_pois; i_poi++) {
+            std::string path_output = trendOutputPath(settings.path_output_trend, poi_names[i_poi], num_pois);
+
+            std::ostringstream results_stream;
+            results_stream << std::setprecision(settings.trend_precision);
+            results_stream << "Beta,Number of iterations," << poi_names[i_poi] << "\n";
+            for (int i_beta=0; i_beta < num_beta_samples; i_beta++) {
+                results_stream << beta_vector[i_beta] << "," << beta_iterations[i_beta] << "," 
+                    << poi_values[i_poi][i_beta] << "\n";
+            }
 
-        // std::cout << "Saved 2D matrix of " << settings.parameter_of_interest << " values to " << settings.path_output_trend << "\n";
+            // Save results for parameter of interest to CSV file
+            std::ofstream output_file;
+            output_file.open(path_output, std::ios_base::out);
+            std::string results_string = results_stream.str();
+            output_file << results_string;
+            output_file.close();
 
+            std::cout << "Saved " << poi_names[i_poi] << " values (by beta) to " << path_output << "\n";
+        }
+        std::cout << "Total # of MAP iterations: " << total_iterations << "\n";
     }
 
     //----------------------------------------------------------------------------------------------
-    // Calculate some parameter of interest (POI) at specified numbers of iterations and beta value.
-    // Iterate through a range of beta values, and a range of N values for each beta.
-    // Output:
+    // Calculate some parameters of interest (POI) at specified numbers of iterations and beta
+    // value. Iterate through a range of beta values, and a range of N values for each beta (a single
+    // MAP run per beta). The betas are unfolded in parallel (num_threads).
+    // Output (one file per POI):
     // First row contains the iteration numbers
     // Other rows contain the beta value in the 1st column, followed by the POI value corresponding
     //  to the beta & N.
     // I.e. result is a 2D matrix of POI values (function of beta and N)
     // Visualize with plot_surface
     //----------------------------------------------------------------------------------------------
-    if (settings.algorithm == "map") {
+    if (settings.algorithm == "map" && !settings.beta_continuation) {
+        PhaseTimer unfold_timer(&performance, "unfold", resolveNumThreads(settings.num_threads));
+
         // Create vector of beta values
         int num_orders_magnitude = log10(settings.beta_max/settings.beta_min);
         double current_beta = settings.beta_min;
@@ -556,84 +611,105 @@ int main(int argc, char* argv[])
         int num_beta_samples = beta_vector.size();
         int num_iteration_samples = num_iterations_vector.size();
 
-        std::vector<double> current_spectrum; // the reconstructed spectrum
-        std::vector<double> energy_correction; // energy correction term used in MAP
+        // The betas are independent: unfold them in parallel, one task per beta. Each task writes
+        // the POI values of its beta into its own (pre-sized) rows, and the rows are output in beta
+        // order afterwards, so the files do not depend on the # of threads.
+        ThreadPool pool(settings.num_threads);
+        std::vector<MlemWorkspace> workspaces(pool.size(), workspace);
+        std::vector<std::vector<double>> spectra(pool.size(), initial_spectrum);
+        std::vector<std::vector<std::vector<double>>> poi_values(num_pois, 
+            std::vector<std::vector<double>>(num_beta_samples, std::vector<double>(num_iteration_samples, 0))
+        );
+        std::vector<int> beta_iterations(num_beta_samples, 0); // # of iterations run for each beta
 
-        // Create stream to append results. First row is number of iteration increments
-        std::ostringstream results_stream;
-        // results_stream << std::scientific;
-        results_stream << "0"; // empty first "cell"
-        for (int i_num = 0; i_num < num_iteration_samples; i_num++) {
-            results_stream << ",";
-            results_stream << num_iterations_vector[i_num];
-        }
-        results_stream << "\n";
+        pool.run(num_beta_samples, [&](int i_beta, int i_thread) {
+            std::ostringstream beta_detail;
+            if (eventTraceEnabled()) {
+                beta_detail << "beta = " << beta_vector[i_beta];
+            }
+            EventSpan beta_event("beta", "unfold", beta_detail.str());
+            std::vector<double> &current_spectrum = spectra[i_thread]; // the reconstructed spectrum
+            int i_num = 0; // index of the current number of iterations
+
+            // Calculate the parameters of interest at each number of iterations
+            IterationObserver observer(num_iterations_vector, 
+                [&](int num_iterations, const std::vector<double> &spectrum, const MlemWorkspace &state) {
+                    for (int i_poi = 0; i_poi < num_pois; i_poi++) {
+                        poi_values[i_poi][i_beta][i_num] = calculateTrendParameter(pois[i_poi], i_num, 
+                            num_measurements, num_bins, measurements, spectrum, state, icrp_factors, 
+                            ref_spectrum
+                        );
+                    }
+                    i_num++;
+                }
+            );
 
-        // Loop through betas
-        for (int i_beta=0; i_beta < num_beta_samples; i_beta++) {
             current_spectrum = initial_spectrum; // re-initialize spectrum for each beta
-            results_stream << beta_vector[i_beta] << ",";
+            int mlem_index = runMAP(beta_vector[i_beta], settings.prior, observer.lastCheckpoint(), 
+                settings.error, num_measurements, num_bins, measurements, current_spectrum, nns_response, 
+                normalized_response, workspaces[i_thread], &observer
+            );
+            beta_iterations[i_beta] = mlem_index < observer.lastCheckpoint() ? mlem_index+1 : mlem_index;
+            observer.notifyRemaining(current_spectrum, workspaces[i_thread]);
+        });
+        long long total_iterations = 0;
+        for (int i_beta=0; i_beta < num_beta_samples; i_beta++) {
+            total_iterations += beta_iterations[i_beta];
+        }
+        unfold_timer.setIterations(total_iterations);
+        unfold_timer.stop();
+
+        PhaseTimer save_timer(&performance, "save");
+        for (int i_poi = 0; i_poi < num_pois; i_poi++) {
+            std::string path_output = trendOutputPath(settings.path_output_trend, poi_names[i_poi], num_pois);
+
+            // Create stream to append results. First row is number of iteration increments
+            std::ostringstream results_stream;
+            results_stream << std::setprecision(settings.trend_precision);
+            // results_stream << std::scientific;
+            results_stream << "0"; // empty first "cell"
+            for (int i_num = 0; i_num < num_iteration_samples; i_num++) {
+                results_stream << ",";
+                results_stream << num_iterations_vector[i_num];
+            }
+            results_stream << "\n";
 
-            // Loop through number of iterations
-            for (int i_num=0; i_num < num_iteration_samples; i_num++) {
-                int num_iterations;
+            // Rows: beta value followed by the POI values
+            for (int i_beta=0; i_beta < num_beta_samples; i_beta++) {
+                results_stream << beta_vector[i_beta] << ",";
+                for (int i_num=0; i_num < num_iteration_samples; i_num++) {
+                    results_stream << poi_values[i_poi][i_beta][i_num];
+                    if (i_num == num_iteration_samples-1)
+                        results_stream << "\n";
 
-                // only do # of iterations since previous run (i.e. don't do 3000, then 4000. Do
-                // 3000 then iteration_size more, etc.)
-                if (i_num == 0)
-                    num_iterations = num_iterations_vector[i_num];
-                else
-                    num_iterations = num_iterations_vector[i_num]-num_iterations_vector[i_num-1];
-                runMAP(energy_correction, beta_vector[i_beta], settings.prior, num_iterations, 
-                    settings.error, num_measurements, num_bins, measurements, current_spectrum, 
-                    nns_response, normalized_response, mlem_ratio
-                );
-            
-                // Calculate one of the following parameters of interest & save to results stream
-                double poi_value = 0;
-                // Total fluence
-                if (settings.parameter_of_interest == "total_fluence")
-                    poi_value = calculateTotalFlux(num_bins,current_spectrum);
-                // Total dose:
-                else if (settings.parameter_of_interest == "total_dose")
-                    poi_value = calculateDose(num_bins, current_spectrum, icrp_factors);
-                // Total energy (penalty) term:
-                else if (settings.parameter_of_interest == "total_energy_correction") {
-                    poi_value = calculateTotalEnergyCorrection(energy_correction);
-                }
-                // Maximum "error" in MLEM ratio
-                else if (settings.parameter_of_interest == "max_mlem_ratio") {
-                    poi_value = calculateMaxRatio(num_measurements,mlem_ratio);
-                }
-                // Average "error" in MLEM ratio
-                else if (settings.parameter_of_interest == "avg_mlem_ratio") {
-                    poi_value = calculateAvgRatio(num_measurements,mlem_ratio);
-                }
-                else {
-                    throw std::logic_error("Unrecognized parameter of interest: " 
-                        + settings.parameter_of_interest 
-                        + ". Please refer to the README for allowed parameters"
-                    );
+                    else
+                        results_stream << ",";
                 }
+            }
 
-                results_stream << poi_value;
-                if (i_num == num_iteration_samples-1)
-                    results_stream << "\n";
+            // Save results for parameter of interest to CSV file
+            std::ofstream output_file;
+            output_file.open(path_output, std::ios_base::out);
+            std::string results_string = results_stream.str();
+            output_file << results_string;
+            output_file.close();
 
-                else
-                    results_stream << ",";
-            }
+            std::cout << "Saved 2D matrix of " << poi_names[i_poi] << " values to " 
+                << path_output << "\n";
         }
+    }
 
-        // Save results for parameter of interest to CSV file
-        std::ofstream output_file;
-        output_file.open(settings.path_output_trend, std::ios_base::out);
-        std::string results_string = results_stream.str();
-        output_file << results_string;
-        output_file.close();
-
-        std::cout << "Saved 2D matrix of " << settings.parameter_of_interest << " values to " 
-            << settings.path_output_trend << "\n";
+    //----------------------------------------------------------------------------------------------
+    // Save the resources used by each phase
+    //----------------------------------------------------------------------------------------------
+    if (settings.generate_performance) {
+        if (settings.path_performance.empty()) {
+            settings.path_performance = "output/performance_trend_" + settings.irradiation_conditions + ".json";
+        }
+        performance.saveJSON(settings.path_performance, "unfold_trend", settings.irradiation_conditions,
+            settings.num_threads
+        );
+        std::cout << "Saved performance data to " << settings.path_performance << "\n";
     }
 
     return 0;